@@ -3,9 +3,23 @@
 #import "CTKLockingTransaction.h"
 #import "CTKReference.h"
 #import "CTKPersistentHashMap.h"
+#import "CTKTrieLeafNode.h"
+#import "CTKTrieBitmapIndexedNode.h"
+#import "CTKTrieFullNode.h"
+#import "CTKTrieHashCollisionNode.h"
+#import "CTKPersistentVector.h"
+#import "CTKTransientVector.h"
+#import "CTKTransactionalHashMap.h"
+#import "CTKTransactionTracer.h"
+#import "CTKPersistentHashMapStatistics.h"
+#import "CTKPersistentPrimitiveMap.h"
+#import "CTKAgent.h"
 #include <libkern/OSAtomic.h>
 #import "CTKUtils.h"
 #include <stdlib.h>
+#include <string.h>
+#include <malloc/malloc.h>
+#include <sys/resource.h>
 
 @interface MockPersistentCollection : NSObject{
 	NSArray *array;
@@ -67,11 +81,484 @@
 @end
 
 
+/*
+ Appends n numbers one version at a time, as a ref holding the collection would, 
+ comparing the copy-on-append MockPersistentCollection against CTKPersistentVector.
+ */
+static void CTKBenchmarkAppends(NSUInteger n)
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	NSUInteger t0;
+	
+	t0 = [CTKUtils currentTimeInMillis];
+	MockPersistentCollection *collection = [MockPersistentCollection new];
+	
+	for (NSUInteger i = 0; i < n; i++) {
+		NSAutoreleasePool * inner = [[NSAutoreleasePool alloc] init];
+		MockPersistentCollection *next = [[collection addObject:[NSNumber numberWithUnsignedInteger:i]] retain];
+		[collection release];
+		collection = next;
+		[inner drain];
+	}
+	
+	NSLog(@"MockPersistentCollection: %U appends in %U ms. Count is %U.", n, [CTKUtils currentTimeInMillis] - t0, [collection count]);
+	[collection release];
+	
+	t0 = [CTKUtils currentTimeInMillis];
+	id <CTKVector> vector = [[CTKPersistentVector emptyVector] retain];
+	
+	for (NSUInteger i = 0; i < n; i++) {
+		NSAutoreleasePool * inner = [[NSAutoreleasePool alloc] init];
+		id <CTKVector> next = [[vector vectorByAddingObject:[NSNumber numberWithUnsignedInteger:i]] retain];
+		[vector release];
+		vector = next;
+		[inner drain];
+	}
+	
+	NSLog(@"CTKPersistentVector: %U appends in %U ms. Count is %U.", n, [CTKUtils currentTimeInMillis] - t0, [vector count]);
+	[vector release];
+	
+	t0 = [CTKUtils currentTimeInMillis];
+	CTKTransientVector *transient = [[CTKPersistentVector emptyVector] transientVector];
+	
+	for (NSUInteger i = 0; i < n; i++)
+		[transient addObject:[NSNumber numberWithUnsignedInteger:i]];
+	
+	vector = [transient persistentVector];
+	NSLog(@"CTKTransientVector: %U appends in %U ms. Count is %U.", n, [CTKUtils currentTimeInMillis] - t0, [vector count]);
+	
+	t0 = [CTKUtils currentTimeInMillis];
+	NSUInteger sum = 0;
+	
+	for (NSUInteger i = 0; i < n; i++)
+		sum += [[vector objectAtIndex:i] unsignedIntegerValue];
+	
+	NSLog(@"CTKPersistentVector: %U indexed reads in %U ms (checksum %U).", n, [CTKUtils currentTimeInMillis] - t0, sum);
+	
+	t0 = [CTKUtils currentTimeInMillis];
+	
+	while ([vector count] > 0)
+		vector = [vector vectorByRemovingLastObject];
+	
+	NSLog(@"CTKPersistentVector: %U pops in %U ms.", n, [CTKUtils currentTimeInMillis] - t0);
+	
+	[pool drain];
+}
+
+
+typedef struct {
+	NSUInteger leaves;
+	NSUInteger depthSum;
+	NSUInteger maxDepth;
+	NSUInteger collisionNodes;
+	NSUInteger collidingLeaves;
+	NSUInteger maxCollision;
+} CTKTrieShape;
+
+static void CTKTrieShapeAccumulate(id <CTKTrieNode> aNode, NSUInteger depth, CTKTrieShape *shape)
+{
+	if ([aNode isKindOfClass:[CTKTrieLeafNode class]]) {
+		shape->leaves++;
+		shape->depthSum += depth;
+		shape->maxDepth = MAX(shape->maxDepth, depth);
+	}
+	
+	else if ([aNode isKindOfClass:[CTKTrieHashCollisionNode class]]) {
+		NSUInteger cnt = [(CTKTrieHashCollisionNode *)aNode count];
+		shape->leaves += cnt;
+		shape->depthSum += depth * cnt;
+		shape->maxDepth = MAX(shape->maxDepth, depth);
+		shape->collisionNodes++;
+		shape->collidingLeaves += cnt;
+		shape->maxCollision = MAX(shape->maxCollision, cnt);
+	}
+	
+	else if ([aNode isKindOfClass:[CTKTrieBitmapIndexedNode class]] || [aNode isKindOfClass:[CTKTrieFullNode class]]) {
+		for (id <CTKTrieNode> child in [(id)aNode nodes])
+			CTKTrieShapeAccumulate(child, depth + 1, shape);
+	}
+}
+
+static void CTKBenchmarkKeySet(NSString *aName, NSArray *keys, NSUInteger aSeed)
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	NSUInteger n = [keys count];
+	NSUInteger t0 = [CTKUtils currentTimeInMillis];
+	id *theKeys = malloc(sizeof(id) * n);
+	
+	[keys getObjects:theKeys range:NSMakeRange(0, n)];
+	
+	CTKPersistentHashMap *map = [CTKPersistentHashMap hashMapWithObjects:theKeys forKeys:theKeys count:n seed:aSeed];
+	NSUInteger buildTime = [CTKUtils currentTimeInMillis] - t0;
+	
+	t0 = [CTKUtils currentTimeInMillis];
+	NSUInteger found = 0;
+	
+	for (NSUInteger i = 0; i < n; i++)
+		if ([map objectForKey:theKeys[i]] != nil)
+			found++;
+	
+	NSUInteger lookupTime = [CTKUtils currentTimeInMillis] - t0;
+	CTKTrieShape shape = {0, 0, 0, 0, 0, 0};
+	
+	CTKTrieShapeAccumulate(map.root, 0, &shape);
+	
+	NSLog(@"%@: %U keys built in %U ms, %U lookups (%U found) in %U ms.", aName, n, buildTime, n, found, lookupTime);
+	NSLog(@"%@: depth max %U avg %.2f, %U collision nodes holding %U keys (largest %U).", 
+		  aName, shape.maxDepth, (shape.leaves > 0) ? (double)shape.depthSum / shape.leaves : 0.0, 
+		  shape.collisionNodes, shape.collidingLeaves, shape.maxCollision);
+	
+	free(theKeys);
+	[pool drain];
+}
+
+/*
+ Trie shape and lookup times for key sets whose -hash is poorly distributed: sequential numbers, short strings 
+ differing in their last characters and long URLs (NSString only hashes the first, middle and last 32 characters 
+ of long strings, so ids in the path collide completely).
+ */
+static void CTKBenchmarkHashing(NSUInteger n)
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	NSMutableArray *numbers = [NSMutableArray arrayWithCapacity:n];
+	NSMutableArray *names = [NSMutableArray arrayWithCapacity:n];
+	NSMutableArray *urls = [NSMutableArray arrayWithCapacity:n / 10];
+	NSString *padding = [@"" stringByPaddingToLength:160 withString:@"/static/assets" startingAtIndex:0];
+	
+	for (NSUInteger i = 0; i < n; i++) {
+		[numbers addObject:[NSNumber numberWithUnsignedInteger:i]];
+		[names addObject:[NSString stringWithFormat:@"user-%08lu", (unsigned long)i]];
+	}
+	
+	for (NSUInteger i = 0; i < n / 10; i++)
+		[urls addObject:[NSString stringWithFormat:@"http://example.com/static/users/%08lu%@", (unsigned long)i, padding]];
+	
+	CTKBenchmarkKeySet(@"Sequential NSNumbers", numbers, 0);
+	CTKBenchmarkKeySet(@"Short NSStrings", names, 0);
+	CTKBenchmarkKeySet(@"Short NSStrings, random seed", names, ((NSUInteger)arc4random() << 32) | arc4random());
+	CTKBenchmarkKeySet(@"Long URLs", urls, 0);
+	
+	[pool drain];
+}
+
+/*
+ Writer-only workload on a ref holding a CTKPersistentHashMap, each transaction sets keysPerTransaction keys.
+ The autoreleasing variant builds the versions with mapBySettingObject:forKey:, the other one with the ownership
+ transferring newMapBySettingObject:forKey:. The transactions push a pool per attempt when built with 
+ CTK_TRANSACTION_ATTEMPT_POOLS=1: the pooled path is that build with --autoreleasing, the pool-less one the default 
+ build without it. ru_maxrss only grows, run each variant in its own process to compare peak RSS.
+ */
+static void CTKBenchmarkMapWriters(NSUInteger transactions, NSUInteger keysPerTransaction, BOOL autoreleasing)
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	CTKReference *ref = [[CTKPersistentHashMap emptyHashMap] reference];
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	dispatch_group_t group = dispatch_group_create();
+	malloc_statistics_t before, after;
+	struct rusage usage;
+	
+	malloc_zone_statistics(NULL, &before);
+	NSUInteger t0 = [CTKUtils currentTimeInMillis];
+	
+	for (NSUInteger t = 0; t < transactions; t++) {
+		
+		dispatch_group_async(group, queue, ^{
+			
+			NSError *error = nil;
+			
+			id result = [CTKLockingTransaction performBlock:^ id (void) {
+				
+				CTKPersistentHashMap *map = (CTKPersistentHashMap *)[ref dereference];
+				
+				if (autoreleasing) {
+					for (NSUInteger k = 0; k < keysPerTransaction; k++)
+						map = [map mapBySettingObject:[NSNumber numberWithUnsignedInteger:t] 
+											   forKey:[NSNumber numberWithUnsignedInteger:t * keysPerTransaction + k]];
+					
+					[ref setValue:map];
+					return map;
+				}
+				
+				[map retain];
+				
+				for (NSUInteger k = 0; k < keysPerTransaction; k++) {
+					NSNumber *key = [[NSNumber alloc] initWithUnsignedInteger:t * keysPerTransaction + k];
+					NSNumber *object = [[NSNumber alloc] initWithUnsignedInteger:t];
+					CTKPersistentHashMap *next = [map newMapBySettingObject:object forKey:key];
+					
+					[key release];
+					[object release];
+					[map release];
+					map = next;
+				}
+				
+				[ref setValue:map]; // the transaction keeps it alive until it commits or retries
+				[map release];
+				
+				return map;
+				
+			} error:&error];
+			
+			if (result == nil && error != nil)
+				NSLog(@"Failed with error %@", [error localizedDescription]);
+		});
+	}
+	
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+	dispatch_release(group);
+	
+	NSUInteger elapsed = [CTKUtils currentTimeInMillis] - t0;
+	
+	malloc_zone_statistics(NULL, &after);
+	getrusage(RUSAGE_SELF, &usage);
+	
+	NSLog(@"%@ map writers, %@ attempts: %U transactions x %U keys in %U ms, count is %U.", 
+		  autoreleasing ? @"Autoreleasing" : @"Owned", CTK_TRANSACTION_ATTEMPT_POOLS ? @"pooled" : @"pool-less", 
+		  transactions, keysPerTransaction, elapsed, 
+		  [(CTKPersistentHashMap *)[ref value] count]);
+	NSLog(@"Heap peak %U KB (%+ld KB in use after the run), peak RSS %ld KB, %ld ms of system time.", 
+		  (NSUInteger)(after.max_size_in_use / 1024), 
+		  ((long)after.size_in_use - (long)before.size_in_use) / 1024, 
+		  (long)usage.ru_maxrss / 1024, (long)(usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000));
+	
+	[pool drain];
+}
+
+/*
+ Writers on disjoint keys: one ref holding the whole map against a CTKTransactionalHashMap. Each transaction sets a
+ single key of its own.
+ */
+static void CTKBenchmarkKeyedWriters(NSUInteger transactions)
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	CTKReference *ref = [[CTKPersistentHashMap emptyHashMap] reference];
+	CTKTransactionalHashMap *keyed = [CTKTransactionalHashMap transactionalHashMap];
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	
+	for (NSUInteger variant = 0; variant < 2; variant++) {
+		
+		dispatch_group_t group = dispatch_group_create();
+		NSUInteger t0 = [CTKUtils currentTimeInMillis];
+		
+		for (NSUInteger t = 0; t < transactions; t++) {
+			
+			dispatch_group_async(group, queue, ^{
+				
+				NSError *error = nil;
+				NSNumber *key = [NSNumber numberWithUnsignedInteger:t];
+				
+				id result = [CTKLockingTransaction performBlock:^ id (void) {
+					
+					if (variant == 0) {
+						CTKPersistentHashMap *map = [(CTKPersistentHashMap *)[ref dereference] mapBySettingObject:key forKey:key];
+						[ref setValue:map];
+					}
+					else
+						[keyed setObject:key forKey:key];
+					
+					return key;
+					
+				} error:&error];
+				
+				if (result == nil && error != nil)
+					NSLog(@"Failed with error %@", [error localizedDescription]);
+			});
+		}
+		
+		dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+		dispatch_release(group);
+		
+		NSLog(@"%@: %U transactions in %U ms, count is %U.", 
+			  (variant == 0) ? @"Single ref" : @"Transactional map", transactions, [CTKUtils currentTimeInMillis] - t0,
+			  (variant == 0) ? [(CTKPersistentHashMap *)[ref value] count] : [keyed count]);
+	}
+	
+	[pool drain];
+}
+
+/*
+ Per access cost of the CTKReference methods, which look the thread's transaction up every time, against the 
+ accessors of the handle passed by performWithTransaction:error:. Both run accesses reads and as many writes in a
+ single transaction.
+ */
+static void CTKBenchmarkAccessPaths(NSUInteger accesses)
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	CTKReference *ref = [[NSNumber numberWithUnsignedInteger:0] reference];
+	NSNumber *value = [NSNumber numberWithUnsignedInteger:1];
+	NSError *error = nil;
+	__block NSUInteger t0, reads, writes;
+	
+	[CTKLockingTransaction performBlock:^ id (void) {
+		
+		t0 = [CTKUtils currentTimeInNanos];
+		for (NSUInteger i = 0; i < accesses; i++)
+			[ref dereference];
+		reads = [CTKUtils currentTimeInNanos] - t0;
+		
+		t0 = [CTKUtils currentTimeInNanos];
+		for (NSUInteger i = 0; i < accesses; i++)
+			[ref setValue:value];
+		writes = [CTKUtils currentTimeInNanos] - t0;
+		
+		return value;
+	} error:&error];
+	
+	NSLog(@"CTKReference methods: %.1f ns per read, %.1f ns per write.", 
+		  (double)reads / accesses, (double)writes / accesses);
+	
+	[CTKLockingTransaction performWithTransaction:^ id (CTKLockingTransaction *txn) {
+		
+		t0 = [CTKUtils currentTimeInNanos];
+		for (NSUInteger i = 0; i < accesses; i++)
+			[txn read:ref];
+		reads = [CTKUtils currentTimeInNanos] - t0;
+		
+		t0 = [CTKUtils currentTimeInNanos];
+		for (NSUInteger i = 0; i < accesses; i++)
+			[txn write:ref value:value];
+		writes = [CTKUtils currentTimeInNanos] - t0;
+		
+		return value;
+	} error:&error];
+	
+	NSLog(@"Transaction handle: %.1f ns per read, %.1f ns per write.", 
+		  (double)reads / accesses, (double)writes / accesses);
+	
+	[pool drain];
+}
+
+/*
+ Lookup time and trie memory of a map keyed by 64-bit ids, boxed in CTKPersistentHashMap against inline in 
+ CTKPersistentInt64Map. Boxed lookups include boxing the id, as callers holding ids have to. The generic memory
+ figure adds the NSNumber keys to the trie bytes, both exclude the objects.
+ */
+static void CTKBenchmarkPrimitiveKeys(NSUInteger n)
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	id *keys = malloc(sizeof(id) * n);
+	int64_t *ids = malloc(sizeof(int64_t) * n);
+	size_t keyBytes = 0;
+	
+	for (NSUInteger i = 0; i < n; i++) {
+		ids[i] = ((int64_t)arc4random() << 31) ^ (int64_t)i;
+		keys[i] = [NSNumber numberWithLongLong:ids[i]];
+		keyBytes += malloc_size(keys[i]);
+	}
+	
+	CTKPersistentHashMap *map = [CTKPersistentHashMap hashMapWithObjects:keys forKeys:keys count:n];
+	CTKPersistentInt64Map *primitiveMap = [CTKPersistentInt64Map mapWithHashMap:map];
+	NSUInteger found = 0;
+	NSUInteger t0 = [CTKUtils currentTimeInNanos];
+	
+	for (NSUInteger i = 0; i < n; i++)
+		if ([map objectForKey:[NSNumber numberWithLongLong:ids[i]]] != nil)
+			found++;
+	
+	NSUInteger boxedTime = [CTKUtils currentTimeInNanos] - t0;
+	
+	t0 = [CTKUtils currentTimeInNanos];
+	
+	for (NSUInteger i = 0; i < n; i++)
+		if ([primitiveMap objectForKey:ids[i]] != nil)
+			found++;
+	
+	NSUInteger inlineTime = [CTKUtils currentTimeInNanos] - t0;
+	
+	NSLog(@"CTKPersistentHashMap: %.1f ns per lookup, %lu bytes.", 
+		  (double)boxedTime / n, (unsigned long)([[map statistics] bytes] + keyBytes));
+	NSLog(@"CTKPersistentInt64Map: %.1f ns per lookup, %lu bytes (%U of %U found).", 
+		  (double)inlineTime / n, (unsigned long)[primitiveMap trieBytes], found, 2 * n);
+	
+	free(keys);
+	free(ids);
+	[pool drain];
+}
+
+/*
+ Increments sent to a counter from 4 threads, by a CTKAgent against the emulation it replaces: a serial queue 
+ running one transaction per update on a ref.
+ */
+static void CTKBenchmarkAgents(NSUInteger updates)
+{
+	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+	dispatch_queue_t senders = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	id (^increment)(id) = ^ id (id aValue) {
+		return [NSNumber numberWithUnsignedInteger:[aValue unsignedIntegerValue] + 1];
+	};
+	
+	CTKAgent *agent = [CTKAgent agentWithValue:[NSNumber numberWithUnsignedInteger:0]];
+	NSUInteger t0 = [CTKUtils currentTimeInMillis];
+	
+	dispatch_apply(4, senders, ^(size_t s){
+		for (NSUInteger i = 0; i < updates / 4; i++)
+			[agent send:increment];
+		[agent await];
+	});
+	
+	NSLog(@"CTKAgent: %@ after %U ms.", [agent dereference], [CTKUtils currentTimeInMillis] - t0);
+	
+	CTKReference *ref = [[NSNumber numberWithUnsignedInteger:0] reference];
+	dispatch_queue_t serial = dispatch_queue_create("CTKBenchmarkAgents", NULL);
+	
+	t0 = [CTKUtils currentTimeInMillis];
+	
+	dispatch_apply(4, senders, ^(size_t s){
+		for (NSUInteger i = 0; i < updates / 4; i++)
+			dispatch_async(serial, ^{
+				NSError *error = nil;
+				[CTKLockingTransaction performBlock:^ id (void) {
+					return [ref alterWithBlock:increment];
+				} error:&error];
+			});
+	});
+	
+	dispatch_sync(serial, ^{});
+	dispatch_release(serial);
+	
+	NSLog(@"Serial queue and ref: %@ after %U ms.", [ref dereference], [CTKUtils currentTimeInMillis] - t0);
+	
+	[pool drain];
+}
 
 int main (int argc, const char * argv[]) {
 	
 	NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
 	int maxTransactions = 100;
+	NSString *tracePath = nil;
+	BOOL autoreleasing = NO;
+	
+	// CTKConcurrency [--autoreleasing] [--trace trace.json]
+	for (int a = 1; a < argc; a++) {
+		if (strcmp(argv[a], "--autoreleasing") == 0)
+			autoreleasing = YES;
+		else if (strcmp(argv[a], "--trace") == 0 && a + 1 < argc)
+			tracePath = [NSString stringWithUTF8String:argv[++a]];
+	}
+	
+	[CTKTransactionTracer setEnabled:(tracePath != nil)];
+	
+	NSLog(@"Appends");
+	CTKBenchmarkAppends(10000);
+	CTKBenchmarkAppends(20000);
+	
+	NSLog(@"Hashing");
+	CTKBenchmarkHashing(100000);
+	
+	NSLog(@"Map writers");
+	CTKBenchmarkMapWriters(1000, 100, autoreleasing);
+	
+	NSLog(@"Access paths");
+	CTKBenchmarkAccessPaths(1000000);
+	
+	NSLog(@"Primitive keys");
+	CTKBenchmarkPrimitiveKeys(1000000);
+	
+	NSLog(@"Agents");
+	CTKBenchmarkAgents(100000);
+	
+	NSLog(@"Keyed writers");
+	CTKBenchmarkKeyedWriters(10000);
 
 	NSLog(@"Readers and Writers");
 	// Readers-Writers
@@ -212,6 +699,21 @@ int main (int argc, const char * argv[]) {
 		
 	}
 	
+	if (tracePath != nil) {
+		
+		NSError *error = nil;
+		
+		[CTKTransactionTracer setEnabled:NO];
+		
+		if (![CTKTransactionTracer writeChromeTraceToFile:tracePath error:&error])
+			NSLog(@"Could not write the trace: %@", [error localizedDescription]);
+		
+		NSLog(@"Hottest conflicting references");
+		
+		for (CTKTraceHotReference *hot in [CTKTransactionTracer hottestReferences:10])
+			NSLog(@"%@", hot);
+	}
+	
 	[pool drain];
 
     return 0;
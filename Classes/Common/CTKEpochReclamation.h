@@ -0,0 +1,58 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+
+/*
+ Deferred release for lock-free structures built with retain/release.
+ 
+ Lock-free readers follow pointers without retaining them, so a writer that unlinks an object by CAS cannot release 
+ it right away. Every operation that may read shared nodes is bracketed by CTKEpochEnter() and CTKEpochExit(), 
+ writers hand the reference they unlinked to CTKEpochRelease(). The release is performed once the global epoch 
+ advanced three times, at that point every operation that could have seen the object has exited.
+ 
+ The state is process wide so that nodes shared by several structures (e.g. a concurrent trie and its snapshots) 
+ are covered by the same grace periods.
+ */
+
+typedef int64_t CTKEpoch;
+
+/**
+ * \brief Marks the calling thread as reading shared nodes. Calls may nest.
+ * \return The token to pass back to CTKEpochExit()
+ */
+extern CTKEpoch CTKEpochEnter(void);
+
+/**
+ * \brief Ends an operation started by CTKEpochEnter() and releases the objects whose grace period elapsed.
+ */
+extern void CTKEpochExit(CTKEpoch anEpoch);
+
+/**
+ * \brief Releases anObject once no operation running at the time of this call can still reach it.
+ * \details Must be called between CTKEpochEnter() and CTKEpochExit(), after anObject was unlinked.
+ */
+extern void CTKEpochRelease(id anObject);
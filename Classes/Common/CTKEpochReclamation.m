@@ -0,0 +1,125 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKEpochReclamation.h"
+#include <libkern/OSAtomic.h>
+#include <stdlib.h>
+
+/*
+ Four slots because an operation may still be running in the previous epoch when the global epoch advances: 
+ when epoch n starts, threads are either in n-1 or n and the slot of epoch n-3 is quiet and safe to drain.
+ */
+enum { CTKEpochSlots = 4 };
+
+typedef struct CTKEpochLimboEntry {
+	struct CTKEpochLimboEntry *next;
+	id object;
+} CTKEpochLimboEntry;
+
+static volatile CTKEpoch CTKEpochGlobal = 0;
+static volatile int64_t CTKEpochActive[CTKEpochSlots] = {0, 0, 0, 0};
+
+/*
+ Each slot is a stack that is only pushed onto or taken whole, so there is no ABA to guard against.
+ */
+static CTKEpochLimboEntry * volatile CTKEpochLimbo[CTKEpochSlots] = {NULL, NULL, NULL, NULL};
+
+static CTKEpochLimboEntry *CTKEpochTakeLimbo(CTKEpochLimboEntry * volatile *aLimbo)
+{
+	CTKEpochLimboEntry *entries;
+	
+	do {
+		entries = *aLimbo;
+	} while (entries != NULL && !OSAtomicCompareAndSwapPtrBarrier(entries, NULL, (void * volatile *)aLimbo));
+	
+	return entries;
+}
+
+static void CTKEpochTryAdvance(void)
+{
+	CTKEpoch epoch = CTKEpochGlobal;
+	
+	OSMemoryBarrier();
+	
+	if (CTKEpochActive[(epoch - 1) & (CTKEpochSlots - 1)] != 0)
+		return;
+	
+	if (!OSAtomicCompareAndSwap64Barrier(epoch, epoch + 1, &CTKEpochGlobal))
+		return; // somebody else advanced it
+	
+	/*
+	 The slot is detached before releasing anything: the drain is not part of any epoch, if the global epoch reaches 
+	 epoch + 2 meanwhile, the objects retired into the slot from then on belong to the new list.
+	 */
+	CTKEpochLimboEntry *entry = CTKEpochTakeLimbo(&CTKEpochLimbo[(epoch + 2) & (CTKEpochSlots - 1)]);
+	
+	while (entry != NULL) {
+		
+		CTKEpochLimboEntry *next = entry->next;
+		
+		[entry->object release];
+		free(entry);
+		entry = next;
+	}
+}
+
+CTKEpoch CTKEpochEnter(void)
+{
+	for (;;) {
+		
+		CTKEpoch epoch = CTKEpochGlobal;
+		
+		OSAtomicIncrement64Barrier(&CTKEpochActive[epoch & (CTKEpochSlots - 1)]);
+		
+		// If the epoch moved while registering, the advancer did not see us, register again
+		if (CTKEpochGlobal == epoch)
+			return epoch;
+		
+		OSAtomicDecrement64Barrier(&CTKEpochActive[epoch & (CTKEpochSlots - 1)]);
+	}
+}
+
+void CTKEpochExit(CTKEpoch anEpoch)
+{
+	OSAtomicDecrement64Barrier(&CTKEpochActive[anEpoch & (CTKEpochSlots - 1)]);
+	CTKEpochTryAdvance();
+}
+
+void CTKEpochRelease(id anObject)
+{
+	if (anObject == nil)
+		return;
+	
+	CTKEpochLimboEntry *entry = malloc(sizeof(CTKEpochLimboEntry));
+	
+	CTKEpochLimboEntry * volatile *limbo = &CTKEpochLimbo[CTKEpochGlobal & (CTKEpochSlots - 1)];
+	
+	entry->object = anObject;
+	
+	do {
+		entry->next = *limbo;
+	} while (!OSAtomicCompareAndSwapPtrBarrier(entry->next, entry, (void * volatile *)limbo));
+}
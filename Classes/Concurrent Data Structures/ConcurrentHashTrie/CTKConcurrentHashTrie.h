@@ -0,0 +1,111 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "CTKTrieNode.h"
+@class CTKCtrieINode;
+@class CTKTrieLeafNode;
+@class CTKPersistentHashMap;
+
+/*
+ * \class CTKConcurrentHashTrie CTKConcurrentHashTrie.h
+ * \brief A mutable hash map that many threads may update directly, without a transaction.
+ * \details A Ctrie ("Concurrent Tries with Efficient Non-Blocking Snapshots", Prokopec et al.): the same 64 way 
+ * bitmap indexed trie as CTKPersistentHashMap where every branching node sits behind an indirection node updated by
+ * compare and swap. Lookups, insertions and removals are lock-free, writers on different keys only contend on the 
+ * indirection nodes they share.
+ * 
+ * Snapshots are O(1): the root is swapped for a copy tagged with a new generation and nodes of older generations are
+ * copied lazily by the next writer that reaches them. persistentHashMap hands such a snapshot to code expecting an 
+ * immutable map (e.g. the value of a CTKReference) without copying the entries.
+ * 
+ * Keys are hashed like in a CTKPersistentHashMap with the default seed, and copied like CTKPersistentHashMapEntry keys.
+ * Replaced nodes are released through CTKEpochRelease(), see CTKEpochReclamation.h.
+ */
+@interface CTKConcurrentHashTrie : NSObject {
+	@private
+	id volatile root; // CTKCtrieINode or a pending CTKCtrieRootDescriptor
+	BOOL readOnly;
+}
+
+/**
+ * \return YES for the snapshots backing persistentHashMap views.
+ */
+@property (readonly, assign, nonatomic) BOOL readOnly;
+
+#pragma mark Initialization
+
++ (id) concurrentHashTrie;
+
+#pragma mark Operations
+
+- (id) objectForKey:(id)aKey;
+
+- (void) setObject:(id)anObject forKey:(id)aKey;
+
+- (void) removeObjectForKey:(id)aKey;
+
+/**
+ * \details Counts the entries of a read-only snapshot, O(n).
+ */
+- (NSUInteger) count;
+
+#pragma mark Snapshots
+
+/**
+ * \return An independent, writable copy of the receiver, taken in O(1).
+ */
+- (CTKConcurrentHashTrie *) snapshot;
+
+/**
+ * \return An immutable view of the receiver's current contents, taken in O(1).
+ * \details Lookups on the view go through the frozen trie. Updates on the view only convert the nodes along the
+ * updated path into CTKPersistentHashMap nodes. The count is computed on first use.
+ */
+- (CTKPersistentHashMap *) persistentHashMap;
+
+#pragma mark Read-only snapshot access (used by CTKCtrieSnapshotNode)
+
+- (CTKTrieLeafNode *) leafForKey:(id)aKey hash:(NSUInteger)aHashValue iNode:(CTKCtrieINode *)anINode shift:(NSUInteger)aShiftValue;
+
+/**
+ * \return The CTKPersistentHashMap node equivalent to the main node of anINode, its inner branches are 
+ * CTKCtrieSnapshotNode(s).
+ */
+- (id <CTKTrieNode>) nodeForINode:(CTKCtrieINode *)anINode shift:(NSUInteger)aShiftValue;
+
+/**
+ * \return The hash of some entry under anINode, what CTKTrieNode hashValue stands for on branching nodes.
+ */
+- (NSUInteger) hashValueOfINode:(CTKCtrieINode *)anINode;
+
+/**
+ * \return The sum of the CTKTrieEntryHash of the entries under anINode, see CTKTrieNode contentHash.
+ * \details Walks the frozen branches, O(entries) in time, without creating CTKPersistentHashMap nodes.
+ */
+- (NSUInteger) contentHashOfINode:(CTKCtrieINode *)anINode;
+
+@end
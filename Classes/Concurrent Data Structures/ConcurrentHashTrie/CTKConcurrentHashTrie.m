@@ -0,0 +1,1046 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKConcurrentHashTrie.h"
+#import "CTKCtrieNodes.h"
+#import "CTKCtrieSnapshotNode.h"
+#import "CTKEpochReclamation.h"
+#import "CTKPersistentHashMap.h"
+#import "CTKTrieLeafNode.h"
+#import "CTKTrieEmptyNode.h"
+#import "CTKTrieBitmapIndexedNode.h"
+#import "CTKTrieFullNode.h"
+#import "CTKTrieHashCollisionNode.h"
+#include <libkern/OSAtomic.h>
+
+// Results of the recursive operations besides a leaf
+static id CTKCtrieRestart = nil;
+static id CTKCtrieNotFound = nil;
+
+// Must match -[CTKPersistentHashMap hashForKey:] with the default seed, the views share the leaves
+static NSUInteger CTKCtrieHash(id aKey)
+{
+	return CTKTrieNodeMixHash((aKey != nil) ? [aKey hash] : 0, 0);
+}
+
+static BOOL CTKCtrieLeafHasKey(CTKTrieLeafNode *aLeaf, id aKey, NSUInteger aHashValue)
+{
+	return aLeaf.hashValue == aHashValue && (aLeaf.key == aKey || [aLeaf.key isEqual:aKey]);
+}
+
+
+/*
+ The view returned by persistentHashMap, counting a Ctrie is O(n) so it is only done if asked for.
+ */
+@interface CTKConcurrentHashTrieMap : CTKPersistentHashMap {
+	@private
+	CTKConcurrentHashTrie *trie;
+	volatile NSUInteger cachedCount;
+	volatile BOOL counted;
+}
+
+- (id) initWithTrie:(CTKConcurrentHashTrie *)aTrie rootNode:(id <CTKTrieNode>)aNode;
+
+@end
+
+
+@interface CTKConcurrentHashTrie ()
+
+@property (readwrite, assign, nonatomic) BOOL readOnly;
+
+- (id) initWithRoot:(CTKCtrieINode *)anINode readOnly:(BOOL)flag;
+
+@end
+
+
+@interface CTKConcurrentHashTrie (Private)
+
+- (BOOL) private_compareAndSwapRoot:(id)anExpectedRoot withRoot:(id)aRoot;
+- (CTKCtrieINode *) private_readRootAbort:(BOOL)abort;
+- (CTKCtrieINode *) private_completeRootDescriptorAbort:(BOOL)abort;
+- (BOOL) private_rdcssRoot:(CTKCtrieINode *)anOldRoot expectedMainNode:(CTKCtrieMainNode *)aMainNode proposedRoot:(CTKCtrieINode *)aRoot;
+- (CTKCtrieINode *) private_readOnlyRoot;
+- (NSUInteger) private_contentHashOfINode:(CTKCtrieINode *)anINode;
+
+- (CTKCtrieMainNode *) private_gcasRead:(CTKCtrieINode *)anINode;
+- (CTKCtrieMainNode *) private_gcasCommit:(CTKCtrieMainNode *)aMainNode iNode:(CTKCtrieINode *)anINode;
+- (BOOL) private_gcas:(CTKCtrieINode *)anINode expectedNode:(CTKCtrieMainNode *)anExpectedNode node:(CTKCtrieMainNode *)aNode;
+
+- (CTKCtrieINode *) private_copyINode:(CTKCtrieINode *)anINode generation:(id)aGeneration;
+- (CTKCtrieCNode *) private_renewedNode:(CTKCtrieCNode *)aNode generation:(id)aGeneration;
+- (CTKCtrieMainNode *) private_contractedNode:(CTKCtrieCNode *)aNode shift:(NSUInteger)aShiftValue;
+- (CTKCtrieMainNode *) private_compressedNode:(CTKCtrieCNode *)aNode shift:(NSUInteger)aShiftValue generation:(id)aGeneration;
+- (void) private_clean:(CTKCtrieINode *)anINode shift:(NSUInteger)aShiftValue;
+- (void) private_cleanParent:(CTKCtrieINode *)aParent 
+					   iNode:(CTKCtrieINode *)anINode 
+						tomb:(CTKCtrieTNode *)aTomb 
+						hash:(NSUInteger)aHashValue 
+					   shift:(NSUInteger)aShiftValue 
+				  generation:(id)aGeneration;
+
+- (id) private_lookupKey:(id)aKey 
+					hash:(NSUInteger)aHashValue 
+				   iNode:(CTKCtrieINode *)anINode 
+				   shift:(NSUInteger)aShiftValue 
+				  parent:(CTKCtrieINode *)aParent 
+			  generation:(id)aGeneration;
+
+- (BOOL) private_insertLeaf:(CTKTrieLeafNode *)aLeaf 
+					  iNode:(CTKCtrieINode *)anINode 
+					  shift:(NSUInteger)aShiftValue 
+					 parent:(CTKCtrieINode *)aParent 
+				 generation:(id)aGeneration;
+
+- (id) private_removeKey:(id)aKey 
+					hash:(NSUInteger)aHashValue 
+				   iNode:(CTKCtrieINode *)anINode 
+				   shift:(NSUInteger)aShiftValue 
+				  parent:(CTKCtrieINode *)aParent 
+			  generation:(id)aGeneration;
+
+- (NSUInteger) private_countINode:(CTKCtrieINode *)anINode;
+
+@end
+
+
+@implementation CTKConcurrentHashTrie
+
+#pragma mark Initialization
+
++ (void) initialize
+{
+	if (self == [CTKConcurrentHashTrie class]) {
+		CTKCtrieRestart = [NSObject new];
+		CTKCtrieNotFound = [NSObject new];
+	}
+}
+
++ (id) concurrentHashTrie
+{
+	return [[[CTKConcurrentHashTrie alloc] init] autorelease];
+}
+
+- (id) init
+{
+	id generation = [[NSObject new] autorelease];
+	CTKCtrieCNode *emptyNode = [CTKCtrieCNode cNodeWithBranches:NULL bitmap:0 generation:generation];
+	
+	return [self initWithRoot:[CTKCtrieINode iNodeWithMainNode:emptyNode generation:generation] readOnly:NO];
+}
+
+- (id) initWithRoot:(CTKCtrieINode *)anINode readOnly:(BOOL)flag
+{
+	NSParameterAssert(anINode);
+	
+	self = [super init];
+	
+	if (self != nil) {
+		root = [anINode retain];
+		self.readOnly = flag;
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[root release];
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize readOnly;
+
+#pragma mark Operations
+
+- (id) objectForKey:(id)aKey
+{
+	NSUInteger hash = CTKCtrieHash(aKey);
+	id object = nil;
+	CTKEpoch epoch = CTKEpochEnter();
+	
+	@try {
+		
+		id result;
+		
+		do {
+			CTKCtrieINode *r = [self private_readRootAbort:NO];
+			result = [self private_lookupKey:aKey hash:hash iNode:r shift:0 parent:nil generation:r.generation];
+		} while (result == CTKCtrieRestart);
+		
+		if (result != CTKCtrieNotFound)
+			object = [[[(CTKTrieLeafNode *)result object] retain] autorelease];
+	}
+	@finally {
+		CTKEpochExit(epoch);
+	}
+	
+	return object;
+}
+
+- (void) setObject:(id)anObject forKey:(id)aKey
+{
+	NSAssert(!self.readOnly, @"Read-only snapshots cannot be modified");
+	
+	CTKTrieLeafNode *leaf = [CTKTrieLeafNode leafNodeWithObject:anObject forKey:aKey hash:CTKCtrieHash(aKey)];
+	CTKEpoch epoch = CTKEpochEnter();
+	
+	@try {
+		
+		BOOL done;
+		
+		do {
+			CTKCtrieINode *r = [self private_readRootAbort:NO];
+			done = [self private_insertLeaf:leaf iNode:r shift:0 parent:nil generation:r.generation];
+		} while (!done);
+	}
+	@finally {
+		CTKEpochExit(epoch);
+	}
+}
+
+- (void) removeObjectForKey:(id)aKey
+{
+	NSAssert(!self.readOnly, @"Read-only snapshots cannot be modified");
+	
+	NSUInteger hash = CTKCtrieHash(aKey);
+	CTKEpoch epoch = CTKEpochEnter();
+	
+	@try {
+		
+		id result;
+		
+		do {
+			CTKCtrieINode *r = [self private_readRootAbort:NO];
+			result = [self private_removeKey:aKey hash:hash iNode:r shift:0 parent:nil generation:r.generation];
+		} while (result == CTKCtrieRestart);
+	}
+	@finally {
+		CTKEpochExit(epoch);
+	}
+}
+
+- (NSUInteger) count
+{
+	NSUInteger count;
+	CTKEpoch epoch = CTKEpochEnter();
+	
+	@try {
+		count = [self private_countINode:[self private_readOnlyRoot]];
+	}
+	@finally {
+		CTKEpochExit(epoch);
+	}
+	
+	return count;
+}
+
+#pragma mark Snapshots
+
+- (CTKConcurrentHashTrie *) snapshot
+{
+	NSAssert(!self.readOnly, @"Take snapshots from the original trie");
+	
+	CTKConcurrentHashTrie *snapshot = nil;
+	CTKEpoch epoch = CTKEpochEnter();
+	
+	@try {
+		
+		for (;;) {
+			
+			CTKCtrieINode *r = [self private_readRootAbort:NO];
+			CTKCtrieMainNode *expectedMainNode = [self private_gcasRead:r];
+			CTKCtrieINode *proposedRoot = [self private_copyINode:r generation:[[NSObject new] autorelease]];
+			
+			// Both tries get a new generation, r is left to the lazy copies
+			if ([self private_rdcssRoot:r expectedMainNode:expectedMainNode proposedRoot:proposedRoot]) {
+				
+				CTKCtrieINode *copy = [self private_copyINode:r generation:[[NSObject new] autorelease]];
+				
+				snapshot = [[[CTKConcurrentHashTrie alloc] initWithRoot:copy readOnly:NO] autorelease];
+				break;
+			}
+		}
+	}
+	@finally {
+		CTKEpochExit(epoch);
+	}
+	
+	return snapshot;
+}
+
+- (CTKPersistentHashMap *) persistentHashMap
+{
+	CTKConcurrentHashTrie *frozen = self;
+	CTKPersistentHashMap *map = nil;
+	CTKEpoch epoch = CTKEpochEnter();
+	
+	@try {
+		
+		if (!self.readOnly)
+			frozen = [[[CTKConcurrentHashTrie alloc] initWithRoot:[self private_readOnlyRoot] readOnly:YES] autorelease];
+		
+		CTKCtrieINode *r = [frozen private_readRootAbort:NO];
+		CTKCtrieMainNode *main = [frozen private_gcasRead:r];
+		
+		if ([main isKindOfClass:[CTKCtrieCNode class]] && [(CTKCtrieCNode *)main count] == 0) {
+			map = [CTKPersistentHashMap emptyHashMap];
+		}
+		
+		else {
+			CTKCtrieSnapshotNode *node = [CTKCtrieSnapshotNode snapshotNodeWithTrie:frozen iNode:r shift:0];
+			map = [[[CTKConcurrentHashTrieMap alloc] initWithTrie:frozen rootNode:node] autorelease];
+		}
+	}
+	@finally {
+		CTKEpochExit(epoch);
+	}
+	
+	return map;
+}
+
+#pragma mark Read-only snapshot access
+
+- (CTKTrieLeafNode *) leafForKey:(id)aKey hash:(NSUInteger)aHashValue iNode:(CTKCtrieINode *)anINode shift:(NSUInteger)aShiftValue
+{
+	NSAssert(self.readOnly, @"Only read-only snapshots can be accessed by node");
+	
+	CTKTrieLeafNode *leaf = nil;
+	CTKEpoch epoch = CTKEpochEnter();
+	
+	@try {
+		
+		// Read-only lookups never restart
+		id result = [self private_lookupKey:aKey 
+									   hash:aHashValue 
+									  iNode:anINode 
+									  shift:aShiftValue 
+									 parent:nil 
+								 generation:anINode.generation];
+		
+		if (result != CTKCtrieNotFound)
+			leaf = [[result retain] autorelease];
+	}
+	@finally {
+		CTKEpochExit(epoch);
+	}
+	
+	return leaf;
+}
+
+- (id <CTKTrieNode>) nodeForINode:(CTKCtrieINode *)anINode shift:(NSUInteger)aShiftValue
+{
+	NSAssert(self.readOnly, @"Only read-only snapshots can be accessed by node");
+	
+	id <CTKTrieNode> node = nil;
+	CTKEpoch epoch = CTKEpochEnter();
+	
+	@try {
+		
+		CTKCtrieMainNode *main = [self private_gcasRead:anINode];
+		
+		if ([main isKindOfClass:[CTKCtrieCNode class]]) {
+			
+			CTKCtrieCNode *cNode = (CTKCtrieCNode *)main;
+			NSMutableArray *nodes = [NSMutableArray arrayWithCapacity:cNode.count];
+			
+			for (NSUInteger i = 0; i < cNode.count; i++) {
+				
+				id branch = [cNode branchAtIndex:i];
+				
+				if ([branch isKindOfClass:[CTKCtrieINode class]])
+					branch = [CTKCtrieSnapshotNode snapshotNodeWithTrie:self 
+																  iNode:branch 
+																  shift:aShiftValue + CTKTrieNodeShiftIncrement];
+				
+				[nodes addObject:branch];
+			}
+			
+			if (cNode.count == 0)
+				node = [CTKTrieEmptyNode emptyNode];
+			else if (cNode.count == CTKTrieNodeMaskCoeficient + 1)
+				node = [CTKTrieFullNode fullNodeWithNodes:nodes shift:aShiftValue];
+			else
+				node = [CTKTrieBitmapIndexedNode bitmapIndexedNodeWithNodes:nodes bitmap:cNode.bitmap shift:aShiftValue];
+		}
+		
+		else if ([main isKindOfClass:[CTKCtrieTNode class]]) {
+			node = [[[(CTKCtrieTNode *)main leaf] retain] autorelease];
+		}
+		
+		else {
+			NSArray *leaves = [(CTKCtrieLNode *)main leaves];
+			node = [CTKTrieHashCollisionNode hashCollisionNodeWithLeaves:leaves 
+																	hash:[[leaves objectAtIndex:0] hashValue]];
+		}
+	}
+	@finally {
+		CTKEpochExit(epoch);
+	}
+	
+	return node;
+}
+
+- (NSUInteger) contentHashOfINode:(CTKCtrieINode *)anINode
+{
+	NSAssert(self.readOnly, @"Only read-only snapshots can be accessed by node");
+	
+	NSUInteger hash = 0;
+	CTKEpoch epoch = CTKEpochEnter();
+	
+	@try {
+		hash = [self private_contentHashOfINode:anINode];
+	}
+	@finally {
+		CTKEpochExit(epoch);
+	}
+	
+	return hash;
+}
+
+- (NSUInteger) hashValueOfINode:(CTKCtrieINode *)anINode
+{
+	NSUInteger hash = 0;
+	CTKEpoch epoch = CTKEpochEnter();
+	
+	@try {
+		
+		for (;;) {
+			
+			CTKCtrieMainNode *main = [self private_gcasRead:anINode];
+			
+			if ([main isKindOfClass:[CTKCtrieTNode class]]) {
+				hash = [(CTKCtrieTNode *)main leaf].hashValue;
+				break;
+			}
+			
+			if ([main isKindOfClass:[CTKCtrieLNode class]]) {
+				hash = [[[(CTKCtrieLNode *)main leaves] objectAtIndex:0] hashValue];
+				break;
+			}
+			
+			CTKCtrieCNode *cNode = (CTKCtrieCNode *)main;
+			
+			if (cNode.count == 0)
+				break;
+			
+			id branch = [cNode branchAtIndex:0];
+			
+			if (![branch isKindOfClass:[CTKCtrieINode class]]) {
+				hash = [(CTKTrieLeafNode *)branch hashValue];
+				break;
+			}
+			
+			anINode = branch;
+		}
+	}
+	@finally {
+		CTKEpochExit(epoch);
+	}
+	
+	return hash;
+}
+
+@end
+
+
+@implementation CTKConcurrentHashTrie (Private)
+
+#pragma mark Root
+
+- (BOOL) private_compareAndSwapRoot:(id)anExpectedRoot withRoot:(id)aRoot
+{
+	[aRoot retain];
+	
+	if (OSAtomicCompareAndSwapPtrBarrier(anExpectedRoot, aRoot, (void * volatile *)&root)) {
+		CTKEpochRelease(anExpectedRoot);
+		return YES;
+	}
+	
+	[aRoot release];
+	return NO;
+}
+
+- (CTKCtrieINode *) private_readRootAbort:(BOOL)abort
+{
+	id r = root;
+	
+	if ([r isKindOfClass:[CTKCtrieINode class]])
+		return r;
+	
+	return [self private_completeRootDescriptorAbort:abort];
+}
+
+- (CTKCtrieINode *) private_completeRootDescriptorAbort:(BOOL)abort
+{
+	for (;;) {
+		
+		id r = root;
+		
+		if ([r isKindOfClass:[CTKCtrieINode class]])
+			return r;
+		
+		CTKCtrieRootDescriptor *descriptor = r;
+		CTKCtrieINode *oldRoot = descriptor.oldRoot;
+		
+		if (abort) {
+			
+			if ([self private_compareAndSwapRoot:descriptor withRoot:oldRoot])
+				return oldRoot;
+			
+			continue;
+		}
+		
+		if ([self private_gcasRead:oldRoot] == descriptor.expectedMainNode) {
+			
+			if ([self private_compareAndSwapRoot:descriptor withRoot:descriptor.proposedRoot]) {
+				descriptor.committed = YES;
+				return descriptor.proposedRoot;
+			}
+			
+			continue;
+		}
+		
+		if ([self private_compareAndSwapRoot:descriptor withRoot:oldRoot])
+			return oldRoot;
+	}
+}
+
+- (BOOL) private_rdcssRoot:(CTKCtrieINode *)anOldRoot expectedMainNode:(CTKCtrieMainNode *)aMainNode proposedRoot:(CTKCtrieINode *)aRoot
+{
+	CTKCtrieRootDescriptor *descriptor = [CTKCtrieRootDescriptor rootDescriptorWithOldRoot:anOldRoot 
+																		  expectedMainNode:aMainNode 
+																			  proposedRoot:aRoot];
+	
+	if (![self private_compareAndSwapRoot:anOldRoot withRoot:descriptor])
+		return NO;
+	
+	[self private_completeRootDescriptorAbort:NO];
+	
+	return descriptor.committed;
+}
+
+/*
+ Must be called between CTKEpochEnter() and CTKEpochExit(), on a read-only snapshot.
+ */
+- (NSUInteger) private_contentHashOfINode:(CTKCtrieINode *)anINode
+{
+	CTKCtrieMainNode *main = [self private_gcasRead:anINode];
+	NSUInteger hash = 0;
+	
+	if ([main isKindOfClass:[CTKCtrieTNode class]])
+		return [[(CTKCtrieTNode *)main leaf] contentHash];
+	
+	if ([main isKindOfClass:[CTKCtrieLNode class]]) {
+		for (CTKTrieLeafNode *leaf in [(CTKCtrieLNode *)main leaves])
+			hash += [leaf contentHash];
+		return hash;
+	}
+	
+	CTKCtrieCNode *cNode = (CTKCtrieCNode *)main;
+	
+	for (NSUInteger i = 0; i < cNode.count; i++) {
+		
+		id branch = [cNode branchAtIndex:i];
+		
+		hash += ([branch isKindOfClass:[CTKCtrieINode class]]) 
+			? [self private_contentHashOfINode:branch] 
+			: [(CTKTrieLeafNode *)branch contentHash];
+	}
+	
+	return hash;
+}
+
+/*
+ The root of a frozen version of the receiver, a read-only trie is already frozen.
+ */
+- (CTKCtrieINode *) private_readOnlyRoot
+{
+	if (self.readOnly)
+		return [self private_readRootAbort:NO];
+	
+	for (;;) {
+		
+		CTKCtrieINode *r = [self private_readRootAbort:NO];
+		CTKCtrieMainNode *expectedMainNode = [self private_gcasRead:r];
+		CTKCtrieINode *proposedRoot = [self private_copyINode:r generation:[[NSObject new] autorelease]];
+		
+		if ([self private_rdcssRoot:r expectedMainNode:expectedMainNode proposedRoot:proposedRoot])
+			return r;
+	}
+}
+
+#pragma mark Generation compare and swap
+
+- (CTKCtrieMainNode *) private_gcasRead:(CTKCtrieINode *)anINode
+{
+	CTKCtrieMainNode *main = anINode.mainNode;
+	
+	if (main.previous == nil)
+		return main;
+	
+	return [self private_gcasCommit:main iNode:anINode];
+}
+
+- (CTKCtrieMainNode *) private_gcasCommit:(CTKCtrieMainNode *)aMainNode iNode:(CTKCtrieINode *)anINode
+{
+	for (;;) {
+		
+		CTKCtrieMainNode *previous = aMainNode.previous;
+		CTKCtrieINode *r = [self private_readRootAbort:YES];
+		
+		if (previous == nil)
+			return aMainNode;
+		
+		if ([previous isKindOfClass:[CTKCtrieFailedNode class]]) {
+			
+			// The proposal was rejected, put back the node it was proposed over
+			if ([anINode compareAndSwapMainNode:aMainNode withNode:previous.previous])
+				return previous.previous;
+			
+			aMainNode = anINode.mainNode;
+			continue;
+		}
+		
+		// Commit only if no snapshot was taken since the proposal
+		if (r.generation == anINode.generation && !self.readOnly) {
+			
+			if ([aMainNode compareAndSwapPrevious:previous withNode:nil])
+				return aMainNode;
+			
+			continue;
+		}
+		
+		[aMainNode compareAndSwapPrevious:previous withNode:[CTKCtrieFailedNode failedNodeWithPrevious:previous]];
+		aMainNode = anINode.mainNode;
+	}
+}
+
+- (BOOL) private_gcas:(CTKCtrieINode *)anINode expectedNode:(CTKCtrieMainNode *)anExpectedNode node:(CTKCtrieMainNode *)aNode
+{
+	[aNode setInitialPrevious:anExpectedNode];
+	
+	if (![anINode compareAndSwapMainNode:anExpectedNode withNode:aNode])
+		return NO;
+	
+	[self private_gcasCommit:aNode iNode:anINode];
+	
+	return aNode.previous == nil;
+}
+
+#pragma mark Node transformations
+
+- (CTKCtrieINode *) private_copyINode:(CTKCtrieINode *)anINode generation:(id)aGeneration
+{
+	return [CTKCtrieINode iNodeWithMainNode:[self private_gcasRead:anINode] generation:aGeneration];
+}
+
+- (CTKCtrieCNode *) private_renewedNode:(CTKCtrieCNode *)aNode generation:(id)aGeneration
+{
+	NSUInteger count = aNode.count;
+	id *branches = malloc(sizeof(id) * MAX(count, 1));
+	
+	for (NSUInteger i = 0; i < count; i++) {
+		
+		id branch = [aNode branchAtIndex:i];
+		
+		branches[i] = ([branch isKindOfClass:[CTKCtrieINode class]]) 
+			? [self private_copyINode:branch generation:aGeneration] 
+			: branch;
+	}
+	
+	CTKCtrieCNode *renewed = [CTKCtrieCNode cNodeWithBranches:branches bitmap:aNode.bitmap generation:aGeneration];
+	
+	free(branches);
+	
+	return renewed;
+}
+
+/*
+ A branching node below the root left with a single leaf is entombed, so that its parent can pull the leaf up.
+ */
+- (CTKCtrieMainNode *) private_contractedNode:(CTKCtrieCNode *)aNode shift:(NSUInteger)aShiftValue
+{
+	if (aShiftValue > 0 && aNode.count == 1 && ![[aNode branchAtIndex:0] isKindOfClass:[CTKCtrieINode class]])
+		return [CTKCtrieTNode tNodeWithLeaf:[aNode branchAtIndex:0]];
+	
+	return aNode;
+}
+
+- (CTKCtrieMainNode *) private_compressedNode:(CTKCtrieCNode *)aNode shift:(NSUInteger)aShiftValue generation:(id)aGeneration
+{
+	NSUInteger count = aNode.count;
+	id *branches = malloc(sizeof(id) * MAX(count, 1));
+	
+	for (NSUInteger i = 0; i < count; i++) {
+		
+		id branch = [aNode branchAtIndex:i];
+		
+		if ([branch isKindOfClass:[CTKCtrieINode class]]) {
+			
+			CTKCtrieMainNode *main = [self private_gcasRead:branch];
+			
+			if ([main isKindOfClass:[CTKCtrieTNode class]])
+				branch = [(CTKCtrieTNode *)main leaf]; // resurrect
+		}
+		
+		branches[i] = branch;
+	}
+	
+	CTKCtrieCNode *compressed = [CTKCtrieCNode cNodeWithBranches:branches bitmap:aNode.bitmap generation:aGeneration];
+	
+	free(branches);
+	
+	return [self private_contractedNode:compressed shift:aShiftValue];
+}
+
+- (void) private_clean:(CTKCtrieINode *)anINode shift:(NSUInteger)aShiftValue
+{
+	if (anINode == nil)
+		return;
+	
+	CTKCtrieMainNode *main = [self private_gcasRead:anINode];
+	
+	if ([main isKindOfClass:[CTKCtrieCNode class]])
+		[self private_gcas:anINode 
+			  expectedNode:main 
+					  node:[self private_compressedNode:(CTKCtrieCNode *)main shift:aShiftValue generation:anINode.generation]];
+}
+
+- (void) private_cleanParent:(CTKCtrieINode *)aParent 
+					   iNode:(CTKCtrieINode *)anINode 
+						tomb:(CTKCtrieTNode *)aTomb 
+						hash:(NSUInteger)aHashValue 
+					   shift:(NSUInteger)aShiftValue 
+				  generation:(id)aGeneration
+{
+	NSUInteger parentShift = aShiftValue - CTKTrieNodeShiftIncrement;
+	
+	for (;;) {
+		
+		CTKCtrieMainNode *main = [self private_gcasRead:aParent];
+		
+		if (![main isKindOfClass:[CTKCtrieCNode class]])
+			return;
+		
+		CTKCtrieCNode *cNode = (CTKCtrieCNode *)main;
+		NSUInteger bit = CTKTrieNodeBitpos(aHashValue, parentShift);
+		
+		if ((cNode.bitmap & bit) == 0)
+			return; // somebody else removed anINode
+		
+		NSUInteger index = CTKTrieNodeIndex(cNode.bitmap, bit);
+		
+		if ([cNode branchAtIndex:index] != anINode)
+			return;
+		
+		CTKCtrieCNode *updated = [cNode cNodeByReplacingBranchAtIndex:index withBranch:aTomb.leaf generation:aParent.generation];
+		
+		if ([self private_gcas:aParent expectedNode:cNode node:[self private_contractedNode:updated shift:parentShift]])
+			return;
+		
+		if ([self private_readRootAbort:NO].generation != aGeneration)
+			return;
+	}
+}
+
+#pragma mark Operations
+
+- (id) private_lookupKey:(id)aKey 
+					hash:(NSUInteger)aHashValue 
+				   iNode:(CTKCtrieINode *)anINode 
+				   shift:(NSUInteger)aShiftValue 
+				  parent:(CTKCtrieINode *)aParent 
+			  generation:(id)aGeneration
+{
+	for (;;) {
+		
+		CTKCtrieMainNode *main = [self private_gcasRead:anINode];
+		
+		if ([main isKindOfClass:[CTKCtrieCNode class]]) {
+			
+			CTKCtrieCNode *cNode = (CTKCtrieCNode *)main;
+			NSUInteger bit = CTKTrieNodeBitpos(aHashValue, aShiftValue);
+			
+			if ((cNode.bitmap & bit) == 0)
+				return CTKCtrieNotFound;
+			
+			id branch = [cNode branchAtIndex:CTKTrieNodeIndex(cNode.bitmap, bit)];
+			
+			if ([branch isKindOfClass:[CTKCtrieINode class]]) {
+				
+				if (self.readOnly || [(CTKCtrieINode *)branch generation] == aGeneration) {
+					aParent = anINode;
+					anINode = branch;
+					aShiftValue += CTKTrieNodeShiftIncrement;
+					continue;
+				}
+				
+				// Older generation, copy the node before going down
+				if ([self private_gcas:anINode expectedNode:cNode node:[self private_renewedNode:cNode generation:aGeneration]])
+					continue;
+				
+				return CTKCtrieRestart;
+			}
+			
+			return (CTKCtrieLeafHasKey(branch, aKey, aHashValue)) ? branch : CTKCtrieNotFound;
+		}
+		
+		if ([main isKindOfClass:[CTKCtrieTNode class]]) {
+			
+			CTKTrieLeafNode *leaf = [(CTKCtrieTNode *)main leaf];
+			
+			if (self.readOnly)
+				return (CTKCtrieLeafHasKey(leaf, aKey, aHashValue)) ? leaf : CTKCtrieNotFound;
+			
+			[self private_clean:aParent shift:aShiftValue - CTKTrieNodeShiftIncrement];
+			return CTKCtrieRestart;
+		}
+		
+		CTKTrieLeafNode *leaf = [(CTKCtrieLNode *)main leafForKey:aKey];
+		
+		return (leaf != nil) ? leaf : CTKCtrieNotFound;
+	}
+}
+
+- (BOOL) private_insertLeaf:(CTKTrieLeafNode *)aLeaf 
+					  iNode:(CTKCtrieINode *)anINode 
+					  shift:(NSUInteger)aShiftValue 
+					 parent:(CTKCtrieINode *)aParent 
+				 generation:(id)aGeneration
+{
+	NSUInteger hash = aLeaf.hashValue;
+	
+	for (;;) {
+		
+		CTKCtrieMainNode *main = [self private_gcasRead:anINode];
+		id generation = anINode.generation;
+		
+		if ([main isKindOfClass:[CTKCtrieCNode class]]) {
+			
+			CTKCtrieCNode *cNode = (CTKCtrieCNode *)main;
+			NSUInteger bit = CTKTrieNodeBitpos(hash, aShiftValue);
+			NSUInteger index = CTKTrieNodeIndex(cNode.bitmap, bit);
+			
+			if ((cNode.bitmap & bit) == 0) {
+				
+				CTKCtrieCNode *renewed = (cNode.generation == generation) ? cNode : [self private_renewedNode:cNode generation:generation];
+				
+				return [self private_gcas:anINode 
+							 expectedNode:cNode 
+									 node:[renewed cNodeByInsertingBranch:aLeaf atIndex:index bit:bit generation:generation]];
+			}
+			
+			id branch = [cNode branchAtIndex:index];
+			
+			if ([branch isKindOfClass:[CTKCtrieINode class]]) {
+				
+				if ([(CTKCtrieINode *)branch generation] == aGeneration) {
+					aParent = anINode;
+					anINode = branch;
+					aShiftValue += CTKTrieNodeShiftIncrement;
+					continue;
+				}
+				
+				if ([self private_gcas:anINode expectedNode:cNode node:[self private_renewedNode:cNode generation:aGeneration]])
+					continue;
+				
+				return NO;
+			}
+			
+			CTKTrieLeafNode *existing = branch;
+			
+			if (CTKCtrieLeafHasKey(existing, aLeaf.key, hash))
+				return [self private_gcas:anINode 
+							 expectedNode:cNode 
+									 node:[cNode cNodeByReplacingBranchAtIndex:index withBranch:aLeaf generation:generation]];
+			
+			// Both leaves move one level down
+			CTKCtrieMainNode *subnode = [CTKCtrieCNode cNodeWithLeaf:existing 
+															 andLeaf:aLeaf 
+															   shift:aShiftValue + CTKTrieNodeShiftIncrement 
+														  generation:generation];
+			CTKCtrieINode *subINode = [CTKCtrieINode iNodeWithMainNode:subnode generation:generation];
+			CTKCtrieCNode *renewed = (cNode.generation == generation) ? cNode : [self private_renewedNode:cNode generation:generation];
+			
+			return [self private_gcas:anINode 
+						 expectedNode:cNode 
+								 node:[renewed cNodeByReplacingBranchAtIndex:index withBranch:subINode generation:generation]];
+		}
+		
+		if ([main isKindOfClass:[CTKCtrieTNode class]]) {
+			[self private_clean:aParent shift:aShiftValue - CTKTrieNodeShiftIncrement];
+			return NO;
+		}
+		
+		return [self private_gcas:anINode expectedNode:main node:[(CTKCtrieLNode *)main lNodeBySettingLeaf:aLeaf]];
+	}
+}
+
+- (id) private_removeKey:(id)aKey 
+					hash:(NSUInteger)aHashValue 
+				   iNode:(CTKCtrieINode *)anINode 
+				   shift:(NSUInteger)aShiftValue 
+				  parent:(CTKCtrieINode *)aParent 
+			  generation:(id)aGeneration
+{
+	CTKCtrieMainNode *main = [self private_gcasRead:anINode];
+	
+	if ([main isKindOfClass:[CTKCtrieTNode class]]) {
+		[self private_clean:aParent shift:aShiftValue - CTKTrieNodeShiftIncrement];
+		return CTKCtrieRestart;
+	}
+	
+	if ([main isKindOfClass:[CTKCtrieLNode class]]) {
+		
+		CTKTrieLeafNode *existing = [(CTKCtrieLNode *)main leafForKey:aKey];
+		
+		if (existing == nil)
+			return CTKCtrieNotFound;
+		
+		CTKCtrieMainNode *updated = [(CTKCtrieLNode *)main nodeByRemovingObjectForKey:aKey];
+		
+		return ([self private_gcas:anINode expectedNode:main node:updated]) ? existing : CTKCtrieRestart;
+	}
+	
+	CTKCtrieCNode *cNode = (CTKCtrieCNode *)main;
+	NSUInteger bit = CTKTrieNodeBitpos(aHashValue, aShiftValue);
+	
+	if ((cNode.bitmap & bit) == 0)
+		return CTKCtrieNotFound;
+	
+	NSUInteger index = CTKTrieNodeIndex(cNode.bitmap, bit);
+	id branch = [cNode branchAtIndex:index];
+	id result;
+	
+	if ([branch isKindOfClass:[CTKCtrieINode class]]) {
+		
+		if ([(CTKCtrieINode *)branch generation] == aGeneration)
+			result = [self private_removeKey:aKey 
+										hash:aHashValue 
+									   iNode:branch 
+									   shift:aShiftValue + CTKTrieNodeShiftIncrement 
+									  parent:anINode 
+								  generation:aGeneration];
+		
+		else if ([self private_gcas:anINode expectedNode:cNode node:[self private_renewedNode:cNode generation:aGeneration]])
+			result = [self private_removeKey:aKey hash:aHashValue iNode:anINode shift:aShiftValue parent:aParent generation:aGeneration];
+		
+		else
+			result = CTKCtrieRestart;
+	}
+	
+	else if (CTKCtrieLeafHasKey(branch, aKey, aHashValue)) {
+		
+		CTKCtrieCNode *updated = [cNode cNodeByRemovingBranchAtIndex:index bit:bit generation:anINode.generation];
+		
+		result = ([self private_gcas:anINode expectedNode:cNode node:[self private_contractedNode:updated shift:aShiftValue]]) 
+			? branch 
+			: CTKCtrieRestart;
+	}
+	
+	else {
+		result = CTKCtrieNotFound;
+	}
+	
+	if (result == CTKCtrieNotFound || result == CTKCtrieRestart)
+		return result;
+	
+	// The root is never entombed
+	if (aParent != nil) {
+		
+		CTKCtrieMainNode *updated = [self private_gcasRead:anINode];
+		
+		if ([updated isKindOfClass:[CTKCtrieTNode class]])
+			[self private_cleanParent:aParent 
+								iNode:anINode 
+								 tomb:(CTKCtrieTNode *)updated 
+								 hash:aHashValue 
+								shift:aShiftValue 
+						   generation:aGeneration];
+	}
+	
+	return result;
+}
+
+- (NSUInteger) private_countINode:(CTKCtrieINode *)anINode
+{
+	CTKCtrieMainNode *main = [self private_gcasRead:anINode];
+	
+	if ([main isKindOfClass:[CTKCtrieTNode class]])
+		return 1;
+	
+	if ([main isKindOfClass:[CTKCtrieLNode class]])
+		return [[(CTKCtrieLNode *)main leaves] count];
+	
+	CTKCtrieCNode *cNode = (CTKCtrieCNode *)main;
+	NSUInteger count = 0;
+	
+	for (NSUInteger i = 0; i < cNode.count; i++) {
+		
+		id branch = [cNode branchAtIndex:i];
+		
+		count += ([branch isKindOfClass:[CTKCtrieINode class]]) ? [self private_countINode:branch] : 1;
+	}
+	
+	return count;
+}
+
+@end
+
+
+@implementation CTKConcurrentHashTrieMap
+
+- (id) initWithTrie:(CTKConcurrentHashTrie *)aTrie rootNode:(id <CTKTrieNode>)aNode
+{
+	self = [super initWithRoot:aNode count:0];
+	
+	if (self != nil)
+		trie = [aTrie retain];
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[trie release];
+	[super dealloc];
+}
+
+- (NSUInteger) count
+{
+	// Computing it twice is harmless, the trie is frozen
+	if (!counted) {
+		cachedCount = [trie count];
+		OSMemoryBarrier();
+		counted = YES;
+	}
+	
+	return cachedCount;
+}
+
+@end
@@ -0,0 +1,176 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+@class CTKTrieLeafNode;
+
+/*
+ Nodes of CTKConcurrentHashTrie, after "Concurrent Tries with Efficient Non-Blocking Snapshots" (Prokopec, Bronson, 
+ Bagwell, Odersky).
+ 
+ Indirection nodes (CTKCtrieINode) are the only mutable nodes, their main node is replaced by CAS. Main nodes are 
+ immutable once published: branching nodes (CTKCtrieCNode) use the same 64 way bitmap indexing as 
+ CTKTrieBitmapIndexedNode, tomb nodes (CTKCtrieTNode) mark a compressible single entry and list nodes 
+ (CTKCtrieLNode) hold full hash collisions. Entries are plain CTKTrieLeafNode(s), so they can be shared as they are
+ with a CTKPersistentHashMap view.
+ 
+ Ownership: the compareAndSwap methods retain the node they install and hand the one they replace to 
+ CTKEpochRelease(), they must be called between CTKEpochEnter() and CTKEpochExit().
+ */
+
+@interface CTKCtrieMainNode : NSObject {
+	@private
+	CTKCtrieMainNode * volatile previous;
+}
+
+/**
+ * \return The main node this one was proposed over while a generation compare and swap is pending, a 
+ * CTKCtrieFailedNode when the proposal was rejected or nil once it was committed.
+ */
+@property (readonly, nonatomic) CTKCtrieMainNode *previous;
+
+- (void) setInitialPrevious:(CTKCtrieMainNode *)aNode; // only before the node is published
+
+- (BOOL) compareAndSwapPrevious:(CTKCtrieMainNode *)anExpectedNode withNode:(CTKCtrieMainNode *)aNode;
+
+@end
+
+
+@interface CTKCtrieFailedNode : CTKCtrieMainNode 
+
++ (id) failedNodeWithPrevious:(CTKCtrieMainNode *)aNode;
+
+@end
+
+
+@interface CTKCtrieINode : NSObject {
+	@private
+	CTKCtrieMainNode * volatile mainNode;
+	id generation;
+}
+
+@property (readonly, nonatomic) CTKCtrieMainNode *mainNode;
+@property (readonly, retain, nonatomic) id generation;
+
++ (id) iNodeWithMainNode:(CTKCtrieMainNode *)aNode generation:(id)aGeneration;
+
+- (id) initWithMainNode:(CTKCtrieMainNode *)aNode generation:(id)aGeneration;
+
+- (BOOL) compareAndSwapMainNode:(CTKCtrieMainNode *)anExpectedNode withNode:(CTKCtrieMainNode *)aNode;
+
+@end
+
+
+@interface CTKCtrieCNode : CTKCtrieMainNode {
+	@private
+	NSUInteger bitmap;
+	NSUInteger count;
+	id generation;
+	id *branches; // CTKCtrieINode or CTKTrieLeafNode
+}
+
+@property (readonly, assign, nonatomic) NSUInteger bitmap;
+@property (readonly, assign, nonatomic) NSUInteger count;
+@property (readonly, retain, nonatomic) id generation;
+
++ (id) cNodeWithBranches:(const id *)someBranches bitmap:(NSUInteger)aBitmap generation:(id)aGeneration;
+
+/**
+ * \brief The node holding two leaves that collide down to aShiftValue, nested as deep as their hashes share chunks.
+ */
++ (CTKCtrieMainNode *) cNodeWithLeaf:(CTKTrieLeafNode *)aLeaf 
+							 andLeaf:(CTKTrieLeafNode *)anotherLeaf 
+							   shift:(NSUInteger)aShiftValue 
+						  generation:(id)aGeneration;
+
+- (id) initWithBranches:(const id *)someBranches bitmap:(NSUInteger)aBitmap generation:(id)aGeneration;
+
+- (id) branchAtIndex:(NSUInteger)anIndex;
+
+- (CTKCtrieCNode *) cNodeByReplacingBranchAtIndex:(NSUInteger)anIndex withBranch:(id)aBranch generation:(id)aGeneration;
+
+- (CTKCtrieCNode *) cNodeByInsertingBranch:(id)aBranch atIndex:(NSUInteger)anIndex bit:(NSUInteger)aBit generation:(id)aGeneration;
+
+- (CTKCtrieCNode *) cNodeByRemovingBranchAtIndex:(NSUInteger)anIndex bit:(NSUInteger)aBit generation:(id)aGeneration;
+
+@end
+
+
+@interface CTKCtrieTNode : CTKCtrieMainNode {
+	@private
+	CTKTrieLeafNode *leaf;
+}
+
+@property (readonly, retain, nonatomic) CTKTrieLeafNode *leaf;
+
++ (id) tNodeWithLeaf:(CTKTrieLeafNode *)aLeaf;
+
+@end
+
+
+@interface CTKCtrieLNode : CTKCtrieMainNode {
+	@private
+	NSArray *leaves;
+}
+
+@property (readonly, retain, nonatomic) NSArray *leaves;
+
++ (id) lNodeWithLeaves:(NSArray *)anArray;
+
+- (CTKTrieLeafNode *) leafForKey:(id)aKey;
+
+- (CTKCtrieLNode *) lNodeBySettingLeaf:(CTKTrieLeafNode *)aLeaf;
+
+/**
+ * \return A CTKCtrieLNode, or a CTKCtrieTNode once a single leaf remains.
+ */
+- (CTKCtrieMainNode *) nodeByRemovingObjectForKey:(id)aKey;
+
+@end
+
+
+/*
+ Pending RDCSS (restricted double compare single swap) on the root: replace oldRoot with proposedRoot only if the main
+ node of oldRoot is still expectedMainNode.
+ */
+@interface CTKCtrieRootDescriptor : NSObject {
+	@private
+	CTKCtrieINode *oldRoot;
+	CTKCtrieMainNode *expectedMainNode;
+	CTKCtrieINode *proposedRoot;
+	BOOL committed;
+}
+
+@property (readonly, retain, nonatomic) CTKCtrieINode *oldRoot;
+@property (readonly, retain, nonatomic) CTKCtrieMainNode *expectedMainNode;
+@property (readonly, retain, nonatomic) CTKCtrieINode *proposedRoot;
+@property (readwrite, assign) BOOL committed;
+
++ (id) rootDescriptorWithOldRoot:(CTKCtrieINode *)anOldRoot 
+				expectedMainNode:(CTKCtrieMainNode *)aMainNode 
+					proposedRoot:(CTKCtrieINode *)aProposedRoot;
+
+@end
@@ -0,0 +1,410 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKCtrieNodes.h"
+#import "CTKTrieNode.h"
+#import "CTKTrieLeafNode.h"
+#import "CTKEpochReclamation.h"
+#include <libkern/OSAtomic.h>
+#include <stdlib.h>
+
+
+@implementation CTKCtrieMainNode
+
+- (void) dealloc
+{
+	[previous release];
+	[super dealloc];
+}
+
+- (CTKCtrieMainNode *) previous
+{
+	return previous;
+}
+
+- (void) setInitialPrevious:(CTKCtrieMainNode *)aNode
+{
+	NSAssert(previous == nil, @"The node was already proposed");
+	previous = [aNode retain];
+}
+
+- (BOOL) compareAndSwapPrevious:(CTKCtrieMainNode *)anExpectedNode withNode:(CTKCtrieMainNode *)aNode
+{
+	[aNode retain];
+	
+	if (OSAtomicCompareAndSwapPtrBarrier(anExpectedNode, aNode, (void * volatile *)&previous)) {
+		CTKEpochRelease(anExpectedNode);
+		return YES;
+	}
+	
+	[aNode release];
+	return NO;
+}
+
+@end
+
+
+@implementation CTKCtrieFailedNode
+
++ (id) failedNodeWithPrevious:(CTKCtrieMainNode *)aNode
+{
+	CTKCtrieFailedNode *node = [[CTKCtrieFailedNode alloc] init];
+	
+	[node setInitialPrevious:aNode];
+	
+	return [node autorelease];
+}
+
+@end
+
+
+@interface CTKCtrieINode ()
+
+@property (readwrite, retain, nonatomic) id generation;
+
+@end
+
+@implementation CTKCtrieINode
+
++ (id) iNodeWithMainNode:(CTKCtrieMainNode *)aNode generation:(id)aGeneration
+{
+	return [[[CTKCtrieINode alloc] initWithMainNode:aNode generation:aGeneration] autorelease];
+}
+
+- (id) initWithMainNode:(CTKCtrieMainNode *)aNode generation:(id)aGeneration
+{
+	NSParameterAssert(aNode);
+	NSParameterAssert(aGeneration);
+	
+	self = [super init];
+	
+	if (self != nil) {
+		mainNode = [aNode retain];
+		self.generation = aGeneration;
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[mainNode release];
+	[generation release];
+	[super dealloc];
+}
+
+@synthesize generation;
+
+- (CTKCtrieMainNode *) mainNode
+{
+	return mainNode;
+}
+
+- (BOOL) compareAndSwapMainNode:(CTKCtrieMainNode *)anExpectedNode withNode:(CTKCtrieMainNode *)aNode
+{
+	[aNode retain];
+	
+	if (OSAtomicCompareAndSwapPtrBarrier(anExpectedNode, aNode, (void * volatile *)&mainNode)) {
+		CTKEpochRelease(anExpectedNode);
+		return YES;
+	}
+	
+	[aNode release];
+	return NO;
+}
+
+@end
+
+
+@interface CTKCtrieCNode ()
+
+@property (readwrite, assign, nonatomic) NSUInteger bitmap;
+@property (readwrite, assign, nonatomic) NSUInteger count;
+@property (readwrite, retain, nonatomic) id generation;
+
+@end
+
+@implementation CTKCtrieCNode
+
++ (id) cNodeWithBranches:(const id *)someBranches bitmap:(NSUInteger)aBitmap generation:(id)aGeneration
+{
+	return [[[CTKCtrieCNode alloc] initWithBranches:someBranches bitmap:aBitmap generation:aGeneration] autorelease];
+}
+
++ (CTKCtrieMainNode *) cNodeWithLeaf:(CTKTrieLeafNode *)aLeaf 
+							 andLeaf:(CTKTrieLeafNode *)anotherLeaf 
+							   shift:(NSUInteger)aShiftValue 
+						  generation:(id)aGeneration
+{
+	// Past the last chunk the hashes are equal
+	if (aShiftValue >= sizeof(NSUInteger) * 8)
+		return [CTKCtrieLNode lNodeWithLeaves:[NSArray arrayWithObjects:aLeaf, anotherLeaf, nil]];
+	
+	NSUInteger index = CTKTrieNodeMask(aLeaf.hashValue, aShiftValue);
+	NSUInteger anotherIndex = CTKTrieNodeMask(anotherLeaf.hashValue, aShiftValue);
+	NSUInteger bitmap = ((NSUInteger)1 << index) | ((NSUInteger)1 << anotherIndex);
+	
+	if (index == anotherIndex) {
+		
+		CTKCtrieMainNode *subnode = [self cNodeWithLeaf:aLeaf 
+												andLeaf:anotherLeaf 
+												  shift:aShiftValue + CTKTrieNodeShiftIncrement 
+											 generation:aGeneration];
+		id branches[1] = {[CTKCtrieINode iNodeWithMainNode:subnode generation:aGeneration]};
+		
+		return [self cNodeWithBranches:branches bitmap:bitmap generation:aGeneration];
+	}
+	
+	id branches[2] = {aLeaf, anotherLeaf};
+	
+	if (anotherIndex < index) {
+		branches[0] = anotherLeaf;
+		branches[1] = aLeaf;
+	}
+	
+	return [self cNodeWithBranches:branches bitmap:bitmap generation:aGeneration];
+}
+
+- (id) initWithBranches:(const id *)someBranches bitmap:(NSUInteger)aBitmap generation:(id)aGeneration
+{
+	self = [super init];
+	
+	if (self != nil) {
+		
+		self.bitmap = aBitmap;
+		self.count = CTKBitCount(aBitmap);
+		self.generation = aGeneration;
+		
+		branches = malloc(sizeof(id) * MAX(self.count, 1));
+		
+		for (NSUInteger i = 0; i < self.count; i++)
+			branches[i] = [someBranches[i] retain];
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	for (NSUInteger i = 0; i < count; i++)
+		[branches[i] release];
+	
+	free(branches);
+	[generation release];
+	[super dealloc];
+}
+
+@synthesize bitmap, count, generation;
+
+- (id) branchAtIndex:(NSUInteger)anIndex
+{
+	NSParameterAssert(anIndex < count);
+	return branches[anIndex];
+}
+
+- (CTKCtrieCNode *) cNodeByReplacingBranchAtIndex:(NSUInteger)anIndex withBranch:(id)aBranch generation:(id)aGeneration
+{
+	NSParameterAssert(anIndex < count);
+	
+	id *copy = malloc(sizeof(id) * count);
+	
+	memcpy(copy, branches, sizeof(id) * count);
+	copy[anIndex] = aBranch;
+	
+	CTKCtrieCNode *node = [CTKCtrieCNode cNodeWithBranches:copy bitmap:bitmap generation:aGeneration];
+	
+	free(copy);
+	
+	return node;
+}
+
+- (CTKCtrieCNode *) cNodeByInsertingBranch:(id)aBranch atIndex:(NSUInteger)anIndex bit:(NSUInteger)aBit generation:(id)aGeneration
+{
+	NSParameterAssert(anIndex <= count);
+	
+	id *copy = malloc(sizeof(id) * (count + 1));
+	
+	memcpy(copy, branches, sizeof(id) * anIndex);
+	copy[anIndex] = aBranch;
+	memcpy(copy + anIndex + 1, branches + anIndex, sizeof(id) * (count - anIndex));
+	
+	CTKCtrieCNode *node = [CTKCtrieCNode cNodeWithBranches:copy bitmap:(bitmap | aBit) generation:aGeneration];
+	
+	free(copy);
+	
+	return node;
+}
+
+- (CTKCtrieCNode *) cNodeByRemovingBranchAtIndex:(NSUInteger)anIndex bit:(NSUInteger)aBit generation:(id)aGeneration
+{
+	NSParameterAssert(anIndex < count);
+	
+	id *copy = malloc(sizeof(id) * MAX(count - 1, 1));
+	
+	memcpy(copy, branches, sizeof(id) * anIndex);
+	memcpy(copy + anIndex, branches + anIndex + 1, sizeof(id) * (count - anIndex - 1));
+	
+	CTKCtrieCNode *node = [CTKCtrieCNode cNodeWithBranches:copy bitmap:(bitmap & ~aBit) generation:aGeneration];
+	
+	free(copy);
+	
+	return node;
+}
+
+@end
+
+
+@interface CTKCtrieTNode ()
+
+@property (readwrite, retain, nonatomic) CTKTrieLeafNode *leaf;
+
+@end
+
+@implementation CTKCtrieTNode
+
++ (id) tNodeWithLeaf:(CTKTrieLeafNode *)aLeaf
+{
+	CTKCtrieTNode *node = [[CTKCtrieTNode alloc] init];
+	
+	node.leaf = aLeaf;
+	
+	return [node autorelease];
+}
+
+- (void) dealloc
+{
+	[leaf release];
+	[super dealloc];
+}
+
+@synthesize leaf;
+
+@end
+
+
+@interface CTKCtrieLNode ()
+
+@property (readwrite, retain, nonatomic) NSArray *leaves;
+
+@end
+
+@implementation CTKCtrieLNode
+
++ (id) lNodeWithLeaves:(NSArray *)anArray
+{
+	CTKCtrieLNode *node = [[CTKCtrieLNode alloc] init];
+	
+	node.leaves = anArray;
+	
+	return [node autorelease];
+}
+
+- (void) dealloc
+{
+	[leaves release];
+	[super dealloc];
+}
+
+@synthesize leaves;
+
+- (CTKTrieLeafNode *) leafForKey:(id)aKey
+{
+	for (CTKTrieLeafNode *leaf in self.leaves) {
+		
+		if (leaf.key == aKey || [leaf.key isEqual:aKey])
+			return leaf;
+	}
+	
+	return nil;
+}
+
+- (CTKCtrieLNode *) lNodeBySettingLeaf:(CTKTrieLeafNode *)aLeaf
+{
+	NSMutableArray *newLeaves = [NSMutableArray arrayWithArray:self.leaves];
+	CTKTrieLeafNode *existing = [self leafForKey:aLeaf.key];
+	
+	if (existing != nil)
+		[newLeaves replaceObjectAtIndex:[newLeaves indexOfObjectIdenticalTo:existing] withObject:aLeaf];
+	else
+		[newLeaves addObject:aLeaf];
+	
+	return [CTKCtrieLNode lNodeWithLeaves:newLeaves];
+}
+
+- (CTKCtrieMainNode *) nodeByRemovingObjectForKey:(id)aKey
+{
+	CTKTrieLeafNode *existing = [self leafForKey:aKey];
+	
+	if (existing == nil)
+		return self;
+	
+	NSMutableArray *newLeaves = [NSMutableArray arrayWithArray:self.leaves];
+	
+	[newLeaves removeObjectIdenticalTo:existing];
+	
+	if ([newLeaves count] == 1)
+		return [CTKCtrieTNode tNodeWithLeaf:[newLeaves objectAtIndex:0]];
+	
+	return [CTKCtrieLNode lNodeWithLeaves:newLeaves];
+}
+
+@end
+
+
+@interface CTKCtrieRootDescriptor ()
+
+@property (readwrite, retain, nonatomic) CTKCtrieINode *oldRoot;
+@property (readwrite, retain, nonatomic) CTKCtrieMainNode *expectedMainNode;
+@property (readwrite, retain, nonatomic) CTKCtrieINode *proposedRoot;
+
+@end
+
+@implementation CTKCtrieRootDescriptor
+
++ (id) rootDescriptorWithOldRoot:(CTKCtrieINode *)anOldRoot 
+				expectedMainNode:(CTKCtrieMainNode *)aMainNode 
+					proposedRoot:(CTKCtrieINode *)aProposedRoot
+{
+	CTKCtrieRootDescriptor *descriptor = [[CTKCtrieRootDescriptor alloc] init];
+	
+	descriptor.oldRoot = anOldRoot;
+	descriptor.expectedMainNode = aMainNode;
+	descriptor.proposedRoot = aProposedRoot;
+	
+	return [descriptor autorelease];
+}
+
+- (void) dealloc
+{
+	[oldRoot release];
+	[expectedMainNode release];
+	[proposedRoot release];
+	[super dealloc];
+}
+
+@synthesize oldRoot, expectedMainNode, proposedRoot, committed;
+
+@end
@@ -0,0 +1,61 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "CTKTrieNode.h"
+@class CTKConcurrentHashTrie;
+@class CTKCtrieINode;
+
+/*
+ A CTKPersistentHashMap node standing for a branch of a read-only CTKConcurrentHashTrie snapshot.
+ 
+ Lookups go through the frozen trie. Setting or removing a key first converts this node only, its inner branches
+ stay in the trie, so a modified version of the view only allocates the nodes along the modified path.
+ */
+@interface CTKCtrieSnapshotNode : NSObject <CTKTrieNode> {
+	@private
+	CTKConcurrentHashTrie *trie;
+	CTKCtrieINode *iNode;
+	NSUInteger shift;
+	NSUInteger hashValue;
+	NSUInteger contentHash;
+	BOOL hasContentHash;
+}
+
+@property (readonly, retain, nonatomic) CTKConcurrentHashTrie *trie;
+@property (readonly, retain, nonatomic) CTKCtrieINode *iNode;
+@property (readonly, assign, nonatomic) NSUInteger shift;
+
++ (id) snapshotNodeWithTrie:(CTKConcurrentHashTrie *)aTrie iNode:(CTKCtrieINode *)anINode shift:(NSUInteger)aShiftValue;
+
+- (id) initWithTrie:(CTKConcurrentHashTrie *)aTrie iNode:(CTKCtrieINode *)anINode shift:(NSUInteger)aShiftValue;
+
+/**
+ * \return The equivalent CTKPersistentHashMap node, its inner branches are CTKCtrieSnapshotNode(s).
+ */
+- (id <CTKTrieNode>) materializedNode;
+
+@end
@@ -0,0 +1,129 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKCtrieSnapshotNode.h"
+#include <libkern/OSAtomic.h>
+#import "CTKConcurrentHashTrie.h"
+#import "CTKCtrieNodes.h"
+#import "CTKTrieLeafNode.h"
+
+@interface CTKCtrieSnapshotNode ()
+
+@property (readwrite, retain, nonatomic) CTKConcurrentHashTrie *trie;
+@property (readwrite, retain, nonatomic) CTKCtrieINode *iNode;
+@property (readwrite, assign, nonatomic) NSUInteger shift;
+@property (readwrite, assign) NSUInteger hashValue;
+
+@end
+
+
+@implementation CTKCtrieSnapshotNode
+
+#pragma mark Initialization
+
++ (id) snapshotNodeWithTrie:(CTKConcurrentHashTrie *)aTrie iNode:(CTKCtrieINode *)anINode shift:(NSUInteger)aShiftValue
+{
+	return [[[CTKCtrieSnapshotNode alloc] initWithTrie:aTrie iNode:anINode shift:aShiftValue] autorelease];
+}
+
+- (id) initWithTrie:(CTKConcurrentHashTrie *)aTrie iNode:(CTKCtrieINode *)anINode shift:(NSUInteger)aShiftValue
+{
+	NSParameterAssert(aTrie.readOnly);
+	NSParameterAssert(anINode);
+	
+	self = [super init];
+	
+	if (self != nil) {
+		self.trie = aTrie;
+		self.iNode = anINode;
+		self.shift = aShiftValue;
+		self.hashValue = [aTrie hashValueOfINode:anINode];
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[trie release];
+	[iNode release];
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize trie, iNode, shift, hashValue;
+
+#pragma mark CTKTrieNode protocol
+
+- (id <CTKTrieNode>) materializedNode
+{
+	return [self.trie nodeForINode:self.iNode shift:self.shift];
+}
+
+- (CTKTrieLeafNode *) objectForKey:(id)aKey hash:(NSUInteger)aHashValue
+{
+	return [self.trie leafForKey:aKey hash:aHashValue iNode:self.iNode shift:self.shift];
+}
+
+- (id <CTKTrieNode>) newNodeBySettingObject:(id)anObject 
+									 forKey:(id)aKey 
+									  shift:(NSUInteger)aShiftValue 
+									   hash:(NSUInteger)aHashValue
+								  addedLeaf:(CTKTrieLeafNode **)aLeaf
+{
+	// Same no-op check as CTKTrieMappedNode, callers compare the result with the receiver
+	CTKTrieLeafNode *existing = [self objectForKey:aKey hash:aHashValue];
+	
+	if (existing != nil && (existing.object == anObject || [existing.object isEqual:anObject]))
+		return [self retain];
+	
+	return [[self materializedNode] newNodeBySettingObject:anObject forKey:aKey shift:aShiftValue hash:aHashValue addedLeaf:aLeaf];
+}
+
+- (id <CTKTrieNode>) newNodeByRemovingObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
+{
+	if ([self objectForKey:aKey hash:aHashValue] == nil)
+		return [self retain];
+	
+	return [[self materializedNode] newNodeByRemovingObjectForKey:aKey hash:aHashValue];
+}
+
+/*
+ Summed over the frozen trie rather than the materialized nodes, hashing a view does not convert it.
+ */
+- (NSUInteger) contentHash
+{
+	if (!hasContentHash) {
+		contentHash = [self.trie contentHashOfINode:self.iNode];
+		OSMemoryBarrier();
+		hasContentHash = YES;
+	}
+	
+	return contentHash;
+}
+
+@end
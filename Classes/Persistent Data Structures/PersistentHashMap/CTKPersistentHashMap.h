@@ -29,21 +29,70 @@
 @class CTKPersistentHashMapEntry;
 @class CTKPersistentHashMap;
 
-@interface CTKPersistentHashMap : NSObject {
+@interface CTKPersistentHashMap : NSObject <NSCoding> {
 	NSUInteger count;
+	NSUInteger seed;
 	id <CTKTrieNode> root;
 }
 
 @property (readonly, retain) id <CTKTrieNode> root;
 @property (readonly, assign) NSUInteger count;
+/**
+ * \return The seed mixed into every key hash, see CTKTrieNodeMixHash. Maps derived from this one keep it.
+ */
+@property (readonly, assign) NSUInteger seed;
 
 
 + (id) emptyHashMap;
 
+/**
+ * \brief An empty map hashing its keys with aSeed.
+ * \details Use a random seed, e.g. ((NSUInteger)arc4random() << 32 | arc4random()), for maps keyed by untrusted input.
+ */
++ (id) emptyHashMapWithSeed:(NSUInteger)aSeed;
+
 + (id) hashMapWithRoot:(id <CTKTrieNode>)aNode count:(NSUInteger)value;
 
++ (id) hashMapWithRoot:(id <CTKTrieNode>)aNode count:(NSUInteger)value seed:(NSUInteger)aSeed;
+
+/**
+ * \brief Like hashMapWithRoot:count:seed: but the caller owns the map.
+ * \details The new... methods transfer ownership instead of autoreleasing, hot loops and transactions use them so 
+ * that they do not need an autorelease pool of their own to keep memory bounded.
+ */
++ (id) newHashMapWithRoot:(id <CTKTrieNode>)aNode count:(NSUInteger)value seed:(NSUInteger)aSeed;
+
+/**
+ * \brief Builds a map holding all the entries of aDictionary.
+ * \details See hashMapWithObjects:forKeys:count:
+ */
++ (id) hashMapWithDictionary:(NSDictionary *)aDictionary;
+
+/**
+ * \brief Builds a map holding objects[i] for keys[i]. Both arrays must have the same count.
+ * \details See hashMapWithObjects:forKeys:count:
+ */
++ (id) hashMapWithObjects:(NSArray *)objects forKeys:(NSArray *)keys;
+
+/**
+ * \brief Bulk constructor, the result is equivalent to folding mapBySettingObject:forKey: over the pairs in order.
+ * \details Keys are hashed in parallel and partitioned by their first level trie chunk (CTKTrieNodeMask at shift 0).
+ * Each of the 64 partitions is built concurrently on a global dispatch queue and the root node, either a CTKTrieFullNode 
+ * or a CTKTrieBitmapIndexedNode, is assembled at the end. Small inputs are built sequentially.
+ */
++ (id) hashMapWithObjects:(const id *)objects forKeys:(const id *)keys count:(NSUInteger)cnt;
+
++ (id) hashMapWithObjects:(const id *)objects forKeys:(const id *)keys count:(NSUInteger)cnt seed:(NSUInteger)aSeed;
+
 - (id) initWithRoot:(id <CTKTrieNode>)aNode count:(NSUInteger)value;
 
+- (id) initWithRoot:(id <CTKTrieNode>)aNode count:(NSUInteger)value seed:(NSUInteger)aSeed;
+
+/**
+ * \return The hash aKey is stored under in this map: its -hash (0 for nil) mixed with the map seed.
+ */
+- (NSUInteger) hashForKey:(id)aKey;
+
 - (CTKPersistentHashMapEntry *) entryForKey:(id)aKey;
 
 - (BOOL) containsObjectForKey:(id)aKey;
@@ -54,10 +103,58 @@
 
 - (CTKPersistentHashMap *) mapByRemovingObjectForKey:(id)aKey;
 
+/**
+ * \brief Like mapBySettingObject:forKey: but the caller owns the result (the receiver retained if nothing changed).
+ */
+- (CTKPersistentHashMap *) newMapBySettingObject:(id)anObject forKey:(id)aKey;
+
+/**
+ * \brief Like mapByRemovingObjectForKey: but the caller owns the result.
+ */
+- (CTKPersistentHashMap *) newMapByRemovingObjectForKey:(id)aKey;
+
+/**
+ * \brief Three-way merge of two versions derived from base.
+ * \details Replays on theirs the keys mine set or removed since base, walking base and mine in parallel and skipping 
+ * the subtrees they share. A key both versions changed is a conflict unless they changed it to equal objects.
+ * \return The merged map, nil on a conflict or if the maps do not share a seed.
+ */
++ (CTKPersistentHashMap *) mapByMergingBase:(CTKPersistentHashMap *)base 
+									 theirs:(CTKPersistentHashMap *)theirs 
+									   mine:(CTKPersistentHashMap *)mine;
+
+/**
+ * \brief Calls aBlock for every entry, in trie order, until it sets *stop to YES.
+ */
+- (void) enumerateKeysAndObjectsUsingBlock:(void (^)(id aKey, id anObject, BOOL *stop))aBlock;
+
 - (NSArray *) allEntries;
 
 - (NSArray *) allValues;
 
 - (NSArray *) allKeys;
 
+/**
+ * \return An order independent hash of the entries, cached in the trie nodes. Equal maps have equal hashes whatever
+ * their seeds, so maps can be used as keys and values of other maps.
+ */
+- (NSUInteger) hash;
+
+/**
+ * \brief Two maps are equal when they hold the same keys mapped to equal objects.
+ * \details Pointer identical subtrees are equal without looking into them and subtrees whose cached hashes differ are
+ * rejected right away, so comparing a map with one of its versions only walks the paths that were modified.
+ */
+- (BOOL) isEqual:(id)anObject;
+
+- (BOOL) isEqualToHashMap:(CTKPersistentHashMap *)aMap;
+
+/**
+ * \brief Encodes the entries and the seed, keyed coders only. Decoding rebuilds the trie with the bulk constructor.
+ * \details Keys and objects must conform to NSCoding, nil keys and objects are kept.
+ */
+- (void) encodeWithCoder:(NSCoder *)aCoder;
+
+- (id) initWithCoder:(NSCoder *)aDecoder;
+
 @end
@@ -28,6 +28,255 @@
 #import "CTKTrieNode.h"
 #import "CTKTrieEmptyNode.h"
 #import "CTKTrieLeafNode.h"
+#import "CTKTrieBitmapIndexedNode.h"
+#import "CTKTrieFullNode.h"
+#import "CTKTrieHashCollisionNode.h"
+#include <dispatch/dispatch.h>
+#include <stdlib.h>
+
+/*
+ Below this number of entries the bulk constructor folds sequentially, the cost of dispatching 
+ 64 partitions is higher than building the trie in the calling thread.
+ */
+static NSUInteger const CTKPersistentHashMapParallelThreshold = 4096;
+static NSUInteger const CTKPersistentHashMapHashingStride = 1024;
+
+#pragma mark Equality
+
+/*
+ Adapters (mapped snapshot nodes, concurrent trie snapshot nodes) are replaced by the real node they stand for.
+ */
+static id <CTKTrieNode> CTKTrieNodeUnwrap(id <CTKTrieNode> aNode)
+{
+	while(![aNode isKindOfClass:[CTKTrieBitmapIndexedNode class]] && ![aNode isKindOfClass:[CTKTrieFullNode class]]
+		  && ![aNode isKindOfClass:[CTKTrieLeafNode class]] && ![aNode isKindOfClass:[CTKTrieHashCollisionNode class]]
+		  && [aNode respondsToSelector:@selector(materializedNode)])
+		aNode = [(id)aNode materializedNode];
+	
+	return aNode;
+}
+
+static void CTKTrieNodeCollectLeaves(id <CTKTrieNode> aNode, NSMutableArray *leaves)
+{
+	aNode = CTKTrieNodeUnwrap(aNode);
+	
+	if([aNode isKindOfClass:[CTKTrieLeafNode class]]){
+		[leaves addObject:aNode];
+		
+	} else if([aNode isKindOfClass:[CTKTrieHashCollisionNode class]]){
+		CTKTrieHashCollisionNode *collisionNode = (CTKTrieHashCollisionNode *)aNode;
+		for(NSUInteger idx = 0; idx < collisionNode.count; idx++)
+			[leaves addObject:[collisionNode leafAtIndex:idx]];
+		
+	} else if([aNode isKindOfClass:[CTKTrieBitmapIndexedNode class]] || [aNode isKindOfClass:[CTKTrieFullNode class]]){
+		for(id <CTKTrieNode> node in [(id)aNode nodes])
+			CTKTrieNodeCollectLeaves(node, leaves);
+	}
+}
+
+static void CTKTrieNodeEnumerate(id <CTKTrieNode> aNode, void (^aBlock)(id, id, BOOL *), BOOL *stop)
+{
+	aNode = CTKTrieNodeUnwrap(aNode);
+	
+	if([aNode isKindOfClass:[CTKTrieLeafNode class]]){
+		aBlock([(CTKTrieLeafNode *)aNode key], [(CTKTrieLeafNode *)aNode object], stop);
+		
+	} else if([aNode isKindOfClass:[CTKTrieHashCollisionNode class]]){
+		CTKTrieHashCollisionNode *collisionNode = (CTKTrieHashCollisionNode *)aNode;
+		for(NSUInteger idx = 0; idx < collisionNode.count && !*stop; idx++){
+			CTKTrieLeafNode *leaf = [collisionNode leafAtIndex:idx];
+			aBlock(leaf.key, leaf.object, stop);
+		}
+		
+	} else if([aNode isKindOfClass:[CTKTrieBitmapIndexedNode class]] || [aNode isKindOfClass:[CTKTrieFullNode class]]){
+		for(id <CTKTrieNode> node in [(id)aNode nodes]){
+			CTKTrieNodeEnumerate(node, aBlock, stop);
+			if(*stop)
+				break;
+		}
+	}
+}
+
+static BOOL CTKTrieObjectsEqual(id anObject, id otherObject)
+{
+	return anObject == otherObject || [anObject isEqual:otherObject];
+}
+
+/*
+ Slow path for subtrees that hold the same hashes but are not laid out alike, e.g. a collision node against a leaf,
+ or a branch built by the bulk constructor against one built by successive insertions. Both nodes live at the same 
+ position of tries with the same seed so a leaf of one is found in the other under its own hashValue.
+ */
+static BOOL CTKTrieNodeEntriesEqual(id <CTKTrieNode> aNode, id <CTKTrieNode> otherNode)
+{
+	NSMutableArray *leaves = [[NSMutableArray alloc] init];
+	NSMutableArray *otherLeaves = [[NSMutableArray alloc] init];
+	BOOL result = NO;
+	
+	CTKTrieNodeCollectLeaves(aNode, leaves);
+	CTKTrieNodeCollectLeaves(otherNode, otherLeaves);
+	
+	if([leaves count] == [otherLeaves count]){
+		
+		result = YES;
+		
+		for(CTKTrieLeafNode *leaf in leaves){
+			CTKTrieLeafNode *otherLeaf = [otherNode objectForKey:leaf.key hash:leaf.hashValue];
+			if(otherLeaf == nil || !CTKTrieObjectsEqual(leaf.object, otherLeaf.object)){
+				result = NO;
+				break;
+			}
+		}
+	}
+	
+	[leaves release];
+	[otherLeaves release];
+	
+	return result;
+}
+
+static BOOL CTKTrieNodeBranch(id <CTKTrieNode> aNode, NSUInteger *aBitmap, NSArray **someNodes)
+{
+	if([aNode isKindOfClass:[CTKTrieBitmapIndexedNode class]]){
+		*aBitmap = [(CTKTrieBitmapIndexedNode *)aNode bitmap];
+		*someNodes = [(CTKTrieBitmapIndexedNode *)aNode nodes];
+		return YES;
+	}
+	
+	if([aNode isKindOfClass:[CTKTrieFullNode class]]){
+		*aBitmap = ~(NSUInteger)0;
+		*someNodes = [(CTKTrieFullNode *)aNode nodes];
+		return YES;
+	}
+	
+	return NO;
+}
+
+/*
+ Structural comparison of two tries built with the same seed.
+ */
+static BOOL CTKTrieNodesEqual(id <CTKTrieNode> aNode, id <CTKTrieNode> otherNode)
+{
+	if(aNode == otherNode)
+		return YES;
+	
+	if([aNode contentHash] != [otherNode contentHash])
+		return NO;
+	
+	aNode = CTKTrieNodeUnwrap(aNode);
+	otherNode = CTKTrieNodeUnwrap(otherNode);
+	
+	if(aNode == otherNode)
+		return YES;
+	
+	if([aNode isKindOfClass:[CTKTrieLeafNode class]] && [otherNode isKindOfClass:[CTKTrieLeafNode class]]){
+		CTKTrieLeafNode *leaf = (CTKTrieLeafNode *)aNode;
+		CTKTrieLeafNode *otherLeaf = (CTKTrieLeafNode *)otherNode;
+		
+		return leaf.hashValue == otherLeaf.hashValue 
+			&& CTKTrieObjectsEqual(leaf.key, otherLeaf.key) 
+			&& CTKTrieObjectsEqual(leaf.object, otherLeaf.object);
+	}
+	
+	NSUInteger bitmap, otherBitmap;
+	NSArray *nodes, *otherNodes;
+	
+	if(CTKTrieNodeBranch(aNode, &bitmap, &nodes) && CTKTrieNodeBranch(otherNode, &otherBitmap, &otherNodes) 
+	   && bitmap == otherBitmap){
+		
+		NSUInteger nodeCount = [nodes count];
+		
+		if(nodeCount != [otherNodes count])
+			return CTKTrieNodeEntriesEqual(aNode, otherNode);
+		
+		for(NSUInteger idx = 0; idx < nodeCount; idx++)
+			if(!CTKTrieNodesEqual([nodes objectAtIndex:idx], [otherNodes objectAtIndex:idx]))
+				return NO;
+		
+		return YES;
+	}
+	
+	return CTKTrieNodeEntriesEqual(aNode, otherNode);
+}
+
+#pragma mark Merging
+
+static BOOL CTKTrieEntriesSame(CTKPersistentHashMapEntry *anEntry, CTKPersistentHashMapEntry *otherEntry)
+{
+	if(anEntry == nil || otherEntry == nil)
+		return anEntry == otherEntry;
+	
+	return CTKTrieObjectsEqual(anEntry.object, otherEntry.object);
+}
+
+/*
+ Calls aBlock for every key whose entry differs between two tries built with the same seed, with the leaf of each 
+ trie (nil where the key is absent). Both tries are walked in parallel and pointer identical subtrees are skipped, 
+ diffing a map against one of its versions only visits the paths that were modified. nil nodes are empty subtrees.
+ */
+static void CTKTrieNodeDiff(id <CTKTrieNode> aNode, id <CTKTrieNode> otherNode, 
+							void (^aBlock)(CTKTrieLeafNode *leaf, CTKTrieLeafNode *otherLeaf, BOOL *stop), BOOL *stop)
+{
+	if(aNode == otherNode || *stop)
+		return;
+	
+	aNode = CTKTrieNodeUnwrap(aNode);
+	otherNode = CTKTrieNodeUnwrap(otherNode);
+	
+	if(aNode == otherNode)
+		return;
+	
+	NSUInteger bitmap, otherBitmap;
+	NSArray *nodes, *otherNodes;
+	
+	if(aNode != nil && otherNode != nil 
+	   && CTKTrieNodeBranch(aNode, &bitmap, &nodes) && CTKTrieNodeBranch(otherNode, &otherBitmap, &otherNodes)){
+		
+		for(NSUInteger mask = 0; mask <= CTKTrieNodeMaskCoeficient && !*stop; mask++){
+			
+			NSUInteger bit = (NSUInteger)1 << mask;
+			id <CTKTrieNode> child = (bitmap & bit) ? [nodes objectAtIndex:CTKTrieNodeIndex(bitmap, bit)] : nil;
+			id <CTKTrieNode> otherChild = (otherBitmap & bit) ? [otherNodes objectAtIndex:CTKTrieNodeIndex(otherBitmap, bit)] : nil;
+			
+			CTKTrieNodeDiff(child, otherChild, aBlock, stop);
+		}
+		
+		return;
+	}
+	
+	// Leaves, collision nodes, or a branch against a leaf: compare the entries
+	NSMutableArray *leaves = [[NSMutableArray alloc] init];
+	NSMutableArray *otherLeaves = [[NSMutableArray alloc] init];
+	
+	if(aNode != nil)
+		CTKTrieNodeCollectLeaves(aNode, leaves);
+	
+	if(otherNode != nil)
+		CTKTrieNodeCollectLeaves(otherNode, otherLeaves);
+	
+	for(CTKTrieLeafNode *otherLeaf in otherLeaves){
+		
+		CTKTrieLeafNode *leaf = (aNode != nil) ? [aNode objectForKey:otherLeaf.key hash:otherLeaf.hashValue] : nil;
+		
+		if(leaf != otherLeaf && !CTKTrieEntriesSame(leaf, otherLeaf))
+			aBlock(leaf, otherLeaf, stop);
+		
+		if(*stop)
+			break;
+	}
+	
+	for(CTKTrieLeafNode *leaf in leaves){
+		
+		if(*stop)
+			break;
+		
+		if(otherNode == nil || [otherNode objectForKey:leaf.key hash:leaf.hashValue] == nil)
+			aBlock(leaf, nil, stop);
+	}
+	
+	[leaves release];
+	[otherLeaves release];
+}
 
 @interface CTKPersistentHashMap ()
 
@@ -35,6 +284,8 @@
 
 @property (readwrite, assign) NSUInteger count;
 
+@property (readwrite, assign) NSUInteger seed;
+
 @end
 
 
@@ -52,12 +303,200 @@
 	return [[sharedEmptyInstance retain] autorelease];
 }
 
++ (id) emptyHashMapWithSeed:(NSUInteger)aSeed
+{
+	if (aSeed == 0)
+		return [CTKPersistentHashMap emptyHashMap];
+	
+	return [[[CTKPersistentHashMap alloc] initWithRoot:[CTKTrieEmptyNode emptyNode] count:0 seed:aSeed] autorelease];
+}
+
 + (id) hashMapWithRoot:(id <CTKTrieNode>)aNode count:(NSUInteger)value
 {
 	return [[[CTKPersistentHashMap alloc] initWithRoot:aNode count:value] autorelease];
 }
 
++ (id) hashMapWithRoot:(id <CTKTrieNode>)aNode count:(NSUInteger)value seed:(NSUInteger)aSeed
+{
+	return [[self newHashMapWithRoot:aNode count:value seed:aSeed] autorelease];
+}
+
++ (id) newHashMapWithRoot:(id <CTKTrieNode>)aNode count:(NSUInteger)value seed:(NSUInteger)aSeed
+{
+	return [[CTKPersistentHashMap alloc] initWithRoot:aNode count:value seed:aSeed];
+}
+
++ (id) hashMapWithDictionary:(NSDictionary *)aDictionary
+{
+	NSUInteger cnt = [aDictionary count];
+	
+	if (cnt == 0)
+		return [CTKPersistentHashMap emptyHashMap];
+	
+	id *objects = malloc(sizeof(id) * cnt);
+	id *keys = malloc(sizeof(id) * cnt);
+	
+	[aDictionary getObjects:objects andKeys:keys];
+	
+	CTKPersistentHashMap *map = [self hashMapWithObjects:objects forKeys:keys count:cnt];
+	
+	free(objects);
+	free(keys);
+	
+	return map;
+}
+
++ (id) hashMapWithObjects:(NSArray *)objects forKeys:(NSArray *)keys
+{
+	NSParameterAssert([objects count] == [keys count]);
+	
+	NSUInteger cnt = [keys count];
+	
+	if (cnt == 0)
+		return [CTKPersistentHashMap emptyHashMap];
+	
+	id *theObjects = malloc(sizeof(id) * cnt);
+	id *theKeys = malloc(sizeof(id) * cnt);
+	
+	[objects getObjects:theObjects range:NSMakeRange(0, cnt)];
+	[keys getObjects:theKeys range:NSMakeRange(0, cnt)];
+	
+	CTKPersistentHashMap *map = [self hashMapWithObjects:theObjects forKeys:theKeys count:cnt];
+	
+	free(theObjects);
+	free(theKeys);
+	
+	return map;
+}
+
++ (id) hashMapWithObjects:(const id *)objects forKeys:(const id *)keys count:(NSUInteger)cnt
+{
+	return [self hashMapWithObjects:objects forKeys:keys count:cnt seed:0];
+}
+
++ (id) hashMapWithObjects:(const id *)objects forKeys:(const id *)keys count:(NSUInteger)cnt seed:(NSUInteger)aSeed
+{
+	if (cnt == 0)
+		return [CTKPersistentHashMap emptyHashMapWithSeed:aSeed];
+	
+	if (cnt < CTKPersistentHashMapParallelThreshold)
+	{
+		CTKPersistentHashMap *map = [CTKPersistentHashMap emptyHashMapWithSeed:aSeed];
+		
+		for (NSUInteger i = 0; i < cnt; i++)
+			map = [map mapBySettingObject:objects[i] forKey:keys[i]];
+		
+		return map;
+	}
+	
+	NSUInteger const width = CTKTrieNodeMaskCoeficient + 1;
+	NSUInteger *hashes = malloc(sizeof(NSUInteger) * cnt);
+	NSUInteger *partitioned = malloc(sizeof(NSUInteger) * cnt);	// entry indexes grouped by first level chunk
+	NSUInteger *offsets = calloc(width + 1, sizeof(NSUInteger));		// partition bounds in partitioned
+	NSUInteger *cursors = calloc(width, sizeof(NSUInteger));
+	NSUInteger *added = calloc(width, sizeof(NSUInteger));			// leaves added per partition
+	id *subtries = calloc(width, sizeof(id));
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	
+	// 1. Hash all the keys in parallel, hash may be arbitrarily expensive (e.g. long strings)
+	
+	size_t strides = (cnt + CTKPersistentHashMapHashingStride - 1) / CTKPersistentHashMapHashingStride;
+	
+	dispatch_apply(strides, queue, ^(size_t stride){
+		NSUInteger end = MIN(cnt, (stride + 1) * CTKPersistentHashMapHashingStride);
+		
+		for (NSUInteger i = stride * CTKPersistentHashMapHashingStride; i < end; i++)
+			hashes[i] = CTKTrieNodeMixHash((keys[i] != nil) ? [keys[i] hash] : 0, aSeed);
+	});
+	
+	// 2. Counting sort of the entries by CTKTrieNodeMask(hash, 0), it keeps the input order inside each partition
+	
+	for (NSUInteger i = 0; i < cnt; i++)
+		offsets[CTKTrieNodeMask(hashes[i], 0) + 1]++;
+	
+	for (NSUInteger bucket = 0; bucket < width; bucket++)
+		offsets[bucket + 1] += offsets[bucket];
+	
+	memcpy(cursors, offsets, sizeof(NSUInteger) * width);
+	
+	for (NSUInteger i = 0; i < cnt; i++)
+		partitioned[cursors[CTKTrieNodeMask(hashes[i], 0)]++] = i;
+	
+	// 3. Build each partition as the subtrie living at shift CTKTrieNodeShiftIncrement
+	
+	dispatch_apply(width, queue, ^(size_t bucket){
+		
+		if (offsets[bucket] == offsets[bucket + 1])
+			return;
+		
+		id <CTKTrieNode> node = [[CTKTrieEmptyNode alloc] init];
+		NSUInteger leaves = 0;
+		
+		for (NSUInteger j = offsets[bucket]; j < offsets[bucket + 1]; j++) {
+			
+			NSUInteger i = partitioned[j];
+			CTKTrieLeafNode *addedLeaf = nil;
+			
+			id <CTKTrieNode> newNode = [node newNodeBySettingObject:objects[i]
+															 forKey:keys[i]
+															  shift:CTKTrieNodeShiftIncrement
+															   hash:hashes[i]
+														  addedLeaf:&addedLeaf];
+			[node release];
+			node = newNode;
+			
+			if (addedLeaf != nil)
+				leaves++;
+		}
+		
+		subtries[bucket] = node; // owned, released once added to the root
+		added[bucket] = leaves;
+	});
+	
+	// 4. Assemble the root
+	
+	NSMutableArray *nodes = [NSMutableArray arrayWithCapacity:width];
+	NSUInteger bitmap = 0;
+	NSUInteger total = 0;
+	
+	for (NSUInteger bucket = 0; bucket < width; bucket++) {
+		
+		if (subtries[bucket] == nil)
+			continue;
+		
+		[nodes addObject:subtries[bucket]];
+		[subtries[bucket] release];
+		bitmap |= (NSUInteger)1 << bucket;
+		total += added[bucket];
+	}
+	
+	free(hashes);
+	free(partitioned);
+	free(offsets);
+	free(cursors);
+	free(added);
+	free(subtries);
+	
+	id <CTKTrieNode> newRoot;
+	
+	if ([nodes count] == width)
+		newRoot = [CTKTrieFullNode fullNodeWithNodes:nodes shift:0];
+	
+	else if ([nodes count] == 1 && [[nodes objectAtIndex:0] isKindOfClass:[CTKTrieLeafNode class]])
+		newRoot = [nodes objectAtIndex:0]; // same shape mapBySettingObject:forKey: would produce
+	
+	else
+		newRoot = [CTKTrieBitmapIndexedNode bitmapIndexedNodeWithNodes:nodes bitmap:bitmap shift:0];
+	
+	return [CTKPersistentHashMap hashMapWithRoot:newRoot count:total seed:aSeed];
+}
+
 - (id) initWithRoot:(id <CTKTrieNode>)aNode count:(NSUInteger)value
+{
+	return [self initWithRoot:aNode count:value seed:0];
+}
+
+- (id) initWithRoot:(id <CTKTrieNode>)aNode count:(NSUInteger)value seed:(NSUInteger)aSeed
 {
 	self = [super init];
 	
@@ -65,6 +504,7 @@
 		
 		self.root = aNode;
 		self.count = value;
+		self.seed = aSeed;
 	}
 	
 	return self;
@@ -85,7 +525,12 @@
 
 #pragma mark Properties
 
-@synthesize root, count;
+@synthesize root, count, seed;
+
+- (NSUInteger) hashForKey:(id)aKey
+{
+	return CTKTrieNodeMixHash((aKey != nil) ? [aKey hash] : 0, self.seed);
+}
 
 - (BOOL) containsObjectForKey:(id)aKey
 {
@@ -95,7 +540,7 @@
 
 - (CTKPersistentHashMapEntry *) entryForKey:(id)aKey
 {
-	return (CTKPersistentHashMapEntry *)[self.root objectForKey:aKey hash:((aKey != nil) ? [aKey hash] : 0)];
+	return (CTKPersistentHashMapEntry *)[self.root objectForKey:aKey hash:[self hashForKey:aKey]];
 }
 
 - (id) objectForKey:(id)aKey
@@ -105,40 +550,241 @@
 
 // assoc()
 - (CTKPersistentHashMap *) mapBySettingObject:(id)anObject forKey:(id)aKey
+{
+	return [[self newMapBySettingObject:anObject forKey:aKey] autorelease];
+}
+
+- (CTKPersistentHashMap *) newMapBySettingObject:(id)anObject forKey:(id)aKey
 {
 	CTKTrieLeafNode *addedLeaf = nil;
 	
-	id <CTKTrieNode> newRoot = [self.root setObject:anObject
-											 forKey:aKey
-											  shift:0
-											   hash:((aKey != nil) ? [aKey hash] : 0)
-										  addedLeaf:&addedLeaf];
-	
-	if([newRoot isEqual:self.root])
-		return self;
+	id <CTKTrieNode> newRoot = [self.root newNodeBySettingObject:anObject
+														  forKey:aKey
+														   shift:0
+															hash:[self hashForKey:aKey]
+													   addedLeaf:&addedLeaf];
 	
+	if([newRoot isEqual:self.root]){
+		[newRoot release];
+		return [self retain];
+	}
 	
 	NSUInteger theCount = (addedLeaf == nil) ? self.count : self.count + 1;
 	
-	return [CTKPersistentHashMap hashMapWithRoot:newRoot count:theCount];
+	CTKPersistentHashMap *map = [CTKPersistentHashMap newHashMapWithRoot:newRoot count:theCount seed:self.seed];
+	[newRoot release];
+	
+	return map;
 }
 
 // without()
 - (CTKPersistentHashMap *) mapByRemovingObjectForKey:(id)aKey
+{
+	return [[self newMapByRemovingObjectForKey:aKey] autorelease];
+}
+
+- (CTKPersistentHashMap *) newMapByRemovingObjectForKey:(id)aKey
 {
 	
-	id <CTKTrieNode> newRoot = [self.root removeObjectForKey:aKey hash:((aKey != nil) ? [aKey hash] : 0)];
+	id <CTKTrieNode> newRoot = [self.root newNodeByRemovingObjectForKey:aKey hash:[self hashForKey:aKey]];
 	
-	if(newRoot == self.root)
-		return self;
+	if(newRoot == self.root){
+		[newRoot release];
+		return [self retain];
+	}
 	
 	if(newRoot == nil)
-		return [CTKPersistentHashMap emptyHashMap];
+		return [[CTKPersistentHashMap emptyHashMapWithSeed:self.seed] retain];
 	
-	return [CTKPersistentHashMap hashMapWithRoot:newRoot count:self.count - 1];
+	CTKPersistentHashMap *map = [CTKPersistentHashMap newHashMapWithRoot:newRoot count:self.count - 1 seed:self.seed];
+	[newRoot release];
+	
+	return map;
 }
 
 
+#pragma mark Equality
+
+- (NSUInteger) hash
+{
+	return CTKTrieNodeMixHash([self.root contentHash], self.count);
+}
+
+- (BOOL) isEqual:(id)anObject
+{
+	if(anObject == self)
+		return YES;
+	
+	if(![anObject isKindOfClass:[CTKPersistentHashMap class]])
+		return NO;
+	
+	return [self isEqualToHashMap:anObject];
+}
+
+- (BOOL) isEqualToHashMap:(CTKPersistentHashMap *)aMap
+{
+	if(aMap == self)
+		return YES;
+	
+	if(aMap == nil || self.count != aMap.count || [self.root contentHash] != [aMap.root contentHash])
+		return NO;
+	
+	if(self.seed == aMap.seed)
+		return CTKTrieNodesEqual(self.root, aMap.root);
+	
+	// Different seeds lay the same keys out differently, look every entry up
+	NSMutableArray *leaves = [[NSMutableArray alloc] init];
+	BOOL result = YES;
+	
+	CTKTrieNodeCollectLeaves(self.root, leaves);
+	
+	for(CTKTrieLeafNode *leaf in leaves){
+		CTKPersistentHashMapEntry *entry = [aMap entryForKey:leaf.key];
+		if(entry == nil || !CTKTrieObjectsEqual(leaf.object, entry.object)){
+			result = NO;
+			break;
+		}
+	}
+	
+	[leaves release];
+	
+	return result;
+}
+
+#pragma mark Merging
+
++ (CTKPersistentHashMap *) mapByMergingBase:(CTKPersistentHashMap *)base 
+									 theirs:(CTKPersistentHashMap *)theirs 
+									   mine:(CTKPersistentHashMap *)mine
+{
+	if(theirs == base || mine == theirs)
+		return mine;
+	
+	if(mine == base)
+		return theirs;
+	
+	// Only versions of the same map can be diffed structurally
+	if(base.seed != mine.seed || base.seed != theirs.seed)
+		return nil;
+	
+	__block CTKPersistentHashMap *result = [theirs retain];
+	__block BOOL conflict = NO;
+	BOOL stopped = NO;
+	
+	// My changes are replayed on theirs unless they changed the same key differently
+	CTKTrieNodeDiff(base.root, mine.root, ^(CTKTrieLeafNode *baseLeaf, CTKTrieLeafNode *mineLeaf, BOOL *stop){
+		
+		id key = (mineLeaf != nil) ? mineLeaf.key : baseLeaf.key;
+		CTKPersistentHashMapEntry *theirEntry = [theirs entryForKey:key];
+		
+		if(CTKTrieEntriesSame(baseLeaf, theirEntry)){
+			
+			CTKPersistentHashMap *next = (mineLeaf != nil) 
+				? [result newMapBySettingObject:mineLeaf.object forKey:key] 
+				: [result newMapByRemovingObjectForKey:key];
+			
+			[result release];
+			result = next;
+		}
+		
+		else if(!CTKTrieEntriesSame(theirEntry, mineLeaf)){
+			conflict = YES;
+			*stop = YES;
+		}
+	}, &stopped);
+	
+	if(conflict){
+		[result release];
+		return nil;
+	}
+	
+	return [result autorelease];
+}
+
+- (void) enumerateKeysAndObjectsUsingBlock:(void (^)(id aKey, id anObject, BOOL *stop))aBlock
+{
+	BOOL stop = NO;
+	
+	CTKTrieNodeEnumerate(self.root, aBlock, &stop);
+}
+
+#pragma mark NSCoding
+
+- (void) encodeWithCoder:(NSCoder *)aCoder
+{
+	NSParameterAssert([aCoder allowsKeyedCoding]);
+	
+	NSMutableArray *leaves = [[NSMutableArray alloc] initWithCapacity:self.count];
+	NSMutableArray *keys = [[NSMutableArray alloc] initWithCapacity:self.count];
+	NSMutableArray *objects = [[NSMutableArray alloc] initWithCapacity:self.count];
+	NSMutableIndexSet *nilKeys = [[NSMutableIndexSet alloc] init];
+	NSMutableIndexSet *nilObjects = [[NSMutableIndexSet alloc] init];
+	
+	CTKTrieNodeCollectLeaves(self.root, leaves);
+	
+	// NSArray cannot hold nil, the indexes of nil keys and objects are encoded apart
+	for(CTKTrieLeafNode *leaf in leaves){
+		
+		if(leaf.key == nil)
+			[nilKeys addIndex:[keys count]];
+		
+		if(leaf.object == nil)
+			[nilObjects addIndex:[objects count]];
+		
+		[keys addObject:(leaf.key != nil) ? leaf.key : [NSNull null]];
+		[objects addObject:(leaf.object != nil) ? leaf.object : [NSNull null]];
+	}
+	
+	[aCoder encodeObject:keys forKey:@"keys"];
+	[aCoder encodeObject:objects forKey:@"objects"];
+	[aCoder encodeObject:nilKeys forKey:@"nilKeys"];
+	[aCoder encodeObject:nilObjects forKey:@"nilObjects"];
+	[aCoder encodeInt64:(int64_t)self.seed forKey:@"seed"];
+	
+	[leaves release];
+	[keys release];
+	[objects release];
+	[nilKeys release];
+	[nilObjects release];
+}
+
+- (id) initWithCoder:(NSCoder *)aDecoder
+{
+	NSParameterAssert([aDecoder allowsKeyedCoding]);
+	
+	NSArray *keys = [aDecoder decodeObjectForKey:@"keys"];
+	NSArray *objects = [aDecoder decodeObjectForKey:@"objects"];
+	NSIndexSet *nilKeys = [aDecoder decodeObjectForKey:@"nilKeys"];
+	NSIndexSet *nilObjects = [aDecoder decodeObjectForKey:@"nilObjects"];
+	NSUInteger cnt = [keys count];
+	
+	if([objects count] != cnt){
+		[self release];
+		return nil;
+	}
+	
+	id *keyBuffer = malloc(sizeof(id) * (cnt + 1));
+	id *objectBuffer = malloc(sizeof(id) * (cnt + 1));
+	
+	[keys getObjects:keyBuffer];
+	[objects getObjects:objectBuffer];
+	
+	for(NSUInteger i = [nilKeys firstIndex]; i != NSNotFound && i < cnt; i = [nilKeys indexGreaterThanIndex:i])
+		keyBuffer[i] = nil;
+	
+	for(NSUInteger i = [nilObjects firstIndex]; i != NSNotFound && i < cnt; i = [nilObjects indexGreaterThanIndex:i])
+		objectBuffer[i] = nil;
+	
+	CTKPersistentHashMap *map = [CTKPersistentHashMap hashMapWithObjects:objectBuffer 
+																  forKeys:keyBuffer 
+																	count:cnt 
+																	 seed:(NSUInteger)[aDecoder decodeInt64ForKey:@"seed"]];
+	free(keyBuffer);
+	free(objectBuffer);
+	
+	return [self initWithRoot:map.root count:map.count seed:map.seed];
+}
+
 - (NSArray *) allEntries
 {
 	return nil; // @TODO Implement
@@ -0,0 +1,146 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "CTKTrieNode.h"
+#import "CTKPersistentHashMap.h"
+@class CTKTrieLeafNode;
+
+/*
+ On disk format of a CTKPersistentHashMap snapshot. 
+ 
+ The file mirrors the trie: each node is a record holding its bitmap and the file offsets of its children instead of
+ pointers. Records are written children first and aligned to 8 bytes, the file header at offset 0 points to the root.
+ Leaves are followed by their key and their object, encoded as a CTKSnapshotValueHeader plus payload.
+ All integers are in host byte order.
+ */
+
+extern NSString * const CTKSnapshotErrorDomain;
+
+enum {
+	CTKSnapshotIOError = 2000,
+	CTKSnapshotFormatError = 2001,
+	CTKSnapshotUnsupportedValueError = 2002
+};
+
+enum {
+	CTKSnapshotNodeBitmapIndexed = 1,
+	CTKSnapshotNodeFull = 2,
+	CTKSnapshotNodeHashCollision = 3,
+	CTKSnapshotNodeLeaf = 4
+};
+
+enum {
+	CTKSnapshotValueNil = 0,
+	CTKSnapshotValueString = 1,		// UTF-8 bytes
+	CTKSnapshotValueNumber = 2,		// 8 bytes, a double, a long long or an unsigned long long depending on subtype (objCType)
+	CTKSnapshotValueData = 3,		// raw bytes
+	CTKSnapshotValueNull = 4		// NSNull
+};
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t count;
+	uint64_t root;		// 0 for an empty map
+	uint64_t seed;		// hashes stored in the nodes are mixed with it (since version 2)
+} CTKSnapshotFileHeader;
+
+typedef struct {
+	uint32_t type;
+	uint32_t count;		// number of child offsets following the header
+	uint64_t hash;		// hashValue of the node
+	uint64_t bitmap;
+	uint64_t shift;
+	uint64_t contentHash;	// contentHash of the node (since version 3)
+} CTKSnapshotNodeHeader;
+
+typedef struct {
+	uint32_t tag;
+	uint32_t subtype;
+	uint64_t length;	// payload length, the payload is padded to 8 bytes
+} CTKSnapshotValueHeader;
+
+
+/*
+ A read only memory mapping of a snapshot file. 
+ 
+ Lookups are served straight from the mapped pages, only the leaf being returned is decoded. CTKTrieNode objects
+ are created lazily by CTKTrieMappedNode along the paths that get modified, see -nodeAtOffset:.
+ The mapping lives as long as any map or node loaded from it.
+ */
+@interface CTKPersistentHashMapSnapshot : NSObject {
+	@private
+	const uint8_t *bytes;
+	size_t length;
+}
+
+@property (readonly, assign, nonatomic) size_t length;
+
+/**
+ * \brief Writes aMap to aPath. The file is written to a temporary path, synced and renamed so readers never see a partial file.
+ * \details Keys and objects must be NSString, NSNumber, NSData or NSNull (objects can also be nil).
+ */
++ (BOOL) writeHashMap:(CTKPersistentHashMap *)aMap toFile:(NSString *)aPath error:(NSError **)error;
+
++ (id) snapshotWithContentsOfFile:(NSString *)aPath error:(NSError **)error;
+
+- (id) initWithContentsOfFile:(NSString *)aPath error:(NSError **)error;
+
+/**
+ * \return A map whose root is served from the mapping. Runs in O(1).
+ */
+- (CTKPersistentHashMap *) hashMap;
+
+#pragma mark Mapped access
+
+/**
+ * \brief Corresponds to CTKTrieNode objectForKey:hash: for the node record at anOffset, without creating any intermediate node.
+ */
+- (CTKTrieLeafNode *) leafForKey:(id)aKey hash:(NSUInteger)aHashValue nodeOffset:(uint64_t)anOffset;
+
+/**
+ * \return The node record at anOffset as a CTKTrieNode object whose children are CTKTrieMappedNode(s). Leaves are decoded.
+ */
+- (id <CTKTrieNode>) nodeAtOffset:(uint64_t)anOffset;
+
+- (NSUInteger) hashValueOfNodeAtOffset:(uint64_t)anOffset;
+
+/**
+ * \return The CTKTrieNode contentHash stored in the node record at anOffset, read without decoding the subtree.
+ */
+- (NSUInteger) contentHashOfNodeAtOffset:(uint64_t)anOffset;
+
+@end
+
+
+@interface CTKPersistentHashMap (CTKSnapshotAdditions)
+
++ (id) hashMapWithContentsOfFile:(NSString *)aPath error:(NSError **)error;
+
+- (BOOL) writeToFile:(NSString *)aPath error:(NSError **)error;
+
+@end
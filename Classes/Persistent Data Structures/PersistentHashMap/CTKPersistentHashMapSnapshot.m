@@ -0,0 +1,690 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKPersistentHashMapSnapshot.h"
+#import "CTKTrieMappedNode.h"
+#import "CTKTrieBitmapIndexedNode.h"
+#import "CTKTrieFullNode.h"
+#import "CTKTrieHashCollisionNode.h"
+#import "CTKTrieLeafNode.h"
+#import "CTKTrieEmptyNode.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+
+NSString * const CTKSnapshotErrorDomain = @"CTKSnapshotErrorDomain";
+
+static char const CTKSnapshotMagic[4] = {'C', 'T', 'K', 'M'};
+static uint32_t const CTKSnapshotVersion = 3; // 1 stored unmixed hashes, 2 no content hashes
+
+static uint64_t CTKSnapshotAlign(uint64_t value)
+{
+	return (value + 7) & ~(uint64_t)7;
+}
+
+static NSError * CTKSnapshotError(NSInteger code, NSString *description, int posixError)
+{
+	NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObject:NSLocalizedString(description, @"") 
+																	   forKey:NSLocalizedDescriptionKey];
+	
+	if (posixError != 0)
+		[userInfo setObject:[NSError errorWithDomain:NSPOSIXErrorDomain code:posixError userInfo:nil] 
+					 forKey:NSUnderlyingErrorKey];
+	
+	return [NSError errorWithDomain:CTKSnapshotErrorDomain code:code userInfo:userInfo];
+}
+
+#pragma mark Writer
+
+typedef struct {
+	FILE *file;
+	uint64_t position;
+	int posixError;				// first I/O failure
+	id unsupportedValue;		// first value that cannot be encoded
+} CTKSnapshotWriter;
+
+static BOOL CTKSnapshotWriterWrite(CTKSnapshotWriter *writer, const void *someBytes, size_t aLength)
+{
+	static uint8_t const padding[8] = {0};
+	size_t padded = (size_t)(CTKSnapshotAlign(aLength) - aLength);
+	
+	if ((aLength > 0 && fwrite(someBytes, 1, aLength, writer->file) != aLength) ||
+		(padded > 0 && fwrite(padding, 1, padded, writer->file) != padded))
+	{
+		writer->posixError = errno;
+		return NO;
+	}
+	
+	writer->position += aLength + padded;
+	return YES;
+}
+
+static BOOL CTKSnapshotWriterWriteValue(CTKSnapshotWriter *writer, id aValue)
+{
+	CTKSnapshotValueHeader header = {CTKSnapshotValueNil, 0, 0};
+	const void *payload = NULL;
+	NSData *data = nil;
+	union { double d; long long ll; unsigned long long ull; } number;
+	
+	if (aValue == nil) {
+		header.tag = CTKSnapshotValueNil;
+	}
+	
+	else if (aValue == [NSNull null]) {
+		header.tag = CTKSnapshotValueNull;
+	}
+	
+	else if ([aValue isKindOfClass:[NSString class]]) {
+		data = [(NSString *)aValue dataUsingEncoding:NSUTF8StringEncoding];
+		header.tag = CTKSnapshotValueString;
+	}
+	
+	else if ([aValue isKindOfClass:[NSData class]]) {
+		data = aValue;
+		header.tag = CTKSnapshotValueData;
+	}
+	
+	else if ([aValue isKindOfClass:[NSNumber class]]) {
+		
+		char type = *[(NSNumber *)aValue objCType];
+		
+		if (type == 'f' || type == 'd')
+			number.d = [aValue doubleValue];
+		else if (type == 'Q' || type == 'L' || type == 'I')
+			number.ull = [aValue unsignedLongLongValue];
+		else
+			number.ll = [aValue longLongValue];
+		
+		header.tag = CTKSnapshotValueNumber;
+		header.subtype = (uint32_t)type;
+		header.length = sizeof(number);
+		payload = &number;
+	}
+	
+	else {
+		writer->unsupportedValue = aValue;
+		return NO;
+	}
+	
+	if (data != nil) {
+		header.length = [data length];
+		payload = [data bytes];
+	}
+	
+	return CTKSnapshotWriterWrite(writer, &header, sizeof(header)) 
+		&& CTKSnapshotWriterWrite(writer, payload, (size_t)header.length);
+}
+
+/*
+ Writes the children first so that their offsets are known when the node record is written.
+ Returns the offset of the record or 0 on failure.
+ */
+static uint64_t CTKSnapshotWriterWriteNode(CTKSnapshotWriter *writer, id <CTKTrieNode> aNode)
+{
+	if ([aNode isKindOfClass:[CTKTrieMappedNode class]])
+		aNode = [(CTKTrieMappedNode *)aNode materializedNode];
+	
+	CTKSnapshotNodeHeader header = {0, 0, aNode.hashValue, 0, 0, [aNode contentHash]};
+	NSArray *children = nil;
+	
+	if ([aNode isKindOfClass:[CTKTrieLeafNode class]]) {
+		
+		CTKTrieLeafNode *leaf = (CTKTrieLeafNode *)aNode;
+		uint64_t offset = writer->position;
+		
+		header.type = CTKSnapshotNodeLeaf;
+		
+		if (!CTKSnapshotWriterWrite(writer, &header, sizeof(header)) ||
+			!CTKSnapshotWriterWriteValue(writer, leaf.key) ||
+			!CTKSnapshotWriterWriteValue(writer, leaf.object))
+			return 0;
+		
+		return offset;
+	}
+	
+	else if ([aNode isKindOfClass:[CTKTrieBitmapIndexedNode class]]) {
+		CTKTrieBitmapIndexedNode *node = (CTKTrieBitmapIndexedNode *)aNode;
+		header.type = CTKSnapshotNodeBitmapIndexed;
+		header.bitmap = node.bitmap;
+		header.shift = node.shift;
+		children = node.nodes;
+	}
+	
+	else if ([aNode isKindOfClass:[CTKTrieFullNode class]]) {
+		CTKTrieFullNode *node = (CTKTrieFullNode *)aNode;
+		header.type = CTKSnapshotNodeFull;
+		header.bitmap = UINT64_MAX;
+		header.shift = node.shift;
+		children = node.nodes;
+	}
+	
+	else if ([aNode isKindOfClass:[CTKTrieHashCollisionNode class]]) {
+		header.type = CTKSnapshotNodeHashCollision;
+		children = [(CTKTrieHashCollisionNode *)aNode leaves];
+	}
+	
+	else {
+		writer->unsupportedValue = aNode;
+		return 0;
+	}
+	
+	header.count = (uint32_t)[children count];
+	uint64_t *offsets = malloc(sizeof(uint64_t) * header.count);
+	uint32_t i = 0;
+	
+	for (id <CTKTrieNode> child in children) {
+		
+		offsets[i] = CTKSnapshotWriterWriteNode(writer, child);
+		
+		if (offsets[i++] == 0) {
+			free(offsets);
+			return 0;
+		}
+	}
+	
+	uint64_t offset = writer->position;
+	BOOL written = CTKSnapshotWriterWrite(writer, &header, sizeof(header)) 
+				&& CTKSnapshotWriterWrite(writer, offsets, sizeof(uint64_t) * header.count);
+	
+	free(offsets);
+	
+	return (written) ? offset : 0;
+}
+
+
+@interface CTKPersistentHashMapSnapshot (Private)
+
+- (const CTKSnapshotNodeHeader *) private_headerAtOffset:(uint64_t)anOffset;
+- (uint64_t) private_childAtIndex:(NSUInteger)anIndex ofNodeAtOffset:(uint64_t)anOffset header:(const CTKSnapshotNodeHeader *)aHeader;
+- (id) private_valueAtOffset:(uint64_t *)anOffset;
+- (CTKTrieLeafNode *) private_leafAtOffset:(uint64_t)anOffset;
+- (BOOL) private_leafAtOffset:(uint64_t)anOffset hasKey:(id)aKey hash:(NSUInteger)aHashValue;
+
+@end
+
+
+@implementation CTKPersistentHashMapSnapshot
+
+#pragma mark Writing
+
++ (BOOL) writeHashMap:(CTKPersistentHashMap *)aMap toFile:(NSString *)aPath error:(NSError **)error
+{
+	NSParameterAssert(aMap);
+	NSParameterAssert(aPath);
+	
+	NSString *temporaryPath = [aPath stringByAppendingString:@".tmp"];
+	CTKSnapshotWriter writer = {NULL, 0, 0, nil};
+	CTKSnapshotFileHeader header = {{0}, CTKSnapshotVersion, aMap.count, 0, aMap.seed};
+	BOOL done = NO;
+	
+	memcpy(header.magic, CTKSnapshotMagic, sizeof(header.magic));
+	
+	writer.file = fopen([temporaryPath fileSystemRepresentation], "wb");
+	
+	if (writer.file == NULL) {
+		
+		if (error != NULL)
+			*error = CTKSnapshotError(CTKSnapshotIOError, @"Could not create the snapshot file", errno);
+		
+		return NO;
+	}
+	
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	
+	// The header is rewritten once we know where the root is
+	if (CTKSnapshotWriterWrite(&writer, &header, sizeof(header))) {
+		
+		if (aMap.count > 0)
+			header.root = CTKSnapshotWriterWriteNode(&writer, aMap.root);
+		
+		done = (aMap.count == 0 || header.root != 0);
+	}
+	
+	if (done) {
+		done = (fseek(writer.file, 0, SEEK_SET) == 0 
+				&& fwrite(&header, sizeof(header), 1, writer.file) == 1
+				&& fflush(writer.file) == 0
+				&& fsync(fileno(writer.file)) == 0);
+		
+		if (!done)
+			writer.posixError = errno;
+	}
+	
+	[writer.unsupportedValue retain];
+	[pool drain];
+	[writer.unsupportedValue autorelease];
+	
+	if (fclose(writer.file) != 0 && done) {
+		writer.posixError = errno;
+		done = NO;
+	}
+	
+	if (done && rename([temporaryPath fileSystemRepresentation], [aPath fileSystemRepresentation]) != 0) {
+		writer.posixError = errno;
+		done = NO;
+	}
+	
+	if (!done) {
+		
+		unlink([temporaryPath fileSystemRepresentation]);
+		
+		if (error != NULL) {
+			
+			if (writer.unsupportedValue != nil) {
+				NSString *description = [NSString stringWithFormat:@"Values of class %@ cannot be written to a snapshot", 
+										 [writer.unsupportedValue class]];
+				*error = CTKSnapshotError(CTKSnapshotUnsupportedValueError, description, 0);
+			}
+			
+			else {
+				*error = CTKSnapshotError(CTKSnapshotIOError, @"Could not write the snapshot file", writer.posixError);
+			}
+		}
+	}
+	
+	return done;
+}
+
+#pragma mark Initialization
+
++ (id) snapshotWithContentsOfFile:(NSString *)aPath error:(NSError **)error
+{
+	return [[[CTKPersistentHashMapSnapshot alloc] initWithContentsOfFile:aPath error:error] autorelease];
+}
+
+- (id) initWithContentsOfFile:(NSString *)aPath error:(NSError **)error
+{
+	NSParameterAssert(aPath);
+	
+	self = [super init];
+	
+	if (self != nil) {
+		
+		struct stat info;
+		int fd = open([aPath fileSystemRepresentation], O_RDONLY);
+		
+		if (fd < 0 || fstat(fd, &info) != 0) {
+			
+			if (error != NULL)
+				*error = CTKSnapshotError(CTKSnapshotIOError, @"Could not open the snapshot file", errno);
+			
+			if (fd >= 0)
+				close(fd);
+			
+			[self release];
+			return nil;
+		}
+		
+		length = (size_t)info.st_size;
+		
+		if (length < sizeof(CTKSnapshotFileHeader)) {
+			
+			if (error != NULL)
+				*error = CTKSnapshotError(CTKSnapshotFormatError, @"The file is not a snapshot", 0);
+			
+			close(fd);
+			[self release];
+			return nil;
+		}
+		
+		void *mapping = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+		int mapError = errno;
+		
+		close(fd); // the mapping keeps the file alive
+		
+		if (mapping == MAP_FAILED) {
+			
+			if (error != NULL)
+				*error = CTKSnapshotError(CTKSnapshotIOError, @"Could not map the snapshot file", mapError);
+			
+			[self release];
+			return nil;
+		}
+		
+		// Lookups touch a handful of pages spread all over the file
+		madvise(mapping, length, MADV_RANDOM);
+		bytes = mapping;
+		
+		const CTKSnapshotFileHeader *header = (const CTKSnapshotFileHeader *)bytes;
+		
+		BOOL validRoot = (header->count == 0);
+		
+		if (!validRoot && header->root < length) {
+			@try {
+				[self private_headerAtOffset:header->root];
+				validRoot = YES;
+			}
+			@catch (NSException *e) {
+				// reported below
+			}
+		}
+		
+		if (memcmp(header->magic, CTKSnapshotMagic, sizeof(header->magic)) != 0 || 
+			header->version != CTKSnapshotVersion ||
+			!validRoot)
+		{
+			if (error != NULL)
+				*error = CTKSnapshotError(CTKSnapshotFormatError, @"The file is not a snapshot or has an unsupported version", 0);
+			
+			[self release];
+			return nil;
+		}
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	if (bytes != NULL)
+		munmap((void *)bytes, length);
+	
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize length;
+
+#pragma mark Operations
+
+- (CTKPersistentHashMap *) hashMap
+{
+	const CTKSnapshotFileHeader *header = (const CTKSnapshotFileHeader *)bytes;
+	
+	if (header->count == 0)
+		return [CTKPersistentHashMap emptyHashMapWithSeed:(NSUInteger)header->seed];
+	
+	return [CTKPersistentHashMap hashMapWithRoot:[CTKTrieMappedNode mappedNodeWithSnapshot:self offset:header->root] 
+										   count:(NSUInteger)header->count 
+											seed:(NSUInteger)header->seed];
+}
+
+- (NSUInteger) hashValueOfNodeAtOffset:(uint64_t)anOffset
+{
+	return (NSUInteger)[self private_headerAtOffset:anOffset]->hash;
+}
+
+- (NSUInteger) contentHashOfNodeAtOffset:(uint64_t)anOffset
+{
+	return (NSUInteger)[self private_headerAtOffset:anOffset]->contentHash;
+}
+
+- (CTKTrieLeafNode *) leafForKey:(id)aKey hash:(NSUInteger)aHashValue nodeOffset:(uint64_t)anOffset
+{
+	// Same walk as the CTKTrieNode objectForKey:hash: implementations, over the records
+	for (;;) {
+		
+		const CTKSnapshotNodeHeader *header = [self private_headerAtOffset:anOffset];
+		
+		switch (header->type) {
+				
+			case CTKSnapshotNodeBitmapIndexed: {
+				
+				NSUInteger bit = CTKTrieNodeBitpos(aHashValue, (NSUInteger)header->shift);
+				
+				if ((header->bitmap & bit) == 0)
+					return nil;
+				
+				anOffset = [self private_childAtIndex:CTKTrieNodeIndex((NSUInteger)header->bitmap, bit) ofNodeAtOffset:anOffset header:header];
+				break;
+			}
+				
+			case CTKSnapshotNodeFull:
+				anOffset = [self private_childAtIndex:CTKTrieNodeMask(aHashValue, (NSUInteger)header->shift) ofNodeAtOffset:anOffset header:header];
+				break;
+				
+			case CTKSnapshotNodeHashCollision:
+				
+				if (header->hash != aHashValue)
+					return nil;
+				
+				for (uint32_t i = 0; i < header->count; i++) {
+					
+					uint64_t child = [self private_childAtIndex:i ofNodeAtOffset:anOffset header:header];
+					
+					if ([self private_leafAtOffset:child hasKey:aKey hash:aHashValue])
+						return [self private_leafAtOffset:child];
+				}
+				
+				return nil;
+				
+			case CTKSnapshotNodeLeaf:
+				return ([self private_leafAtOffset:anOffset hasKey:aKey hash:aHashValue]) 
+				? [self private_leafAtOffset:anOffset] 
+				: nil;
+				
+			default:
+				@throw [NSException exceptionWithName:@"InvalidState" 
+											   reason:@"Corrupted snapshot, unknown node type" 
+											 userInfo:nil];
+		}
+	}
+}
+
+- (id <CTKTrieNode>) nodeAtOffset:(uint64_t)anOffset
+{
+	const CTKSnapshotNodeHeader *header = [self private_headerAtOffset:anOffset];
+	
+	if (header->type == CTKSnapshotNodeLeaf)
+		return [self private_leafAtOffset:anOffset];
+	
+	NSMutableArray *nodes = [NSMutableArray arrayWithCapacity:header->count];
+	
+	for (uint32_t i = 0; i < header->count; i++) {
+		
+		uint64_t child = [self private_childAtIndex:i ofNodeAtOffset:anOffset header:header];
+		
+		// Collision nodes expect real leaves, every other node keeps its children mapped
+		if (header->type == CTKSnapshotNodeHashCollision)
+			[nodes addObject:[self private_leafAtOffset:child]];
+		else
+			[nodes addObject:[CTKTrieMappedNode mappedNodeWithSnapshot:self offset:child]];
+	}
+	
+	switch (header->type) {
+			
+		case CTKSnapshotNodeBitmapIndexed:
+			return [CTKTrieBitmapIndexedNode bitmapIndexedNodeWithNodes:nodes 
+																 bitmap:(NSUInteger)header->bitmap 
+																  shift:(NSUInteger)header->shift];
+			
+		case CTKSnapshotNodeFull:
+			return [CTKTrieFullNode fullNodeWithNodes:nodes shift:(NSUInteger)header->shift];
+			
+		case CTKSnapshotNodeHashCollision:
+			return [CTKTrieHashCollisionNode hashCollisionNodeWithLeaves:nodes hash:(NSUInteger)header->hash];
+			
+		default:
+			@throw [NSException exceptionWithName:@"InvalidState" 
+										   reason:@"Corrupted snapshot, unknown node type" 
+										 userInfo:nil];
+	}
+	
+	return nil;
+}
+
+#pragma mark Private
+
+/*
+ Checks that the record and its child offsets are inside the mapping and that its count matches its type.
+ */
+- (const CTKSnapshotNodeHeader *) private_headerAtOffset:(uint64_t)anOffset
+{
+	if (anOffset < sizeof(CTKSnapshotFileHeader) || anOffset > length || length - anOffset < sizeof(CTKSnapshotNodeHeader))
+		@throw [NSException exceptionWithName:@"InvalidState" 
+									   reason:@"Corrupted snapshot, node offset out of bounds" 
+									 userInfo:nil];
+	
+	const CTKSnapshotNodeHeader *header = (const CTKSnapshotNodeHeader *)(bytes + anOffset);
+	
+	// count is 32 bits wide, the size of the offsets cannot overflow
+	if ((uint64_t)header->count * sizeof(uint64_t) > length - anOffset - sizeof(CTKSnapshotNodeHeader))
+		@throw [NSException exceptionWithName:@"InvalidState" 
+									   reason:@"Corrupted snapshot, child offsets out of bounds" 
+									 userInfo:nil];
+	
+	BOOL consistent = NO;
+	
+	switch (header->type) {
+			
+		case CTKSnapshotNodeLeaf:
+			consistent = (header->count == 0);
+			break;
+			
+		case CTKSnapshotNodeBitmapIndexed:
+			consistent = (header->shift < 64 && CTKBitCount((NSUInteger)header->bitmap) == header->count);
+			break;
+			
+		case CTKSnapshotNodeFull:
+			consistent = (header->shift < 64 && header->count == CTKTrieNodeMaskCoeficient + 1);
+			break;
+			
+		case CTKSnapshotNodeHashCollision:
+			consistent = (header->count > 0);
+			break;
+	}
+	
+	if (!consistent)
+		@throw [NSException exceptionWithName:@"InvalidState" 
+									   reason:@"Corrupted snapshot, inconsistent node record" 
+									 userInfo:nil];
+	
+	return header;
+}
+
+/*
+ The writer writes the children before their parent, requiring it makes every walk over the records terminate.
+ */
+- (uint64_t) private_childAtIndex:(NSUInteger)anIndex ofNodeAtOffset:(uint64_t)anOffset header:(const CTKSnapshotNodeHeader *)aHeader
+{
+	const uint64_t *children = (const uint64_t *)(bytes + anOffset + sizeof(CTKSnapshotNodeHeader));
+	
+	if (anIndex >= aHeader->count || children[anIndex] >= anOffset)
+		@throw [NSException exceptionWithName:@"InvalidState" 
+									   reason:@"Corrupted snapshot, child offset out of bounds" 
+									 userInfo:nil];
+	
+	return children[anIndex];
+}
+
+/*
+ Decodes the value at *anOffset and advances the offset past it.
+ */
+- (id) private_valueAtOffset:(uint64_t *)anOffset
+{
+	if (*anOffset > length || length - *anOffset < sizeof(CTKSnapshotValueHeader))
+		@throw [NSException exceptionWithName:@"InvalidState" 
+									   reason:@"Corrupted snapshot, value out of bounds" 
+									 userInfo:nil];
+	
+	const CTKSnapshotValueHeader *header = (const CTKSnapshotValueHeader *)(bytes + *anOffset);
+	const uint8_t *payload = bytes + *anOffset + sizeof(CTKSnapshotValueHeader);
+	uint64_t available = length - *anOffset - sizeof(CTKSnapshotValueHeader);
+	
+	// The length is compared before it is aligned so that a huge one cannot wrap around
+	if (header->length > available || CTKSnapshotAlign(header->length) > available || 
+		(header->tag == CTKSnapshotValueNumber && header->length < sizeof(uint64_t)))
+		@throw [NSException exceptionWithName:@"InvalidState" 
+									   reason:@"Corrupted snapshot, value out of bounds" 
+									 userInfo:nil];
+	
+	*anOffset += sizeof(CTKSnapshotValueHeader) + CTKSnapshotAlign(header->length);
+	
+	switch (header->tag) {
+			
+		case CTKSnapshotValueString:
+			return [[[NSString alloc] initWithBytes:payload 
+											 length:(NSUInteger)header->length 
+										   encoding:NSUTF8StringEncoding] autorelease];
+			
+		case CTKSnapshotValueData:
+			return [NSData dataWithBytes:payload length:(NSUInteger)header->length];
+			
+		case CTKSnapshotValueNumber: {
+			
+			char type = (char)header->subtype;
+			
+			if (type == 'f' || type == 'd')
+				return [NSNumber numberWithDouble:*(const double *)payload];
+			
+			if (type == 'Q' || type == 'L' || type == 'I')
+				return [NSNumber numberWithUnsignedLongLong:*(const unsigned long long *)payload];
+			
+			return [NSNumber numberWithLongLong:*(const long long *)payload];
+		}
+			
+		case CTKSnapshotValueNull:
+			return [NSNull null];
+			
+		default:
+			return nil;
+	}
+}
+
+- (BOOL) private_leafAtOffset:(uint64_t)anOffset hasKey:(id)aKey hash:(NSUInteger)aHashValue
+{
+	const CTKSnapshotNodeHeader *header = [self private_headerAtOffset:anOffset];
+	
+	if (header->hash != aHashValue)
+		return NO;
+	
+	uint64_t valueOffset = anOffset + sizeof(CTKSnapshotNodeHeader);
+	id key = [self private_valueAtOffset:&valueOffset];
+	
+	return (key == aKey || [key isEqual:aKey]);
+}
+
+- (CTKTrieLeafNode *) private_leafAtOffset:(uint64_t)anOffset
+{
+	const CTKSnapshotNodeHeader *header = [self private_headerAtOffset:anOffset];
+	uint64_t valueOffset = anOffset + sizeof(CTKSnapshotNodeHeader);
+	
+	id key = [self private_valueAtOffset:&valueOffset];
+	id object = [self private_valueAtOffset:&valueOffset];
+	
+	return [CTKTrieLeafNode leafNodeWithObject:object forKey:key hash:(NSUInteger)header->hash];
+}
+
+@end
+
+
+@implementation CTKPersistentHashMap (CTKSnapshotAdditions)
+
++ (id) hashMapWithContentsOfFile:(NSString *)aPath error:(NSError **)error
+{
+	return [[CTKPersistentHashMapSnapshot snapshotWithContentsOfFile:aPath error:error] hashMap];
+}
+
+- (BOOL) writeToFile:(NSString *)aPath error:(NSError **)error
+{
+	return [CTKPersistentHashMapSnapshot writeHashMap:self toFile:aPath error:error];
+}
+
+@end
@@ -0,0 +1,99 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "CTKPersistentHashMap.h"
+
+/*
+ * \class CTKPersistentHashMapStatistics CTKPersistentHashMapStatistics.h
+ * \brief Shape and memory figures of a CTKPersistentHashMap version, for capacity planning.
+ * \details Bytes are what the trie itself allocates (nodes, their child arrays and leaves, as reported by malloc_size),
+ * keys and objects are not included. Nodes that stand for data held elsewhere (CTKTrieMappedNode, 
+ * CTKCtrieSnapshotNode) are counted as opaque and not descended into.
+ */
+@interface CTKPersistentHashMapStatistics : NSObject {
+	@private
+	NSUInteger bitmapNodes;
+	NSUInteger fullNodes;
+	NSUInteger collisionNodes;
+	NSUInteger leafNodes;
+	NSUInteger opaqueNodes;
+	NSArray *depthHistogram;
+	double averageBitmapFill;
+	size_t bytes;
+	size_t sharedBytes;
+}
+
+@property (readonly, assign, nonatomic) NSUInteger bitmapNodes;
+@property (readonly, assign, nonatomic) NSUInteger fullNodes;
+@property (readonly, assign, nonatomic) NSUInteger collisionNodes;
+/**
+ * \return The number of leaves, including the ones held by collision nodes.
+ */
+@property (readonly, assign, nonatomic) NSUInteger leafNodes;
+@property (readonly, assign, nonatomic) NSUInteger opaqueNodes;
+/**
+ * \return NSNumber(s), the element at index d is the number of entries stored d levels below the root.
+ */
+@property (readonly, retain, nonatomic) NSArray *depthHistogram;
+/**
+ * \return The average number of children of the bitmap indexed nodes divided by 64.
+ */
+@property (readonly, assign, nonatomic) double averageBitmapFill;
+@property (readonly, assign, nonatomic) size_t bytes;
+/**
+ * \return The bytes of this version also reachable from the version it was compared to, 0 if none.
+ */
+@property (readonly, assign, nonatomic) size_t sharedBytes;
+/**
+ * \return bytes - sharedBytes
+ */
+@property (readonly, assign, nonatomic) size_t uniqueBytes;
+
++ (id) statisticsForMap:(CTKPersistentHashMap *)aMap;
+
+/**
+ * \brief Same as statisticsForMap: and splits the bytes between the ones shared with anotherMap and the unique ones.
+ */
++ (id) statisticsForMap:(CTKPersistentHashMap *)aMap relativeToMap:(CTKPersistentHashMap *)anotherMap;
+
+/**
+ * \return The bytes held by the maps (or other objects) of someVersions after the first one that are not shared 
+ * with any version before them in the array. Each node is counted once.
+ * \details Pass the newest version first, the result is what keeping the older ones costs.
+ */
++ (size_t) retainedBytesOfVersions:(NSArray *)someVersions;
+
+@end
+
+
+@interface CTKPersistentHashMap (CTKStatistics)
+
+- (CTKPersistentHashMapStatistics *) statistics;
+
+- (CTKPersistentHashMapStatistics *) statisticsRelativeToMap:(CTKPersistentHashMap *)aMap;
+
+@end
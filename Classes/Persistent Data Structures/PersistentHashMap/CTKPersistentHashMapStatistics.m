@@ -0,0 +1,305 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKPersistentHashMapStatistics.h"
+#import "CTKTrieNode.h"
+#import "CTKTrieLeafNode.h"
+#import "CTKTrieBitmapIndexedNode.h"
+#import "CTKTrieFullNode.h"
+#import "CTKTrieHashCollisionNode.h"
+#import "CTKTrieEmptyNode.h"
+#include <malloc/malloc.h>
+
+// 64 bit hashes are exhausted after 11 levels of 6 bits, collision nodes sit right below
+enum { CTKTrieMaximumDepth = 16 };
+
+typedef struct {
+	NSUInteger bitmapNodes;
+	NSUInteger bitmapChildren;
+	NSUInteger fullNodes;
+	NSUInteger collisionNodes;
+	NSUInteger leafNodes;
+	NSUInteger opaqueNodes;
+	NSUInteger depths[CTKTrieMaximumDepth];
+	size_t bytes;
+	size_t sharedBytes;
+	CFSetRef otherNodes; // nodes of the version we compare to, may be NULL
+} CTKTrieWalk;
+
+static BOOL CTKTrieNodeIsBranch(id aNode)
+{
+	return [aNode isKindOfClass:[CTKTrieBitmapIndexedNode class]] || [aNode isKindOfClass:[CTKTrieFullNode class]];
+}
+
+/*
+ The node itself and the storage only it uses, children excluded.
+ */
+static size_t CTKTrieNodeOwnBytes(id aNode)
+{
+	size_t size = malloc_size(aNode);
+	
+	if (CTKTrieNodeIsBranch(aNode))
+		size += malloc_size([aNode nodes]);
+	
+	else if ([aNode isKindOfClass:[CTKTrieHashCollisionNode class]])
+		size += (sizeof(id) + sizeof(CTKTrieLeafNode *)) * [(CTKTrieHashCollisionNode *)aNode count];
+	
+	return size;
+}
+
+static void CTKTrieWalkAddBytes(CTKTrieWalk *walk, id aNode, BOOL shared)
+{
+	size_t size = CTKTrieNodeOwnBytes(aNode);
+	
+	walk->bytes += size;
+	
+	if (shared || (walk->otherNodes != NULL && CFSetContainsValue(walk->otherNodes, aNode)))
+		walk->sharedBytes += size;
+}
+
+static void CTKTrieWalkNode(id aNode, NSUInteger depth, BOOL shared, CTKTrieWalk *walk)
+{
+	// Nodes are immutable, everything below a shared node is shared
+	shared = shared || (walk->otherNodes != NULL && CFSetContainsValue(walk->otherNodes, aNode));
+	depth = MIN(depth, CTKTrieMaximumDepth - 1);
+	
+	CTKTrieWalkAddBytes(walk, aNode, shared);
+	
+	if ([aNode isKindOfClass:[CTKTrieLeafNode class]]) {
+		walk->leafNodes++;
+		walk->depths[depth]++;
+	}
+	
+	else if ([aNode isKindOfClass:[CTKTrieHashCollisionNode class]]) {
+		
+		CTKTrieHashCollisionNode *node = aNode;
+		
+		walk->collisionNodes++;
+		
+		for (NSUInteger i = 0; i < node.count; i++) {
+			CTKTrieWalkAddBytes(walk, [node leafAtIndex:i], shared);
+			walk->leafNodes++;
+			walk->depths[depth]++;
+		}
+	}
+	
+	else if (CTKTrieNodeIsBranch(aNode)) {
+		
+		NSArray *children = [aNode nodes];
+		
+		if ([aNode isKindOfClass:[CTKTrieFullNode class]]) {
+			walk->fullNodes++;
+		}
+		
+		else {
+			walk->bitmapNodes++;
+			walk->bitmapChildren += [children count];
+		}
+		
+		for (id child in children)
+			CTKTrieWalkNode(child, depth + 1, shared, walk);
+	}
+	
+	else if (![aNode isKindOfClass:[CTKTrieEmptyNode class]]) {
+		walk->opaqueNodes++;
+	}
+}
+
+/*
+ Adds to aSet the nodes under aNode that are not there yet, returning their bytes. A node already in the set had 
+ its whole subtree added along with it.
+ */
+static size_t CTKTrieCollectNodes(id aNode, CFMutableSetRef aSet)
+{
+	if (CFSetContainsValue(aSet, aNode))
+		return 0;
+	
+	CFSetAddValue(aSet, aNode);
+	
+	size_t size = CTKTrieNodeOwnBytes(aNode);
+	
+	if ([aNode isKindOfClass:[CTKTrieHashCollisionNode class]]) {
+		
+		CTKTrieHashCollisionNode *node = aNode;
+		
+		for (NSUInteger i = 0; i < node.count; i++)
+			size += CTKTrieCollectNodes([node leafAtIndex:i], aSet);
+	}
+	
+	else if (CTKTrieNodeIsBranch(aNode)) {
+		
+		for (id child in [aNode nodes])
+			size += CTKTrieCollectNodes(child, aSet);
+	}
+	
+	return size;
+}
+
+static size_t CTKCollectVersion(id aVersion, CFMutableSetRef aSet)
+{
+	if (CFSetContainsValue(aSet, aVersion))
+		return 0;
+	
+	CFSetAddValue(aSet, aVersion);
+	
+	size_t size = malloc_size(aVersion);
+	
+	if ([aVersion isKindOfClass:[CTKPersistentHashMap class]])
+		size += CTKTrieCollectNodes([(CTKPersistentHashMap *)aVersion root], aSet);
+	
+	return size;
+}
+
+
+@interface CTKPersistentHashMapStatistics ()
+
+@property (readwrite, assign, nonatomic) NSUInteger bitmapNodes;
+@property (readwrite, assign, nonatomic) NSUInteger fullNodes;
+@property (readwrite, assign, nonatomic) NSUInteger collisionNodes;
+@property (readwrite, assign, nonatomic) NSUInteger leafNodes;
+@property (readwrite, assign, nonatomic) NSUInteger opaqueNodes;
+@property (readwrite, retain, nonatomic) NSArray *depthHistogram;
+@property (readwrite, assign, nonatomic) double averageBitmapFill;
+@property (readwrite, assign, nonatomic) size_t bytes;
+@property (readwrite, assign, nonatomic) size_t sharedBytes;
+
+@end
+
+
+@implementation CTKPersistentHashMapStatistics
+
++ (id) statisticsForMap:(CTKPersistentHashMap *)aMap
+{
+	return [self statisticsForMap:aMap relativeToMap:nil];
+}
+
++ (id) statisticsForMap:(CTKPersistentHashMap *)aMap relativeToMap:(CTKPersistentHashMap *)anotherMap
+{
+	NSParameterAssert(aMap);
+	
+	CTKTrieWalk walk;
+	CFMutableSetRef otherNodes = NULL;
+	
+	memset(&walk, 0, sizeof(walk));
+	
+	if (anotherMap != nil) {
+		otherNodes = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL); // pointer identity, no retains
+		CTKTrieCollectNodes(anotherMap.root, otherNodes);
+		walk.otherNodes = otherNodes;
+	}
+	
+	CTKTrieWalkNode(aMap.root, 0, NO, &walk);
+	
+	if (otherNodes != NULL)
+		CFRelease(otherNodes);
+	
+	NSUInteger levels = CTKTrieMaximumDepth;
+	
+	while (levels > 0 && walk.depths[levels - 1] == 0)
+		levels--;
+	
+	NSMutableArray *histogram = [NSMutableArray arrayWithCapacity:levels];
+	
+	for (NSUInteger depth = 0; depth < levels; depth++)
+		[histogram addObject:[NSNumber numberWithUnsignedInteger:walk.depths[depth]]];
+	
+	CTKPersistentHashMapStatistics *statistics = [[[CTKPersistentHashMapStatistics alloc] init] autorelease];
+	
+	statistics.bitmapNodes = walk.bitmapNodes;
+	statistics.fullNodes = walk.fullNodes;
+	statistics.collisionNodes = walk.collisionNodes;
+	statistics.leafNodes = walk.leafNodes;
+	statistics.opaqueNodes = walk.opaqueNodes;
+	statistics.depthHistogram = histogram;
+	statistics.averageBitmapFill = (walk.bitmapNodes > 0) 
+		? (double)walk.bitmapChildren / (walk.bitmapNodes * (CTKTrieNodeMaskCoeficient + 1)) 
+		: 0.0;
+	statistics.bytes = walk.bytes + malloc_size(aMap);
+	statistics.sharedBytes = walk.sharedBytes;
+	
+	return statistics;
+}
+
++ (size_t) retainedBytesOfVersions:(NSArray *)someVersions
+{
+	if ([someVersions count] < 2)
+		return 0;
+	
+	CFMutableSetRef seen = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+	size_t size = 0;
+	
+	CTKCollectVersion([someVersions objectAtIndex:0], seen);
+	
+	for (NSUInteger i = 1; i < [someVersions count]; i++)
+		size += CTKCollectVersion([someVersions objectAtIndex:i], seen);
+	
+	CFRelease(seen);
+	
+	return size;
+}
+
+- (void) dealloc
+{
+	[depthHistogram release];
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize bitmapNodes, fullNodes, collisionNodes, leafNodes, opaqueNodes, depthHistogram, averageBitmapFill;
+@synthesize bytes, sharedBytes;
+
+- (size_t) uniqueBytes
+{
+	return self.bytes - self.sharedBytes;
+}
+
+- (NSString *) description
+{
+	return [NSString stringWithFormat:@"<%@: bitmap %lu, full %lu, collision %lu, leaves %lu, opaque %lu, fill %.2f, depths %@, bytes %lu (%lu shared)>",
+			[self class], 
+			(unsigned long)self.bitmapNodes, (unsigned long)self.fullNodes, (unsigned long)self.collisionNodes, 
+			(unsigned long)self.leafNodes, (unsigned long)self.opaqueNodes, self.averageBitmapFill, 
+			[self.depthHistogram componentsJoinedByString:@"/"], 
+			(unsigned long)self.bytes, (unsigned long)self.sharedBytes];
+}
+
+@end
+
+
+@implementation CTKPersistentHashMap (CTKStatistics)
+
+- (CTKPersistentHashMapStatistics *) statistics
+{
+	return [CTKPersistentHashMapStatistics statisticsForMap:self];
+}
+
+- (CTKPersistentHashMapStatistics *) statisticsRelativeToMap:(CTKPersistentHashMap *)aMap
+{
+	return [CTKPersistentHashMapStatistics statisticsForMap:self relativeToMap:aMap];
+}
+
+@end
@@ -35,6 +35,8 @@
 	NSArray *nodes;
 	NSUInteger shift;
 	NSUInteger hashValue;
+	NSUInteger contentHash;
+	volatile BOOL hasContentHash;
 }
 
 @property (readonly, retain) NSArray *nodes; // was copy
@@ -52,15 +54,23 @@
 @property (readonly) NSUInteger shift;
 
 
-+ (id <CTKTrieNode>) nodeWithObject:(id)anObject
-							 forKey:(id)aKey
-							 branch:(id <CTKTrieNode>)aBranch
-							  shift:(NSUInteger)aShiftValue 
-							   hash:(NSUInteger)aHashValue
-						  addedLeaf:(CTKTrieLeafNode **)aLeaf;
+/**
+ * \brief A node holding aBranch and a new leaf for anObject, the caller owns it.
+ */
++ (id <CTKTrieNode>) newNodeWithObject:(id)anObject
+								forKey:(id)aKey
+								branch:(id <CTKTrieNode>)aBranch
+								 shift:(NSUInteger)aShiftValue 
+								  hash:(NSUInteger)aHashValue
+							 addedLeaf:(CTKTrieLeafNode **)aLeaf;
 
 + (id) bitmapIndexedNodeWithNodes:(NSArray *)anArray bitmap:(NSUInteger)aBitmap shift:(NSUInteger)aShiftValue;
 
+/**
+ * \brief Like bitmapIndexedNodeWithNodes:bitmap:shift: but the caller owns the node, used by the trie internals.
+ */
++ (id) newBitmapIndexedNodeWithNodes:(NSArray *)anArray bitmap:(NSUInteger)aBitmap shift:(NSUInteger)aShiftValue;
+
 - (id) initWithNodes:(NSArray *)anArray bitmap:(NSUInteger)aBitmap shift:(NSUInteger)aShiftValue;
 
 
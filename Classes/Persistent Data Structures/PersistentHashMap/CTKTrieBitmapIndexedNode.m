@@ -25,6 +25,7 @@
  */
 
 #import "CTKTrieBitmapIndexedNode.h"
+#include <libkern/OSAtomic.h>
 #import "CTKTrieLeafNode.h"
 #import "CTKTrieFullNode.h"
 
@@ -41,15 +42,15 @@
 
 @interface CTKTrieBitmapIndexedNode (Private)
 
-- (id <CTKTrieNode>) private_nodeFromExistingNodeWithObject:(id)anObject
-													 forKey:(id)aKey
-													   hash:(NSUInteger)aHashValue
-												  addedLeaf:(CTKTrieLeafNode **)aLeaf;
+- (id <CTKTrieNode>) private_newNodeFromExistingNodeWithObject:(id)anObject
+														forKey:(id)aKey
+														  hash:(NSUInteger)aHashValue
+													 addedLeaf:(CTKTrieLeafNode **)aLeaf;
 
-- (id <CTKTrieNode>) private_nodeByAddingLeafNodeWithObject:(id)anObject 
-													 forKey:(id)aKey 
-													   hash:(NSUInteger)aHashValue
-												  addedLeaf:(CTKTrieLeafNode **)aLeaf;
+- (id <CTKTrieNode>) private_newNodeByAddingLeafNodeWithObject:(id)anObject 
+														forKey:(id)aKey 
+														  hash:(NSUInteger)aHashValue
+													 addedLeaf:(CTKTrieLeafNode **)aLeaf;
 @end
 
 
@@ -57,33 +58,44 @@
 
 #pragma mark Initialization
 
-+ (id <CTKTrieNode>) nodeWithObject:(id)anObject
-							 forKey:(id)aKey
-							 branch:(id <CTKTrieNode>)aBranch
-							  shift:(NSUInteger)aShiftValue 
-							   hash:(NSUInteger)aHashValue
-						  addedLeaf:(CTKTrieLeafNode **)aLeaf
++ (id <CTKTrieNode>) newNodeWithObject:(id)anObject
+								forKey:(id)aKey
+								branch:(id <CTKTrieNode>)aBranch
+								 shift:(NSUInteger)aShiftValue 
+								  hash:(NSUInteger)aHashValue
+							 addedLeaf:(CTKTrieLeafNode **)aLeaf
 {
 	//NSLog(@"+++ [%@] %s.\nCalled with object:%@ key:%@ branch:%@ shift:%U hash:%U", [self class], _cmd, anObject, aKey, aBranch, aShiftValue, aHashValue);
 	NSParameterAssert(aBranch);
 	
-	CTKTrieBitmapIndexedNode *node =  [self bitmapIndexedNodeWithNodes:[NSArray arrayWithObject:aBranch]
-																bitmap:CTKTrieNodeBitpos(aBranch.hashValue, aShiftValue)
-																 shift:aShiftValue];
+	NSArray *branches = [[NSArray alloc] initWithObjects:&aBranch count:1];
+	CTKTrieBitmapIndexedNode *node =  [self newBitmapIndexedNodeWithNodes:branches
+																   bitmap:CTKTrieNodeBitpos(aBranch.hashValue, aShiftValue)
+																	shift:aShiftValue];
+	[branches release];
 	
-	return [node setObject:anObject forKey:aKey shift:aShiftValue hash:aHashValue addedLeaf:aLeaf];
+	id <CTKTrieNode> result = [node newNodeBySettingObject:anObject forKey:aKey shift:aShiftValue hash:aHashValue addedLeaf:aLeaf];
+	[node release];
+	
+	return result;
 }
 
 + (id) bitmapIndexedNodeWithNodes:(NSArray *)anArray 
 						   bitmap:(NSUInteger)aBitmap 
 							shift:(NSUInteger)aShiftValue
+{
+	return [[self newBitmapIndexedNodeWithNodes:anArray bitmap:aBitmap shift:aShiftValue] autorelease];
+}
+
++ (id) newBitmapIndexedNodeWithNodes:(NSArray *)anArray 
+							  bitmap:(NSUInteger)aBitmap 
+							   shift:(NSUInteger)aShiftValue
 {
 	//NSLog(@"+++ [%@] %s.\nCalled with array:%@ bitmap:%U shift:%U", [self class], _cmd, anArray, aBitmap, aShiftValue);
 	
-	
-	return [[[self alloc] initWithNodes:anArray
-								 bitmap:aBitmap
-								  shift:aShiftValue] autorelease];
+	return [[self alloc] initWithNodes:anArray
+								bitmap:aBitmap
+								 shift:aShiftValue];
 }
 
 
@@ -139,11 +151,11 @@
 	return nil;
 }
 
-- (id <CTKTrieNode>) setObject:(id)anObject 
-						forKey:(id)aKey 
-						 shift:(NSUInteger)aShiftValue 
-						  hash:(NSUInteger)aHashValue
-					 addedLeaf:(CTKTrieLeafNode **)aLeaf
+- (id <CTKTrieNode>) newNodeBySettingObject:(id)anObject 
+									 forKey:(id)aKey 
+									  shift:(NSUInteger)aShiftValue 
+									   hash:(NSUInteger)aHashValue
+								  addedLeaf:(CTKTrieLeafNode **)aLeaf
 {
 	
 	//NSLog(@"+++ [%@] %s.\n -> count:%U", [self class], _cmd, [self.nodes count]);
@@ -157,22 +169,22 @@
 	
 	if(nodeShouldExist){
 		
-		return [self private_nodeFromExistingNodeWithObject:anObject
-													 forKey:aKey
-													   hash:aHashValue
-												  addedLeaf:aLeaf];
+		return [self private_newNodeFromExistingNodeWithObject:anObject
+														forKey:aKey
+														  hash:aHashValue
+													 addedLeaf:aLeaf];
 	} 
 	
-	return [self private_nodeByAddingLeafNodeWithObject:anObject 
-												 forKey:aKey 
-												   hash:aHashValue 
-											  addedLeaf:aLeaf];
+	return [self private_newNodeByAddingLeafNodeWithObject:anObject 
+													forKey:aKey 
+													  hash:aHashValue 
+												 addedLeaf:aLeaf];
 }
 
-- (id <CTKTrieNode>) private_nodeFromExistingNodeWithObject:(id)anObject
-													 forKey:(id)aKey
-													   hash:(NSUInteger)aHashValue
-												  addedLeaf:(CTKTrieLeafNode **)aLeaf
+- (id <CTKTrieNode>) private_newNodeFromExistingNodeWithObject:(id)anObject
+														forKey:(id)aKey
+														  hash:(NSUInteger)aHashValue
+													 addedLeaf:(CTKTrieLeafNode **)aLeaf
 {
 	NSUInteger bit = CTKTrieNodeBitpos(aHashValue, self.shift);
 	NSUInteger index = CTKTrieNodeIndex(self.bitmap, bit);
@@ -187,38 +199,44 @@
 		
 	}
 	
-	id <CTKTrieNode> newNode = [existingNode setObject:anObject
-												forKey:aKey
-												 shift:(self.shift + CTKTrieNodeShiftIncrement)
-												  hash:aHashValue 
-											 addedLeaf:aLeaf];
+	id <CTKTrieNode> newNode = [existingNode newNodeBySettingObject:anObject
+															 forKey:aKey
+															  shift:(self.shift + CTKTrieNodeShiftIncrement)
+															   hash:aHashValue 
+														  addedLeaf:aLeaf];
 	
 	if(newNode == existingNode){
-		return self;
+		[newNode release];
+		return [self retain];
 	}
 	
-	NSMutableArray *newNodes = [NSMutableArray arrayWithArray:self.nodes];
+	NSMutableArray *newNodes = [[NSMutableArray alloc] initWithArray:self.nodes];
 	[newNodes replaceObjectAtIndex:index withObject:newNode];
+	[newNode release];
 	
 	//NSLog(@"+++ [%@] %s.\n <- count:%U verif(%U)", [self class], _cmd, [newNodes count], CTKBitCount(self.bitmap));
 
-	return [CTKTrieBitmapIndexedNode bitmapIndexedNodeWithNodes:newNodes
-														 bitmap:self.bitmap
-														  shift:self.shift];
+	CTKTrieBitmapIndexedNode *node = [CTKTrieBitmapIndexedNode newBitmapIndexedNodeWithNodes:newNodes
+																					  bitmap:self.bitmap
+																					   shift:self.shift];
+	[newNodes release];
+	
+	return node;
 }
 
-- (id <CTKTrieNode>) private_nodeByAddingLeafNodeWithObject:(id)anObject 
-													 forKey:(id)aKey 
-													   hash:(NSUInteger)aHashValue
-												  addedLeaf:(CTKTrieLeafNode **)aLeaf
+- (id <CTKTrieNode>) private_newNodeByAddingLeafNodeWithObject:(id)anObject 
+														forKey:(id)aKey 
+														  hash:(NSUInteger)aHashValue
+													 addedLeaf:(CTKTrieLeafNode **)aLeaf
 
 {
 	NSUInteger bit = CTKTrieNodeBitpos(aHashValue, self.shift);
 	NSUInteger index = CTKTrieNodeIndex(self.bitmap, bit);
 	
-	NSMutableArray *newNodes = [NSMutableArray arrayWithArray:self.nodes];
-	CTKTrieLeafNode *newNode = [CTKTrieLeafNode leafNodeWithObject:anObject forKey:aKey hash:aHashValue];	
+	NSMutableArray *newNodes = [[NSMutableArray alloc] initWithArray:self.nodes];
+	CTKTrieLeafNode *newNode = [CTKTrieLeafNode newLeafNodeWithObject:anObject forKey:aKey hash:aHashValue];	
 	[newNodes insertObject:newNode atIndex:index];
+	[newNode release];
 	
 	if(aLeaf != NULL)
 		*aLeaf = newNode;
@@ -227,12 +245,16 @@
 
 	// (newBitmap) aBitmap == -1
 	// CTKBitCount(newBitmap) == CTKTrieNodeMaskCoeficient + 1
-	return (CTKBitCount(newBitmap) >= 64) 
-	? [CTKTrieFullNode fullNodeWithNodes:newNodes shift:self.shift]
-	: [CTKTrieBitmapIndexedNode bitmapIndexedNodeWithNodes:newNodes bitmap:newBitmap shift:self.shift];
+	id <CTKTrieNode> node = (CTKBitCount(newBitmap) >= 64) 
+	? [CTKTrieFullNode newFullNodeWithNodes:newNodes shift:self.shift]
+	: [CTKTrieBitmapIndexedNode newBitmapIndexedNodeWithNodes:newNodes bitmap:newBitmap shift:self.shift];
+	
+	[newNodes release];
+	
+	return node;
 }
 
-- (id <CTKTrieNode>) removeObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
+- (id <CTKTrieNode>) newNodeByRemovingObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
 {
 	
 	NSUInteger bit = CTKTrieNodeBitpos(aHashValue, self.shift);
@@ -253,7 +275,7 @@
 			
 		}
 		
-		id <CTKTrieNode> newNode = [existingNode removeObjectForKey:aKey hash:aHashValue];
+		id <CTKTrieNode> newNode = [existingNode newNodeByRemovingObjectForKey:aKey hash:aHashValue];
 		
 		if(newNode != existingNode){
 			
@@ -262,30 +284,55 @@
 				if(self.bitmap == bit)
 					return nil;
 				
-				NSMutableArray *newNodes = [NSMutableArray arrayWithArray:self.nodes];
+				NSMutableArray *newNodes = [[NSMutableArray alloc] initWithArray:self.nodes];
 				[newNodes removeObjectAtIndex:index];
 				
 				NSUInteger newBitmap = (self.bitmap & ~bit);
 				
-				return [CTKTrieBitmapIndexedNode bitmapIndexedNodeWithNodes:newNodes
-																	 bitmap:newBitmap
-																	  shift:self.shift];
+				CTKTrieBitmapIndexedNode *node = [CTKTrieBitmapIndexedNode newBitmapIndexedNodeWithNodes:newNodes
+																								  bitmap:newBitmap
+																								   shift:self.shift];
+				[newNodes release];
 				
+				return node;
 			}
 			
-			NSMutableArray *newNodes = [NSMutableArray arrayWithArray:self.nodes];
+			NSMutableArray *newNodes = [[NSMutableArray alloc] initWithArray:self.nodes];
 			[newNodes replaceObjectAtIndex:index withObject:newNode];
+			[newNode release];
 			
-			return [CTKTrieBitmapIndexedNode bitmapIndexedNodeWithNodes:newNodes
-																 bitmap:self.bitmap
-																  shift:self.shift];
+			CTKTrieBitmapIndexedNode *node = [CTKTrieBitmapIndexedNode newBitmapIndexedNodeWithNodes:newNodes
+																							  bitmap:self.bitmap
+																							   shift:self.shift];
+			[newNodes release];
+			
+			return node;
 		}
+		
+		[newNode release];
 	}
 	
-	return self;
+	return [self retain];
 }
 
 
 
 
+- (NSUInteger) contentHash
+{
+	if(!hasContentHash){
+		
+		NSUInteger hash = 0;
+		
+		for(id <CTKTrieNode> node in self.nodes)
+			hash += [node contentHash];
+		
+		contentHash = hash;
+		OSMemoryBarrier();
+		hasContentHash = YES;
+	}
+	
+	return contentHash;
+}
+
 @end
@@ -59,15 +59,15 @@
 	return nil;
 }
 
-- (id <CTKTrieNode>) setObject:(id)anObject 
-						forKey:(id)aKey 
-						 shift:(NSUInteger)aShiftValue 
-						  hash:(NSUInteger)aHashValue
-					 addedLeaf:(CTKTrieLeafNode **)aLeaf
+- (id <CTKTrieNode>) newNodeBySettingObject:(id)anObject 
+									 forKey:(id)aKey 
+									  shift:(NSUInteger)aShiftValue 
+									   hash:(NSUInteger)aHashValue
+								  addedLeaf:(CTKTrieLeafNode **)aLeaf
 {
 	//NSLog(@"+++ [%@] %s.\nCalled with object:%@ key:%@ shift:%U hash:%U", [self class], _cmd, anObject, aKey, aShiftValue, aHashValue);
 	
-	CTKTrieLeafNode *ret = [CTKTrieLeafNode leafNodeWithObject:anObject forKey:aKey hash:aHashValue];
+	CTKTrieLeafNode *ret = [CTKTrieLeafNode newLeafNodeWithObject:anObject forKey:aKey hash:aHashValue];
 	
 	if(aLeaf != NULL)
 		*aLeaf = ret;
@@ -75,10 +75,15 @@
 	return ret;
 }
 
-- (id <CTKTrieNode>) removeObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
+- (id <CTKTrieNode>) newNodeByRemovingObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
 {
-	return self;
+	return [self retain];
 }
 
 
+- (NSUInteger) contentHash
+{
+	return 0;
+}
+
 @end
@@ -32,6 +32,8 @@
 	NSArray *nodes;
 	NSUInteger shift;
 	NSUInteger hashValue;
+	NSUInteger contentHash;
+	volatile BOOL hasContentHash;
 }
 
 @property (readonly, retain) NSArray *nodes;
@@ -42,6 +44,11 @@
 
 + (id) fullNodeWithNodes:(NSArray *)anArray shift:(NSUInteger)aShiftValue;
 
+/**
+ * \brief Like fullNodeWithNodes:shift: but the caller owns the node, used by the trie internals.
+ */
++ (id) newFullNodeWithNodes:(NSArray *)anArray shift:(NSUInteger)aShiftValue;
+
 - (id) initWithNodes:(NSArray *)anArray shift:(NSUInteger)aShiftValue;
 
 @end
@@ -27,6 +27,7 @@
 #import "CTKTrieFullNode.h"
 #import "CTKTrieLeafNode.h"
 #import "CTKTrieBitmapIndexedNode.h"
+#include <libkern/OSAtomic.h>
 
 @interface CTKTrieFullNode ()
 
@@ -43,7 +44,12 @@
 
 + (id) fullNodeWithNodes:(NSArray *)anArray shift:(NSUInteger)aShiftValue
 {
-	return [[[CTKTrieFullNode alloc] initWithNodes:anArray shift:aShiftValue] autorelease];
+	return [[self newFullNodeWithNodes:anArray shift:aShiftValue] autorelease];
+}
+
++ (id) newFullNodeWithNodes:(NSArray *)anArray shift:(NSUInteger)aShiftValue
+{
+	return [[CTKTrieFullNode alloc] initWithNodes:anArray shift:aShiftValue];
 }
 
 - (id) initWithNodes:(NSArray *)anArray shift:(NSUInteger)aShiftValue
@@ -84,65 +90,96 @@
 	return [theNode objectForKey:aKey hash:aHashValue];
 }
 
-- (id <CTKTrieNode>) setObject:(id)anObject 
-						forKey:(id)aKey 
-						 shift:(NSUInteger)aShiftValue 
-						  hash:(NSUInteger)aHashValue
-					 addedLeaf:(CTKTrieLeafNode **)aLeaf
+- (id <CTKTrieNode>) newNodeBySettingObject:(id)anObject 
+									 forKey:(id)aKey 
+									  shift:(NSUInteger)aShiftValue 
+									   hash:(NSUInteger)aHashValue
+								  addedLeaf:(CTKTrieLeafNode **)aLeaf
 {
 	//NSLog(@"+++ [%@] %s.\nCalled with object:%@ key:%@ shift:%U hash:%U", [self class], _cmd, anObject, aKey, aShiftValue, aHashValue);
 	
 	NSUInteger index = CTKTrieNodeMask(aHashValue, self.shift);
 	
 	id <CTKTrieNode> existingNode = [self.nodes objectAtIndex:index];
-	id <CTKTrieNode> newNode = [existingNode setObject:anObject
-												forKey:aKey
-												 shift:(self.shift + CTKTrieNodeShiftIncrement)
-												  hash:aHashValue
-											 addedLeaf:aLeaf];
+	id <CTKTrieNode> newNode = [existingNode newNodeBySettingObject:anObject
+															 forKey:aKey
+															  shift:(self.shift + CTKTrieNodeShiftIncrement)
+															   hash:aHashValue
+														  addedLeaf:aLeaf];
 	
 	if(newNode != existingNode){
 		
-		NSMutableArray *newNodes = [NSMutableArray arrayWithArray:self.nodes];
+		NSMutableArray *newNodes = [[NSMutableArray alloc] initWithArray:self.nodes];
 		[newNodes replaceObjectAtIndex:index withObject:newNode];
+		[newNode release];
 		
-		return [CTKTrieFullNode fullNodeWithNodes:newNodes shift:self.shift];
+		CTKTrieFullNode *node = [CTKTrieFullNode newFullNodeWithNodes:newNodes shift:self.shift];
+		[newNodes release];
 		
+		return node;
 	}
 	
-	return self;
+	[newNode release];
+	
+	return [self retain];
 
 }
 
-- (id <CTKTrieNode>) removeObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
+- (id <CTKTrieNode>) newNodeByRemovingObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
 {
 	
 	NSUInteger index = CTKTrieNodeMask(aHashValue, self.shift);
 	id <CTKTrieNode> existingNode = [self.nodes objectAtIndex:index];
 
-	id <CTKTrieNode> newNode = [existingNode removeObjectForKey:aKey hash:aHashValue];
+	id <CTKTrieNode> newNode = [existingNode newNodeByRemovingObjectForKey:aKey hash:aHashValue];
 	
 	if(newNode != existingNode){
 		
-		NSMutableArray *newNodes = [NSMutableArray arrayWithArray:self.nodes];
+		NSMutableArray *newNodes = [[NSMutableArray alloc] initWithArray:self.nodes];
+		id <CTKTrieNode> node;
 
 		if(newNode == nil){
 			
 			[newNodes removeObjectAtIndex:index];
 			NSUInteger newBitmap = ~CTKTrieNodeBitpos(aHashValue, self.shift);
 			
-			return [CTKTrieBitmapIndexedNode bitmapIndexedNodeWithNodes:newNodes
-																 bitmap:newBitmap
-																  shift:self.shift];
+			node = [CTKTrieBitmapIndexedNode newBitmapIndexedNodeWithNodes:newNodes
+																	bitmap:newBitmap
+																	 shift:self.shift];
+		} else {
+			
+			[newNodes replaceObjectAtIndex:index withObject:newNode];
+			[newNode release];
+			
+			node = [CTKTrieFullNode newFullNodeWithNodes:newNodes shift:self.shift];
 		}
 		
-		[newNodes replaceObjectAtIndex:index withObject:newNode];
+		[newNodes release];
 		
-		return [CTKTrieFullNode fullNodeWithNodes:newNodes shift:self.shift];
+		return node;
 	}
 	
-	return self;
+	[newNode release];
+	
+	return [self retain];
 }
 
 
+- (NSUInteger) contentHash
+{
+	if(!hasContentHash){
+		
+		NSUInteger hash = 0;
+		
+		for(id <CTKTrieNode> node in self.nodes)
+			hash += [node contentHash];
+		
+		contentHash = hash;
+		OSMemoryBarrier();
+		hasContentHash = YES;
+	}
+	
+	return contentHash;
+}
+
 @end
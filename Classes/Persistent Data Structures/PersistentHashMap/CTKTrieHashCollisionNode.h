@@ -27,18 +27,39 @@
 #import <Cocoa/Cocoa.h>
 #import "CTKTrieNode.h"
 
+/*
+ Leaves whose full hashes are equal. They are kept in a C array along with their keys, a lookup compares key pointers
+ first and then calls the IMP of the looked up key's -isEqual: directly, there is no message send per probe.
+ */
 @interface CTKTrieHashCollisionNode : NSObject <CTKTrieNode> {
 	NSUInteger hashValue;
-	NSArray *leaves;
+	NSUInteger contentHash;
+	volatile BOOL hasContentHash;
+	NSUInteger count;
+	CTKTrieLeafNode **leafArray;
+	id *keys;
 }
 
-@property (readonly, retain) NSArray *leaves;
+/**
+ * \return The leaves, in a new array.
+ */
+@property (readonly) NSArray *leaves;
+@property (readonly, assign) NSUInteger count;
 
 
 + (id) hashCollisionNodeWithLeaves:(NSArray *)anArray hash:(NSUInteger)aHashValue;
 
+/**
+ * \brief Like hashCollisionNodeWithLeaves:hash: but the caller owns the node, used by the trie internals.
+ */
++ (id) newHashCollisionNodeWithLeaves:(NSArray *)anArray hash:(NSUInteger)aHashValue;
+
 - (id) initWithLeaves:(NSArray *)anArray hash:(NSUInteger)aHashValue;
 
+- (id) initWithLeaves:(CTKTrieLeafNode * const *)someLeaves count:(NSUInteger)aCount hash:(NSUInteger)aHashValue;
+
+- (CTKTrieLeafNode *) leafAtIndex:(NSUInteger)anIndex;
+
 - (NSUInteger) indexOfObjectForKey:(id)aKey hash:(NSUInteger)aHashValue;
 
 @end
@@ -28,10 +28,16 @@
 #import "CTKTrieBitmapIndexedNode.h"
 #import "CTKTrieLeafNode.h"
 
+#include <objc/runtime.h>
+#include <stdlib.h>
+#include <libkern/OSAtomic.h>
+
+typedef BOOL (*CTKIsEqualIMP)(id, SEL, id);
+
 @interface CTKTrieHashCollisionNode ()
 
-@property (readwrite, retain) NSArray *leaves;
 @property (readwrite, assign) NSUInteger hashValue;
+@property (readwrite, assign) NSUInteger count;
 
 @end
 
@@ -41,18 +47,44 @@
 
 + (id) hashCollisionNodeWithLeaves:(NSArray *)anArray hash:(NSUInteger)aHashValue
 {
-	return [[[CTKTrieHashCollisionNode alloc] initWithLeaves:anArray 
-												   hash:aHashValue] autorelease];
+	return [[self newHashCollisionNodeWithLeaves:anArray hash:aHashValue] autorelease];
+}
+
++ (id) newHashCollisionNodeWithLeaves:(NSArray *)anArray hash:(NSUInteger)aHashValue
+{
+	return [[CTKTrieHashCollisionNode alloc] initWithLeaves:anArray hash:aHashValue];
 }
 
 - (id) initWithLeaves:(NSArray *)anArray hash:(NSUInteger)aHashValue
 {
-	//NSLog(@"+++ [%@] %s.\nCalled with array:%@ hash:%U", [self class], _cmd, anArray, aHashValue);
+	NSUInteger cnt = [anArray count];
+	CTKTrieLeafNode **someLeaves = malloc(sizeof(CTKTrieLeafNode *) * MAX(cnt, 1));
+	
+	[anArray getObjects:(id *)someLeaves range:NSMakeRange(0, cnt)];
+	self = [self initWithLeaves:someLeaves count:cnt hash:aHashValue];
+	free(someLeaves);
+	
+	return self;
+}
+
+- (id) initWithLeaves:(CTKTrieLeafNode * const *)someLeaves count:(NSUInteger)aCount hash:(NSUInteger)aHashValue
+{
+	//NSLog(@"+++ [%@] %s.\nCalled with count:%U hash:%U", [self class], _cmd, aCount, aHashValue);
 	self = [super init];
 	
 	if(self != nil){
-		self.leaves = anArray;
+		
 		self.hashValue = aHashValue;
+		self.count = aCount;
+		
+		// One block for both arrays, the keys are what lookups scan
+		keys = malloc((sizeof(id) + sizeof(CTKTrieLeafNode *)) * MAX(aCount, 1));
+		leafArray = (CTKTrieLeafNode **)(keys + MAX(aCount, 1));
+		
+		for (NSUInteger i = 0; i < aCount; i++) {
+			leafArray[i] = [someLeaves[i] retain];
+			keys[i] = someLeaves[i].key;
+		}
 	}
 	
 	return self;
@@ -60,14 +92,28 @@
 
 - (void) dealloc
 {
-	[leaves release];
+	for (NSUInteger i = 0; i < count; i++)
+		[leafArray[i] release];
+	
+	free(keys);
 	[super dealloc];
 }
 
 
 #pragma mark Properties
 
-@synthesize hashValue, leaves;
+@synthesize hashValue, count;
+
+- (NSArray *) leaves
+{
+	return [NSArray arrayWithObjects:(id *)leafArray count:self.count];
+}
+
+- (CTKTrieLeafNode *) leafAtIndex:(NSUInteger)anIndex
+{
+	NSParameterAssert(anIndex < count);
+	return leafArray[anIndex];
+}
 
 
 #pragma mark Operations
@@ -78,17 +124,17 @@
 	NSUInteger idx = [self indexOfObjectForKey:aKey hash:aHashValue];
 	
 	if(idx != NSNotFound)
-		return [self.leaves objectAtIndex:idx];
+		return leafArray[idx];
 	
 	return nil;
 	
 }
 
-- (id <CTKTrieNode>) setObject:(id)anObject 
-						forKey:(id)aKey 
-						 shift:(NSUInteger)aShiftValue 
-						  hash:(NSUInteger)aHashValue
-					 addedLeaf:(CTKTrieLeafNode **)aLeaf
+- (id <CTKTrieNode>) newNodeBySettingObject:(id)anObject 
+									 forKey:(id)aKey 
+									  shift:(NSUInteger)aShiftValue 
+									   hash:(NSUInteger)aHashValue
+								  addedLeaf:(CTKTrieLeafNode **)aLeaf
 {
 	
 	//NSLog(@"+++ [%@] %s.\nCalled with object:%@ key:%@ shift:%U hash:%U", [self class], _cmd, anObject, aKey, aShiftValue, aHashValue);
@@ -96,69 +142,118 @@
 	if(aHashValue == self.hashValue){
 		
 		NSUInteger idx = [self indexOfObjectForKey:aKey hash:aHashValue];
-		NSMutableArray *newLeaves = [NSMutableArray arrayWithArray:self.leaves];
-		CTKTrieLeafNode *newLeaf = [CTKTrieLeafNode leafNodeWithObject:anObject forKey:aKey hash:aHashValue];
+		CTKTrieLeafNode *newLeaf;
+		CTKTrieHashCollisionNode *newNode;
+		CTKTrieLeafNode **newLeaves = malloc(sizeof(CTKTrieLeafNode *) * (count + 1));
+		
+		memcpy(newLeaves, leafArray, sizeof(CTKTrieLeafNode *) * count);
 		
 		//note  - do not set addedLeaf yet, since we might be replacing
 		
 		if(idx != NSNotFound){
 			
-			if([[[self.leaves objectAtIndex:idx] object] isEqual:anObject])
-				return self;
+			if(leafArray[idx].object == anObject || [leafArray[idx].object isEqual:anObject]){
+				free(newLeaves);
+				return [self retain];
+			}
 			
-			[newLeaves replaceObjectAtIndex:idx withObject:newLeaf];
-			return [CTKTrieHashCollisionNode hashCollisionNodeWithLeaves:newLeaves hash:aHashValue];
+			newLeaf = [CTKTrieLeafNode newLeafNodeWithObject:anObject forKey:aKey hash:aHashValue];
+			newLeaves[idx] = newLeaf;
+			newNode = [[CTKTrieHashCollisionNode alloc] initWithLeaves:newLeaves count:count hash:aHashValue];
+			free(newLeaves);
+			[newLeaf release];
+			
+			return newNode;
 		}
 		
-		[newLeaves addObject:newLeaf];
+		newLeaf = [CTKTrieLeafNode newLeafNodeWithObject:anObject forKey:aKey hash:aHashValue];
+		newLeaves[count] = newLeaf;
+		newNode = [[CTKTrieHashCollisionNode alloc] initWithLeaves:newLeaves count:count + 1 hash:aHashValue];
+		free(newLeaves);
+		[newLeaf release];
 		
 		if(aLeaf != NULL)
 			*aLeaf = newLeaf;
 		
-		return [CTKTrieHashCollisionNode hashCollisionNodeWithLeaves:newLeaves hash:aHashValue];
+		return newNode;
 		
 	}
 	
-	return [CTKTrieBitmapIndexedNode nodeWithObject:anObject
-										forKey:aKey
-										branch:self
-										 shift:aShiftValue
-										  hash:aHashValue
-									 addedLeaf:aLeaf];
+	return [CTKTrieBitmapIndexedNode newNodeWithObject:anObject
+												forKey:aKey
+												branch:self
+												 shift:aShiftValue
+												  hash:aHashValue
+											 addedLeaf:aLeaf];
 }
 
-- (id <CTKTrieNode>) removeObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
+- (id <CTKTrieNode>) newNodeByRemovingObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
 {
 	
 	NSUInteger idx = [self indexOfObjectForKey:aKey hash:aHashValue];
 	
 	if(idx == NSNotFound)
-		return self;
+		return [self retain];
+	
+	if(count == 2)
+		return [((idx == 0) ? leafArray[1] : leafArray[0]) retain];
 	
-	if([self.leaves count] == 2)
-		return (idx == 0) ? [self.leaves objectAtIndex:1] : [self.leaves objectAtIndex:0];
+	CTKTrieLeafNode **newLeaves = malloc(sizeof(CTKTrieLeafNode *) * (count - 1));
 	
-	NSMutableArray *newLeaves = [NSMutableArray arrayWithArray:self.leaves];
-	[newLeaves removeObjectAtIndex:idx];
+	memcpy(newLeaves, leafArray, sizeof(CTKTrieLeafNode *) * idx);
+	memcpy(newLeaves + idx, leafArray + idx + 1, sizeof(CTKTrieLeafNode *) * (count - idx - 1));
 	
-	return [CTKTrieHashCollisionNode hashCollisionNodeWithLeaves:newLeaves hash:aHashValue];
+	CTKTrieHashCollisionNode *newNode = [[CTKTrieHashCollisionNode alloc] initWithLeaves:newLeaves count:count - 1 hash:aHashValue];
+	
+	free(newLeaves);
+	
+	return newNode;
 	
 }
 
 
 - (NSUInteger) indexOfObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
 {
-	NSUInteger idx = 0;
+	// All the leaves share the node hash
+	if(aHashValue != self.hashValue)
+		return NSNotFound;
 	
-	for(id leaf in self.leaves){
+	for(NSUInteger idx = 0; idx < count; idx++){
 		
-		if([leaf objectForKey:aKey hash:aHashValue] != nil)
+		if(keys[idx] == aKey)
 			return idx;
+	}
+	
+	if(aKey == nil)
+		return NSNotFound;
+	
+	SEL isEqualSelector = @selector(isEqual:);
+	CTKIsEqualIMP isEqual = (CTKIsEqualIMP)class_getMethodImplementation(object_getClass(aKey), isEqualSelector);
+	
+	for(NSUInteger idx = 0; idx < count; idx++){
 		
-		idx++;
+		if(keys[idx] != nil && isEqual(aKey, isEqualSelector, keys[idx]))
+			return idx;
 	}
 	
 	return NSNotFound;
 }
 
+- (NSUInteger) contentHash
+{
+	if(!hasContentHash){
+		
+		NSUInteger hash = 0;
+		
+		for(NSUInteger idx = 0; idx < count; idx++)
+			hash += [leafArray[idx] contentHash];
+		
+		contentHash = hash;
+		OSMemoryBarrier();
+		hasContentHash = YES;
+	}
+	
+	return contentHash;
+}
+
 @end
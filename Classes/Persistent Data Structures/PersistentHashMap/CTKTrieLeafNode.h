@@ -31,10 +31,17 @@
 
 @interface CTKTrieLeafNode : CTKPersistentHashMapEntry <CTKTrieNode> {
 	NSUInteger hashValue;
+	NSUInteger contentHash;
+	volatile BOOL hasContentHash;
 }
 
 + (id) leafNodeWithObject:(id)anObject forKey:(id)aKey hash:(NSUInteger)aHashValue;
 
+/**
+ * \brief Like leafNodeWithObject:forKey:hash: but the caller owns the leaf, used by the trie internals.
+ */
++ (id) newLeafNodeWithObject:(id)anObject forKey:(id)aKey hash:(NSUInteger)aHashValue;
+
 - (id) initWithObject:(id)anObject forKey:(id)aKey hash:(NSUInteger)aHashValue;
 
 
@@ -27,6 +27,7 @@
 #import "CTKTrieLeafNode.h"
 #import "CTKTrieHashCollisionNode.h"
 #import "CTKTrieBitmapIndexedNode.h"
+#include <libkern/OSAtomic.h>
 
 @interface CTKTrieLeafNode ()
 
@@ -38,7 +39,12 @@
 
 + (id) leafNodeWithObject:(id)anObject forKey:(id)aKey hash:(NSUInteger)aHashValue
 {
-	return [[[CTKTrieLeafNode alloc] initWithObject:anObject forKey:aKey hash:aHashValue] autorelease];
+	return [[self newLeafNodeWithObject:anObject forKey:aKey hash:aHashValue] autorelease];
+}
+
++ (id) newLeafNodeWithObject:(id)anObject forKey:(id)aKey hash:(NSUInteger)aHashValue
+{
+	return [[CTKTrieLeafNode alloc] initWithObject:anObject forKey:aKey hash:aHashValue];
 }
 
 - (id) initWithObject:(id)anObject forKey:(id)aKey hash:(NSUInteger)aHashValue
@@ -68,11 +74,11 @@
 	return nil;
 }
 
-- (id <CTKTrieNode>) setObject:(id)anObject 
-						forKey:(id)aKey 
-						 shift:(NSUInteger)aShiftValue 
-						  hash:(NSUInteger)aHashValue
-					 addedLeaf:(CTKTrieLeafNode **)aLeaf
+- (id <CTKTrieNode>) newNodeBySettingObject:(id)anObject 
+									 forKey:(id)aKey 
+									  shift:(NSUInteger)aShiftValue 
+									   hash:(NSUInteger)aHashValue
+								  addedLeaf:(CTKTrieLeafNode **)aLeaf
 {	
 	//NSLog(@"+++ [%@] %s.\nCalled with object:%@ key:%@ shift:%U hash:%U", [self class], _cmd, anObject, aKey, aShiftValue, aHashValue);
 	
@@ -82,8 +88,8 @@
 		
 		if([aKey isEqual:self.key]){
 			
-			if([anObject isEqual:self.object])
-				return self;
+			if(anObject == self.object || [anObject isEqual:self.object])
+				return [self retain];
 			
 			/* 
 			 We do not set aLeaf, since I am replacing myself with a new leaf node containing
@@ -92,7 +98,7 @@
 			
 			//NSLog(@"+++ [%@] %s.\nWill return a replacement leaf", [self class], _cmd);
 			
-			return [CTKTrieLeafNode leafNodeWithObject:anObject forKey:aKey hash:aHashValue];
+			return [CTKTrieLeafNode newLeafNodeWithObject:anObject forKey:aKey hash:aHashValue];
 		}
 		
 		else {
@@ -102,36 +108,50 @@
 			 I will replace myself with a hash collision node.
 			 */
 			
-			CTKTrieLeafNode *newLeaf = [CTKTrieLeafNode leafNodeWithObject:anObject forKey:aKey hash:aHashValue];
+			CTKTrieLeafNode *newLeaf = [CTKTrieLeafNode newLeafNodeWithObject:anObject forKey:aKey hash:aHashValue];
+			CTKTrieLeafNode *leaves[2] = { self, newLeaf };
 			
 			if(aLeaf != NULL)
 				*aLeaf = newLeaf;
 			
-			NSArray *leaves = [NSArray arrayWithObjects:self, newLeaf, nil];
+			CTKTrieHashCollisionNode *newNode = [[CTKTrieHashCollisionNode alloc] initWithLeaves:leaves 
+																						   count:2 
+																							hash:aHashValue];
+			[newLeaf release];
 			
-			return [CTKTrieHashCollisionNode hashCollisionNodeWithLeaves:leaves 
-																	hash:aHashValue];
+			return newNode;
 		}
 	}
 		
 	/* 
 	 This is a new entry so I will replace myself with a bitmap node 
 	 */
-	return [CTKTrieBitmapIndexedNode nodeWithObject:anObject
-											 forKey:aKey
-											 branch:self
-											  shift:aShiftValue 
-											   hash:aHashValue
-										  addedLeaf:aLeaf];
+	return [CTKTrieBitmapIndexedNode newNodeWithObject:anObject
+												forKey:aKey
+												branch:self
+												 shift:aShiftValue 
+												  hash:aHashValue
+											 addedLeaf:aLeaf];
 	
 }
 
-- (id <CTKTrieNode>) removeObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
+- (id <CTKTrieNode>) newNodeByRemovingObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
 {
 	if(aHashValue == [self hashValue] && [self.key isEqual:aKey])
 		return nil;
 	
-	return self;
+	return [self retain];
+}
+
+- (NSUInteger) contentHash
+{
+	if(!hasContentHash){
+		contentHash = CTKTrieEntryHash(self.key, self.object);
+		OSMemoryBarrier();
+		hasContentHash = YES;
+	}
+	
+	return contentHash;
 }
 
 @end
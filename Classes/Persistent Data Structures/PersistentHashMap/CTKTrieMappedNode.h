@@ -0,0 +1,56 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "CTKTrieNode.h"
+@class CTKPersistentHashMapSnapshot;
+
+/*
+ A trie node still living in a CTKPersistentHashMapSnapshot mapping.
+ 
+ Lookups go straight through the mapped records. Setting or removing a key first materializes this node only,
+ its children stay mapped, so a modified version of a loaded map only allocates the nodes along the modified path.
+ */
+@interface CTKTrieMappedNode : NSObject <CTKTrieNode> {
+	@private
+	CTKPersistentHashMapSnapshot *snapshot;
+	uint64_t offset;
+	NSUInteger hashValue;
+}
+
+@property (readonly, retain, nonatomic) CTKPersistentHashMapSnapshot *snapshot;
+@property (readonly, assign, nonatomic) uint64_t offset;
+
++ (id) mappedNodeWithSnapshot:(CTKPersistentHashMapSnapshot *)aSnapshot offset:(uint64_t)anOffset;
+
+- (id) initWithSnapshot:(CTKPersistentHashMapSnapshot *)aSnapshot offset:(uint64_t)anOffset;
+
+/**
+ * \return The equivalent in memory node, its children are CTKTrieMappedNode(s).
+ */
+- (id <CTKTrieNode>) materializedNode;
+
+@end
@@ -0,0 +1,120 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKTrieMappedNode.h"
+#import "CTKPersistentHashMapSnapshot.h"
+#import "CTKTrieLeafNode.h"
+
+@interface CTKTrieMappedNode ()
+
+@property (readwrite, retain, nonatomic) CTKPersistentHashMapSnapshot *snapshot;
+@property (readwrite, assign, nonatomic) uint64_t offset;
+@property (readwrite, assign) NSUInteger hashValue;
+
+@end
+
+
+@implementation CTKTrieMappedNode
+
+#pragma mark Initialization
+
++ (id) mappedNodeWithSnapshot:(CTKPersistentHashMapSnapshot *)aSnapshot offset:(uint64_t)anOffset
+{
+	return [[[CTKTrieMappedNode alloc] initWithSnapshot:aSnapshot offset:anOffset] autorelease];
+}
+
+- (id) initWithSnapshot:(CTKPersistentHashMapSnapshot *)aSnapshot offset:(uint64_t)anOffset
+{
+	NSParameterAssert(aSnapshot);
+	
+	self = [super init];
+	
+	if (self != nil) {
+		self.snapshot = aSnapshot;
+		self.offset = anOffset;
+		self.hashValue = [aSnapshot hashValueOfNodeAtOffset:anOffset];
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[snapshot release];
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize snapshot, offset, hashValue;
+
+#pragma mark CTKTrieNode protocol
+
+- (id <CTKTrieNode>) materializedNode
+{
+	return [self.snapshot nodeAtOffset:self.offset];
+}
+
+- (CTKTrieLeafNode *) objectForKey:(id)aKey hash:(NSUInteger)aHashValue
+{
+	return [self.snapshot leafForKey:aKey hash:aHashValue nodeOffset:self.offset];
+}
+
+- (id <CTKTrieNode>) newNodeBySettingObject:(id)anObject 
+									 forKey:(id)aKey 
+									  shift:(NSUInteger)aShiftValue 
+									   hash:(NSUInteger)aHashValue
+								  addedLeaf:(CTKTrieLeafNode **)aLeaf
+{
+	/*
+	 Callers compare the returned node with the receiver to detect a no-op, we check it here so that
+	 we do not materialize (and copy the path to) a node that does not change.
+	 */
+	CTKTrieLeafNode *existing = [self objectForKey:aKey hash:aHashValue];
+	
+	if (existing != nil && (existing.object == anObject || [existing.object isEqual:anObject]))
+		return [self retain];
+	
+	return [[self materializedNode] newNodeBySettingObject:anObject forKey:aKey shift:aShiftValue hash:aHashValue addedLeaf:aLeaf];
+}
+
+- (id <CTKTrieNode>) newNodeByRemovingObjectForKey:(id)aKey hash:(NSUInteger)aHashValue
+{
+	if ([self objectForKey:aKey hash:aHashValue] == nil)
+		return [self retain];
+	
+	return [[self materializedNode] newNodeByRemovingObjectForKey:aKey hash:aHashValue];
+}
+
+/*
+ Stored in the record by the writer, hashing a loaded map does not decode it.
+ */
+- (NSUInteger) contentHash
+{
+	return [self.snapshot contentHashOfNodeAtOffset:self.offset];
+}
+
+@end
@@ -72,7 +72,38 @@ static NSUInteger CTKTrieNodeBitpos(NSUInteger hashValue, NSUInteger shiftValue)
 // The index of a child is the number of 1’s to the right of the child’s bitpos in the bit map
 static NSUInteger CTKTrieNodeIndex(NSUInteger bitmap, NSUInteger bit)
 {
-	return CTKBitCount(bitmap & (bit - 1));	
+	return CTKBitCount(bitmap & (bit - 1));
+}
+
+/*
+ The 64-bit finalizer of MurmurHash3 (fmix64). Every key hash goes through it before entering the trie: many
+ Foundation hashes only vary in a few bits (sequential NSNumbers, NSString hashes sampling a few characters), the
+ finalizer spreads them over all the 6 bit chunks so that the trie stays shallow and balanced.
+ The seed is folded in first, with a secret seed the chunk each key lands in cannot be predicted by whoever
+ chooses the keys. Keys whose -hash are equal still collide, whatever the seed.
+ */
+static NSUInteger CTKTrieNodeMixHash(NSUInteger hashValue, NSUInteger seed)
+{
+	uint64_t h = (uint64_t)hashValue ^ (uint64_t)seed;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return (NSUInteger)h;
+}
+
+/*
+ The contribution of one entry to a contentHash. It uses the raw -hash of the key, not the seeded one stored in 
+ the leaves, so that maps with different seeds but equal entries hash alike. Contributions are added, the order
+ of the entries and the shape of the trie do not matter.
+ */
+static NSUInteger CTKTrieEntryHash(id aKey, id anObject)
+{
+	return CTKTrieNodeMixHash((aKey != nil) ? [aKey hash] : 0, 0) 
+		^ CTKTrieNodeMixHash((anObject != nil) ? [anObject hash] : 0, (NSUInteger)0x9e3779b97f4a7c15ULL);
 }
 
 static NSString * CTKNSUIntegerToBinFormat(NSUInteger value)
@@ -120,9 +151,10 @@ static NSString * CTKNSUIntegerToBinFormat(NSUInteger value)
 - (CTKTrieLeafNode *) objectForKey:(id)aKey hash:(NSUInteger)aHashValue;
 
 /*!
-    @method     setObject:forKey:shift:hash:addedLeaf:
+    @method     newNodeBySettingObject:forKey:shift:hash:addedLeaf:
     @abstract   Corresponds to the Clojure assoc method
-    @discussion <#(comprehensive description)#>
+    @discussion The caller owns the returned node, which is the receiver retained when nothing changed. No node built 
+				along the way goes through the autorelease pool.
     @param      anObject <#(description)#>
     @param      aKey <#(description)#>
     @param      aShiftValue <#(description)#>
@@ -130,21 +162,30 @@ static NSString * CTKNSUIntegerToBinFormat(NSUInteger value)
     @param      aLeaf <#(description)#>
     @result     <#(description)#>
 */
-- (id <CTKTrieNode>) setObject:(id)anObject 
-						forKey:(id)aKey 
-						 shift:(NSUInteger)aShiftValue 
-						  hash:(NSUInteger)aHashValue
-					 addedLeaf:(CTKTrieLeafNode **)aLeaf;
+- (id <CTKTrieNode>) newNodeBySettingObject:(id)anObject 
+									 forKey:(id)aKey 
+									  shift:(NSUInteger)aShiftValue 
+									   hash:(NSUInteger)aHashValue
+								  addedLeaf:(CTKTrieLeafNode **)aLeaf;
 
 /*!
-    @method     removeObjectForKey:hash:
+    @method     newNodeByRemovingObjectForKey:hash:
     @abstract   Corresponds to the Clojure without method
-    @discussion <#(comprehensive description)#>
+    @discussion The caller owns the returned node, nil when the last entry was removed.
     @param      aKey <#(description)#>
     @param      aHashValue <#(description)#>
     @result     <#(description)#>
 */
-- (id <CTKTrieNode>) removeObjectForKey:(id)aKey hash:(NSUInteger)aHashValue;
+- (id <CTKTrieNode>) newNodeByRemovingObjectForKey:(id)aKey hash:(NSUInteger)aHashValue;
+
+/*!
+    @method     contentHash
+    @abstract   Sum of the CTKTrieEntryHash of the entries under this node.
+    @discussion Nodes are immutable so it is computed on first use and cached, a new version of a map only computes it 
+				for the nodes along the modified path and reuses the cached values of the shared subtrees.
+    @result     The same value for any two nodes holding the same entries.
+*/
+- (NSUInteger) contentHash;
 
 
 @end
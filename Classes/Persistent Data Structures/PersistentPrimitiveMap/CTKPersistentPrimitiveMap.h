@@ -0,0 +1,146 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#import <Cocoa/Cocoa.h>
+@class CTKPersistentHashMap;
+
+/*
+ * \class CTKPersistentInt64Map CTKPersistentPrimitiveMap.h
+ * \brief A persistent hash map keyed by int64_t, without boxing the keys.
+ * \details Same semantics as CTKPersistentHashMap: every update returns a new map sharing the unchanged nodes with the
+ * receiver, which is left untouched. The trie is a C++ template (CTKPrimitiveTrie.h) whose leaves store the key inline,
+ * lookups hash the key with an inline function and compare it with ==, the only message sent is to compare values on
+ * updates. A leaf is a single 32 byte allocation, against an NSNumber and a CTKTrieLeafNode in the generic map.
+ */
+@interface CTKPersistentInt64Map : NSObject {
+	@private
+	void *root; // ctk::PrimitiveNode
+	NSUInteger count;
+	NSUInteger seed;
+}
+
+@property (readonly, assign) NSUInteger count;
+@property (readonly, assign) NSUInteger seed;
+
++ (id) emptyMap;
+
++ (id) emptyMapWithSeed:(NSUInteger)aSeed;
+
+/**
+ * \brief A map holding the entries of aMap, whose keys must be NSNumber(s) (longLongValue is used).
+ * \return nil if a key of aMap is not an NSNumber.
+ * \attention NSNumber(s) with the same longLongValue (e.g. @1 and @1.5) are the same key, count may then be lower.
+ */
++ (id) mapWithHashMap:(CTKPersistentHashMap *)aMap;
+
+- (id) objectForKey:(int64_t)aKey;
+
+- (BOOL) containsObjectForKey:(int64_t)aKey;
+
+- (CTKPersistentInt64Map *) mapBySettingObject:(id)anObject forKey:(int64_t)aKey;
+
+- (CTKPersistentInt64Map *) mapByRemovingObjectForKey:(int64_t)aKey;
+
+/**
+ * \brief Like mapBySettingObject:forKey: but the caller owns the result (the receiver retained if nothing changed).
+ */
+- (CTKPersistentInt64Map *) newMapBySettingObject:(id)anObject forKey:(int64_t)aKey;
+
+- (CTKPersistentInt64Map *) newMapByRemovingObjectForKey:(int64_t)aKey;
+
+- (void) enumerateKeysAndObjectsUsingBlock:(void (^)(int64_t aKey, id anObject, BOOL *stop))aBlock;
+
+/**
+ * \return A CTKPersistentHashMap with the same seed holding the entries, keys boxed as NSNumber(s).
+ */
+- (CTKPersistentHashMap *) persistentHashMap;
+
+/**
+ * \return The bytes allocated by the trie, values excluded.
+ */
+- (size_t) trieBytes;
+
+@end
+
+#pragma mark -
+
+/*
+ * \class CTKPersistentUTF8Map CTKPersistentPrimitiveMap.h
+ * \brief A persistent hash map keyed by UTF-8 byte strings, see CTKPersistentInt64Map.
+ * \details The bytes of each key are copied right after its leaf, in the same allocation. Keys are compared bytewise:
+ * differently normalized NSString(s) that are isEqual: are different keys here.
+ */
+@interface CTKPersistentUTF8Map : NSObject {
+	@private
+	void *root; // ctk::PrimitiveNode
+	NSUInteger count;
+	NSUInteger seed;
+}
+
+@property (readonly, assign) NSUInteger count;
+@property (readonly, assign) NSUInteger seed;
+
++ (id) emptyMap;
+
++ (id) emptyMapWithSeed:(NSUInteger)aSeed;
+
+/**
+ * \brief A map holding the entries of aMap, whose keys must be NSString(s).
+ * \return nil if a key of aMap is not an NSString.
+ */
++ (id) mapWithHashMap:(CTKPersistentHashMap *)aMap;
+
+- (id) objectForKey:(const char *)someBytes length:(NSUInteger)aLength;
+
+/**
+ * \param aString A NUL terminated UTF-8 string.
+ */
+- (id) objectForUTF8String:(const char *)aString;
+
+- (BOOL) containsObjectForKey:(const char *)someBytes length:(NSUInteger)aLength;
+
+- (CTKPersistentUTF8Map *) mapBySettingObject:(id)anObject forKey:(const char *)someBytes length:(NSUInteger)aLength;
+
+- (CTKPersistentUTF8Map *) mapBySettingObject:(id)anObject forUTF8String:(const char *)aString;
+
+- (CTKPersistentUTF8Map *) mapByRemovingObjectForKey:(const char *)someBytes length:(NSUInteger)aLength;
+
+- (CTKPersistentUTF8Map *) newMapBySettingObject:(id)anObject forKey:(const char *)someBytes length:(NSUInteger)aLength;
+
+- (CTKPersistentUTF8Map *) newMapByRemovingObjectForKey:(const char *)someBytes length:(NSUInteger)aLength;
+
+/**
+ * \details someBytes are NUL terminated and only valid during the call.
+ */
+- (void) enumerateKeysAndObjectsUsingBlock:(void (^)(const char *someBytes, NSUInteger aLength, id anObject, BOOL *stop))aBlock;
+
+/**
+ * \return A CTKPersistentHashMap with the same seed holding the entries, keys as NSString(s).
+ */
+- (CTKPersistentHashMap *) persistentHashMap;
+
+- (size_t) trieBytes;
+
+@end
@@ -0,0 +1,456 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#import "CTKPersistentPrimitiveMap.h"
+#import "CTKPersistentHashMap.h"
+#import "CTKPrimitiveTrie.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef ctk::PrimitiveTrie<ctk::Int64KeyTraits> CTKInt64Trie;
+typedef ctk::PrimitiveTrie<ctk::UTF8KeyTraits> CTKUTF8Trie;
+
+/*
+ The caller owns the returned root, which is aRoot retained when nothing changed.
+ */
+template <class Trie>
+static ctk::PrimitiveNode *CTKPrimitiveMapSet(void *aRoot, NSUInteger aSeed, const typename Trie::Key &aKey, id anObject, bool *added)
+{
+	NSUInteger hash = Trie::KeyTraits::hash(aKey, aSeed);
+	
+	return Trie::assoc((ctk::PrimitiveNode *)aRoot, 0, hash, aKey, anObject, added);
+}
+
+template <class Trie>
+static ctk::PrimitiveNode *CTKPrimitiveMapRemove(void *aRoot, NSUInteger aSeed, const typename Trie::Key &aKey, bool *removed)
+{
+	NSUInteger hash = Trie::KeyTraits::hash(aKey, aSeed);
+	
+	return Trie::dissoc((ctk::PrimitiveNode *)aRoot, 0, hash, aKey, removed);
+}
+
+template <class Trie>
+static typename Trie::Leaf *CTKPrimitiveMapFind(void *aRoot, NSUInteger aSeed, const typename Trie::Key &aKey)
+{
+	if (aRoot == NULL)
+		return NULL;
+	
+	return Trie::find((ctk::PrimitiveNode *)aRoot, aKey, Trie::KeyTraits::hash(aKey, aSeed));
+}
+
+#pragma mark -
+
+@interface CTKPersistentInt64Map ()
+
+- (id) initWithRoot:(void *)aRoot count:(NSUInteger)aCount seed:(NSUInteger)aSeed;
+
+@end
+
+@interface CTKPersistentUTF8Map ()
+
+- (id) initWithRoot:(void *)aRoot count:(NSUInteger)aCount seed:(NSUInteger)aSeed;
+
+@end
+
+/*
+ The code shared by both maps, aClass is the map class and aKeyFunction converts the keys of aMap, returning false for
+ a key it cannot convert. Returns nil if any key could not be converted.
+ */
+template <class Trie>
+static id CTKPrimitiveMapWithHashMap(Class aClass, CTKPersistentHashMap *aMap, bool (*aKeyFunction)(id, typename Trie::Key *))
+{
+	__block ctk::PrimitiveNode *newRoot = NULL;
+	__block NSUInteger newCount = 0;
+	__block bool converted = true;
+	NSUInteger aSeed = aMap.seed;
+	
+	// The new root is never shared until the map is returned, each step releases the previous one
+	[aMap enumerateKeysAndObjectsUsingBlock:^(id aKey, id anObject, BOOL *stop){
+		
+		typename Trie::Key key;
+		
+		if (!aKeyFunction(aKey, &key)) {
+			converted = false;
+			*stop = YES;
+			return;
+		}
+		
+		bool added = false;
+		ctk::PrimitiveNode *next = CTKPrimitiveMapSet<Trie>(newRoot, aSeed, key, anObject, &added);
+		
+		Trie::release(newRoot);
+		newRoot = next;
+		newCount += added ? 1 : 0;
+	}];
+	
+	if (!converted) {
+		Trie::release(newRoot);
+		return nil;
+	}
+	
+	return [[[aClass alloc] initWithRoot:newRoot count:newCount seed:aSeed] autorelease];
+}
+
+/*
+ The caller owns the returned map, which is aMap retained when nothing changed.
+ */
+template <class Trie>
+static id CTKPrimitiveMapNewBySetting(id aMap, void *aRoot, NSUInteger aCount, NSUInteger aSeed, const typename Trie::Key &aKey, id anObject)
+{
+	bool added = false;
+	ctk::PrimitiveNode *newRoot = CTKPrimitiveMapSet<Trie>(aRoot, aSeed, aKey, anObject, &added);
+	
+	if (newRoot == aRoot) {
+		Trie::release(newRoot);
+		return [aMap retain];
+	}
+	
+	return [[[aMap class] alloc] initWithRoot:newRoot count:aCount + (added ? 1 : 0) seed:aSeed];
+}
+
+template <class Trie>
+static id CTKPrimitiveMapNewByRemoving(id aMap, void *aRoot, NSUInteger aCount, NSUInteger aSeed, const typename Trie::Key &aKey)
+{
+	bool removed = false;
+	ctk::PrimitiveNode *newRoot = CTKPrimitiveMapRemove<Trie>(aRoot, aSeed, aKey, &removed);
+	
+	if (!removed) {
+		Trie::release(newRoot);
+		return [aMap retain];
+	}
+	
+	return [[[aMap class] alloc] initWithRoot:newRoot count:aCount - 1 seed:aSeed];
+}
+
+template <class Trie>
+struct CTKPrimitiveMapBoxingContext {
+	id *keys;
+	id *objects;
+	NSUInteger cursor;
+	id (*boxKey)(const typename Trie::Key &);
+};
+
+template <class Trie>
+static bool CTKPrimitiveMapBoxEntry(const typename Trie::Key &aKey, id anObject, void *aContext)
+{
+	CTKPrimitiveMapBoxingContext<Trie> *context = (CTKPrimitiveMapBoxingContext<Trie> *)aContext;
+	
+	context->keys[context->cursor] = context->boxKey(aKey);
+	context->objects[context->cursor] = anObject;
+	context->cursor++;
+	return true;
+}
+
+template <class Trie>
+static CTKPersistentHashMap *CTKPrimitiveMapHashMap(void *aRoot, NSUInteger aCount, NSUInteger aSeed, id (*aBoxFunction)(const typename Trie::Key &))
+{
+	CTKPrimitiveMapBoxingContext<Trie> context = {
+		(id *)malloc(sizeof(id) * (aCount + 1)), 
+		(id *)malloc(sizeof(id) * (aCount + 1)), 
+		0, 
+		aBoxFunction
+	};
+	
+	Trie::enumerate((ctk::PrimitiveNode *)aRoot, CTKPrimitiveMapBoxEntry<Trie>, &context);
+	
+	CTKPersistentHashMap *map = [CTKPersistentHashMap hashMapWithObjects:context.objects forKeys:context.keys count:context.cursor seed:aSeed];
+	
+	free(context.keys);
+	free(context.objects);
+	
+	return map;
+}
+
+#pragma mark Key specific functions
+
+static bool CTKInt64MapKey(id aKey, int64_t *aResult)
+{
+	// longLongValue would turn an NSString (or nil) into 0 and merge it with the other keys
+	if (![aKey isKindOfClass:[NSNumber class]])
+		return false;
+	
+	*aResult = (int64_t)[aKey longLongValue];
+	return true;
+}
+
+static id CTKInt64MapBoxKey(const int64_t &aKey)
+{
+	return [NSNumber numberWithLongLong:aKey];
+}
+
+static bool CTKUTF8MapKey(id aKey, ctk::UTF8Key *aResult)
+{
+	if (![aKey isKindOfClass:[NSString class]])
+		return false;
+	
+	aResult->bytes = [aKey UTF8String];
+	aResult->length = [aKey lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+	return true;
+}
+
+static id CTKUTF8MapBoxKey(const ctk::UTF8Key &aKey)
+{
+	return [[[NSString alloc] initWithBytes:aKey.bytes length:aKey.length encoding:NSUTF8StringEncoding] autorelease];
+}
+
+struct CTKPrimitiveMapBlockContext {
+	id block;
+	BOOL stop;
+};
+
+static bool CTKInt64MapCallBlock(const int64_t &aKey, id anObject, void *aContext)
+{
+	CTKPrimitiveMapBlockContext *context = (CTKPrimitiveMapBlockContext *)aContext;
+	((void (^)(int64_t, id, BOOL *))context->block)(aKey, anObject, &context->stop);
+	return !context->stop;
+}
+
+static bool CTKUTF8MapCallBlock(const ctk::UTF8Key &aKey, id anObject, void *aContext)
+{
+	CTKPrimitiveMapBlockContext *context = (CTKPrimitiveMapBlockContext *)aContext;
+	((void (^)(const char *, NSUInteger, id, BOOL *))context->block)(aKey.bytes, aKey.length, anObject, &context->stop);
+	return !context->stop;
+}
+
+#pragma mark -
+
+@implementation CTKPersistentInt64Map
+
+@synthesize count, seed;
+
++ (id) emptyMap
+{
+	return [self emptyMapWithSeed:0];
+}
+
++ (id) emptyMapWithSeed:(NSUInteger)aSeed
+{
+	return [[[CTKPersistentInt64Map alloc] initWithRoot:NULL count:0 seed:aSeed] autorelease];
+}
+
++ (id) mapWithHashMap:(CTKPersistentHashMap *)aMap
+{
+	return CTKPrimitiveMapWithHashMap<CTKInt64Trie>([CTKPersistentInt64Map class], aMap, CTKInt64MapKey);
+}
+
+/*
+ Takes ownership of aRoot.
+ */
+- (id) initWithRoot:(void *)aRoot count:(NSUInteger)aCount seed:(NSUInteger)aSeed
+{
+	self = [super init];
+	
+	if (self != nil) {
+		root = aRoot;
+		count = aCount;
+		seed = aSeed;
+	}
+	
+	else
+		CTKInt64Trie::release((ctk::PrimitiveNode *)aRoot);
+	
+	return self;
+}
+
+- (id) init
+{
+	return [self initWithRoot:NULL count:0 seed:0];
+}
+
+- (void) dealloc
+{
+	CTKInt64Trie::release((ctk::PrimitiveNode *)root);
+	[super dealloc];
+}
+
+- (id) objectForKey:(int64_t)aKey
+{
+	CTKInt64Trie::Leaf *leaf = CTKPrimitiveMapFind<CTKInt64Trie>(root, seed, aKey);
+	
+	return (leaf != NULL) ? leaf->value : nil;
+}
+
+- (BOOL) containsObjectForKey:(int64_t)aKey
+{
+	return CTKPrimitiveMapFind<CTKInt64Trie>(root, seed, aKey) != NULL;
+}
+
+- (CTKPersistentInt64Map *) mapBySettingObject:(id)anObject forKey:(int64_t)aKey
+{
+	return [[self newMapBySettingObject:anObject forKey:aKey] autorelease];
+}
+
+- (CTKPersistentInt64Map *) mapByRemovingObjectForKey:(int64_t)aKey
+{
+	return [[self newMapByRemovingObjectForKey:aKey] autorelease];
+}
+
+- (CTKPersistentInt64Map *) newMapBySettingObject:(id)anObject forKey:(int64_t)aKey
+{
+	return CTKPrimitiveMapNewBySetting<CTKInt64Trie>(self, root, count, seed, aKey, anObject);
+}
+
+- (CTKPersistentInt64Map *) newMapByRemovingObjectForKey:(int64_t)aKey
+{
+	return CTKPrimitiveMapNewByRemoving<CTKInt64Trie>(self, root, count, seed, aKey);
+}
+
+- (void) enumerateKeysAndObjectsUsingBlock:(void (^)(int64_t aKey, id anObject, BOOL *stop))aBlock
+{
+	CTKPrimitiveMapBlockContext context = { aBlock, NO };
+	
+	CTKInt64Trie::enumerate((ctk::PrimitiveNode *)root, CTKInt64MapCallBlock, &context);
+}
+
+- (CTKPersistentHashMap *) persistentHashMap
+{
+	return CTKPrimitiveMapHashMap<CTKInt64Trie>(root, count, seed, CTKInt64MapBoxKey);
+}
+
+- (size_t) trieBytes
+{
+	return CTKInt64Trie::bytes((ctk::PrimitiveNode *)root);
+}
+
+@end
+
+#pragma mark -
+
+@implementation CTKPersistentUTF8Map
+
+@synthesize count, seed;
+
++ (id) emptyMap
+{
+	return [self emptyMapWithSeed:0];
+}
+
++ (id) emptyMapWithSeed:(NSUInteger)aSeed
+{
+	return [[[CTKPersistentUTF8Map alloc] initWithRoot:NULL count:0 seed:aSeed] autorelease];
+}
+
++ (id) mapWithHashMap:(CTKPersistentHashMap *)aMap
+{
+	return CTKPrimitiveMapWithHashMap<CTKUTF8Trie>([CTKPersistentUTF8Map class], aMap, CTKUTF8MapKey);
+}
+
+/*
+ Takes ownership of aRoot.
+ */
+- (id) initWithRoot:(void *)aRoot count:(NSUInteger)aCount seed:(NSUInteger)aSeed
+{
+	self = [super init];
+	
+	if (self != nil) {
+		root = aRoot;
+		count = aCount;
+		seed = aSeed;
+	}
+	
+	else
+		CTKUTF8Trie::release((ctk::PrimitiveNode *)aRoot);
+	
+	return self;
+}
+
+- (id) init
+{
+	return [self initWithRoot:NULL count:0 seed:0];
+}
+
+- (void) dealloc
+{
+	CTKUTF8Trie::release((ctk::PrimitiveNode *)root);
+	[super dealloc];
+}
+
+- (id) objectForKey:(const char *)someBytes length:(NSUInteger)aLength
+{
+	ctk::UTF8Key key = { someBytes, aLength };
+	CTKUTF8Trie::Leaf *leaf = CTKPrimitiveMapFind<CTKUTF8Trie>(root, seed, key);
+	
+	return (leaf != NULL) ? leaf->value : nil;
+}
+
+- (id) objectForUTF8String:(const char *)aString
+{
+	return [self objectForKey:aString length:strlen(aString)];
+}
+
+- (BOOL) containsObjectForKey:(const char *)someBytes length:(NSUInteger)aLength
+{
+	ctk::UTF8Key key = { someBytes, aLength };
+	
+	return CTKPrimitiveMapFind<CTKUTF8Trie>(root, seed, key) != NULL;
+}
+
+- (CTKPersistentUTF8Map *) mapBySettingObject:(id)anObject forKey:(const char *)someBytes length:(NSUInteger)aLength
+{
+	return [[self newMapBySettingObject:anObject forKey:someBytes length:aLength] autorelease];
+}
+
+- (CTKPersistentUTF8Map *) mapBySettingObject:(id)anObject forUTF8String:(const char *)aString
+{
+	return [[self newMapBySettingObject:anObject forKey:aString length:strlen(aString)] autorelease];
+}
+
+- (CTKPersistentUTF8Map *) mapByRemovingObjectForKey:(const char *)someBytes length:(NSUInteger)aLength
+{
+	return [[self newMapByRemovingObjectForKey:someBytes length:aLength] autorelease];
+}
+
+- (CTKPersistentUTF8Map *) newMapBySettingObject:(id)anObject forKey:(const char *)someBytes length:(NSUInteger)aLength
+{
+	ctk::UTF8Key key = { someBytes, aLength };
+	
+	return CTKPrimitiveMapNewBySetting<CTKUTF8Trie>(self, root, count, seed, key, anObject);
+}
+
+- (CTKPersistentUTF8Map *) newMapByRemovingObjectForKey:(const char *)someBytes length:(NSUInteger)aLength
+{
+	ctk::UTF8Key key = { someBytes, aLength };
+	
+	return CTKPrimitiveMapNewByRemoving<CTKUTF8Trie>(self, root, count, seed, key);
+}
+
+- (void) enumerateKeysAndObjectsUsingBlock:(void (^)(const char *someBytes, NSUInteger aLength, id anObject, BOOL *stop))aBlock
+{
+	CTKPrimitiveMapBlockContext context = { aBlock, NO };
+	
+	CTKUTF8Trie::enumerate((ctk::PrimitiveNode *)root, CTKUTF8MapCallBlock, &context);
+}
+
+- (CTKPersistentHashMap *) persistentHashMap
+{
+	return CTKPrimitiveMapHashMap<CTKUTF8Trie>(root, count, seed, CTKUTF8MapBoxKey);
+}
+
+- (size_t) trieBytes
+{
+	return CTKUTF8Trie::bytes((ctk::PrimitiveNode *)root);
+}
+
+@end
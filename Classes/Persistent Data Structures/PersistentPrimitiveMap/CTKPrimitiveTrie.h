@@ -0,0 +1,563 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#ifndef CTK_PRIMITIVE_TRIE_H
+#define CTK_PRIMITIVE_TRIE_H
+
+#ifdef __cplusplus
+
+#import <Cocoa/Cocoa.h>
+#import "CTKTrieNode.h"
+#include <libkern/OSAtomic.h>
+#include <malloc/malloc.h>
+#include <alloca.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ The trie behind CTKPersistentInt64Map and CTKPersistentUTF8Map, included by Objective-C++ sources only.
+ 
+ Same 64 way hash array mapped trie as CTKPersistentHashMap but nodes are plain structs: keys are stored inline in the
+ leaves (UTF-8 bytes follow the leaf in the same allocation), hashed by an inline function of the key traits and compared
+ without a message send. Nodes are immutable and shared between versions, an atomic count tracks their owners. The only
+ Objective-C objects are the values, retained by their leaves.
+ 
+ Unlike CTKPersistentHashMap there are no full nodes, a branch is a bitmap and a packed array of children, and branches 
+ left with a single leaf or collision node are replaced by it.
+ */
+
+namespace ctk {
+	
+	enum {
+		CTKPrimitiveLeafKind = 0,
+		CTKPrimitiveBranchKind = 1,
+		CTKPrimitiveCollisionKind = 2
+	};
+	
+	struct PrimitiveNode {
+		volatile int32_t owners;
+		uint32_t kind;
+	};
+	
+	inline PrimitiveNode *PrimitiveNodeRetain(PrimitiveNode *aNode)
+	{
+		if (aNode != NULL)
+			OSAtomicIncrement32Barrier(&aNode->owners);
+		
+		return aNode;
+	}
+	
+	/*
+	 Keys by value, hashed by CTKTrieNodeMixHash like the keys of CTKPersistentHashMap.
+	 */
+	struct Int64KeyTraits {
+		typedef int64_t Key;
+		typedef int64_t Stored;
+		
+		static NSUInteger hash(Key aKey, NSUInteger aSeed) { return CTKTrieNodeMixHash((NSUInteger)aKey, aSeed); }
+		static bool equal(const Stored &stored, Key aKey) { return stored == aKey; }
+		static size_t extraBytes(Key aKey) { return 0; }
+		static void store(Stored *stored, Key aKey, void *extra) { *stored = aKey; }
+		static Key view(const Stored &stored) { return stored; }
+	};
+	
+	struct UTF8Key {
+		const char *bytes;
+		NSUInteger length;
+	};
+	
+	/*
+	 Bytes are hashed with 64 bit FNV-1a then mixed with the seed, the stored key points right after its leaf.
+	 */
+	struct UTF8KeyTraits {
+		typedef UTF8Key Key;
+		typedef UTF8Key Stored;
+		
+		static NSUInteger hash(const Key &aKey, NSUInteger aSeed)
+		{
+			uint64_t h = 0xcbf29ce484222325ULL;
+			
+			for (NSUInteger i = 0; i < aKey.length; i++) {
+				h ^= (uint8_t)aKey.bytes[i];
+				h *= 0x100000001b3ULL;
+			}
+			
+			return CTKTrieNodeMixHash((NSUInteger)h, aSeed);
+		}
+		
+		static bool equal(const Stored &stored, const Key &aKey) 
+		{
+			return stored.length == aKey.length && memcmp(stored.bytes, aKey.bytes, aKey.length) == 0;
+		}
+		
+		static size_t extraBytes(const Key &aKey) { return aKey.length + 1; }
+		
+		static void store(Stored *stored, const Key &aKey, void *extra)
+		{
+			memcpy(extra, aKey.bytes, aKey.length);
+			((char *)extra)[aKey.length] = '\0';
+			stored->bytes = (const char *)extra;
+			stored->length = aKey.length;
+		}
+		
+		static Key view(const Stored &stored) { return stored; }
+	};
+	
+	template <class Traits>
+	class PrimitiveTrie {
+		
+	public:
+		
+		typedef Traits KeyTraits;
+		typedef typename Traits::Key Key;
+		typedef typename Traits::Stored Stored;
+		
+		struct Leaf {
+			PrimitiveNode header;
+			NSUInteger hash;
+			id value;
+			Stored key;
+		};
+		
+		struct Branch {
+			PrimitiveNode header;
+			uint64_t bitmap;
+			uint32_t count;
+			PrimitiveNode *children[1];
+		};
+		
+		struct Collision {
+			PrimitiveNode header;
+			NSUInteger hash;
+			uint32_t count;
+			Leaf *leaves[1];
+		};
+		
+#pragma mark Lookup
+		
+		/*
+		 Iterative, no message is sent along the way.
+		 */
+		static Leaf *find(PrimitiveNode *aNode, const Key &aKey, NSUInteger aHash)
+		{
+			NSUInteger shift = 0;
+			
+			while (aNode != NULL) {
+				
+				if (aNode->kind == CTKPrimitiveLeafKind) {
+					Leaf *leaf = (Leaf *)aNode;
+					return (leaf->hash == aHash && Traits::equal(leaf->key, aKey)) ? leaf : NULL;
+				}
+				
+				if (aNode->kind == CTKPrimitiveCollisionKind) {
+					Collision *collision = (Collision *)aNode;
+					
+					if (collision->hash != aHash)
+						return NULL;
+					
+					for (uint32_t i = 0; i < collision->count; i++)
+						if (Traits::equal(collision->leaves[i]->key, aKey))
+							return collision->leaves[i];
+					
+					return NULL;
+				}
+				
+				Branch *branch = (Branch *)aNode;
+				uint64_t bit = (uint64_t)1 << CTKTrieNodeMask(aHash, shift);
+				
+				if ((branch->bitmap & bit) == 0)
+					return NULL;
+				
+				aNode = branch->children[CTKBitCount((NSUInteger)(branch->bitmap & (bit - 1)))];
+				shift += CTKTrieNodeShiftIncrement;
+			}
+			
+			return NULL;
+		}
+		
+#pragma mark Updates
+		
+		/*
+		 The caller owns the result, aNode retained when nothing changed.
+		 */
+		static PrimitiveNode *assoc(PrimitiveNode *aNode, NSUInteger shift, NSUInteger aHash, const Key &aKey, id aValue, bool *added)
+		{
+			if (aNode == NULL) {
+				*added = true;
+				return (PrimitiveNode *)newLeaf(aHash, aKey, aValue);
+			}
+			
+			if (aNode->kind == CTKPrimitiveLeafKind) {
+				
+				Leaf *leaf = (Leaf *)aNode;
+				
+				if (leaf->hash == aHash) {
+					
+					if (Traits::equal(leaf->key, aKey)) {
+						
+						if (leaf->value == aValue || [leaf->value isEqual:aValue])
+							return PrimitiveNodeRetain(aNode);
+						
+						return (PrimitiveNode *)newLeaf(aHash, aKey, aValue);
+					}
+					
+					Leaf *leaves[2] = { (Leaf *)PrimitiveNodeRetain(aNode), newLeaf(aHash, aKey, aValue) };
+					*added = true;
+					return (PrimitiveNode *)newCollision(aHash, leaves, 2);
+				}
+				
+				*added = true;
+				return pair(shift, PrimitiveNodeRetain(aNode), leaf->hash, (PrimitiveNode *)newLeaf(aHash, aKey, aValue), aHash);
+			}
+			
+			if (aNode->kind == CTKPrimitiveCollisionKind) {
+				
+				Collision *collision = (Collision *)aNode;
+				
+				if (collision->hash != aHash) {
+					*added = true;
+					return pair(shift, PrimitiveNodeRetain(aNode), collision->hash, (PrimitiveNode *)newLeaf(aHash, aKey, aValue), aHash);
+				}
+				
+				uint32_t count = collision->count;
+				Leaf **leaves = (Leaf **)alloca(sizeof(Leaf *) * (count + 1));
+				
+				for (uint32_t i = 0; i < count; i++) {
+					
+					if (Traits::equal(collision->leaves[i]->key, aKey)) {
+						
+						Leaf *leaf = collision->leaves[i];
+						
+						if (leaf->value == aValue || [leaf->value isEqual:aValue])
+							return PrimitiveNodeRetain(aNode);
+						
+						for (uint32_t j = 0; j < count; j++)
+							leaves[j] = (j == i) ? newLeaf(aHash, aKey, aValue) : (Leaf *)PrimitiveNodeRetain((PrimitiveNode *)collision->leaves[j]);
+						
+						return (PrimitiveNode *)newCollision(aHash, leaves, count);
+					}
+				}
+				
+				for (uint32_t j = 0; j < count; j++)
+					leaves[j] = (Leaf *)PrimitiveNodeRetain((PrimitiveNode *)collision->leaves[j]);
+				
+				leaves[count] = newLeaf(aHash, aKey, aValue);
+				*added = true;
+				
+				return (PrimitiveNode *)newCollision(aHash, leaves, count + 1);
+			}
+			
+			Branch *branch = (Branch *)aNode;
+			uint64_t bit = (uint64_t)1 << CTKTrieNodeMask(aHash, shift);
+			uint32_t index = (uint32_t)CTKBitCount((NSUInteger)(branch->bitmap & (bit - 1)));
+			
+			if (branch->bitmap & bit) {
+				
+				PrimitiveNode *child = branch->children[index];
+				PrimitiveNode *newChild = assoc(child, shift + CTKTrieNodeShiftIncrement, aHash, aKey, aValue, added);
+				
+				if (newChild == child) {
+					release(newChild);
+					return PrimitiveNodeRetain(aNode);
+				}
+				
+				return (PrimitiveNode *)copyBranch(branch, branch->bitmap, index, newChild, false);
+			}
+			
+			*added = true;
+			return (PrimitiveNode *)copyBranch(branch, branch->bitmap | bit, index, (PrimitiveNode *)newLeaf(aHash, aKey, aValue), true);
+		}
+		
+		/*
+		 The caller owns the result: aNode retained when the key is absent, NULL when the last entry was removed.
+		 */
+		static PrimitiveNode *dissoc(PrimitiveNode *aNode, NSUInteger shift, NSUInteger aHash, const Key &aKey, bool *removed)
+		{
+			if (aNode == NULL)
+				return NULL;
+			
+			if (aNode->kind == CTKPrimitiveLeafKind) {
+				
+				Leaf *leaf = (Leaf *)aNode;
+				
+				if (leaf->hash == aHash && Traits::equal(leaf->key, aKey)) {
+					*removed = true;
+					return NULL;
+				}
+				
+				return PrimitiveNodeRetain(aNode);
+			}
+			
+			if (aNode->kind == CTKPrimitiveCollisionKind) {
+				
+				Collision *collision = (Collision *)aNode;
+				uint32_t count = collision->count;
+				uint32_t found = count;
+				
+				if (collision->hash == aHash)
+					for (uint32_t i = 0; i < count && found == count; i++)
+						if (Traits::equal(collision->leaves[i]->key, aKey))
+							found = i;
+				
+				if (found == count)
+					return PrimitiveNodeRetain(aNode);
+				
+				*removed = true;
+				
+				if (count == 2)
+					return PrimitiveNodeRetain((PrimitiveNode *)collision->leaves[1 - found]);
+				
+				Leaf **leaves = (Leaf **)alloca(sizeof(Leaf *) * count);
+				uint32_t cursor = 0;
+				
+				for (uint32_t i = 0; i < count; i++)
+					if (i != found)
+						leaves[cursor++] = (Leaf *)PrimitiveNodeRetain((PrimitiveNode *)collision->leaves[i]);
+				
+				return (PrimitiveNode *)newCollision(aHash, leaves, count - 1);
+			}
+			
+			Branch *branch = (Branch *)aNode;
+			uint64_t bit = (uint64_t)1 << CTKTrieNodeMask(aHash, shift);
+			
+			if ((branch->bitmap & bit) == 0)
+				return PrimitiveNodeRetain(aNode);
+			
+			uint32_t index = (uint32_t)CTKBitCount((NSUInteger)(branch->bitmap & (bit - 1)));
+			PrimitiveNode *child = branch->children[index];
+			PrimitiveNode *newChild = dissoc(child, shift + CTKTrieNodeShiftIncrement, aHash, aKey, removed);
+			
+			if (newChild == child) {
+				release(newChild);
+				return PrimitiveNodeRetain(aNode);
+			}
+			
+			if (newChild == NULL) {
+				
+				if (branch->count == 1)
+					return NULL;
+				
+				// A single leaf or collision node left moves up, lookups compare full hashes at any depth
+				if (branch->count == 2 && branch->children[1 - index]->kind != CTKPrimitiveBranchKind)
+					return PrimitiveNodeRetain(branch->children[1 - index]);
+				
+				return (PrimitiveNode *)copyBranchRemoving(branch, bit, index);
+			}
+			
+			if (branch->count == 1 && newChild->kind != CTKPrimitiveBranchKind)
+				return newChild;
+			
+			return (PrimitiveNode *)copyBranch(branch, branch->bitmap, index, newChild, false);
+		}
+		
+		static void release(PrimitiveNode *aNode)
+		{
+			if (aNode == NULL || OSAtomicDecrement32Barrier(&aNode->owners) != 0)
+				return;
+			
+			if (aNode->kind == CTKPrimitiveLeafKind) {
+				[((Leaf *)aNode)->value release];
+			}
+			
+			else if (aNode->kind == CTKPrimitiveCollisionKind) {
+				Collision *collision = (Collision *)aNode;
+				for (uint32_t i = 0; i < collision->count; i++)
+					release((PrimitiveNode *)collision->leaves[i]);
+			}
+			
+			else {
+				Branch *branch = (Branch *)aNode;
+				for (uint32_t i = 0; i < branch->count; i++)
+					release(branch->children[i]);
+			}
+			
+			free(aNode);
+		}
+		
+#pragma mark Iteration
+		
+		/*
+		 Calls aFunction(key, value, context) for every entry until it returns false. Returns false if it was stopped.
+		 */
+		static bool enumerate(PrimitiveNode *aNode, bool (*aFunction)(const Key &, id, void *), void *context)
+		{
+			if (aNode == NULL)
+				return true;
+			
+			if (aNode->kind == CTKPrimitiveLeafKind) {
+				Leaf *leaf = (Leaf *)aNode;
+				return aFunction(Traits::view(leaf->key), leaf->value, context);
+			}
+			
+			if (aNode->kind == CTKPrimitiveCollisionKind) {
+				Collision *collision = (Collision *)aNode;
+				for (uint32_t i = 0; i < collision->count; i++)
+					if (!aFunction(Traits::view(collision->leaves[i]->key), collision->leaves[i]->value, context))
+						return false;
+				return true;
+			}
+			
+			Branch *branch = (Branch *)aNode;
+			
+			for (uint32_t i = 0; i < branch->count; i++)
+				if (!enumerate(branch->children[i], aFunction, context))
+					return false;
+			
+			return true;
+		}
+		
+		/*
+		 Bytes allocated by the nodes, values excluded.
+		 */
+		static size_t bytes(PrimitiveNode *aNode)
+		{
+			if (aNode == NULL)
+				return 0;
+			
+			size_t total = malloc_size(aNode);
+			
+			if (aNode->kind == CTKPrimitiveCollisionKind) {
+				Collision *collision = (Collision *)aNode;
+				for (uint32_t i = 0; i < collision->count; i++)
+					total += malloc_size(collision->leaves[i]);
+			}
+			
+			else if (aNode->kind == CTKPrimitiveBranchKind) {
+				Branch *branch = (Branch *)aNode;
+				for (uint32_t i = 0; i < branch->count; i++)
+					total += bytes(branch->children[i]);
+			}
+			
+			return total;
+		}
+		
+	private:
+		
+		static Leaf *newLeaf(NSUInteger aHash, const Key &aKey, id aValue)
+		{
+			size_t extra = Traits::extraBytes(aKey);
+			Leaf *leaf = (Leaf *)malloc(sizeof(Leaf) + extra);
+			
+			leaf->header.owners = 1;
+			leaf->header.kind = CTKPrimitiveLeafKind;
+			leaf->hash = aHash;
+			leaf->value = [aValue retain];
+			Traits::store(&leaf->key, aKey, (char *)leaf + sizeof(Leaf));
+			
+			return leaf;
+		}
+		
+		/*
+		 Takes ownership of someLeaves.
+		 */
+		static Collision *newCollision(NSUInteger aHash, Leaf **someLeaves, uint32_t aCount)
+		{
+			Collision *collision = (Collision *)malloc(offsetof(Collision, leaves) + sizeof(Leaf *) * aCount);
+			
+			collision->header.owners = 1;
+			collision->header.kind = CTKPrimitiveCollisionKind;
+			collision->hash = aHash;
+			collision->count = aCount;
+			memcpy(collision->leaves, someLeaves, sizeof(Leaf *) * aCount);
+			
+			return collision;
+		}
+		
+		static Branch *newBranch(uint64_t aBitmap, uint32_t aCount)
+		{
+			Branch *branch = (Branch *)malloc(offsetof(Branch, children) + sizeof(PrimitiveNode *) * aCount);
+			
+			branch->header.owners = 1;
+			branch->header.kind = CTKPrimitiveBranchKind;
+			branch->bitmap = aBitmap;
+			branch->count = aCount;
+			
+			return branch;
+		}
+		
+		/*
+		 Two owned nodes with different hashes under a new branch, nested as long as their chunks at shift agree.
+		 */
+		static PrimitiveNode *pair(NSUInteger shift, PrimitiveNode *aNode, NSUInteger aHash, PrimitiveNode *otherNode, NSUInteger otherHash)
+		{
+			NSUInteger mask = CTKTrieNodeMask(aHash, shift);
+			NSUInteger otherMask = CTKTrieNodeMask(otherHash, shift);
+			
+			if (mask == otherMask) {
+				Branch *branch = newBranch((uint64_t)1 << mask, 1);
+				branch->children[0] = pair(shift + CTKTrieNodeShiftIncrement, aNode, aHash, otherNode, otherHash);
+				return (PrimitiveNode *)branch;
+			}
+			
+			Branch *branch = newBranch(((uint64_t)1 << mask) | ((uint64_t)1 << otherMask), 2);
+			branch->children[0] = (mask < otherMask) ? aNode : otherNode;
+			branch->children[1] = (mask < otherMask) ? otherNode : aNode;
+			
+			return (PrimitiveNode *)branch;
+		}
+		
+		/*
+		 Copy of aBranch with aChild (owned) at anIndex, inserted or replacing the child there.
+		 */
+		static Branch *copyBranch(Branch *aBranch, uint64_t aBitmap, uint32_t anIndex, PrimitiveNode *aChild, bool inserting)
+		{
+			uint32_t count = aBranch->count + (inserting ? 1 : 0);
+			Branch *branch = newBranch(aBitmap, count);
+			uint32_t source = 0;
+			
+			for (uint32_t i = 0; i < count; i++) {
+				
+				if (i == anIndex) {
+					branch->children[i] = aChild;
+					
+					if (!inserting)
+						source++;
+				}
+				
+				else
+					branch->children[i] = PrimitiveNodeRetain(aBranch->children[source++]);
+			}
+			
+			return branch;
+		}
+		
+		static Branch *copyBranchRemoving(Branch *aBranch, uint64_t aBit, uint32_t anIndex)
+		{
+			Branch *branch = newBranch(aBranch->bitmap & ~aBit, aBranch->count - 1);
+			uint32_t cursor = 0;
+			
+			for (uint32_t i = 0; i < aBranch->count; i++)
+				if (i != anIndex)
+					branch->children[cursor++] = PrimitiveNodeRetain(aBranch->children[i]);
+			
+			return branch;
+		}
+	};
+	
+}
+
+#endif
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+@class CTKSortedMapNode;
+@class CTKPersistentHashMapEntry;
+
+/*
+ A persistent sorted map backed by a B+tree with path copying.
+ 
+ Keys are ordered by the map comparator, which defaults to compare:. Insertion, removal, lookups by key, floor, 
+ ceiling and rank are O(log n). Range enumeration walks the leaves, which keep CTKSortedMapNodeWidth entries 
+ in contiguous arrays.
+ */
+@interface CTKPersistentSortedMap : NSObject {
+	@private
+	NSComparator comparator;
+	CTKSortedMapNode *root;
+}
+
+@property (readonly, copy, nonatomic) NSComparator comparator;
+@property (readonly, retain, nonatomic) CTKSortedMapNode *root;
+@property (readonly, assign, nonatomic) NSUInteger count;
+
+#pragma mark Initialization
+
+/**
+ * \return An empty map ordering its keys with compare:
+ */
++ (id) emptySortedMap;
+
++ (id) sortedMapWithComparator:(NSComparator)aComparator;
+
++ (id) sortedMapWithRoot:(CTKSortedMapNode *)aNode comparator:(NSComparator)aComparator;
+
+- (id) initWithRoot:(CTKSortedMapNode *)aNode comparator:(NSComparator)aComparator;
+
+#pragma mark Lookups
+
+- (BOOL) containsObjectForKey:(id)aKey;
+
+- (id) objectForKey:(id)aKey;
+
+- (CTKPersistentHashMapEntry *) entryForKey:(id)aKey;
+
+/**
+ * \return The entry with the greatest key less than or equal to aKey, or nil.
+ */
+- (CTKPersistentHashMapEntry *) floorEntryForKey:(id)aKey;
+
+/**
+ * \return The entry with the least key greater than or equal to aKey, or nil.
+ */
+- (CTKPersistentHashMapEntry *) ceilingEntryForKey:(id)aKey;
+
+- (CTKPersistentHashMapEntry *) firstEntry;
+
+- (CTKPersistentHashMapEntry *) lastEntry;
+
+/**
+ * \return The number of keys strictly less than aKey, whether aKey is in the map or not.
+ */
+- (NSUInteger) rankOfKey:(id)aKey;
+
+/**
+ * \return The position of aKey in the map order or NSNotFound.
+ */
+- (NSUInteger) indexOfKey:(id)aKey;
+
+/**
+ * \return The entry at the given position in the map order.
+ * \throws NSRangeException
+ */
+- (CTKPersistentHashMapEntry *) entryAtIndex:(NSUInteger)anIndex;
+
+#pragma mark Operations
+
+- (CTKPersistentSortedMap *) mapBySettingObject:(id)anObject forKey:(id)aKey;
+
+- (CTKPersistentSortedMap *) mapByRemovingObjectForKey:(id)aKey;
+
+#pragma mark Enumeration
+
+- (void) enumerateEntriesUsingBlock:(void (^)(id key, id obj, BOOL *stop))aBlock;
+
+/**
+ * \brief Enumerates in order the entries with keys in [fromKey, toKey). A nil bound is unbounded.
+ */
+- (void) enumerateEntriesFromKey:(id)fromKey toKey:(id)toKey usingBlock:(void (^)(id key, id obj, BOOL *stop))aBlock;
+
+- (NSArray *) allKeys;
+
+- (NSArray *) allValues;
+
+@end
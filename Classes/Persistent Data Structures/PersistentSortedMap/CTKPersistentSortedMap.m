@@ -0,0 +1,244 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKPersistentSortedMap.h"
+#import "CTKSortedMapNode.h"
+#import "CTKPersistentHashMapEntry.h"
+#include <dispatch/dispatch.h>
+
+@interface CTKPersistentSortedMap ()
+
+@property (readwrite, copy, nonatomic) NSComparator comparator;
+@property (readwrite, retain, nonatomic) CTKSortedMapNode *root;
+
+@end
+
+
+@implementation CTKPersistentSortedMap
+
+#pragma mark Initialization
+
++ (id) emptySortedMap
+{
+	static CTKPersistentSortedMap *sharedEmptyInstance;
+	static dispatch_once_t once;
+	
+	dispatch_once(&once, ^{
+		sharedEmptyInstance = [[CTKPersistentSortedMap alloc] initWithRoot:nil comparator:nil];
+	});
+	
+	return [[sharedEmptyInstance retain] autorelease];
+}
+
++ (id) sortedMapWithComparator:(NSComparator)aComparator
+{
+	return [[[CTKPersistentSortedMap alloc] initWithRoot:nil comparator:aComparator] autorelease];
+}
+
++ (id) sortedMapWithRoot:(CTKSortedMapNode *)aNode comparator:(NSComparator)aComparator
+{
+	return [[[CTKPersistentSortedMap alloc] initWithRoot:aNode comparator:aComparator] autorelease];
+}
+
+- (id) initWithRoot:(CTKSortedMapNode *)aNode comparator:(NSComparator)aComparator
+{
+	self = [super init];
+	
+	if (self != nil) {
+		
+		self.root = aNode;
+		self.comparator = (aComparator != nil) ? aComparator : ^ NSComparisonResult (id obj1, id obj2) {
+			return [obj1 compare:obj2];
+		};
+	}
+	
+	return self;
+}
+
+- (id) init
+{
+	return [self initWithRoot:nil comparator:nil];
+}
+
+- (void) dealloc
+{
+	[comparator release];
+	[root release];
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize comparator, root;
+@dynamic count;
+
+- (NSUInteger) count
+{
+	return (root == nil) ? 0 : root.size;
+}
+
+#pragma mark Lookups
+
+- (BOOL) containsObjectForKey:(id)aKey
+{
+	BOOL found = NO;
+	[root rankOfKey:aKey comparator:comparator found:&found];
+	
+	return found;
+}
+
+- (id) objectForKey:(id)aKey
+{
+	return [root objectForKey:aKey comparator:comparator];
+}
+
+- (CTKPersistentHashMapEntry *) entryForKey:(id)aKey
+{
+	return [root entryForKey:aKey comparator:comparator];
+}
+
+- (CTKPersistentHashMapEntry *) floorEntryForKey:(id)aKey
+{
+	return [root floorEntryForKey:aKey comparator:comparator];
+}
+
+- (CTKPersistentHashMapEntry *) ceilingEntryForKey:(id)aKey
+{
+	return [root ceilingEntryForKey:aKey comparator:comparator];
+}
+
+- (CTKPersistentHashMapEntry *) firstEntry
+{
+	return [root firstEntry];
+}
+
+- (CTKPersistentHashMapEntry *) lastEntry
+{
+	return [root lastEntry];
+}
+
+- (NSUInteger) rankOfKey:(id)aKey
+{
+	return (root == nil) ? 0 : [root rankOfKey:aKey comparator:comparator found:NULL];
+}
+
+- (NSUInteger) indexOfKey:(id)aKey
+{
+	BOOL found = NO;
+	NSUInteger rank = [root rankOfKey:aKey comparator:comparator found:&found];
+	
+	return (found) ? rank : NSNotFound;
+}
+
+- (CTKPersistentHashMapEntry *) entryAtIndex:(NSUInteger)anIndex
+{
+	if (root == nil)
+		@throw [NSException exceptionWithName:NSRangeException reason:@"The map is empty" userInfo:nil];
+	
+	return [root entryAtIndex:anIndex];
+}
+
+#pragma mark Operations
+
+// assoc()
+- (CTKPersistentSortedMap *) mapBySettingObject:(id)anObject forKey:(id)aKey
+{
+	NSParameterAssert(aKey);
+	
+	if (root == nil)
+		return [CTKPersistentSortedMap sortedMapWithRoot:[CTKSortedMapNode leafNodeWithObject:anObject forKey:aKey] 
+											  comparator:comparator];
+	
+	BOOL added = NO;
+	CTKSortedMapNode *splitNode = nil;
+	CTKSortedMapNode *newRoot = [root nodeBySettingObject:anObject forKey:aKey comparator:comparator added:&added split:&splitNode];
+	
+	if (newRoot == root)
+		return self;
+	
+	// The root was split, the tree grows one level
+	if (splitNode != nil)
+		newRoot = [CTKSortedMapNode innerNodeWithLeftNode:newRoot rightNode:splitNode];
+	
+	return [CTKPersistentSortedMap sortedMapWithRoot:newRoot comparator:comparator];
+}
+
+// without()
+- (CTKPersistentSortedMap *) mapByRemovingObjectForKey:(id)aKey
+{
+	if (root == nil)
+		return self;
+	
+	CTKSortedMapNode *newRoot = [root nodeByRemovingObjectForKey:aKey comparator:comparator];
+	
+	if (newRoot == root)
+		return self;
+	
+	// The tree shrinks while the root has a single child
+	while (!newRoot.isLeaf && newRoot.count == 1)
+		newRoot = [newRoot childAtIndex:0];
+	
+	if (newRoot.count == 0)
+		newRoot = nil;
+	
+	return [CTKPersistentSortedMap sortedMapWithRoot:newRoot comparator:comparator];
+}
+
+#pragma mark Enumeration
+
+- (void) enumerateEntriesUsingBlock:(void (^)(id key, id obj, BOOL *stop))aBlock
+{
+	[self enumerateEntriesFromKey:nil toKey:nil usingBlock:aBlock];
+}
+
+- (void) enumerateEntriesFromKey:(id)fromKey toKey:(id)toKey usingBlock:(void (^)(id key, id obj, BOOL *stop))aBlock
+{
+	[root enumerateEntriesFromKey:fromKey toKey:toKey comparator:comparator usingBlock:aBlock];
+}
+
+- (NSArray *) allKeys
+{
+	NSMutableArray *result = [NSMutableArray arrayWithCapacity:self.count];
+	
+	[self enumerateEntriesUsingBlock:^(id key, id obj, BOOL *stop){
+		[result addObject:key];
+	}];
+	
+	return result;
+}
+
+- (NSArray *) allValues
+{
+	NSMutableArray *result = [NSMutableArray arrayWithCapacity:self.count];
+	
+	[self enumerateEntriesUsingBlock:^(id key, id obj, BOOL *stop){
+		[result addObject:obj];
+	}];
+	
+	return result;
+}
+
+@end
@@ -0,0 +1,132 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+@class CTKPersistentHashMapEntry;
+
+/*
+ A node of the persistent B+tree backing CTKPersistentSortedMap. 
+ 
+ Leaves hold up to CTKSortedMapNodeWidth keys and objects in sorted order. Inner nodes hold up to CTKSortedMapNodeWidth
+ children, each one along with its smallest key and the number of entries in its subtree (used for rank lookups).
+ Keys and values live in plain C arrays so that a range scan walks contiguous memory. Nodes are immutable once 
+ returned, every modification copies the path from the root to the affected leaf.
+ */
+
+enum {
+	CTKSortedMapNodeWidth = 32,
+	CTKSortedMapNodeMinimum = CTKSortedMapNodeWidth / 2 // non root nodes below this are merged with a sibling
+};
+
+@interface CTKSortedMapNode : NSObject {
+	@private
+	BOOL isLeaf;
+	NSUInteger count;
+	NSUInteger size;
+	id keys[CTKSortedMapNodeWidth];
+	id values[CTKSortedMapNodeWidth]; // objects in leaves, children in inner nodes
+	NSUInteger sizes[CTKSortedMapNodeWidth];
+}
+
+@property (readonly, assign, nonatomic) BOOL isLeaf;
+/**
+ * \return the number of slots used in this node
+ */
+@property (readonly, assign, nonatomic) NSUInteger count;
+/**
+ * \return the number of entries in the subtree rooted at this node
+ */
+@property (readonly, assign, nonatomic) NSUInteger size;
+
+#pragma mark Initialization
+
++ (id) leafNodeWithObject:(id)anObject forKey:(id)aKey;
+
++ (id) innerNodeWithLeftNode:(CTKSortedMapNode *)aLeftNode rightNode:(CTKSortedMapNode *)aRightNode;
+
+#pragma mark Accessors
+
+- (CTKSortedMapNode *) childAtIndex:(NSUInteger)anIndex;
+
+#pragma mark Lookups
+
+- (id) objectForKey:(id)aKey comparator:(NSComparator)aComparator;
+
+- (CTKPersistentHashMapEntry *) entryForKey:(id)aKey comparator:(NSComparator)aComparator;
+
+/**
+ * \return the entry with the greatest key less than or equal to aKey, nil if there is none.
+ */
+- (CTKPersistentHashMapEntry *) floorEntryForKey:(id)aKey comparator:(NSComparator)aComparator;
+
+/**
+ * \return the entry with the least key greater than or equal to aKey, nil if there is none.
+ */
+- (CTKPersistentHashMapEntry *) ceilingEntryForKey:(id)aKey comparator:(NSComparator)aComparator;
+
+/**
+ * \return the number of keys strictly less than aKey. 
+ */
+- (NSUInteger) rankOfKey:(id)aKey comparator:(NSComparator)aComparator found:(BOOL *)found;
+
+/**
+ * \throws NSRangeException
+ */
+- (CTKPersistentHashMapEntry *) entryAtIndex:(NSUInteger)anIndex;
+
+- (CTKPersistentHashMapEntry *) firstEntry;
+
+- (CTKPersistentHashMapEntry *) lastEntry;
+
+/**
+ * \brief In order traversal of the keys in [fromKey, toKey). A nil bound is unbounded.
+ * \return NO if the enumeration was stopped, either by the block or by reaching toKey.
+ */
+- (BOOL) enumerateEntriesFromKey:(id)fromKey 
+						   toKey:(id)toKey 
+					  comparator:(NSComparator)aComparator 
+					  usingBlock:(void (^)(id key, id obj, BOOL *stop))aBlock;
+
+#pragma mark Operations
+
+/**
+ * \brief Path copying insertion. 
+ * \return the new node, or the receiver if anObject was already set for aKey. If the new node had to be split 
+ * its right half is returned in aSplitNode.
+ */
+- (CTKSortedMapNode *) nodeBySettingObject:(id)anObject 
+									forKey:(id)aKey 
+								comparator:(NSComparator)aComparator 
+									 added:(BOOL *)added 
+									 split:(CTKSortedMapNode **)aSplitNode;
+
+/**
+ * \brief Path copying removal, underflowing children are merged with (or redistributed with) a sibling.
+ * \return the new node, which may be underflowing or empty, or the receiver if aKey was not found.
+ */
+- (CTKSortedMapNode *) nodeByRemovingObjectForKey:(id)aKey comparator:(NSComparator)aComparator;
+
+@end
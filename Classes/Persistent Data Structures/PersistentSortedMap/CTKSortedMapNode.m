@@ -0,0 +1,574 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKSortedMapNode.h"
+#import "CTKPersistentHashMapEntry.h"
+
+#pragma mark Util Functions
+
+/*
+ Binary search, returns the index of the first key not less than aKey. Keys are unique so we stop on the first match.
+ */
+static NSUInteger CTKSortedMapNodeLowerBound(id const *someKeys, NSUInteger n, id aKey, NSComparator aComparator, BOOL *found)
+{
+	NSUInteger lo = 0;
+	NSUInteger hi = n;
+	
+	while (lo < hi) {
+		
+		NSUInteger mid = (lo + hi) >> 1;
+		NSComparisonResult result = aComparator(someKeys[mid], aKey);
+		
+		if (result == NSOrderedSame) {
+			*found = YES;
+			return mid;
+		}
+		
+		if (result == NSOrderedAscending)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	*found = NO;
+	return lo;
+}
+
+/*
+ The child of an inner node that may hold aKey is the last one whose smallest key is not greater than aKey.
+ Keys smaller than every key in the node go to the first child.
+ */
+static NSUInteger CTKSortedMapNodeChildIndex(id const *someKeys, NSUInteger n, id aKey, NSComparator aComparator)
+{
+	BOOL found = NO;
+	NSUInteger index = CTKSortedMapNodeLowerBound(someKeys, n, aKey, aComparator, &found);
+	
+	if (found || index == 0)
+		return index;
+	
+	return index - 1;
+}
+
+
+@interface CTKSortedMapNode (Private)
+
++ (CTKSortedMapNode *) private_nodeWithLeaf:(BOOL)leaf 
+									   keys:(id *)someKeys 
+									 values:(id *)someValues 
+									  sizes:(NSUInteger *)someSizes 
+									  count:(NSUInteger)n 
+									  split:(CTKSortedMapNode **)aSplitNode;
+
++ (CTKSortedMapNode *) private_nodeByConcatenatingNode:(CTKSortedMapNode *)aLeftNode 
+												  node:(CTKSortedMapNode *)aRightNode 
+												 split:(CTKSortedMapNode **)aSplitNode;
+
+- (CTKPersistentHashMapEntry *) private_entryAtSlot:(NSUInteger)anIndex;
+
+@end
+
+
+@implementation CTKSortedMapNode
+
+#pragma mark Initialization
+
++ (id) leafNodeWithObject:(id)anObject forKey:(id)aKey
+{
+	return [self private_nodeWithLeaf:YES keys:&aKey values:&anObject sizes:NULL count:1 split:NULL];
+}
+
++ (id) innerNodeWithLeftNode:(CTKSortedMapNode *)aLeftNode rightNode:(CTKSortedMapNode *)aRightNode
+{
+	id someKeys[2] = {aLeftNode->keys[0], aRightNode->keys[0]};
+	id someValues[2] = {aLeftNode, aRightNode};
+	NSUInteger someSizes[2] = {aLeftNode->size, aRightNode->size};
+	
+	return [self private_nodeWithLeaf:NO keys:someKeys values:someValues sizes:someSizes count:2 split:NULL];
+}
+
+/*
+ Creates a node holding the n given slots. If n does not fit in a node, the slots are split evenly in two nodes 
+ and the right one is returned in aSplitNode.
+ */
++ (CTKSortedMapNode *) private_nodeWithLeaf:(BOOL)leaf 
+									   keys:(id *)someKeys 
+									 values:(id *)someValues 
+									  sizes:(NSUInteger *)someSizes 
+									  count:(NSUInteger)n 
+									  split:(CTKSortedMapNode **)aSplitNode
+{
+	if (n > CTKSortedMapNodeWidth) {
+		
+		NSParameterAssert(aSplitNode != NULL && n <= 2 * CTKSortedMapNodeWidth);
+		
+		NSUInteger half = n / 2;
+		
+		*aSplitNode = [self private_nodeWithLeaf:leaf 
+											keys:(someKeys + half) 
+										  values:(someValues + half) 
+										   sizes:(leaf ? NULL : someSizes + half) 
+										   count:(n - half) 
+										   split:NULL];
+		n = half;
+	}
+	
+	else if (aSplitNode != NULL) {
+		*aSplitNode = nil;
+	}
+	
+	CTKSortedMapNode *node = [[CTKSortedMapNode alloc] init];
+	
+	node->isLeaf = leaf;
+	node->count = n;
+	node->size = (leaf) ? n : 0;
+	
+	for (NSUInteger i = 0; i < n; i++) {
+		
+		node->keys[i] = [someKeys[i] retain];
+		node->values[i] = [someValues[i] retain];
+		
+		if (!leaf) {
+			node->sizes[i] = someSizes[i];
+			node->size += someSizes[i];
+		}
+	}
+	
+	return [node autorelease];
+}
+
++ (CTKSortedMapNode *) private_nodeByConcatenatingNode:(CTKSortedMapNode *)aLeftNode 
+												  node:(CTKSortedMapNode *)aRightNode 
+												 split:(CTKSortedMapNode **)aSplitNode
+{
+	NSParameterAssert(aLeftNode->isLeaf == aRightNode->isLeaf);
+	
+	id someKeys[2 * CTKSortedMapNodeWidth];
+	id someValues[2 * CTKSortedMapNodeWidth];
+	NSUInteger someSizes[2 * CTKSortedMapNodeWidth];
+	NSUInteger n = 0;
+	
+	for (CTKSortedMapNode *node in [NSArray arrayWithObjects:aLeftNode, aRightNode, nil]) {
+		
+		memcpy(someKeys + n, node->keys, node->count * sizeof(id));
+		memcpy(someValues + n, node->values, node->count * sizeof(id));
+		memcpy(someSizes + n, node->sizes, node->count * sizeof(NSUInteger));
+		n += node->count;
+	}
+	
+	return [self private_nodeWithLeaf:aLeftNode->isLeaf keys:someKeys values:someValues sizes:someSizes count:n split:aSplitNode];
+}
+
+- (void) dealloc
+{
+	for (NSUInteger i = 0; i < count; i++) {
+		[keys[i] release];
+		[values[i] release];
+	}
+	
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize isLeaf, count, size;
+
+#pragma mark Accessors
+
+- (CTKSortedMapNode *) childAtIndex:(NSUInteger)anIndex
+{
+	NSParameterAssert(!isLeaf && anIndex < count);
+	return values[anIndex];
+}
+
+#pragma mark Lookups
+
+- (id) objectForKey:(id)aKey comparator:(NSComparator)aComparator
+{
+	CTKSortedMapNode *node = self;
+	BOOL found = NO;
+	
+	while (!node->isLeaf)
+		node = node->values[CTKSortedMapNodeChildIndex(node->keys, node->count, aKey, aComparator)];
+	
+	NSUInteger index = CTKSortedMapNodeLowerBound(node->keys, node->count, aKey, aComparator, &found);
+	
+	return (found) ? node->values[index] : nil;
+}
+
+- (CTKPersistentHashMapEntry *) entryForKey:(id)aKey comparator:(NSComparator)aComparator
+{
+	CTKSortedMapNode *node = self;
+	BOOL found = NO;
+	
+	while (!node->isLeaf)
+		node = node->values[CTKSortedMapNodeChildIndex(node->keys, node->count, aKey, aComparator)];
+	
+	NSUInteger index = CTKSortedMapNodeLowerBound(node->keys, node->count, aKey, aComparator, &found);
+	
+	return (found) ? [node private_entryAtSlot:index] : nil;
+}
+
+- (CTKPersistentHashMapEntry *) floorEntryForKey:(id)aKey comparator:(NSComparator)aComparator
+{
+	CTKSortedMapNode *node = self;
+	BOOL found = NO;
+	
+	/*
+	 We always descend into a child whose smallest key is not greater than aKey, so the floor is in that child.
+	 The only way of not finding one is aKey being smaller than every key in the tree.
+	 */
+	while (!node->isLeaf) {
+		
+		NSUInteger index = CTKSortedMapNodeLowerBound(node->keys, node->count, aKey, aComparator, &found);
+		
+		if (!found && index == 0)
+			return nil;
+		
+		node = node->values[(found) ? index : index - 1];
+	}
+	
+	NSUInteger index = CTKSortedMapNodeLowerBound(node->keys, node->count, aKey, aComparator, &found);
+	
+	if (found)
+		return [node private_entryAtSlot:index];
+	
+	return (index == 0) ? nil : [node private_entryAtSlot:(index - 1)];
+}
+
+- (CTKPersistentHashMapEntry *) ceilingEntryForKey:(id)aKey comparator:(NSComparator)aComparator
+{
+	CTKSortedMapNode *node = self;
+	CTKSortedMapNode *nextSubtree = nil; // the closest subtree to the right of the path
+	BOOL found = NO;
+	
+	while (!node->isLeaf) {
+		
+		NSUInteger index = CTKSortedMapNodeChildIndex(node->keys, node->count, aKey, aComparator);
+		
+		if (index + 1 < node->count)
+			nextSubtree = node->values[index + 1];
+		
+		node = node->values[index];
+	}
+	
+	NSUInteger index = CTKSortedMapNodeLowerBound(node->keys, node->count, aKey, aComparator, &found);
+	
+	if (index < node->count)
+		return [node private_entryAtSlot:index];
+	
+	return [nextSubtree firstEntry];
+}
+
+- (NSUInteger) rankOfKey:(id)aKey comparator:(NSComparator)aComparator found:(BOOL *)found
+{
+	CTKSortedMapNode *node = self;
+	NSUInteger rank = 0;
+	BOOL wasFound = NO;
+	
+	while (!node->isLeaf) {
+		
+		NSUInteger index = CTKSortedMapNodeChildIndex(node->keys, node->count, aKey, aComparator);
+		
+		for (NSUInteger i = 0; i < index; i++)
+			rank += node->sizes[i];
+		
+		node = node->values[index];
+	}
+	
+	rank += CTKSortedMapNodeLowerBound(node->keys, node->count, aKey, aComparator, &wasFound);
+	
+	if (found != NULL)
+		*found = wasFound;
+	
+	return rank;
+}
+
+- (CTKPersistentHashMapEntry *) entryAtIndex:(NSUInteger)anIndex
+{
+	if (anIndex >= size) {
+		
+		NSString *reason = [NSString stringWithFormat:@"Index %U out of bounds [0, %U)", anIndex, size];
+		@throw [NSException exceptionWithName:NSRangeException reason:reason userInfo:nil];
+	}
+	
+	CTKSortedMapNode *node = self;
+	
+	while (!node->isLeaf) {
+		
+		NSUInteger i = 0;
+		
+		while (anIndex >= node->sizes[i]) {
+			anIndex -= node->sizes[i];
+			i++;
+		}
+		
+		node = node->values[i];
+	}
+	
+	return [node private_entryAtSlot:anIndex];
+}
+
+- (CTKPersistentHashMapEntry *) firstEntry
+{
+	CTKSortedMapNode *node = self;
+	
+	while (!node->isLeaf)
+		node = node->values[0];
+	
+	return (node->count == 0) ? nil : [node private_entryAtSlot:0];
+}
+
+- (CTKPersistentHashMapEntry *) lastEntry
+{
+	CTKSortedMapNode *node = self;
+	
+	while (!node->isLeaf)
+		node = node->values[node->count - 1];
+	
+	return (node->count == 0) ? nil : [node private_entryAtSlot:(node->count - 1)];
+}
+
+- (BOOL) enumerateEntriesFromKey:(id)fromKey 
+						   toKey:(id)toKey 
+					  comparator:(NSComparator)aComparator 
+					  usingBlock:(void (^)(id key, id obj, BOOL *stop))aBlock
+{
+	NSUInteger start = 0;
+	BOOL found = NO;
+	BOOL stop = NO;
+	
+	if (isLeaf) {
+		
+		if (fromKey != nil)
+			start = CTKSortedMapNodeLowerBound(keys, count, fromKey, aComparator, &found);
+		
+		for (NSUInteger i = start; i < count; i++) {
+			
+			if (toKey != nil && aComparator(keys[i], toKey) != NSOrderedAscending)
+				return NO;
+			
+			aBlock(keys[i], values[i], &stop);
+			
+			if (stop)
+				return NO;
+		}
+		
+		return YES;
+	}
+	
+	if (fromKey != nil)
+		start = CTKSortedMapNodeChildIndex(keys, count, fromKey, aComparator);
+	
+	for (NSUInteger i = start; i < count; i++) {
+		
+		if (toKey != nil && aComparator(keys[i], toKey) != NSOrderedAscending)
+			return NO;
+		
+		// Only the first child visited can hold keys below fromKey
+		if (![values[i] enumerateEntriesFromKey:((i == start) ? fromKey : nil) 
+										  toKey:toKey 
+									 comparator:aComparator 
+									 usingBlock:aBlock])
+			return NO;
+	}
+	
+	return YES;
+}
+
+#pragma mark Operations
+
+// assoc()
+- (CTKSortedMapNode *) nodeBySettingObject:(id)anObject 
+									forKey:(id)aKey 
+								comparator:(NSComparator)aComparator 
+									 added:(BOOL *)added 
+									 split:(CTKSortedMapNode **)aSplitNode
+{
+	id someKeys[CTKSortedMapNodeWidth + 1];
+	id someValues[CTKSortedMapNodeWidth + 1];
+	NSUInteger someSizes[CTKSortedMapNodeWidth + 1];
+	BOOL found = NO;
+	
+	*aSplitNode = nil;
+	
+	if (isLeaf) {
+		
+		NSUInteger index = CTKSortedMapNodeLowerBound(keys, count, aKey, aComparator, &found);
+		
+		memcpy(someKeys, keys, count * sizeof(id));
+		memcpy(someValues, values, count * sizeof(id));
+		
+		if (found) {
+			
+			*added = NO;
+			
+			if ([values[index] isEqual:anObject])
+				return self;
+			
+			someValues[index] = anObject;
+			
+			return [CTKSortedMapNode private_nodeWithLeaf:YES keys:someKeys values:someValues sizes:NULL count:count split:aSplitNode];
+		}
+		
+		*added = YES;
+		
+		memmove(someKeys + index + 1, someKeys + index, (count - index) * sizeof(id));
+		memmove(someValues + index + 1, someValues + index, (count - index) * sizeof(id));
+		someKeys[index] = aKey;
+		someValues[index] = anObject;
+		
+		return [CTKSortedMapNode private_nodeWithLeaf:YES keys:someKeys values:someValues sizes:NULL count:(count + 1) split:aSplitNode];
+	}
+	
+	NSUInteger index = CTKSortedMapNodeChildIndex(keys, count, aKey, aComparator);
+	CTKSortedMapNode *child = values[index];
+	CTKSortedMapNode *childSplit = nil;
+	CTKSortedMapNode *newChild = [child nodeBySettingObject:anObject 
+													 forKey:aKey 
+												 comparator:aComparator 
+													  added:added 
+													  split:&childSplit];
+	
+	if (newChild == child)
+		return self;
+	
+	NSUInteger n = count;
+	
+	memcpy(someKeys, keys, count * sizeof(id));
+	memcpy(someValues, values, count * sizeof(id));
+	memcpy(someSizes, sizes, count * sizeof(NSUInteger));
+	
+	// The smallest key of the child changes when aKey is inserted at its very beginning
+	someKeys[index] = newChild->keys[0];
+	someValues[index] = newChild;
+	someSizes[index] = newChild->size;
+	
+	if (childSplit != nil) {
+		
+		memmove(someKeys + index + 2, someKeys + index + 1, (n - index - 1) * sizeof(id));
+		memmove(someValues + index + 2, someValues + index + 1, (n - index - 1) * sizeof(id));
+		memmove(someSizes + index + 2, someSizes + index + 1, (n - index - 1) * sizeof(NSUInteger));
+		
+		someKeys[index + 1] = childSplit->keys[0];
+		someValues[index + 1] = childSplit;
+		someSizes[index + 1] = childSplit->size;
+		n++;
+	}
+	
+	return [CTKSortedMapNode private_nodeWithLeaf:NO keys:someKeys values:someValues sizes:someSizes count:n split:aSplitNode];
+}
+
+// without()
+- (CTKSortedMapNode *) nodeByRemovingObjectForKey:(id)aKey comparator:(NSComparator)aComparator
+{
+	id someKeys[CTKSortedMapNodeWidth];
+	id someValues[CTKSortedMapNodeWidth];
+	NSUInteger someSizes[CTKSortedMapNodeWidth];
+	BOOL found = NO;
+	
+	if (isLeaf) {
+		
+		NSUInteger index = CTKSortedMapNodeLowerBound(keys, count, aKey, aComparator, &found);
+		
+		if (!found)
+			return self;
+		
+		memcpy(someKeys, keys, count * sizeof(id));
+		memcpy(someValues, values, count * sizeof(id));
+		memmove(someKeys + index, someKeys + index + 1, (count - index - 1) * sizeof(id));
+		memmove(someValues + index, someValues + index + 1, (count - index - 1) * sizeof(id));
+		
+		return [CTKSortedMapNode private_nodeWithLeaf:YES keys:someKeys values:someValues sizes:NULL count:(count - 1) split:NULL];
+	}
+	
+	NSUInteger index = CTKSortedMapNodeChildIndex(keys, count, aKey, aComparator);
+	CTKSortedMapNode *child = values[index];
+	CTKSortedMapNode *newChild = [child nodeByRemovingObjectForKey:aKey comparator:aComparator];
+	
+	if (newChild == child)
+		return self;
+	
+	NSUInteger n = count;
+	
+	memcpy(someKeys, keys, count * sizeof(id));
+	memcpy(someValues, values, count * sizeof(id));
+	memcpy(someSizes, sizes, count * sizeof(NSUInteger));
+	
+	if (newChild->count == 0) {
+		
+		memmove(someKeys + index, someKeys + index + 1, (n - index - 1) * sizeof(id));
+		memmove(someValues + index, someValues + index + 1, (n - index - 1) * sizeof(id));
+		memmove(someSizes + index, someSizes + index + 1, (n - index - 1) * sizeof(NSUInteger));
+		n--;
+	}
+	
+	else if (newChild->count < CTKSortedMapNodeMinimum && n > 1) {
+		
+		/*
+		 The child underflows, we concatenate it with its right sibling (left one for the last child). 
+		 If both fit in a single node they are merged, otherwise the entries are redistributed evenly.
+		 */
+		NSUInteger left = (index + 1 < n) ? index : index - 1;
+		CTKSortedMapNode *leftNode = (left == index) ? newChild : values[left];
+		CTKSortedMapNode *rightNode = (left == index) ? values[left + 1] : newChild;
+		CTKSortedMapNode *splitNode = nil;
+		CTKSortedMapNode *merged = [CTKSortedMapNode private_nodeByConcatenatingNode:leftNode node:rightNode split:&splitNode];
+		
+		someKeys[left] = merged->keys[0];
+		someValues[left] = merged;
+		someSizes[left] = merged->size;
+		
+		if (splitNode != nil) {
+			someKeys[left + 1] = splitNode->keys[0];
+			someValues[left + 1] = splitNode;
+			someSizes[left + 1] = splitNode->size;
+		}
+		
+		else {
+			memmove(someKeys + left + 1, someKeys + left + 2, (n - left - 2) * sizeof(id));
+			memmove(someValues + left + 1, someValues + left + 2, (n - left - 2) * sizeof(id));
+			memmove(someSizes + left + 1, someSizes + left + 2, (n - left - 2) * sizeof(NSUInteger));
+			n--;
+		}
+	}
+	
+	else {
+		someKeys[index] = newChild->keys[0];
+		someValues[index] = newChild;
+		someSizes[index] = newChild->size;
+	}
+	
+	return [CTKSortedMapNode private_nodeWithLeaf:NO keys:someKeys values:someValues sizes:someSizes count:n split:NULL];
+}
+
+#pragma mark Private
+
+- (CTKPersistentHashMapEntry *) private_entryAtSlot:(NSUInteger)anIndex
+{
+	return [CTKPersistentHashMapEntry entryWithObject:values[anIndex] forKey:keys[anIndex]];
+}
+
+@end
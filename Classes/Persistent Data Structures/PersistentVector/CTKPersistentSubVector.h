@@ -0,0 +1,50 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "CTKVector.h"
+@class CTKPersistentVector;
+
+/*
+ Corresponds to Clojure's APersistentVector.SubVector class.
+ A view over a range of a CTKPersistentVector, it shares the whole vector and does not copy any element.
+ */
+@interface CTKPersistentSubVector : NSObject <CTKVector> {
+	@private
+	CTKPersistentVector *vector;
+	NSUInteger start;
+	NSUInteger end;
+}
+
+@property (readonly, retain, nonatomic) CTKPersistentVector *vector;
+@property (readonly, assign, nonatomic) NSUInteger start;
+@property (readonly, assign, nonatomic) NSUInteger end;
+
++ (id) subVectorWithVector:(CTKPersistentVector *)aVector range:(NSRange)aRange;
+
+- (id) initWithVector:(CTKPersistentVector *)aVector range:(NSRange)aRange;
+
+@end
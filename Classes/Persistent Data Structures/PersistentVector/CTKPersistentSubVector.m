@@ -0,0 +1,172 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKPersistentSubVector.h"
+#import "CTKPersistentVector.h"
+
+@interface CTKPersistentSubVector ()
+
+@property (readwrite, retain, nonatomic) CTKPersistentVector *vector;
+@property (readwrite, assign, nonatomic) NSUInteger start;
+@property (readwrite, assign, nonatomic) NSUInteger end;
+
+@end
+
+@interface CTKPersistentSubVector (Private)
+
+- (void) private_raiseRangeExceptionForIndex:(NSUInteger)anIndex;
+
+@end
+
+
+@implementation CTKPersistentSubVector
+
+#pragma mark Initialization
+
++ (id) subVectorWithVector:(CTKPersistentVector *)aVector range:(NSRange)aRange
+{
+	return [[[CTKPersistentSubVector alloc] initWithVector:aVector range:aRange] autorelease];
+}
+
+- (id) initWithVector:(CTKPersistentVector *)aVector range:(NSRange)aRange
+{
+	NSParameterAssert(aVector);
+	NSParameterAssert(NSMaxRange(aRange) <= aVector.count);
+	
+	self = [super init];
+	
+	if (self != nil) {
+		self.vector = aVector;
+		self.start = aRange.location;
+		self.end = NSMaxRange(aRange);
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[vector release];
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize vector, start, end;
+@dynamic count;
+
+- (NSUInteger) count
+{
+	return end - start;
+}
+
+#pragma mark CTKVector protocol
+
+- (id) objectAtIndex:(NSUInteger)anIndex
+{
+	if (anIndex >= end - start)
+		[self private_raiseRangeExceptionForIndex:anIndex];
+	
+	return [vector objectAtIndex:(start + anIndex)];
+}
+
+- (id) lastObject
+{
+	return (end == start) ? nil : [vector objectAtIndex:(end - 1)];
+}
+
+- (id <CTKVector>) vectorByAddingObject:(id)anObject
+{
+	// Elements of the vector past end are not visible, we overwrite them instead of appending
+	CTKPersistentVector *newVector = (end == vector.count)
+	? (CTKPersistentVector *)[vector vectorByAddingObject:anObject]
+	: (CTKPersistentVector *)[vector vectorBySettingObject:anObject atIndex:end];
+	
+	return [CTKPersistentSubVector subVectorWithVector:newVector range:NSMakeRange(start, end - start + 1)];
+}
+
+- (id <CTKVector>) vectorBySettingObject:(id)anObject atIndex:(NSUInteger)anIndex
+{
+	if (anIndex == end - start)
+		return [self vectorByAddingObject:anObject];
+	
+	if (anIndex > end - start)
+		[self private_raiseRangeExceptionForIndex:anIndex];
+	
+	CTKPersistentVector *newVector = (CTKPersistentVector *)[vector vectorBySettingObject:anObject atIndex:(start + anIndex)];
+	
+	return [CTKPersistentSubVector subVectorWithVector:newVector range:NSMakeRange(start, end - start)];
+}
+
+- (id <CTKVector>) vectorByRemovingLastObject
+{
+	if (end == start)
+		@throw [NSException exceptionWithName:NSRangeException 
+									   reason:@"Cannot remove the last object of an empty vector"
+									 userInfo:nil];
+	
+	if (end - start == 1)
+		return [CTKPersistentVector emptyVector];
+	
+	return [CTKPersistentSubVector subVectorWithVector:vector range:NSMakeRange(start, end - start - 1)];
+}
+
+- (id <CTKVector>) subvectorWithRange:(NSRange)aRange
+{
+	if (NSMaxRange(aRange) > end - start)
+		[self private_raiseRangeExceptionForIndex:NSMaxRange(aRange)];
+	
+	return [CTKPersistentSubVector subVectorWithVector:vector range:NSMakeRange(start + aRange.location, aRange.length)];
+}
+
+- (void) enumerateObjectsUsingBlock:(void (^)(id obj, NSUInteger idx, BOOL *stop))aBlock
+{
+	BOOL stop = NO;
+	
+	for (NSUInteger i = start; i < end && !stop; i++)
+		aBlock([vector objectAtIndex:i], i - start, &stop);
+}
+
+- (NSArray *) allObjects
+{
+	NSMutableArray *objects = [NSMutableArray arrayWithCapacity:(end - start)];
+	
+	[self enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop){
+		[objects addObject:obj];
+	}];
+	
+	return objects;
+}
+
+#pragma mark Private
+
+- (void) private_raiseRangeExceptionForIndex:(NSUInteger)anIndex
+{
+	NSString *reason = [NSString stringWithFormat:@"Index %U out of bounds [0, %U)", anIndex, end - start];
+	@throw [NSException exceptionWithName:NSRangeException reason:reason userInfo:nil];
+}
+
+@end
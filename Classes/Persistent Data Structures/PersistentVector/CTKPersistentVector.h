@@ -0,0 +1,74 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "CTKVector.h"
+@class CTKVectorNode;
+@class CTKTransientVector;
+
+/*
+ Corresponds to Clojure's PersistentVector class.
+ 
+ A 32-way trie holding the elements at its leaves plus a tail buffer holding the last (up to 32) elements.
+ Appending and removing the last object only copy the tail, except once every 32 operations when the tail is
+ pushed into (or pulled from) the trie. Indexed access and updates are O(log32 n).
+ */
+@interface CTKPersistentVector : NSObject <CTKVector> {
+	@private
+	NSUInteger count;
+	NSUInteger shift;
+	CTKVectorNode *root;
+	CTKVectorNode *tail;
+}
+
+@property (readonly, assign, nonatomic) NSUInteger count;
+@property (readonly, assign, nonatomic) NSUInteger shift;
+@property (readonly, retain, nonatomic) CTKVectorNode *root;
+@property (readonly, retain, nonatomic) CTKVectorNode *tail;
+
++ (id) emptyVector;
+
+/**
+ * \brief Builds the vector with a CTKTransientVector, no intermediate version is created.
+ */
++ (id) vectorWithArray:(NSArray *)anArray;
+
++ (id) vectorWithCount:(NSUInteger)aCount shift:(NSUInteger)aShiftValue root:(CTKVectorNode *)aRoot tail:(CTKVectorNode *)aTail;
+
+- (id) initWithCount:(NSUInteger)aCount shift:(NSUInteger)aShiftValue root:(CTKVectorNode *)aRoot tail:(CTKVectorNode *)aTail;
+
+/**
+ * \return A transient vector holding the same elements as the receiver, the receiver is not modified.
+ */
+- (CTKTransientVector *) transientVector;
+
+/**
+ * \warning You should not call this method directly.
+ * \return The leaf node (or the tail) holding the object at anIndex.
+ */
+- (CTKVectorNode *) leafForIndex:(NSUInteger)anIndex;
+
+@end
@@ -0,0 +1,377 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKPersistentVector.h"
+#import "CTKPersistentSubVector.h"
+#import "CTKTransientVector.h"
+#import "CTKVectorNode.h"
+#include <dispatch/dispatch.h>
+
+@interface CTKPersistentVector ()
+
+@property (readwrite, assign, nonatomic) NSUInteger count;
+@property (readwrite, assign, nonatomic) NSUInteger shift;
+@property (readwrite, retain, nonatomic) CTKVectorNode *root;
+@property (readwrite, retain, nonatomic) CTKVectorNode *tail;
+
+@end
+
+@interface CTKPersistentVector (Private)
+
+- (NSUInteger) private_tailOffset;
+- (CTKVectorNode *) private_pushTailWithLevel:(NSUInteger)aLevel parent:(CTKVectorNode *)aParent tailNode:(CTKVectorNode *)aTailNode;
+- (CTKVectorNode *) private_popTailWithLevel:(NSUInteger)aLevel node:(CTKVectorNode *)aNode;
+- (CTKVectorNode *) private_nodeBySettingObject:(id)anObject atIndex:(NSUInteger)anIndex level:(NSUInteger)aLevel node:(CTKVectorNode *)aNode;
+- (void) private_raiseRangeExceptionForIndex:(NSUInteger)anIndex;
+
+@end
+
+
+@implementation CTKPersistentVector
+
+#pragma mark Initialization
+
++ (id) emptyVector
+{
+	static CTKPersistentVector *sharedEmptyInstance;
+	static dispatch_once_t once;
+	
+	dispatch_once(&once, ^{
+		sharedEmptyInstance = [[CTKPersistentVector alloc] init];
+	});
+	
+	return [[sharedEmptyInstance retain] autorelease];
+}
+
++ (id) vectorWithArray:(NSArray *)anArray
+{
+	CTKTransientVector *transient = [[CTKPersistentVector emptyVector] transientVector];
+	
+	for (id anObject in anArray)
+		[transient addObject:anObject];
+	
+	return [transient persistentVector];
+}
+
++ (id) vectorWithCount:(NSUInteger)aCount shift:(NSUInteger)aShiftValue root:(CTKVectorNode *)aRoot tail:(CTKVectorNode *)aTail
+{
+	return [[[CTKPersistentVector alloc] initWithCount:aCount shift:aShiftValue root:aRoot tail:aTail] autorelease];
+}
+
+- (id) initWithCount:(NSUInteger)aCount shift:(NSUInteger)aShiftValue root:(CTKVectorNode *)aRoot tail:(CTKVectorNode *)aTail
+{
+	NSParameterAssert(aRoot);
+	NSParameterAssert(aTail);
+	
+	self = [super init];
+	
+	if (self != nil) {
+		self.count = aCount;
+		self.shift = aShiftValue;
+		self.root = aRoot;
+		self.tail = aTail;
+	}
+	
+	return self;
+}
+
+- (id) init
+{
+	return [self initWithCount:0 
+						 shift:CTKVectorNodeShiftIncrement 
+						  root:[CTKVectorNode nodeWithEdit:nil] 
+						  tail:[CTKVectorNode nodeWithEdit:nil]];
+}
+
+- (void) dealloc
+{
+	[root release];
+	[tail release];
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize count, shift, root, tail;
+
+#pragma mark CTKVector protocol
+
+- (id) objectAtIndex:(NSUInteger)anIndex
+{
+	if (anIndex >= count)
+		[self private_raiseRangeExceptionForIndex:anIndex];
+	
+	return [[self leafForIndex:anIndex] objectAtIndex:(anIndex & CTKVectorNodeMaskCoeficient)];
+}
+
+- (id) lastObject
+{
+	return (count == 0) ? nil : [tail objectAtIndex:((count - 1) & CTKVectorNodeMaskCoeficient)];
+}
+
+// cons()
+- (id <CTKVector>) vectorByAddingObject:(id)anObject
+{
+	NSUInteger tailCount = count - [self private_tailOffset];
+	
+	// Room in the tail, we only copy the tail
+	if (tailCount < CTKVectorNodeWidth) {
+		
+		CTKVectorNode *newTail = [CTKVectorNode nodeWithEdit:nil node:tail count:tailCount];
+		[newTail setObject:anObject atIndex:tailCount];
+		
+		return [CTKPersistentVector vectorWithCount:(count + 1) shift:shift root:root tail:newTail];
+	}
+	
+	/*
+	 The tail is full and becomes a leaf of the trie as is, since nodes are immutable.
+	 If the root has no room left for it we grow the trie one level.
+	 */
+	CTKVectorNode *newRoot;
+	NSUInteger newShift = shift;
+	
+	if ((count >> CTKVectorNodeShiftIncrement) > ((NSUInteger)1 << shift)) {
+		
+		newRoot = [CTKVectorNode nodeWithEdit:nil];
+		[newRoot setObject:root atIndex:0];
+		[newRoot setObject:[CTKVectorNode pathWithEdit:nil level:shift node:tail] atIndex:1];
+		newShift += CTKVectorNodeShiftIncrement;
+	}
+	
+	else {
+		newRoot = [self private_pushTailWithLevel:shift parent:root tailNode:tail];
+	}
+	
+	CTKVectorNode *newTail = [CTKVectorNode nodeWithEdit:nil];
+	[newTail setObject:anObject atIndex:0];
+	
+	return [CTKPersistentVector vectorWithCount:(count + 1) shift:newShift root:newRoot tail:newTail];
+}
+
+// assocN()
+- (id <CTKVector>) vectorBySettingObject:(id)anObject atIndex:(NSUInteger)anIndex
+{
+	if (anIndex == count)
+		return [self vectorByAddingObject:anObject];
+	
+	if (anIndex > count)
+		[self private_raiseRangeExceptionForIndex:anIndex];
+	
+	if (anIndex >= [self private_tailOffset]) {
+		
+		CTKVectorNode *newTail = [CTKVectorNode nodeWithEdit:nil node:tail count:(count - [self private_tailOffset])];
+		[newTail setObject:anObject atIndex:(anIndex & CTKVectorNodeMaskCoeficient)];
+		
+		return [CTKPersistentVector vectorWithCount:count shift:shift root:root tail:newTail];
+	}
+	
+	CTKVectorNode *newRoot = [self private_nodeBySettingObject:anObject atIndex:anIndex level:shift node:root];
+	
+	return [CTKPersistentVector vectorWithCount:count shift:shift root:newRoot tail:tail];
+}
+
+// pop()
+- (id <CTKVector>) vectorByRemovingLastObject
+{
+	if (count == 0)
+		@throw [NSException exceptionWithName:NSRangeException 
+									   reason:@"Cannot remove the last object of an empty vector"
+									 userInfo:nil];
+	
+	if (count == 1)
+		return [CTKPersistentVector emptyVector];
+	
+	NSUInteger tailCount = count - [self private_tailOffset];
+	
+	if (tailCount > 1) {
+		
+		CTKVectorNode *newTail = [CTKVectorNode nodeWithEdit:nil node:tail count:(tailCount - 1)];
+		return [CTKPersistentVector vectorWithCount:(count - 1) shift:shift root:root tail:newTail];
+	}
+	
+	// The rightmost leaf of the trie becomes the tail
+	CTKVectorNode *newTail = [self leafForIndex:(count - 2)];
+	CTKVectorNode *newRoot = [self private_popTailWithLevel:shift node:root];
+	NSUInteger newShift = shift;
+	
+	if (newRoot == nil)
+		newRoot = [CTKVectorNode nodeWithEdit:nil];
+	
+	if (shift > CTKVectorNodeShiftIncrement && [newRoot objectAtIndex:1] == nil) {
+		newRoot = [newRoot objectAtIndex:0];
+		newShift -= CTKVectorNodeShiftIncrement;
+	}
+	
+	return [CTKPersistentVector vectorWithCount:(count - 1) shift:newShift root:newRoot tail:newTail];
+}
+
+- (id <CTKVector>) subvectorWithRange:(NSRange)aRange
+{
+	if (NSMaxRange(aRange) > count)
+		[self private_raiseRangeExceptionForIndex:NSMaxRange(aRange)];
+	
+	if (aRange.location == 0 && aRange.length == count)
+		return self;
+	
+	return [CTKPersistentSubVector subVectorWithVector:self range:aRange];
+}
+
+- (void) enumerateObjectsUsingBlock:(void (^)(id obj, NSUInteger idx, BOOL *stop))aBlock
+{
+	BOOL stop = NO;
+	
+	// One descent per leaf, not per element
+	for (NSUInteger base = 0; base < count && !stop; base += CTKVectorNodeWidth) {
+		
+		CTKVectorNode *leaf = [self leafForIndex:base];
+		NSUInteger end = MIN(count - base, CTKVectorNodeWidth);
+		
+		for (NSUInteger i = 0; i < end && !stop; i++)
+			aBlock([leaf objectAtIndex:i], base + i, &stop);
+	}
+}
+
+- (NSArray *) allObjects
+{
+	NSMutableArray *objects = [NSMutableArray arrayWithCapacity:count];
+	
+	[self enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop){
+		[objects addObject:obj];
+	}];
+	
+	return objects;
+}
+
+#pragma mark Operations
+
+- (CTKTransientVector *) transientVector
+{
+	return [CTKTransientVector transientVectorWithVector:self];
+}
+
+- (CTKVectorNode *) leafForIndex:(NSUInteger)anIndex
+{
+	if (anIndex >= [self private_tailOffset])
+		return tail;
+	
+	CTKVectorNode *node = root;
+	
+	for (NSUInteger level = shift; level > 0; level -= CTKVectorNodeShiftIncrement)
+		node = [node objectAtIndex:((anIndex >> level) & CTKVectorNodeMaskCoeficient)];
+	
+	return node;
+}
+
+#pragma mark Private
+
+- (NSUInteger) private_tailOffset
+{
+	if (count < CTKVectorNodeWidth)
+		return 0;
+	
+	return ((count - 1) >> CTKVectorNodeShiftIncrement) << CTKVectorNodeShiftIncrement;
+}
+
+- (CTKVectorNode *) private_pushTailWithLevel:(NSUInteger)aLevel parent:(CTKVectorNode *)aParent tailNode:(CTKVectorNode *)aTailNode
+{
+	NSUInteger subidx = ((count - 1) >> aLevel) & CTKVectorNodeMaskCoeficient;
+	CTKVectorNode *newNode = [CTKVectorNode nodeWithEdit:nil node:aParent count:CTKVectorNodeWidth];
+	CTKVectorNode *nodeToInsert;
+	
+	if (aLevel == CTKVectorNodeShiftIncrement) {
+		nodeToInsert = aTailNode;
+	}
+	
+	else {
+		
+		CTKVectorNode *child = [aParent objectAtIndex:subidx];
+		
+		nodeToInsert = (child != nil)
+		? [self private_pushTailWithLevel:(aLevel - CTKVectorNodeShiftIncrement) parent:child tailNode:aTailNode]
+		: [CTKVectorNode pathWithEdit:nil level:(aLevel - CTKVectorNodeShiftIncrement) node:aTailNode];
+	}
+	
+	[newNode setObject:nodeToInsert atIndex:subidx];
+	
+	return newNode;
+}
+
+- (CTKVectorNode *) private_popTailWithLevel:(NSUInteger)aLevel node:(CTKVectorNode *)aNode
+{
+	NSUInteger subidx = ((count - 2) >> aLevel) & CTKVectorNodeMaskCoeficient;
+	
+	if (aLevel > CTKVectorNodeShiftIncrement) {
+		
+		CTKVectorNode *newChild = [self private_popTailWithLevel:(aLevel - CTKVectorNodeShiftIncrement)
+															node:[aNode objectAtIndex:subidx]];
+		
+		if (newChild == nil && subidx == 0)
+			return nil;
+		
+		CTKVectorNode *newNode = [CTKVectorNode nodeWithEdit:nil node:aNode count:CTKVectorNodeWidth];
+		[newNode setObject:newChild atIndex:subidx];
+		
+		return newNode;
+	}
+	
+	if (subidx == 0)
+		return nil;
+	
+	CTKVectorNode *newNode = [CTKVectorNode nodeWithEdit:nil node:aNode count:CTKVectorNodeWidth];
+	[newNode setObject:nil atIndex:subidx];
+	
+	return newNode;
+}
+
+// doAssoc()
+- (CTKVectorNode *) private_nodeBySettingObject:(id)anObject atIndex:(NSUInteger)anIndex level:(NSUInteger)aLevel node:(CTKVectorNode *)aNode
+{
+	CTKVectorNode *newNode = [CTKVectorNode nodeWithEdit:nil node:aNode count:CTKVectorNodeWidth];
+	
+	if (aLevel == 0) {
+		[newNode setObject:anObject atIndex:(anIndex & CTKVectorNodeMaskCoeficient)];
+	}
+	
+	else {
+		
+		NSUInteger subidx = (anIndex >> aLevel) & CTKVectorNodeMaskCoeficient;
+		CTKVectorNode *newChild = [self private_nodeBySettingObject:anObject 
+															atIndex:anIndex 
+															  level:(aLevel - CTKVectorNodeShiftIncrement)
+															   node:[aNode objectAtIndex:subidx]];
+		[newNode setObject:newChild atIndex:subidx];
+	}
+	
+	return newNode;
+}
+
+- (void) private_raiseRangeExceptionForIndex:(NSUInteger)anIndex
+{
+	NSString *reason = [NSString stringWithFormat:@"Index %U out of bounds [0, %U)", anIndex, count];
+	@throw [NSException exceptionWithName:NSRangeException reason:reason userInfo:nil];
+}
+
+@end
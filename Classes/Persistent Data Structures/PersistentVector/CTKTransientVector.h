@@ -0,0 +1,69 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+@class CTKPersistentVector;
+@class CTKVectorNode;
+
+/*
+ Corresponds to Clojure's PersistentVector.TransientVector class.
+ 
+ A transient updates in place the nodes it has already copied, so building a vector of n elements costs O(n) 
+ instead of creating n intermediate versions. A transient is meant to be used by a single thread and is 
+ invalidated by persistentVector, any later use raises an NSInternalInconsistencyException.
+ */
+@interface CTKTransientVector : NSObject {
+	@private
+	NSUInteger count;
+	NSUInteger shift;
+	CTKVectorNode *root;
+	CTKVectorNode *tail;
+	id edit;
+}
+
+@property (readonly, assign, nonatomic) NSUInteger count;
+
++ (id) transientVectorWithVector:(CTKPersistentVector *)aVector;
+
+- (id) initWithVector:(CTKPersistentVector *)aVector;
+
+- (id) objectAtIndex:(NSUInteger)anIndex;
+
+- (void) addObject:(id)anObject;
+
+/**
+ * \brief An index equal to count appends.
+ */
+- (void) setObject:(id)anObject atIndex:(NSUInteger)anIndex;
+
+- (void) removeLastObject;
+
+/**
+ * \brief Returns a persistent vector sharing the nodes of the receiver in O(1) and invalidates the receiver.
+ */
+- (CTKPersistentVector *) persistentVector;
+
+@end
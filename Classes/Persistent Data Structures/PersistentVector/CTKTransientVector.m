@@ -0,0 +1,330 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKTransientVector.h"
+#import "CTKPersistentVector.h"
+#import "CTKVectorNode.h"
+
+@interface CTKTransientVector ()
+
+@property (readwrite, assign, nonatomic) NSUInteger count;
+@property (readwrite, assign, nonatomic) NSUInteger shift;
+@property (readwrite, retain, nonatomic) CTKVectorNode *root;
+@property (readwrite, retain, nonatomic) CTKVectorNode *tail;
+@property (readwrite, retain, nonatomic) id edit;
+
+@end
+
+@interface CTKTransientVector (Private)
+
+- (void) private_ensureEditable;
+- (CTKVectorNode *) private_editableNode:(CTKVectorNode *)aNode;
+- (NSUInteger) private_tailOffset;
+- (CTKVectorNode *) private_leafForIndex:(NSUInteger)anIndex;
+- (CTKVectorNode *) private_pushTailWithLevel:(NSUInteger)aLevel parent:(CTKVectorNode *)aParent tailNode:(CTKVectorNode *)aTailNode;
+- (CTKVectorNode *) private_popTailWithLevel:(NSUInteger)aLevel node:(CTKVectorNode *)aNode;
+- (CTKVectorNode *) private_nodeBySettingObject:(id)anObject atIndex:(NSUInteger)anIndex level:(NSUInteger)aLevel node:(CTKVectorNode *)aNode;
+- (void) private_raiseRangeExceptionForIndex:(NSUInteger)anIndex;
+
+@end
+
+
+@implementation CTKTransientVector
+
+#pragma mark Initialization
+
++ (id) transientVectorWithVector:(CTKPersistentVector *)aVector
+{
+	return [[[CTKTransientVector alloc] initWithVector:aVector] autorelease];
+}
+
+- (id) initWithVector:(CTKPersistentVector *)aVector
+{
+	NSParameterAssert(aVector);
+	
+	self = [super init];
+	
+	if (self != nil) {
+		
+		id anEdit = [NSObject new];
+		self.edit = anEdit;
+		[anEdit release];
+		
+		self.count = aVector.count;
+		self.shift = aVector.shift;
+		self.root = [CTKVectorNode nodeWithEdit:edit node:aVector.root count:CTKVectorNodeWidth];
+		self.tail = [CTKVectorNode nodeWithEdit:edit node:aVector.tail count:CTKVectorNodeWidth];
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[root release];
+	[tail release];
+	[edit release];
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize count, shift, root, tail, edit;
+
+#pragma mark Operations
+
+- (id) objectAtIndex:(NSUInteger)anIndex
+{
+	[self private_ensureEditable];
+	
+	if (anIndex >= count)
+		[self private_raiseRangeExceptionForIndex:anIndex];
+	
+	return [[self private_leafForIndex:anIndex] objectAtIndex:(anIndex & CTKVectorNodeMaskCoeficient)];
+}
+
+- (void) addObject:(id)anObject
+{
+	[self private_ensureEditable];
+	
+	NSUInteger tailCount = count - [self private_tailOffset];
+	
+	if (tailCount < CTKVectorNodeWidth) {
+		[tail setObject:anObject atIndex:tailCount];
+		count++;
+		return;
+	}
+	
+	// The tail is full and it is ours, it becomes a leaf of the trie without copying
+	CTKVectorNode *tailNode = tail;
+	CTKVectorNode *newRoot;
+	NSUInteger newShift = shift;
+	
+	if ((count >> CTKVectorNodeShiftIncrement) > ((NSUInteger)1 << shift)) {
+		
+		newRoot = [CTKVectorNode nodeWithEdit:edit];
+		[newRoot setObject:root atIndex:0];
+		[newRoot setObject:[CTKVectorNode pathWithEdit:edit level:shift node:tailNode] atIndex:1];
+		newShift += CTKVectorNodeShiftIncrement;
+	}
+	
+	else {
+		newRoot = [self private_pushTailWithLevel:shift parent:root tailNode:tailNode];
+	}
+	
+	CTKVectorNode *newTail = [CTKVectorNode nodeWithEdit:edit];
+	[newTail setObject:anObject atIndex:0];
+	
+	self.root = newRoot;
+	self.tail = newTail;
+	self.shift = newShift;
+	count++;
+}
+
+- (void) setObject:(id)anObject atIndex:(NSUInteger)anIndex
+{
+	[self private_ensureEditable];
+	
+	if (anIndex == count) {
+		[self addObject:anObject];
+		return;
+	}
+	
+	if (anIndex > count)
+		[self private_raiseRangeExceptionForIndex:anIndex];
+	
+	if (anIndex >= [self private_tailOffset]) {
+		[tail setObject:anObject atIndex:(anIndex & CTKVectorNodeMaskCoeficient)];
+		return;
+	}
+	
+	self.root = [self private_nodeBySettingObject:anObject atIndex:anIndex level:shift node:root];
+}
+
+- (void) removeLastObject
+{
+	[self private_ensureEditable];
+	
+	if (count == 0)
+		@throw [NSException exceptionWithName:NSRangeException 
+									   reason:@"Cannot remove the last object of an empty vector"
+									 userInfo:nil];
+	
+	NSUInteger lastIndex = count - 1;
+	
+	if (count == 1 || (lastIndex & CTKVectorNodeMaskCoeficient) > 0) {
+		[tail setObject:nil atIndex:(lastIndex & CTKVectorNodeMaskCoeficient)];
+		count--;
+		return;
+	}
+	
+	// The rightmost leaf of the trie becomes the tail
+	CTKVectorNode *newTail = [self private_editableNode:[self private_leafForIndex:(count - 2)]];
+	CTKVectorNode *newRoot = [self private_popTailWithLevel:shift node:root];
+	NSUInteger newShift = shift;
+	
+	if (newRoot == nil)
+		newRoot = [CTKVectorNode nodeWithEdit:edit];
+	
+	if (shift > CTKVectorNodeShiftIncrement && [newRoot objectAtIndex:1] == nil) {
+		newRoot = [self private_editableNode:[newRoot objectAtIndex:0]];
+		newShift -= CTKVectorNodeShiftIncrement;
+	}
+	
+	self.root = newRoot;
+	self.tail = newTail;
+	self.shift = newShift;
+	count--;
+}
+
+- (CTKPersistentVector *) persistentVector
+{
+	[self private_ensureEditable];
+	
+	// From now on no one owns the nodes carrying our edit object
+	self.edit = nil;
+	
+	return [CTKPersistentVector vectorWithCount:count shift:shift root:root tail:tail];
+}
+
+#pragma mark Private
+
+- (void) private_ensureEditable
+{
+	if (edit == nil)
+		@throw [NSException exceptionWithName:NSInternalInconsistencyException
+									   reason:@"Transient used after persistentVector call"
+									 userInfo:nil];
+}
+
+- (CTKVectorNode *) private_editableNode:(CTKVectorNode *)aNode
+{
+	if (aNode.edit == edit)
+		return aNode;
+	
+	return [CTKVectorNode nodeWithEdit:edit node:aNode count:CTKVectorNodeWidth];
+}
+
+- (NSUInteger) private_tailOffset
+{
+	if (count < CTKVectorNodeWidth)
+		return 0;
+	
+	return ((count - 1) >> CTKVectorNodeShiftIncrement) << CTKVectorNodeShiftIncrement;
+}
+
+- (CTKVectorNode *) private_leafForIndex:(NSUInteger)anIndex
+{
+	if (anIndex >= [self private_tailOffset])
+		return tail;
+	
+	CTKVectorNode *node = root;
+	
+	for (NSUInteger level = shift; level > 0; level -= CTKVectorNodeShiftIncrement)
+		node = [node objectAtIndex:((anIndex >> level) & CTKVectorNodeMaskCoeficient)];
+	
+	return node;
+}
+
+- (CTKVectorNode *) private_pushTailWithLevel:(NSUInteger)aLevel parent:(CTKVectorNode *)aParent tailNode:(CTKVectorNode *)aTailNode
+{
+	CTKVectorNode *node = [self private_editableNode:aParent];
+	NSUInteger subidx = ((count - 1) >> aLevel) & CTKVectorNodeMaskCoeficient;
+	CTKVectorNode *nodeToInsert;
+	
+	if (aLevel == CTKVectorNodeShiftIncrement) {
+		nodeToInsert = aTailNode;
+	}
+	
+	else {
+		
+		CTKVectorNode *child = [node objectAtIndex:subidx];
+		
+		nodeToInsert = (child != nil)
+		? [self private_pushTailWithLevel:(aLevel - CTKVectorNodeShiftIncrement) parent:child tailNode:aTailNode]
+		: [CTKVectorNode pathWithEdit:edit level:(aLevel - CTKVectorNodeShiftIncrement) node:aTailNode];
+	}
+	
+	[node setObject:nodeToInsert atIndex:subidx];
+	
+	return node;
+}
+
+- (CTKVectorNode *) private_popTailWithLevel:(NSUInteger)aLevel node:(CTKVectorNode *)aNode
+{
+	NSUInteger subidx = ((count - 2) >> aLevel) & CTKVectorNodeMaskCoeficient;
+	
+	if (aLevel > CTKVectorNodeShiftIncrement) {
+		
+		CTKVectorNode *newChild = [self private_popTailWithLevel:(aLevel - CTKVectorNodeShiftIncrement)
+															node:[aNode objectAtIndex:subidx]];
+		
+		if (newChild == nil && subidx == 0)
+			return nil;
+		
+		CTKVectorNode *node = [self private_editableNode:aNode];
+		[node setObject:newChild atIndex:subidx];
+		
+		return node;
+	}
+	
+	if (subidx == 0)
+		return nil;
+	
+	CTKVectorNode *node = [self private_editableNode:aNode];
+	[node setObject:nil atIndex:subidx];
+	
+	return node;
+}
+
+- (CTKVectorNode *) private_nodeBySettingObject:(id)anObject atIndex:(NSUInteger)anIndex level:(NSUInteger)aLevel node:(CTKVectorNode *)aNode
+{
+	CTKVectorNode *node = [self private_editableNode:aNode];
+	
+	if (aLevel == 0) {
+		[node setObject:anObject atIndex:(anIndex & CTKVectorNodeMaskCoeficient)];
+	}
+	
+	else {
+		
+		NSUInteger subidx = (anIndex >> aLevel) & CTKVectorNodeMaskCoeficient;
+		CTKVectorNode *newChild = [self private_nodeBySettingObject:anObject 
+															atIndex:anIndex 
+															  level:(aLevel - CTKVectorNodeShiftIncrement)
+															   node:[node objectAtIndex:subidx]];
+		[node setObject:newChild atIndex:subidx];
+	}
+	
+	return node;
+}
+
+- (void) private_raiseRangeExceptionForIndex:(NSUInteger)anIndex
+{
+	NSString *reason = [NSString stringWithFormat:@"Index %U out of bounds [0, %U)", anIndex, count];
+	@throw [NSException exceptionWithName:NSRangeException reason:reason userInfo:nil];
+}
+
+@end
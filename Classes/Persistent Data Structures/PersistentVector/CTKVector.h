@@ -0,0 +1,72 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+
+/*!
+    @protocol    CTKVector <NSObject>
+    @abstract    Common interface of CTKPersistentVector and CTKPersistentSubVector
+    @discussion  Corresponds to Clojure's IPersistentVector. All the operations leave the receiver untouched and return a new version. 
+*/
+@protocol CTKVector <NSObject>
+
+@property (readonly, assign, nonatomic) NSUInteger count;
+
+/**
+ * \throws NSRangeException
+ */
+- (id) objectAtIndex:(NSUInteger)anIndex;
+
+- (id) lastObject;
+
+/**
+ * \brief Corresponds to the Clojure cons method.
+ */
+- (id <CTKVector>) vectorByAddingObject:(id)anObject;
+
+/**
+ * \brief Corresponds to the Clojure assocN method. An index equal to count appends.
+ * \throws NSRangeException
+ */
+- (id <CTKVector>) vectorBySettingObject:(id)anObject atIndex:(NSUInteger)anIndex;
+
+/**
+ * \brief Corresponds to the Clojure pop method.
+ * \throws NSRangeException when the vector is empty
+ */
+- (id <CTKVector>) vectorByRemovingLastObject;
+
+/**
+ * \brief Returns a view over aRange of the receiver in O(1), no element is copied.
+ * \throws NSRangeException
+ */
+- (id <CTKVector>) subvectorWithRange:(NSRange)aRange;
+
+- (void) enumerateObjectsUsingBlock:(void (^)(id obj, NSUInteger idx, BOOL *stop))aBlock;
+
+- (NSArray *) allObjects;
+
+@end
@@ -0,0 +1,70 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import <Cocoa/Cocoa.h>
+
+static NSUInteger const CTKVectorNodeShiftIncrement = 5;
+static NSUInteger const CTKVectorNodeWidth = 32;
+static NSUInteger const CTKVectorNodeMaskCoeficient = 0x1f;
+
+/*
+ Corresponds to Clojure's PersistentVector.Node class.
+ A node holds up to 32 children (inner nodes) or 32 objects (leaves) in a plain C array. 
+ 
+ The edit object identifies the CTKTransientVector that created the node. A transient can update in place the nodes
+ that carry its own edit object and has to copy any other node. Nodes retain their edit object so its address 
+ cannot be reused by a later transient. Nodes created by persistent operations have a nil edit.
+ */
+@interface CTKVectorNode : NSObject {
+	@private
+	id edit;
+	id array[32];
+}
+
+@property (readonly, retain) id edit;
+
++ (id) nodeWithEdit:(id)anEdit;
+
+/**
+ * \brief Returns a copy of aNode owned by anEdit. The first aCount slots are copied, the others are left empty.
+ */
++ (id) nodeWithEdit:(id)anEdit node:(CTKVectorNode *)aNode count:(NSUInteger)aCount;
+
+/**
+ * \brief Corresponds to the Clojure newPath method. Wraps aNode in a chain of single child nodes down from aLevel.
+ */
++ (CTKVectorNode *) pathWithEdit:(id)anEdit level:(NSUInteger)aLevel node:(CTKVectorNode *)aNode;
+
+- (id) initWithEdit:(id)anEdit;
+
+- (id) objectAtIndex:(NSUInteger)anIndex;
+
+/**
+ * \warning Only to be called on a node that has just been created or that is owned by the calling transient.
+ */
+- (void) setObject:(id)anObject atIndex:(NSUInteger)anIndex;
+
+@end
@@ -0,0 +1,107 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+
+#import "CTKVectorNode.h"
+
+@interface CTKVectorNode ()
+
+@property (readwrite, retain) id edit;
+
+@end
+
+
+@implementation CTKVectorNode
+
+#pragma mark Initialization
+
++ (id) nodeWithEdit:(id)anEdit
+{
+	return [[[CTKVectorNode alloc] initWithEdit:anEdit] autorelease];
+}
+
++ (id) nodeWithEdit:(id)anEdit node:(CTKVectorNode *)aNode count:(NSUInteger)aCount
+{
+	NSParameterAssert(aCount <= CTKVectorNodeWidth);
+	
+	CTKVectorNode *node = [[CTKVectorNode alloc] initWithEdit:anEdit];
+	
+	for (NSUInteger i = 0; i < aCount; i++)
+		node->array[i] = [aNode->array[i] retain];
+	
+	return [node autorelease];
+}
+
++ (CTKVectorNode *) pathWithEdit:(id)anEdit level:(NSUInteger)aLevel node:(CTKVectorNode *)aNode
+{
+	if (aLevel == 0)
+		return aNode;
+	
+	CTKVectorNode *node = [CTKVectorNode nodeWithEdit:anEdit];
+	[node setObject:[self pathWithEdit:anEdit level:(aLevel - CTKVectorNodeShiftIncrement) node:aNode] atIndex:0];
+	
+	return node;
+}
+
+- (id) initWithEdit:(id)anEdit
+{
+	self = [super init];
+	
+	if (self != nil) {
+		self.edit = anEdit;
+		// array is zeroed by alloc
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	for (NSUInteger i = 0; i < CTKVectorNodeWidth; i++)
+		[array[i] release];
+	
+	[edit release];
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize edit;
+
+#pragma mark Operations
+
+- (id) objectAtIndex:(NSUInteger)anIndex
+{
+	return array[anIndex];
+}
+
+- (void) setObject:(id)anObject atIndex:(NSUInteger)anIndex
+{
+	id old = array[anIndex];
+	array[anIndex] = [anObject retain];
+	[old release];
+}
+
+@end
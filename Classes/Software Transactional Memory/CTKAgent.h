@@ -0,0 +1,118 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#import <Cocoa/Cocoa.h>
+@class CTKAgent;
+
+/*
+ * \class CTKAgentAction CTKAgent.h
+ * \brief A block sent to an agent, corresponds to Clojure's Agent.Action.
+ * \details Created by send: and sendOff:. Actions sent inside a transaction are held by it and dispatched once it 
+ * commits, you should not need to create or dispatch them yourself.
+ */
+@interface CTKAgentAction : NSObject {
+	@private
+	CTKAgent *agent;
+	id (^block)(id);
+	BOOL blocking;
+	CTKAgentAction *next; // link in the queue of the agent
+}
+
+- (id) initWithAgent:(CTKAgent *)anAgent block:(id (^)(id))aBlock blocking:(BOOL)isBlocking;
+
+/**
+ * \brief Queues the receiver in its agent, outside of any transaction.
+ */
+- (void) dispatch;
+
+@end
+
+#pragma mark -
+
+/*
+ * \class CTKAgent CTKAgent.h
+ * \defgroup STM Software Transactional Memory
+ * \brief Corresponds to Clojure's Agent class: a value changed asynchronously by the actions sent to it.
+ * \details send: and sendOff: return immediately, the actions are applied later, one at a time and in the order they 
+ * were sent (for the sends of one thread), each one receiving the value returned by the previous one. 
+ * dereference never blocks and returns the last published value.
+ *
+ * Senders push their actions on a lock-free queue. A single drain runs at any time for an agent: it takes every 
+ * pending action at once, applies the whole batch and publishes the final value, readers never see the values in 
+ * between and a burst of sends costs a single publication. Replaced values are released through 
+ * CTKEpochRelease(), dereference does not lock.
+ *
+ * send: drains on the default priority global queue and is meant for CPU bound actions. sendOff: drains on the low 
+ * priority global queue, the system brings up more worker threads when the ones running blocking actions wait in the 
+ * kernel. A drain running on the default queue stops in front of a sendOff: action, publishes and moves to the 
+ * low priority queue.
+ *
+ * Sends made inside a transaction are held until the transaction commits (after its durable references are synced) 
+ * and dropped if it retries, an action is sent once whatever the number of attempts.
+ *
+ * An action that raises an exception is logged and skipped, the next action receives the value it was given.
+ * \code
+ * CTKAgent *log = [CTKAgent agentWithValue:[CTKPersistentVector emptyVector]];
+ * [log send:^ id (id aVector) {
+ *		return [aVector vectorByAddingObject:entry];
+ * }];
+ * \endcode
+ */
+@interface CTKAgent : NSObject {
+	@private
+	id state;
+	CTKAgentAction * volatile pending; // sent, not yet taken by a drain, most recent first
+	CTKAgentAction *batch; // taken by a drain and not applied yet, in sending order. Only used by the drain
+	volatile int32_t queued; // actions sent and not applied, a send taking it from 0 to 1 schedules the drain
+}
+
++ (id) agentWithValue:(id)aValue;
+
+- (id) initWithValue:(id)aValue;
+
+/**
+ * \return The value published by the last drain.
+ */
+- (id) dereference;
+
+/**
+ * \brief Queues aBlock, it will be called with the value of the receiver and return its new value.
+ * \details For actions that do not block, they share a pool sized to the number of cores.
+ */
+- (void) send:(id (^)(id))aBlock;
+
+/**
+ * \brief Same as send: for actions that may block (I/O, locks), they do not hold up the send: pool.
+ */
+- (void) sendOff:(id (^)(id))aBlock;
+
+/**
+ * \brief Blocks until every action sent by the calling thread before this call is applied.
+ * \warning Do not call it inside a transaction, the actions sent there are held until it commits, nor from an 
+ * action of the receiver.
+ */
+- (void) await;
+
+@end
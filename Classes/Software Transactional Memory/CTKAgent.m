@@ -0,0 +1,307 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#import "CTKAgent.h"
+#import "CTKLockingTransaction.h"
+#import "CTKEpochReclamation.h"
+#include <dispatch/dispatch.h>
+#include <libkern/OSAtomic.h>
+
+static void CTKAgentDrainCompute(void *anAgent);
+static void CTKAgentDrainBlocking(void *anAgent);
+
+@interface CTKAgentAction ()
+
+@property (readonly, copy, nonatomic) id (^block)(id);
+@property (readonly, assign, nonatomic) BOOL blocking;
+@property (readwrite, assign, nonatomic) CTKAgentAction *next;
+
+@end
+
+@interface CTKAgent (Private)
+
+- (void) private_enqueueAction:(CTKAgentAction *)anAction;
+- (void) private_scheduleBlocking:(BOOL)blocking;
+- (void) private_drainBlocking:(BOOL)blocking;
+- (CTKAgentAction *) private_takePending;
+- (void) private_publish:(id)aValue;
+
+@end
+
+#pragma mark -
+
+@implementation CTKAgentAction
+
+@synthesize block, blocking, next;
+
+- (id) initWithAgent:(CTKAgent *)anAgent block:(id (^)(id))aBlock blocking:(BOOL)isBlocking
+{
+	NSParameterAssert(anAgent);
+	NSParameterAssert(aBlock);
+	self = [super init];
+	
+	if (self != nil) {
+		agent = [anAgent retain];
+		block = [aBlock copy];
+		blocking = isBlocking;
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[agent release];
+	[block release];
+	[super dealloc];
+}
+
+- (void) dispatch
+{
+	[agent private_enqueueAction:self];
+}
+
+@end
+
+#pragma mark -
+
+@implementation CTKAgent
+
++ (id) agentWithValue:(id)aValue
+{
+	return [[[CTKAgent alloc] initWithValue:aValue] autorelease];
+}
+
+- (id) init
+{
+	return [self initWithValue:nil];
+}
+
+- (id) initWithValue:(id)aValue
+{
+	self = [super init];
+	
+	if (self != nil) {
+		state = [aValue retain];
+	}
+	
+	return self;
+}
+
+/*
+ A scheduled drain retains the agent, the queue and the batch are empty once it is deallocated.
+ */
+- (void) dealloc
+{
+	[state release];
+	[super dealloc];
+}
+
+- (id) dereference
+{
+	CTKEpoch epoch = CTKEpochEnter();
+	id value = [[state retain] autorelease];
+	
+	CTKEpochExit(epoch);
+	
+	return value;
+}
+
+- (void) send:(id (^)(id))aBlock
+{
+	CTKLockingTransaction *txn = [CTKLockingTransaction runningTransaction];
+	
+	if (txn != nil)
+		[txn send:self block:aBlock];
+	
+	else {
+		CTKAgentAction *action = [[CTKAgentAction alloc] initWithAgent:self block:aBlock blocking:NO];
+		[action dispatch];
+		[action release];
+	}
+}
+
+- (void) sendOff:(id (^)(id))aBlock
+{
+	CTKLockingTransaction *txn = [CTKLockingTransaction runningTransaction];
+	
+	if (txn != nil)
+		[txn sendOff:self block:aBlock];
+	
+	else {
+		CTKAgentAction *action = [[CTKAgentAction alloc] initWithAgent:self block:aBlock blocking:YES];
+		[action dispatch];
+		[action release];
+	}
+}
+
+- (void) await
+{
+	NSAssert(![CTKLockingTransaction isRunning], @"await cannot be called inside a transaction.");
+	dispatch_semaphore_t applied = dispatch_semaphore_create(0);
+	
+	[self send:^ id (id aValue) {
+		dispatch_semaphore_signal(applied);
+		return aValue;
+	}];
+	
+	dispatch_semaphore_wait(applied, DISPATCH_TIME_FOREVER);
+	dispatch_release(applied);
+}
+
+- (NSString *) description
+{
+	return [NSString stringWithFormat:@"<%@ %p: %@>", [self class], self, [self dereference]];
+}
+
+@end
+
+#pragma mark -
+
+@implementation CTKAgent (Private)
+
+/*
+ The action is pushed before it is counted. A drain may take and apply it before the increment, its count then goes
+ below zero until the increment brings it back, and that increment cannot schedule a second drain.
+ */
+- (void) private_enqueueAction:(CTKAgentAction *)anAction
+{
+	CTKAgentAction *head;
+	
+	[anAction retain]; // released by the drain once applied
+	
+	do {
+		head = pending;
+		anAction.next = head;
+	} while (!OSAtomicCompareAndSwapPtrBarrier(head, anAction, (void * volatile *)&pending));
+	
+	if (OSAtomicIncrement32Barrier(&queued) == 1)
+		[self private_scheduleBlocking:anAction.blocking];
+}
+
+- (void) private_scheduleBlocking:(BOOL)blocking
+{
+	[self retain]; // released when the drain finds nothing left to apply
+	
+	if (blocking)
+		dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), self, CTKAgentDrainBlocking);
+	else
+		dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), self, CTKAgentDrainCompute);
+}
+
+/*
+ Swaps the whole queue out and reverses it, the result is in sending order.
+ */
+- (CTKAgentAction *) private_takePending
+{
+	CTKAgentAction *head;
+	
+	do {
+		head = pending;
+	} while (head != nil && !OSAtomicCompareAndSwapPtrBarrier(head, nil, (void * volatile *)&pending));
+	
+	CTKAgentAction *ordered = nil;
+	
+	while (head != nil) {
+		CTKAgentAction *following = head.next;
+		head.next = ordered;
+		ordered = head;
+		head = following;
+	}
+	
+	return ordered;
+}
+
+- (void) private_drainBlocking:(BOOL)blocking
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	id value = [state retain];
+	int32_t applied = 0;
+	
+	if (batch == nil)
+		batch = [self private_takePending];
+	
+	while (batch != nil) {
+		
+		CTKAgentAction *action = batch;
+		
+		// Blocking actions do not run on the compute pool, the rest of the batch moves to the blocking one
+		if (action.blocking && !blocking)
+			break;
+		
+		batch = action.next;
+		action.next = nil;
+		
+		@try {
+			id result = action.block(value);
+			[value release];
+			value = [result retain];
+		}
+		@catch (NSException *e) {
+			CTKErrorLog(@"An action of %p raised %@, it is skipped.", self, e);
+		}
+		
+		[action release];
+		applied++;
+	}
+	
+	[self private_publish:value];
+	[value release];
+	[pool drain];
+	
+	if (OSAtomicAdd32Barrier(-applied, &queued) > 0) {
+		[self private_scheduleBlocking:(batch != nil)];
+	}
+	
+	[self release]; // the retain of this drain
+}
+
+- (void) private_publish:(id)aValue
+{
+	if (aValue == state)
+		return;
+	
+	CTKEpoch epoch = CTKEpochEnter();
+	id previous = state;
+	
+	state = [aValue retain];
+	OSMemoryBarrier();
+	CTKEpochRelease(previous);
+	CTKEpochExit(epoch);
+}
+
+@end
+
+#pragma mark -
+
+static void CTKAgentDrainCompute(void *anAgent)
+{
+	[(CTKAgent *)anAgent private_drainBlocking:NO];
+}
+
+static void CTKAgentDrainBlocking(void *anAgent)
+{
+	[(CTKAgent *)anAgent private_drainBlocking:YES];
+}
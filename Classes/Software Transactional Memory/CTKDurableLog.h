@@ -0,0 +1,194 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#import <Cocoa/Cocoa.h>
+#include <pthread.h>
+@class CTKReference;
+
+extern NSString * const CTKDurableLogErrorDomain;
+
+enum {
+	CTKDurableLogIOError = 3000,
+	CTKDurableLogFormatError = 3001
+};
+
+/*
+ When a committing transaction waits for its values to reach the disk.
+ */
+typedef enum {
+	CTKDurableLogSyncCommit = 0,	// commit returns once the values are fsynced, commits of many threads share one fsync
+	CTKDurableLogSyncInterval,		// the log is fsynced every syncInterval ms, a crash loses at most that window
+	CTKDurableLogSyncNone			// the log is written but never fsynced, the OS decides when it reaches the disk
+} CTKDurableLogSyncPolicy;
+
+/*
+ * \class CTKDurableLogEntry CTKDurableLog.h
+ * \brief The encoded value of a reference, appended to the log once its commit point is known.
+ * \details Committing transactions encode the values they set before locking the references: archiving a large 
+ * value (a whole CTKPersistentHashMap) takes time proportional to its size and must stay out of the critical section.
+ */
+@interface CTKDurableLogEntry : NSObject {
+	@private
+	NSString *name;
+	id value;
+	NSData *nameData;
+	NSData *valueData;
+	uint32_t checksum; // of the name and value bytes, the record header is folded in when it is appended
+}
+
+@end
+
+/*
+ * \class CTKDurableLog CTKDurableLog.h
+ * \brief A write-ahead log of the values committed to designated references.
+ * \details When a transaction commits, the new values of the references registered with a log are appended to it 
+ * tagged with their commit point (see CTKLockingTransaction private_commitPoint). Appends only copy bytes to a buffer, 
+ * a flusher thread writes the buffer and fsyncs it: every commit waiting under CTKDurableLogSyncCommit is covered by
+ * the same fsync (group commit). The references are unlocked before waiting, other transactions may read a value 
+ * before it is durable but no commit returns before its values are.
+ * A commit fails with CTKTransactionDurabilityError when a log it appends to is closed or failed (nothing is
+ * committed), or when the log fails before the values are synced (they are committed but may be lost on a crash).
+ *
+ * The log is a directory of segments (%016llx.wal) and checkpoints (%016llx.checkpoint). Segments are rotated once they
+ * reach segmentLimit bytes, and every few segments the last committed value of each reference is written to a checkpoint 
+ * and the segments it covers are deleted, on a global queue so that the flusher keeps syncing commits. Opening the log replays the last checkpoint and the segments that follow it,
+ * referenceNamed:initialValue: returns references bound to the recovered values.
+ *
+ * Values must conform to NSCoding, they are encoded with NSKeyedArchiver (CTKPersistentHashMap does).
+ * \code
+ * CTKDurableLog *log = [CTKDurableLog logWithDirectory:path syncPolicy:CTKDurableLogSyncCommit error:&error];
+ * CTKReference *sessions = [log referenceNamed:@"sessions" initialValue:[CTKPersistentHashMap emptyHashMap]];
+ * \endcode
+ */
+@interface CTKDurableLog : NSObject {
+	@private
+	NSString *directory;
+	CTKDurableLogSyncPolicy syncPolicy;
+	NSUInteger syncInterval;
+	NSUInteger segmentLimit;
+	NSUInteger checkpointSegments;
+	
+	pthread_mutex_t mutex;
+	pthread_cond_t appendedCondition;	// signaled when there is something to flush
+	pthread_cond_t flushedCondition;	// broadcasted when syncedTicket moves or a scheduled checkpoint ends
+	pthread_t flusher;
+	BOOL flusherRunning;
+	BOOL closing;
+	BOOL checkpointScheduled;			// a checkpoint requested by the flusher runs on a global queue
+	int posixError;						// first write or fsync failure, the log stops accepting appends
+	
+	NSMutableData *pending;				// appended but not yet written
+	uint64_t appendedTicket;			// bytes appended since the log was opened
+	uint64_t syncedTicket;				// bytes written (and synced, as the policy says)
+	
+	int descriptor;
+	uint64_t segment;
+	uint64_t segmentLength;
+	uint64_t checkpoint;				// first segment not covered by the last checkpoint
+	
+	NSMutableDictionary *values;		// name -> last appended value, what the next checkpoint holds
+	NSMutableDictionary *points;		// name -> commit point of that value
+	NSMutableDictionary *recovered;		// name -> value found when opening, consumed by referenceNamed:initialValue:
+	NSArray *recoveredNames;			// the names found when opening
+}
+
+@property (readonly, copy) NSString *directory;
+@property (readonly, assign) CTKDurableLogSyncPolicy syncPolicy;
+/**
+ * \brief The fsync period in ms of CTKDurableLogSyncInterval. Defaults to 10.
+ */
+@property (readwrite, assign) NSUInteger syncInterval;
+/**
+ * \brief Segment size in bytes that triggers a rotation. Defaults to 64 MB.
+ */
+@property (readwrite, assign) NSUInteger segmentLimit;
+/**
+ * \brief Number of rotated segments that triggers a checkpoint. Defaults to 4.
+ */
+@property (readwrite, assign) NSUInteger checkpointSegments;
+
+/**
+ * \brief Opens the log at aPath, creating the directory if needed, and recovers the values it holds.
+ */
++ (id) logWithDirectory:(NSString *)aPath syncPolicy:(CTKDurableLogSyncPolicy)aPolicy error:(NSError **)error;
+
+- (id) initWithDirectory:(NSString *)aPath syncPolicy:(CTKDurableLogSyncPolicy)aPolicy error:(NSError **)error;
+
+/**
+ * \return A reference registered with this log under aName, holding the recovered value for aName or aValue if the log
+ * has none. Names identify references across restarts, each name must be used by a single reference.
+ */
+- (CTKReference *) referenceNamed:(NSString *)aName initialValue:(id)aValue;
+
+/**
+ * \brief Makes aRef durable from its next commit on. Its current value is not logged.
+ */
+- (void) registerReference:(CTKReference *)aRef name:(NSString *)aName;
+
+/**
+ * \return The names the log recovered values for.
+ */
+- (NSArray *) recoveredNames;
+
+/**
+ * \brief Writes a checkpoint now and deletes the segments it covers.
+ */
+- (BOOL) checkpoint:(NSError **)error;
+
+/**
+ * \brief Flushes and fsyncs what was appended, then stops the flusher and waits for a running automatic checkpoint.
+ * Later commits of registered refs are not logged.
+ */
+- (void) close;
+
+#pragma mark Private Operations
+
+/**
+ * \return The encoded aValue, owned by the caller.
+ * \warning Called by committing transactions before they lock aRef, you should not call this method directly.
+ */
+- (CTKDurableLogEntry *) newEntryWithValue:(id)aValue forReference:(CTKReference *)aRef;
+
+/**
+ * \return A ticket to pass to waitForTicket:.
+ * \warning Called by committing transactions while they hold the lock of the reference, you should not call this 
+ * method directly.
+ */
+- (uint64_t) appendEntry:(CTKDurableLogEntry *)anEntry point:(NSUInteger)aPoint;
+
+/**
+ * \brief newEntryWithValue:forReference: then appendEntry:point:, for values only known once the reference is locked
+ * (commutes, merges).
+ * \warning You should not call this method directly.
+ */
+- (uint64_t) appendValue:(id)aValue forReference:(CTKReference *)aRef point:(NSUInteger)aPoint;
+
+/**
+ * \brief Blocks until the ticket is durable as the sync policy says (does not block for CTKDurableLogSyncInterval and CTKDurableLogSyncNone).
+ * \warning You should not call this method directly.
+ */
+- (BOOL) waitForTicket:(uint64_t)aTicket;
+
+@end
@@ -0,0 +1,911 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#import "CTKDurableLog.h"
+#import "CTKReference.h"
+#import "CTKLockingTransaction.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <dispatch/dispatch.h>
+
+NSString * const CTKDurableLogErrorDomain = @"CTKDurableLogErrorDomain";
+
+static char const CTKDurableLogMagic[4] = {'C', 'T', 'K', 'W'};
+static uint32_t const CTKDurableLogVersion = 1;
+
+static NSString * const CTKDurableLogSegmentExtension = @"wal";
+static NSString * const CTKDurableLogCheckpointExtension = @"checkpoint";
+static NSString * const CTKDurableLogValuesKey = @"values";
+static NSString * const CTKDurableLogPointsKey = @"points";
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+} CTKDurableLogSegmentHeader;
+
+/*
+ A record is its header followed by the UTF-8 name of the reference and the keyed archive of its value (empty for nil).
+ The checksum covers everything after it, a record that does not match ends the replay of its segment (torn write).
+ It is computed over the name and value first so that the value is hashed when encoded, before the commit point is 
+ known.
+ */
+typedef struct {
+	uint32_t length;		// name and value bytes following the header
+	uint32_t checksum;
+	uint64_t point;
+	uint32_t nameLength;
+	uint32_t reserved;
+} CTKDurableLogRecordHeader;
+
+#pragma mark Util Functions
+
+// FNV-1a
+static uint32_t CTKDurableLogChecksum(uint32_t hash, const void *someBytes, size_t aLength)
+{
+	const uint8_t *bytes = someBytes;
+	
+	for (size_t i = 0; i < aLength; i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	
+	return hash;
+}
+
+static uint32_t CTKDurableLogPayloadChecksum(const void *name, size_t nameLength, const void *value, size_t valueLength)
+{
+	uint32_t hash = 2166136261u;
+	
+	hash = CTKDurableLogChecksum(hash, name, nameLength);
+	hash = CTKDurableLogChecksum(hash, value, valueLength);
+	
+	return hash;
+}
+
+static uint32_t CTKDurableLogRecordChecksum(const CTKDurableLogRecordHeader *header, uint32_t payloadChecksum)
+{
+	return CTKDurableLogChecksum(payloadChecksum, &header->point, sizeof(CTKDurableLogRecordHeader) - offsetof(CTKDurableLogRecordHeader, point));
+}
+
+static NSError * CTKDurableLogError(NSInteger code, NSString *description, int posixError)
+{
+	NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObject:NSLocalizedString(description, @"") 
+																	   forKey:NSLocalizedDescriptionKey];
+	
+	if (posixError != 0)
+		[userInfo setObject:[NSError errorWithDomain:NSPOSIXErrorDomain code:posixError userInfo:nil] 
+					 forKey:NSUnderlyingErrorKey];
+	
+	return [NSError errorWithDomain:CTKDurableLogErrorDomain code:code userInfo:userInfo];
+}
+
+static BOOL CTKDurableLogWriteAll(int aDescriptor, const void *someBytes, size_t aLength, int *posixError)
+{
+	const uint8_t *bytes = someBytes;
+	
+	while (aLength > 0) {
+		
+		ssize_t written = write(aDescriptor, bytes, aLength);
+		
+		if (written < 0) {
+			
+			if (errno == EINTR)
+				continue;
+			
+			*posixError = errno;
+			return NO;
+		}
+		
+		bytes += written;
+		aLength -= (size_t)written;
+	}
+	
+	return YES;
+}
+
+/*
+ Creating, renaming or unlinking a file only reaches the disk with the directory entry, which its own fsync covers.
+ */
+static int CTKDurableLogSyncDirectory(NSString *aPath)
+{
+	int failure = 0;
+	int fd = open([aPath fileSystemRepresentation], O_RDONLY);
+	
+	if (fd < 0)
+		return errno;
+	
+	if (fsync(fd) != 0)
+		failure = errno;
+	
+	close(fd);
+	
+	return failure;
+}
+
+static NSString * CTKDurableLogFileName(uint64_t anIndex, NSString *anExtension)
+{
+	return [NSString stringWithFormat:@"%016llx.%@", (unsigned long long)anIndex, anExtension];
+}
+
+static struct timespec CTKDurableLogDeadline(NSUInteger msecs)
+{
+	struct timeval now;
+	struct timespec deadline;
+	
+	gettimeofday(&now, NULL);
+	
+	uint64_t nanos = (uint64_t)now.tv_usec * 1000 + (uint64_t)msecs * 1000000;
+	
+	deadline.tv_sec = now.tv_sec + (time_t)(nanos / 1000000000);
+	deadline.tv_nsec = (long)(nanos % 1000000000);
+	
+	return deadline;
+}
+
+static void * CTKDurableLogFlusherMain(void *aLog);
+static void CTKDurableLogCheckpointMain(void *aLog);
+
+#pragma mark -
+
+@interface CTKDurableLogEntry ()
+
+@property (readonly, copy, nonatomic) NSString *name;
+@property (readonly, retain, nonatomic) id value;
+@property (readonly, retain, nonatomic) NSData *nameData;
+@property (readonly, retain, nonatomic) NSData *valueData;
+@property (readonly, assign, nonatomic) uint32_t checksum;
+
+- (id) initWithValue:(id)aValue name:(NSString *)aName;
+
+@end
+
+@implementation CTKDurableLogEntry
+
+@synthesize name, value, nameData, valueData, checksum;
+
+- (id) initWithValue:(id)aValue name:(NSString *)aName
+{
+	self = [super init];
+	
+	if (self != nil) {
+		NSAutoreleasePool *pool = [NSAutoreleasePool new]; // archiving creates many temporary objects
+		
+		name = [aName copy];
+		value = [aValue retain];
+		nameData = [[name dataUsingEncoding:NSUTF8StringEncoding] retain];
+		valueData = [((aValue != nil) ? [NSKeyedArchiver archivedDataWithRootObject:aValue] : [NSData data]) retain];
+		checksum = CTKDurableLogPayloadChecksum([nameData bytes], [nameData length], [valueData bytes], [valueData length]);
+		
+		[pool drain];
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[name release];
+	[value release];
+	[nameData release];
+	[valueData release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface CTKDurableLog ()
+
+@property (readwrite, copy) NSString *directory;
+@property (readwrite, assign) CTKDurableLogSyncPolicy syncPolicy;
+
+@end
+
+@interface CTKDurableLog (Private)
+
+- (BOOL) private_recover:(NSError **)error;
+- (BOOL) private_replaySegmentAtPath:(NSString *)aPath maxPoint:(uint64_t *)aPoint;
+- (int) private_createSegment:(uint64_t)anIndex error:(int *)posixError;
+- (BOOL) private_openSegment:(uint64_t)anIndex error:(int *)posixError;
+- (void) private_flushLoop;
+- (void) private_checkpointEnded;
+- (void) private_deleteFilesBefore:(uint64_t)anIndex;
+
+@end
+
+#pragma mark -
+
+@implementation CTKDurableLog
+
+#pragma mark Initialization
+
++ (id) logWithDirectory:(NSString *)aPath syncPolicy:(CTKDurableLogSyncPolicy)aPolicy error:(NSError **)error
+{
+	return [[[CTKDurableLog alloc] initWithDirectory:aPath syncPolicy:aPolicy error:error] autorelease];
+}
+
+- (id) initWithDirectory:(NSString *)aPath syncPolicy:(CTKDurableLogSyncPolicy)aPolicy error:(NSError **)error
+{
+	NSParameterAssert(aPath);
+	
+	self = [super init];
+	
+	if (self != nil) {
+		
+		self.directory = aPath;
+		self.syncPolicy = aPolicy;
+		self.syncInterval = 10;
+		self.segmentLimit = 64 * 1024 * 1024;
+		self.checkpointSegments = 4;
+		
+		descriptor = -1;
+		pending = [[NSMutableData alloc] init];
+		values = [[NSMutableDictionary alloc] init];
+		points = [[NSMutableDictionary alloc] init];
+		
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&appendedCondition, NULL);
+		pthread_cond_init(&flushedCondition, NULL);
+		
+		if (![self private_recover:error]) {
+			[self release];
+			return nil;
+		}
+		
+		if (pthread_create(&flusher, NULL, CTKDurableLogFlusherMain, self) != 0) {
+			
+			if (error != NULL)
+				*error = CTKDurableLogError(CTKDurableLogIOError, @"Could not start the log flusher thread", errno);
+			
+			[self release];
+			return nil;
+		}
+		
+		flusherRunning = YES;
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[self close];
+	
+	if (descriptor >= 0)
+		close(descriptor);
+	
+	pthread_cond_destroy(&flushedCondition);
+	pthread_cond_destroy(&appendedCondition);
+	pthread_mutex_destroy(&mutex);
+	
+	[directory release];
+	[pending release];
+	[values release];
+	[points release];
+	[recovered release];
+	[recoveredNames release];
+	
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize directory, syncPolicy, syncInterval, segmentLimit, checkpointSegments;
+
+#pragma mark Operations
+
+- (CTKReference *) referenceNamed:(NSString *)aName initialValue:(id)aValue
+{
+	NSParameterAssert(aName);
+	
+	pthread_mutex_lock(&mutex);
+	
+	id value = [[[recovered objectForKey:aName] retain] autorelease];
+	[recovered removeObjectForKey:aName];
+	
+	pthread_mutex_unlock(&mutex);
+	
+	if (value == nil)
+		value = aValue;
+	
+	else if (value == [NSNull null])
+		value = nil;
+	
+	CTKReference *ref = [CTKReference referenceWithValue:value];
+	[self registerReference:ref name:aName];
+	
+	return ref;
+}
+
+- (void) registerReference:(CTKReference *)aRef name:(NSString *)aName
+{
+	NSParameterAssert(aRef);
+	NSParameterAssert(aName);
+	
+	aRef.durableName = aName;
+	aRef.durableLog = self;
+}
+
+- (NSArray *) recoveredNames
+{
+	return [[recoveredNames retain] autorelease]; // set once when opening
+}
+
+- (CTKDurableLogEntry *) newEntryWithValue:(id)aValue forReference:(CTKReference *)aRef
+{
+	return [[CTKDurableLogEntry alloc] initWithValue:aValue name:aRef.durableName];
+}
+
+- (uint64_t) appendEntry:(CTKDurableLogEntry *)anEntry point:(NSUInteger)aPoint
+{
+	NSData *nameData = anEntry.nameData;
+	NSData *valueData = anEntry.valueData;
+	CTKDurableLogRecordHeader header;
+	uint64_t ticket = 0;
+	
+	header.length = (uint32_t)([nameData length] + [valueData length]);
+	header.point = (uint64_t)aPoint;
+	header.nameLength = (uint32_t)[nameData length];
+	header.reserved = 0;
+	header.checksum = CTKDurableLogRecordChecksum(&header, anEntry.checksum);
+	
+	pthread_mutex_lock(&mutex);
+	
+	if (posixError == 0 && !closing) {
+		
+		[pending appendBytes:&header length:sizeof(header)];
+		[pending appendData:nameData];
+		[pending appendData:valueData];
+		
+		appendedTicket += sizeof(header) + header.length;
+		ticket = appendedTicket;
+		
+		[values setObject:(anEntry.value != nil) ? anEntry.value : [NSNull null] forKey:anEntry.name];
+		[points setObject:[NSNumber numberWithUnsignedLongLong:header.point] forKey:anEntry.name];
+		
+		pthread_cond_signal(&appendedCondition);
+	}
+	
+	pthread_mutex_unlock(&mutex);
+	
+	if (ticket == 0)
+		CTKErrorLog(@"The durable log %@ is closed or failed, the commit of %@ was not logged.", self.directory, anEntry.name);
+	
+	return ticket;
+}
+
+- (uint64_t) appendValue:(id)aValue forReference:(CTKReference *)aRef point:(NSUInteger)aPoint
+{
+	CTKDurableLogEntry *entry = [self newEntryWithValue:aValue forReference:aRef];
+	uint64_t ticket = [self appendEntry:entry point:aPoint];
+	
+	[entry release];
+	
+	return ticket;
+}
+
+- (BOOL) waitForTicket:(uint64_t)aTicket
+{
+	BOOL durable;
+	
+	if (aTicket == 0)
+		return NO;
+	
+	pthread_mutex_lock(&mutex);
+	
+	if (self.syncPolicy == CTKDurableLogSyncCommit)
+		while (syncedTicket < aTicket && posixError == 0)
+			pthread_cond_wait(&flushedCondition, &mutex);
+	
+	durable = (posixError == 0);
+	
+	pthread_mutex_unlock(&mutex);
+	
+	return durable;
+}
+
+- (BOOL) checkpoint:(NSError **)error
+{
+	@synchronized(self) {
+		
+		NSAutoreleasePool *pool = [NSAutoreleasePool new];
+		NSDictionary *state;
+		uint64_t covering;
+		
+		/*
+		 The checkpoint holds every value appended so far and is named after the current segment: whatever is already
+		 in older segments is covered, replaying the current one and the next ones after it only moves refs forward.
+		 */
+		pthread_mutex_lock(&mutex);
+		
+		state = [NSDictionary dictionaryWithObjectsAndKeys:
+				 [[values copy] autorelease], CTKDurableLogValuesKey, 
+				 [[points copy] autorelease], CTKDurableLogPointsKey, 
+				 nil];
+		covering = segment;
+		
+		pthread_mutex_unlock(&mutex);
+		
+		NSData *data = [NSKeyedArchiver archivedDataWithRootObject:state];
+		NSString *path = [self.directory stringByAppendingPathComponent:CTKDurableLogFileName(covering, CTKDurableLogCheckpointExtension)];
+		NSString *temporaryPath = [path stringByAppendingString:@".tmp"];
+		int failure = 0;
+		int fd = open([temporaryPath fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		
+		if (fd < 0)
+			failure = errno;
+		
+		else {
+			
+			if (CTKDurableLogWriteAll(fd, [data bytes], [data length], &failure) && fsync(fd) != 0)
+				failure = errno;
+			
+			close(fd);
+			
+			if (failure == 0 && rename([temporaryPath fileSystemRepresentation], [path fileSystemRepresentation]) != 0)
+				failure = errno;
+			
+			// The rename must be durable before the covered files are unlinked, or a crash could keep only the unlinks
+			if (failure == 0)
+				failure = CTKDurableLogSyncDirectory(self.directory);
+		}
+		
+		if (failure != 0) {
+			
+			unlink([temporaryPath fileSystemRepresentation]);
+			
+			if (error != NULL)
+				*error = [CTKDurableLogError(CTKDurableLogIOError, @"Could not write the checkpoint", failure) retain];
+			
+			[pool drain];
+			
+			if (error != NULL)
+				[*error autorelease];
+			
+			return NO;
+		}
+		
+		pthread_mutex_lock(&mutex);
+		checkpoint = covering;
+		pthread_mutex_unlock(&mutex);
+		
+		[self private_deleteFilesBefore:covering];
+		
+		[pool drain];
+	}
+	
+	return YES;
+}
+
+- (void) close
+{
+	pthread_mutex_lock(&mutex);
+	
+	BOOL join = flusherRunning;
+	closing = YES;
+	flusherRunning = NO;
+	pthread_cond_broadcast(&appendedCondition);
+	
+	pthread_mutex_unlock(&mutex);
+	
+	if (join)
+		pthread_join(flusher, NULL);
+	
+	// The checkpoint uses the receiver, it is not left running past close (or dealloc)
+	pthread_mutex_lock(&mutex);
+	
+	while (checkpointScheduled)
+		pthread_cond_wait(&flushedCondition, &mutex);
+	
+	pthread_mutex_unlock(&mutex);
+}
+
+@end
+
+#pragma mark -
+
+@implementation CTKDurableLog (Private)
+
+- (BOOL) private_recover:(NSError **)error
+{
+	NSFileManager *fileManager = [NSFileManager defaultManager];
+	NSArray *files;
+	uint64_t lastCheckpoint = 0, lastSegment = 0, maxPoint = 0;
+	BOOL hasCheckpoint = NO, hasSegment = NO;
+	int failure = 0;
+	
+	if (![fileManager createDirectoryAtPath:self.directory withIntermediateDirectories:YES attributes:nil error:error])
+		return NO;
+	
+	files = [fileManager contentsOfDirectoryAtPath:self.directory error:error];
+	
+	if (files == nil)
+		return NO;
+	
+	for (NSString *file in files) {
+		
+		unsigned long long index = 0;
+		NSScanner *scanner = [NSScanner scannerWithString:[file stringByDeletingPathExtension]];
+		
+		if (![scanner scanHexLongLong:&index] || ![scanner isAtEnd])
+			continue;
+		
+		if ([[file pathExtension] isEqualToString:CTKDurableLogCheckpointExtension] && (!hasCheckpoint || index > lastCheckpoint)) {
+			lastCheckpoint = index;
+			hasCheckpoint = YES;
+		}
+		
+		else if ([[file pathExtension] isEqualToString:CTKDurableLogSegmentExtension] && (!hasSegment || index > lastSegment)) {
+			lastSegment = index;
+			hasSegment = YES;
+		}
+	}
+	
+	// 1. The last checkpoint
+	
+	if (hasCheckpoint) {
+		
+		NSString *path = [self.directory stringByAppendingPathComponent:CTKDurableLogFileName(lastCheckpoint, CTKDurableLogCheckpointExtension)];
+		NSDictionary *state = nil;
+		
+		@try {
+			state = [NSKeyedUnarchiver unarchiveObjectWithFile:path];
+		}
+		@catch (NSException * e) {
+			state = nil;
+		}
+		
+		if (![state isKindOfClass:[NSDictionary class]]) {
+			
+			if (error != NULL)
+				*error = CTKDurableLogError(CTKDurableLogFormatError, 
+											[NSString stringWithFormat:@"The checkpoint %@ is not valid", path], 0);
+			return NO;
+		}
+		
+		[values addEntriesFromDictionary:[state objectForKey:CTKDurableLogValuesKey]];
+		[points addEntriesFromDictionary:[state objectForKey:CTKDurableLogPointsKey]];
+		
+		for (NSNumber *point in [points objectEnumerator])
+			maxPoint = MAX(maxPoint, [point unsignedLongLongValue]);
+	}
+	
+	// 2. The segments that follow it, in order: the last record of a ref is its last committed value
+	
+	for (uint64_t index = lastCheckpoint; hasSegment && index <= lastSegment; index++) {
+		
+		NSString *path = [self.directory stringByAppendingPathComponent:CTKDurableLogFileName(index, CTKDurableLogSegmentExtension)];
+		
+		if ([fileManager fileExistsAtPath:path] && ![self private_replaySegmentAtPath:path maxPoint:&maxPoint])
+			CTKWarningLog(@"The segment %@ ends with a partial record, the rest of it was ignored.", path);
+	}
+	
+	recovered = [values mutableCopy];
+	recoveredNames = [[values allKeys] copy];
+	checkpoint = lastCheckpoint;
+	
+	// Commit points restart with the process, keep them growing in the log
+	[CTKLockingTransaction advancePointTo:(NSUInteger)maxPoint];
+	
+	// 3. Never append to a recovered segment, its tail may be torn
+	
+	if (![self private_openSegment:(hasSegment ? MAX(lastSegment + 1, lastCheckpoint) : lastCheckpoint) error:&failure]) {
+		
+		if (error != NULL)
+			*error = CTKDurableLogError(CTKDurableLogIOError, @"Could not create a log segment", failure);
+		return NO;
+	}
+	
+	return YES;
+}
+
+- (BOOL) private_replaySegmentAtPath:(NSString *)aPath maxPoint:(uint64_t *)aPoint
+{
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	NSData *data = [NSData dataWithContentsOfFile:aPath options:NSDataReadingMapped error:NULL];
+	const uint8_t *bytes = [data bytes];
+	size_t length = [data length];
+	size_t offset = sizeof(CTKDurableLogSegmentHeader);
+	BOOL complete = NO;
+	
+	if (length < offset || memcmp(bytes, CTKDurableLogMagic, sizeof(CTKDurableLogMagic)) != 0 
+		|| ((const CTKDurableLogSegmentHeader *)bytes)->version != CTKDurableLogVersion) {
+		[pool drain];
+		return NO;
+	}
+	
+	while (YES) {
+		
+		if (offset == length) {
+			complete = YES;
+			break;
+		}
+		
+		if (length - offset < sizeof(CTKDurableLogRecordHeader))
+			break;
+		
+		CTKDurableLogRecordHeader header;
+		memcpy(&header, bytes + offset, sizeof(header));
+		
+		const uint8_t *name = bytes + offset + sizeof(header);
+		const uint8_t *value = name + header.nameLength;
+		
+		if (header.nameLength > header.length || length - offset - sizeof(header) < header.length)
+			break;
+		
+		size_t valueLength = header.length - header.nameLength;
+		
+		if (CTKDurableLogRecordChecksum(&header, CTKDurableLogPayloadChecksum(name, header.nameLength, value, valueLength)) != header.checksum)
+			break;
+		
+		NSString *key = [[[NSString alloc] initWithBytes:name length:header.nameLength encoding:NSUTF8StringEncoding] autorelease];
+		id object = [NSNull null];
+		
+		if (valueLength > 0) {
+			@try {
+				object = [NSKeyedUnarchiver unarchiveObjectWithData:[NSData dataWithBytesNoCopy:(void *)value 
+																						  length:valueLength 
+																					freeWhenDone:NO]];
+			}
+			@catch (NSException * e) {
+				break;
+			}
+		}
+		
+		if (key == nil || object == nil)
+			break;
+		
+		[values setObject:object forKey:key];
+		[points setObject:[NSNumber numberWithUnsignedLongLong:header.point] forKey:key];
+		*aPoint = MAX(*aPoint, header.point);
+		
+		offset += sizeof(header) + header.length;
+	}
+	
+	[pool drain];
+	
+	return complete;
+}
+
+/*
+ Creates the segment and syncs it with its directory entry, the receiver is not modified so it can run unlocked.
+ Returns the descriptor or -1.
+ */
+- (int) private_createSegment:(uint64_t)anIndex error:(int *)posixError
+{
+	NSString *path = [self.directory stringByAppendingPathComponent:CTKDurableLogFileName(anIndex, CTKDurableLogSegmentExtension)];
+	int fd = open([path fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	CTKDurableLogSegmentHeader header;
+	
+	if (fd < 0) {
+		*posixError = errno;
+		return -1;
+	}
+	
+	memcpy(header.magic, CTKDurableLogMagic, sizeof(header.magic));
+	header.version = CTKDurableLogVersion;
+	
+	if (!CTKDurableLogWriteAll(fd, &header, sizeof(header), posixError)) {
+		close(fd);
+		return -1;
+	}
+	
+	// Commits acknowledged in this segment must not vanish with its directory entry
+	if (fsync(fd) != 0 || (*posixError = CTKDurableLogSyncDirectory(self.directory)) != 0) {
+		
+		if (*posixError == 0)
+			*posixError = errno;
+		
+		close(fd);
+		return -1;
+	}
+	
+	return fd;
+}
+
+/*
+ Opens the first segment when the log is opened.
+ */
+- (BOOL) private_openSegment:(uint64_t)anIndex error:(int *)posixError
+{
+	int fd = [self private_createSegment:anIndex error:posixError];
+	
+	if (fd < 0)
+		return NO;
+	
+	descriptor = fd;
+	segment = anIndex;
+	segmentLength = sizeof(CTKDurableLogSegmentHeader);
+	
+	return YES;
+}
+
+- (void) private_deleteFilesBefore:(uint64_t)anIndex
+{
+	NSFileManager *fileManager = [NSFileManager defaultManager];
+	
+	for (NSString *file in [fileManager contentsOfDirectoryAtPath:self.directory error:NULL]) {
+		
+		unsigned long long index = 0;
+		NSScanner *scanner = [NSScanner scannerWithString:[file stringByDeletingPathExtension]];
+		NSString *extension = [file pathExtension];
+		
+		if (![extension isEqualToString:CTKDurableLogSegmentExtension] && ![extension isEqualToString:CTKDurableLogCheckpointExtension])
+			continue;
+		
+		if ([scanner scanHexLongLong:&index] && [scanner isAtEnd] && index < anIndex)
+			[fileManager removeItemAtPath:[self.directory stringByAppendingPathComponent:file] error:NULL];
+	}
+}
+
+- (void) private_checkpointEnded
+{
+	pthread_mutex_lock(&mutex);
+	checkpointScheduled = NO;
+	pthread_cond_broadcast(&flushedCondition);
+	pthread_mutex_unlock(&mutex);
+}
+
+/*
+ Writes what was appended while the previous batch was being written and synced. Under CTKDurableLogSyncCommit the 
+ committers wait in waitForTicket:, the longer an fsync takes the more commits the next one covers.
+ */
+- (void) private_flushLoop
+{
+	NSMutableData *writing = [[NSMutableData alloc] init];
+	struct timeval lastSync;
+	
+	gettimeofday(&lastSync, NULL);
+	pthread_mutex_lock(&mutex);
+	
+	while (YES) {
+		
+		if ([pending length] == 0) {
+			
+			if (closing)
+				break;
+			
+			pthread_cond_wait(&appendedCondition, &mutex);
+			continue;
+		}
+		
+		if (self.syncPolicy == CTKDurableLogSyncInterval && !closing) {
+			
+			struct timeval now;
+			gettimeofday(&now, NULL);
+			
+			NSUInteger elapsed = (NSUInteger)((now.tv_sec - lastSync.tv_sec) * 1000 + (now.tv_usec - lastSync.tv_usec) / 1000);
+			
+			if (elapsed < self.syncInterval) {
+				struct timespec deadline = CTKDurableLogDeadline(self.syncInterval - elapsed);
+				pthread_cond_timedwait(&appendedCondition, &mutex, &deadline);
+				continue;
+			}
+		}
+		
+		NSMutableData *batch = pending;
+		pending = writing;
+		writing = batch;
+		
+		uint64_t target = appendedTicket;
+		int fd = descriptor;
+		int failure = 0;
+		BOOL shouldSync = (self.syncPolicy != CTKDurableLogSyncNone || closing);
+		
+		pthread_mutex_unlock(&mutex);
+		
+		if (CTKDurableLogWriteAll(fd, [writing bytes], [writing length], &failure) && shouldSync && fsync(fd) != 0)
+			failure = errno;
+		
+		gettimeofday(&lastSync, NULL);
+		
+		pthread_mutex_lock(&mutex);
+		
+		segmentLength += [writing length];
+		[writing setLength:0];
+		
+		if (failure != 0) {
+			CTKErrorLog(@"The durable log %@ failed: %s", self.directory, strerror(failure));
+			posixError = failure;
+			[pending setLength:0];
+		}
+		
+		else
+			syncedTicket = target;
+		
+		pthread_cond_broadcast(&flushedCondition);
+		
+		if (posixError == 0 && !closing && segmentLength >= self.segmentLimit) {
+			
+			uint64_t next = segment + 1;
+			int previous = descriptor;
+			
+			// Only this thread writes the segments: the fsyncs run unlocked, committers keep appending to pending
+			pthread_mutex_unlock(&mutex);
+			
+			int created = [self private_createSegment:next error:&failure];
+			
+			// What was written to the outgoing segment since the last interval sync is synced before it is left behind
+			if (created >= 0 && self.syncPolicy != CTKDurableLogSyncNone && fsync(previous) != 0)
+				CTKErrorLog(@"Could not sync the segment %llx of the durable log %@: %s", 
+							(unsigned long long)(next - 1), self.directory, strerror(errno));
+			
+			pthread_mutex_lock(&mutex);
+			
+			if (created < 0)
+				CTKErrorLog(@"Could not rotate the durable log %@: %s", self.directory, strerror(failure));
+			
+			else {
+				
+				close(previous);
+				descriptor = created;
+				segment = next;
+				segmentLength = sizeof(CTKDurableLogSegmentHeader);
+				
+				// Archiving every value takes long, the flusher keeps syncing the group commits meanwhile
+				if (!checkpointScheduled && segment - checkpoint >= self.checkpointSegments) {
+					checkpointScheduled = YES;
+					dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), self, CTKDurableLogCheckpointMain);
+				}
+			}
+		}
+	}
+	
+	pthread_mutex_unlock(&mutex);
+	[writing release];
+}
+
+@end
+
+static void * CTKDurableLogFlusherMain(void *aLog)
+{
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	
+	[(CTKDurableLog *)aLog private_flushLoop];
+	
+	[pool drain];
+	
+	return NULL;
+}
+
+/*
+ The log is not retained, its close waits for checkpointScheduled to be cleared.
+ */
+static void CTKDurableLogCheckpointMain(void *aLog)
+{
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	CTKDurableLog *log = (CTKDurableLog *)aLog;
+	NSError *error = nil;
+	
+	if (![log checkpoint:&error])
+		CTKErrorLog(@"%@", [error localizedDescription]);
+	
+	[log private_checkpointEnded];
+	
+	[pool drain];
+}
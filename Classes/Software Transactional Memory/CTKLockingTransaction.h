@@ -27,6 +27,15 @@
 #import <Cocoa/Cocoa.h>
 @class CTKLockingTransactionInfo;
 @class CTKReference;
+@class CTKAgent;
+
+/*
+ Build with CTK_TRANSACTION_ATTEMPT_POOLS=1 to push an autorelease pool around every attempt of performBlock:error:,
+ as transactions did before their objects were built with the new... constructors. Only meant to compare both paths.
+ */
+#ifndef CTK_TRANSACTION_ATTEMPT_POOLS
+#	define CTK_TRANSACTION_ATTEMPT_POOLS 0
+#endif
 
 // Exceptions and Errors
 
@@ -37,7 +46,8 @@ extern NSString * const CTKTransactionErrorDomain;
 enum {
 	CTKTransactionInitializationError = 1000,
 	CTKTransactionRetryError = 1001,
-	CTKTransactionRetryLimitError = 1002
+	CTKTransactionRetryLimitError = 1002,
+	CTKTransactionDurabilityError = 1003 // a durable log failed: nothing was committed, or the values are committed but may not be durable
 };
 
 
@@ -61,7 +71,10 @@ enum {
 	NSMapTable *commutes;
 	NSUInteger retryLimit;
 	NSMutableSet *ensures;
-	//NSMutableArray *actions;
+	NSMapTable *merges; // CTKReference -> value at the read point (NSNull for nil), for refs merged on commit
+	NSMapTable *durableTickets; // CTKDurableLog -> last ticket appended by the commit
+	NSMapTable *durableEntries; // CTKReference -> CTKDurableLogEntry encoded before the commit locks the references
+	NSMutableArray *actions; // CTKAgentAction(s) sent by the attempt, dispatched once it commits
 
 }
 
@@ -92,6 +105,24 @@ enum {
 
 + (id) performBlock:(id (^)(void))aBlock onError:(id (^)(NSError *))onErrorBlock;
 
+/**
+ * \brief Performs aBlock in the current thread's transaction and passes it the transaction.
+ * \details The transaction is looked up once, the accessors of the handle (read:, write:value:, alter:block:, 
+ * commute:block:, ensure:) go straight to it without the thread specific data lookup every CTKReference method does. 
+ * The handle is not synchronized: it may only be used by one thread at a time, during the attempt. Code aBlock runs 
+ * synchronously on another queue (dispatch_sync) can use it where CTKReference methods would find that thread's 
+ * transaction (or none), but it must not let exceptions out of the dispatched block: catch them there, 
+ * CTKTransactionRetryException included, and raise them again on aBlock's thread so that the attempt is retried.
+ * Never use it from asynchronously dispatched code.
+ * \code
+ * [CTKLockingTransaction performWithTransaction:^ id (CTKLockingTransaction *txn) {
+ *		NSNumber *balance = [txn read:account];
+ *		return [txn write:account value:[NSNumber numberWithInteger:[balance integerValue] + 10]];
+ * } error:&error];
+ * \endcode
+ */
++ (id) performWithTransaction:(id (^)(CTKLockingTransaction *txn))aBlock error:(NSError **)error;
+
 /**
  * \brief This method executes begin on the current thread's transaction
  */
@@ -107,12 +138,23 @@ enum {
  */
 + (void) abort;
 
+/**
+ * \brief Moves the transaction clock forward so that the next points are greater than aPoint.
+ * \details Used by CTKDurableLog after recovery, the points it logs keep growing across restarts.
+ */
++ (void) advancePointTo:(NSUInteger)aPoint;
+
 #pragma mark Operations
 
 - (id) performBlock:(id (^)(void))aBlock error:(NSError **)error;
 
 - (id) performBlock:(id (^)(void))aBlock onError:(id (^)(NSError *))anotherBlock;
 
+/**
+ * \brief Performs aBlock in the receiver, retrying as performBlock:error: does, see +performWithTransaction:error:.
+ */
+- (id) performWithTransaction:(id (^)(CTKLockingTransaction *txn))aBlock error:(NSError **)error;
+
 //- (id) performBlock:(id (^)(void))aBlock error:(NSError **)error timeout:(NSUInteger)msecs;
 
 /**
@@ -155,6 +197,50 @@ enum {
  */
 - (id) commuteReference:(CTKReference *)aRef block:(id (^)(id))aBlock;
 
+#pragma mark Transaction Handle
+
+/**
+ * \brief Same as [aRef dereference] inside the receiver, without looking the transaction up.
+ * \throws CTKTransactionRetryException
+ */
+- (id) read:(CTKReference *)aRef;
+
+/**
+ * \brief Same as [aRef setValue:aValue] inside the receiver.
+ * \throws CTKTransactionRetryException
+ */
+- (id) write:(CTKReference *)aRef value:(id)aValue;
+
+/**
+ * \brief Same as [aRef alterWithBlock:aBlock] inside the receiver.
+ * \throws CTKTransactionRetryException
+ */
+- (id) alter:(CTKReference *)aRef block:(id (^)(id))aBlock;
+
+/**
+ * \brief Same as [aRef commuteWithBlock:aBlock] inside the receiver.
+ * \throws CTKTransactionRetryException
+ */
+- (id) commute:(CTKReference *)aRef block:(id (^)(id))aBlock;
+
+/**
+ * \brief Same as [aRef touch] inside the receiver.
+ * \throws CTKTransactionRetryException
+ */
+- (void) ensure:(CTKReference *)aRef;
+
+/**
+ * \brief Same as [anAgent send:aBlock] inside the receiver: the action is dispatched once the receiver commits.
+ * \throws CTKTransactionRetryException
+ */
+- (void) send:(CTKAgent *)anAgent block:(id (^)(id))aBlock;
+
+/**
+ * \brief Same as [anAgent sendOff:aBlock] inside the receiver.
+ * \throws CTKTransactionRetryException
+ */
+- (void) sendOff:(CTKAgent *)anAgent block:(id (^)(id))aBlock;
+
 
 @end
 
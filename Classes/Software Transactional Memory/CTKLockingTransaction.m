@@ -40,6 +40,10 @@
 #import "CTKUtils.h"
 #import "CTKLockingTransactionInfo.h"
 #import "CTKLockingTransactionValue.h"
+#import "CTKDurableLog.h"
+#import "CTKPersistentHashMap.h"
+#import "CTKTransactionTracer.h"
+#import "CTKAgent.h"
 #include <libkern/OSAtomic.h>
 #include <pthread.h>
 
@@ -61,6 +65,16 @@ static volatile int64_t lastPoint;
 
 // FUNCTIONS
 
+static NSError * CTKTransactionDurabilityErrorWithLog(CTKDurableLog *aLog, NSString *aReason)
+{
+	NSString *description = [NSString stringWithFormat:aReason, aLog.directory];
+	NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+							  description, NSLocalizedDescriptionKey,
+							  nil];
+	
+	return [NSError errorWithDomain:CTKTransactionErrorDomain code:CTKTransactionDurabilityError userInfo:userInfo];
+}
+
 void CTKPthreadTransactionDestructor(void *txn)
 {
 	[(CTKLockingTransaction *)txn release];
@@ -83,8 +97,9 @@ void CTKPthreadTransactionDestructor(void *txn)
 @property (readwrite, assign, nonatomic) NSUInteger startTime;
 @property (readwrite, assign, nonatomic) NSUInteger readPoint;
 @property (readwrite, retain, nonatomic) NSMutableSet *ensures;
+@property (readwrite, retain, nonatomic) NSMapTable *merges;
 @property (readwrite, assign, nonatomic) BOOL bargeTimeElapsed;
-//@property (readwrite, retain, nonatomic) NSMutableArray *actions;
+@property (readwrite, retain, nonatomic) NSMutableArray *actions;
 
 @end
 
@@ -98,14 +113,15 @@ void CTKPthreadTransactionDestructor(void *txn)
 #pragma mark Initialization and dealloc
 - (void) private_resetState;
 #pragma mark Operations
-- (BOOL) private_canBargeIntoTransactionWithInfo:(CTKLockingTransactionInfo *)refInfo;
+- (BOOL) private_canBargeIntoTransactionWithInfo:(CTKLockingTransactionInfo *)refInfo reference:(CTKReference *)aRef;
 - (BOOL) private_releaseReferenceIfEnsured:(CTKReference *)aRef;
-- (void) private_blockAndBailWithInfo:(CTKLockingTransactionInfo *)refInfo;
+- (void) private_blockAndBailWithInfo:(CTKLockingTransactionInfo *)refInfo reference:(CTKReference *)aRef;
 - (void) private_stopWithStatus:(CTKTransactionStatus)aStatus;
 #pragma mark Operations (Commit steps)
 - (BOOL) private_lockAndPerformCommutes:(NSMutableArray **)lockedRefs;
+- (BOOL) private_lockAndMerge:(NSMutableArray **)lockedRefs;
 - (BOOL) private_validateAndEnqueueNotifications;
-- (void) private_processChanges;
+- (BOOL) private_processChanges:(NSError **)error;
 #pragma mark Properties
 - (void) private_acquireReadPoint;
 - (NSUInteger) private_commitPoint;
@@ -139,14 +155,19 @@ void CTKPthreadTransactionDestructor(void *txn)
 	if (txn == nil)
 	{
 		NSError *error = nil;
-		txn = [[CTKLockingTransaction new] autorelease];		
+		txn = [CTKLockingTransaction new];
 		
 		if ([self private_setThreadTransaction:txn error:&error])
+		{
+			[txn release]; // owned by the thread specific data from now on
 			[txn begin];
+		}
 		
 		else
+		{
 			CTKErrorLog(@"%@", [error localizedDescription]);
-		
+			[txn autorelease];
+		}
 	}
 	
 	return txn;
@@ -196,6 +217,11 @@ void CTKPthreadTransactionDestructor(void *txn)
 	return [[CTKLockingTransaction transaction] performBlock:aBlock onError:anotherBlock];
 }
 
++ (id) performWithTransaction:(id (^)(CTKLockingTransaction *txn))aBlock error:(NSError **)error
+{
+	return [[CTKLockingTransaction transaction] performWithTransaction:aBlock error:error];
+}
+
 + (void) begin
 {
 	[[CTKLockingTransaction transaction] begin];
@@ -211,6 +237,19 @@ void CTKPthreadTransactionDestructor(void *txn)
 	[[CTKLockingTransaction transaction] abort];
 }
 
++ (void) advancePointTo:(NSUInteger)aPoint
+{
+	int64_t current;
+	
+	do {
+		current = lastPoint;
+		
+		if (current >= (int64_t)aPoint)
+			return;
+		
+	} while (!OSAtomicCompareAndSwap64Barrier(current, (int64_t)aPoint, &lastPoint));
+}
+
 #pragma mark Initializers and dealloc
 
 - (id) init
@@ -221,11 +260,16 @@ void CTKPthreadTransactionDestructor(void *txn)
 	{
 		self.retryLimit = CTK_RETRY_LIMIT;
 		self.info = nil;
-		self.vals = [NSMapTable mapTableWithStrongToStrongObjects];
-		self.sets = [NSMutableSet set];
-		self.commutes = [NSMapTable mapTableWithStrongToStrongObjects];
-		self.ensures = [NSMutableSet set];
-		//self.actions = [NSMutableArray array];
+		vals = [[NSMapTable alloc] initWithKeyOptions:NSMapTableStrongMemory valueOptions:NSMapTableStrongMemory capacity:0];
+		sets = [[NSMutableSet alloc] init];
+		commutes = [[NSMapTable alloc] initWithKeyOptions:NSMapTableStrongMemory valueOptions:NSMapTableStrongMemory capacity:0];
+		ensures = [[NSMutableSet alloc] init];
+		merges = [[NSMapTable alloc] initWithKeyOptions:NSMapTableStrongMemory valueOptions:NSMapTableStrongMemory capacity:0];
+		durableTickets = [[NSMapTable alloc] initWithKeyOptions:NSMapTableStrongMemory 
+												   valueOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsIntegerPersonality 
+													   capacity:0];
+		durableEntries = [[NSMapTable alloc] initWithKeyOptions:NSMapTableStrongMemory valueOptions:NSMapTableStrongMemory capacity:0];
+		actions = [[NSMutableArray alloc] init];
 	}
 	
 	return self;
@@ -233,12 +277,15 @@ void CTKPthreadTransactionDestructor(void *txn)
 
 - (void) private_resetState
 {
+	// The collections are emptied and reused by the next attempt instead of being replaced by autoreleased ones
 	self.info = nil;
-	self.vals = [NSMapTable mapTableWithStrongToStrongObjects];
-	self.sets = [NSMutableSet set];
-	self.commutes = [NSMapTable mapTableWithStrongToStrongObjects];
-	self.ensures = [NSMutableSet set];
-	//self.actions = [NSMutableArray array];
+	[vals removeAllObjects];
+	[sets removeAllObjects];
+	[commutes removeAllObjects];
+	[ensures removeAllObjects];
+	[merges removeAllObjects];
+	[durableEntries removeAllObjects];
+	[actions removeAllObjects];
 }
 
 - (void) dealloc
@@ -248,7 +295,10 @@ void CTKPthreadTransactionDestructor(void *txn)
 	[sets release];
 	[commutes release];
 	[ensures release];
-	//[actions release]; // not implemented yet
+	[merges release];
+	[durableTickets release];
+	[durableEntries release];
+	[actions release];
 	
 	[super dealloc];
 }
@@ -275,12 +325,16 @@ void CTKPthreadTransactionDestructor(void *txn)
 	BOOL done = NO;
 	NSError *commitError = nil;
 	NSError *savedError = nil;
-	NSException *savedException = nil;
 	id (^operation)(void) = [aBlock copy];
 	id result = nil;
 	NSUInteger retries = 0;
 	
-	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	/*
+	 Attempts do not push autorelease pools of their own. The maps, trie nodes, history values and infos created by
+	 an attempt are built with the new... constructors and owned by the transaction, so the memory of a failed attempt 
+	 is reclaimed when it is reset. What aBlock autoreleases, and the retry exceptions and errors of failed 
+	 attempts, go to the caller pool. See CTK_TRANSACTION_ATTEMPT_POOLS.
+	 */
 	
 	@try {
 		
@@ -289,15 +343,18 @@ void CTKPthreadTransactionDestructor(void *txn)
 			
 			//CTKConditionalLog(retries == self.retryLimit / 2, @"Retries %U", retries);
 			
-			NSAutoreleasePool *innerPool = [NSAutoreleasePool new];
+#if CTK_TRANSACTION_ATTEMPT_POOLS
+			NSAutoreleasePool *attemptPool = [NSAutoreleasePool new];
+#endif
 			
 			@try {
 				
 				// We need to call begin each time since we might be recovering from a retry exception.
 				[self begin];
 				
-				result = operation();
-				[result retain];
+				[result release]; // the result of a failed attempt
+				result = nil;
+				result = [operation() retain];
 
 				done = [self commit:&commitError];
 				
@@ -316,27 +373,19 @@ void CTKPthreadTransactionDestructor(void *txn)
 				 transaction, otherwise I will not be able to retry. 
 				 We swallow CTKTransactionRetryException(s) to retry.
 				 */				
+				CTKTrace(CTKTraceEventRetry, self.startPoint, 0, CTKTraceCauseNone, 0);
 				[self private_stopWithStatus:CTKTransactionStatusRetry];
 			}
-			@catch (NSException * e) {
-				done = NO;
-				savedException = [e retain];
-				@throw savedException; // This will break the loop and jump into outer exception handler
-			}
-			@finally {	
-				[innerPool drain];	
-				[savedException autorelease];
-			}
+			
+#if CTK_TRANSACTION_ATTEMPT_POOLS
+			// Left to the caller pool when the loop breaks on an error or another exception unwinds
+			[attemptPool drain];
+#endif
 			
 		}
 	}
-	@catch (NSException * e) {
-		savedException = [e retain];
-		@throw savedException;
-	}
 	@finally {
 		
-		[pool drain];
 		[operation release];
 		
 		if(savedError != nil)
@@ -347,7 +396,11 @@ void CTKPthreadTransactionDestructor(void *txn)
 		if(result != nil)
 			[result autorelease];
 		
-		if (!done && error != nil)
+		// Not retried, and not wrapped so that callers can tell whether the values were committed
+		if (!done && error != nil && [savedError code] == CTKTransactionDurabilityError)
+			*error = savedError;
+		
+		else if (!done && error != nil)
 		{
 			NSMutableDictionary *userInfo = [NSMutableDictionary new];
 			
@@ -376,6 +429,15 @@ void CTKPthreadTransactionDestructor(void *txn)
 	
 }
 
+- (id) performWithTransaction:(id (^)(CTKLockingTransaction *txn))aBlock error:(NSError **)error
+{
+	NSParameterAssert(aBlock);
+	
+	return [self performBlock:^ id (void) {
+		return aBlock(self);
+	} error:error];
+}
+
 - (void) begin
 {
 	if (self.info == nil)
@@ -383,39 +445,63 @@ void CTKPthreadTransactionDestructor(void *txn)
 		[self private_acquireReadPoint];
 		self.startPoint = self.readPoint;
 		self.startTime = [CTKUtils currentTimeInNanos];
-		self.info = [[[CTKLockingTransactionInfo alloc] 
-					  initWithStatus:CTKTransactionStatusRunning startPoint:self.startPoint] autorelease];
+		[info release];
+		info = [CTKLockingTransactionInfo newInfoWithStatus:CTKTransactionStatusRunning startPoint:self.startPoint];
+		CTKTrace(CTKTraceEventBegin, self.startPoint, 0, CTKTraceCauseNone, 0);
 	}
 	
 	else if (!self.info.isRunning)
 	{		
 		// We probably want to retry since we still have info assigned
 		[self private_acquireReadPoint];
-		self.info = [[[CTKLockingTransactionInfo alloc] initWithStatus:CTKTransactionStatusRunning startPoint:self.startPoint] autorelease];
+		[info release];
+		info = [CTKLockingTransactionInfo newInfoWithStatus:CTKTransactionStatusRunning startPoint:self.startPoint];
+		CTKTrace(CTKTraceEventBegin, self.startPoint, 0, CTKTraceCauseNone, 0);
 	}
 }
 
 - (BOOL) commit:(NSError **)error
 {	
 	BOOL done = NO;
-	NSMutableArray *lockedRefs = [NSMutableArray array];
+	NSError *durabilityError = nil;
+	NSMutableArray *lockedRefs = [[NSMutableArray alloc] init];
 	
 	@try {
 				
 		if ([self.info compareStatus:CTKTransactionStatusRunning setStatus:CTKTransactionStatusCommitting]) 
 		{
 			// Other transactions will not be able to stop us now
+			
+			/*
+			 The values set by the transaction are final: archive the durable ones before locking, only the values
+			 computed under the locks (commutes, merges) are archived in private_processChanges.
+			 */
+			for(CTKReference *ref in self.sets){
+				
+				if (ref.durableLog == nil || [self.merges objectForKey:ref] != nil)
+					continue;
+				
+				CTKDurableLogEntry *entry = [ref.durableLog newEntryWithValue:[self.vals objectForKey:ref] forReference:ref];
+				[durableEntries setObject:entry forKey:ref];
+				[entry release];
+			}
 						
 			if(![self private_lockAndPerformCommutes:&lockedRefs])
 			{
 				return NO; // This will force a retry
 			}
 			
+			if(![self private_lockAndMerge:&lockedRefs])
+			{
+				return NO; // This will force a retry
+			}
+			
 			// Acquire write locks for all refs modified in txn so there can be no readers
 			for(CTKReference *ref in self.sets){
 				
 				if (![ref tryWriteLock])
 				{
+					CTKTrace(CTKTraceEventConflict, self.startPoint, ref.identifier, CTKTraceCauseLockBusy, 0);
 					return done; // This will force a retry
 				}
 				
@@ -432,12 +518,19 @@ void CTKPthreadTransactionDestructor(void *txn)
 			 * At this point, all values calculated, all refs to be written locked
 			 * no more client code to be called
 			 */
-			[self private_processChanges];
+			if (![self private_processChanges:&durabilityError])
+			{
+				return done; // Nothing was committed, retrying would fail the same way
+			}
+			
 			done = YES; 
 			self.info.status = CTKTransactionStatusCommitted;
 			
 		}
 		
+		else
+			CTKTrace(CTKTraceEventConflict, self.startPoint, 0, CTKTraceCauseKilled, 0);
+		
 	}
 	@catch (CTKTransactionRetryException *re){
 		done = NO;
@@ -455,7 +548,7 @@ void CTKPthreadTransactionDestructor(void *txn)
 			[ref unlock];
 		}
 		
-		[lockedRefs removeAllObjects];
+		[lockedRefs release];
 		lockedRefs = nil;
 		
 		// Unlock ensured
@@ -465,13 +558,41 @@ void CTKPthreadTransactionDestructor(void *txn)
 		
 		//[ensures removeAllObjects];		
 		
+		// Resetting the state empties the actions, the ones of a committed attempt are kept to be dispatched below
+		NSArray *committedActions = (done && [actions count] > 0) ? [actions copy] : nil;
+		
+		CTKTrace((done) ? CTKTraceEventCommit : CTKTraceEventRetry, self.startPoint, 0, CTKTraceCauseNone, 0);
 		[self private_stopWithStatus:(done) ? CTKTransactionStatusCommitted : CTKTransactionStatusRetry];
 		
-		if (!done && error != nil)
+		// The refs are unlocked, waiting for the fsync does not block other transactions and lets their commits join it
+		if (done)
+			for (CTKDurableLog *log in durableTickets) {
+				
+				if (![log waitForTicket:(uint64_t)(uintptr_t)NSMapGet(durableTickets, log)] && durabilityError == nil)
+					durabilityError = CTKTransactionDurabilityErrorWithLog(log, @"The values were committed but may not be durable in %@");
+			}
+		
+		NSResetMapTable(durableTickets);
+		
+		// Agents see the committed values, and durable ones once synced
+		for (CTKAgentAction *action in committedActions)
+			[action dispatch];
+		
+		[committedActions release];
+		
+		if (durabilityError != nil)
+			CTKErrorLog(@"%@", [durabilityError localizedDescription]);
+		
+		if (error != nil && durabilityError != nil)
+			*error = durabilityError;
+		
+		else if (!done && error != nil)
 			*error = [NSError errorWithDomain:CTKTransactionErrorDomain 
 										 code:CTKTransactionRetryError
 									 userInfo:nil];
-		return done;
+		
+		// Under CTKDurableLogSyncCommit a commit is only acknowledged once durable
+		return done && durabilityError == nil;
 	}
 	
 
@@ -482,13 +603,14 @@ void CTKPthreadTransactionDestructor(void *txn)
 	
 	for(CTKReference *ref in orderedKeys){
 		
-		if ([self.sets containsObject:ref])
+		if ([self.sets containsObject:ref] || [self.merges objectForKey:ref] != nil)
 			continue;
 		
 		BOOL wasEnsured = [self private_releaseReferenceIfEnsured:ref];
 		
 		if (![ref tryWriteLock])
 		{				
+			CTKTrace(CTKTraceEventConflict, self.startPoint, ref.identifier, CTKTraceCauseLockBusy, 0);
 			return NO; // This will force a retry
 		}
 		
@@ -496,6 +618,7 @@ void CTKPthreadTransactionDestructor(void *txn)
 		
 		if (wasEnsured && ref.tvals != nil && ref.tvals.point > self.readPoint)
 		{
+			CTKTrace(CTKTraceEventConflict, self.startPoint, ref.identifier, CTKTraceCauseNewerValue, 0);
 			return NO; // This will force a retry
 		}
 		
@@ -503,8 +626,9 @@ void CTKPthreadTransactionDestructor(void *txn)
 		
 		if (refInfo != nil && refInfo != self.info && refInfo.isRunning)
 		{
-			if (![self private_canBargeIntoTransactionWithInfo:refInfo])
+			if (![self private_canBargeIntoTransactionWithInfo:refInfo reference:ref])
 			{
+				CTKTrace(CTKTraceEventConflict, self.startPoint, ref.identifier, CTKTraceCauseOwned, refInfo.startPoint);
 				return NO; // This will force a retry
 			}
 			
@@ -523,12 +647,68 @@ void CTKPthreadTransactionDestructor(void *txn)
 	return YES;
 }
 
+- (BOOL) private_lockAndMerge:(NSMutableArray **)lockedRefs
+{
+	for(CTKReference *ref in self.merges){
+		
+		[self private_releaseReferenceIfEnsured:ref];
+		
+		if (![ref tryWriteLock])
+		{
+			CTKTrace(CTKTraceEventConflict, self.startPoint, ref.identifier, CTKTraceCauseLockBusy, 0);
+			return NO; // This will force a retry
+		}
+		
+		[*lockedRefs addObject:ref];
+		
+		// A transaction that took ownership with a plain write keeps it
+		CTKLockingTransactionInfo *refInfo = ref.txnInfo;
+		
+		if (refInfo != nil && refInfo != self.info && refInfo.isRunning)
+		{
+			if (![self private_canBargeIntoTransactionWithInfo:refInfo reference:ref])
+			{
+				CTKTrace(CTKTraceEventConflict, self.startPoint, ref.identifier, CTKTraceCauseOwned, refInfo.startPoint);
+				return NO; // This will force a retry
+			}
+		}
+		
+		if (ref.tvals == nil || ref.tvals.point <= self.readPoint)
+			continue;
+		
+		id base = [self.merges objectForKey:ref];
+		id theirs = ref.tvals.value;
+		id mine = [self.vals objectForKey:ref];
+		
+		base = (base == [NSNull null]) ? nil : base;
+		
+		if (![base isKindOfClass:[CTKPersistentHashMap class]] || ![theirs isKindOfClass:[CTKPersistentHashMap class]] 
+			|| ![mine isKindOfClass:[CTKPersistentHashMap class]])
+		{
+			CTKTrace(CTKTraceEventConflict, self.startPoint, ref.identifier, CTKTraceCauseNewerValue, 0);
+			return NO; // This will force a retry
+		}
+		
+		id merged = [CTKPersistentHashMap mapByMergingBase:base theirs:theirs mine:mine];
+		
+		if (merged == nil)
+		{
+			CTKTrace(CTKTraceEventConflict, self.startPoint, ref.identifier, CTKTraceCauseMergeConflict, 0);
+			return NO; // A key was changed by both, this will force a retry
+		}
+		
+		[self.vals setObject:merged forKey:ref];
+	}
+	
+	return YES;
+}
+
 - (BOOL) private_validateAndEnqueueNotifications
 {
 	return YES; // Not implemented yet
 }
 
-- (void) private_processChanges
+- (BOOL) private_processChanges:(NSError **)error
 {
 	/*
 	 When a change to a Ref is committed:
@@ -544,25 +724,56 @@ void CTKPthreadTransactionDestructor(void *txn)
 	NSUInteger msecs = [CTKUtils currentTimeInMillis];
 	NSUInteger txnCommitPoint = [self private_commitPoint];
 	
+	/*
+	 Logged under the ref locks, so the order of the records of a ref is the order of its commits, and before any value
+	 is published: a closed or failed log fails the commit. Records already appended to other logs stay there.
+	 */
+	for(CTKReference *ref in [self.vals keyEnumerator]){
+		
+		if (ref.durableLog == nil)
+			continue;
+		
+		CTKDurableLogEntry *entry = [durableEntries objectForKey:ref];
+		uint64_t ticket = (entry != nil) 
+			? [ref.durableLog appendEntry:entry point:txnCommitPoint] 
+			: [ref.durableLog appendValue:[self.vals objectForKey:ref] forReference:ref point:txnCommitPoint];
+		
+		if (ticket == 0)
+		{
+			if (error != NULL)
+				*error = CTKTransactionDurabilityErrorWithLog(ref.durableLog, @"The durable log %@ is closed or failed, nothing was committed");
+			
+			return NO;
+		}
+		
+		if (ticket > (uint64_t)(uintptr_t)NSMapGet(durableTickets, ref.durableLog))
+			NSMapInsert(durableTickets, ref.durableLog, (void *)(uintptr_t)ticket);
+	}
+	
 	for(CTKReference *ref in [self.vals keyEnumerator]){
 		
 		//id oldValue = (ref.tvals == nil) ? nil : ref.tvals.value;
 		id newValue = [self.vals objectForKey:ref];
+		
 		NSUInteger hcount = (NSUInteger)[ref private_historyCount]; // ref is locked so it is safe to call
 		
 		if (ref.tvals == nil)
 		{
-			ref.tvals = [CTKLockingTransactionValue transactionValueWithValue:newValue
-																		point:txnCommitPoint
-																		msecs:msecs];
+			CTKLockingTransactionValue *tval = [CTKLockingTransactionValue newTransactionValueWithValue:newValue
+																								 point:txnCommitPoint
+																								 msecs:msecs];
+			ref.tvals = tval;
+			[tval release];
 		}
 		
 		else if ((ref.faults > 0 && hcount < ref.maxHistory ) || hcount < ref.minHistory)
 		{
-			ref.tvals = [CTKLockingTransactionValue transactionValueWithValue:newValue
-																		point:txnCommitPoint
-																		msecs:msecs
-																		prior:ref.tvals];
+			CTKLockingTransactionValue *tval = [CTKLockingTransactionValue newTransactionValueWithValue:newValue
+																								 point:txnCommitPoint
+																								 msecs:msecs
+																								 prior:ref.tvals];
+			ref.tvals = tval;
+			[tval release];
 			[ref resetFaults];
 		}
 		
@@ -575,6 +786,8 @@ void CTKPthreadTransactionDestructor(void *txn)
 		}
 		
 	}
+	
+	return YES;
 }
 
 // @TODO Elminate exception here
@@ -598,12 +811,14 @@ void CTKPthreadTransactionDestructor(void *txn)
 	if ([self.ensures containsObject:aRef])
 		return;
 	
+	CTKTrace(CTKTraceEventEnsure, self.startPoint, aRef.identifier, CTKTraceCauseNone, 0);
 	[aRef readLock];
 	
 	// Check if someone completed a write after our snapshot
 	if (aRef.tvals != nil && aRef.tvals.point > self.readPoint)
 	{
 		[aRef unlock];
+		CTKTrace(CTKTraceEventConflict, self.startPoint, aRef.identifier, CTKTraceCauseNewerValue, 0);
 		@throw [CTKTransactionRetryException exceptionWithName:CTKTransactionRetryExceptionName
 														reason:@"Another transaction completed a write after this transation snapshot."
 													  userInfo:nil];
@@ -617,11 +832,13 @@ void CTKPthreadTransactionDestructor(void *txn)
 	 */
 	if (refInfo != nil && refInfo.isRunning)
 	{
+		// Waited on after unlocking, when its owner may already have released it
+		[[refInfo retain] autorelease];
 		[aRef unlock];
 		
 		if (refInfo != self.info)
 		{
-			[self private_blockAndBailWithInfo:refInfo];
+			[self private_blockAndBailWithInfo:refInfo reference:aRef];
 		}
 	}
 	
@@ -643,6 +860,7 @@ void CTKPthreadTransactionDestructor(void *txn)
 		
 		if (unlocked)
 		{
+			CTKTrace(CTKTraceEventConflict, self.startPoint, aRef.identifier, CTKTraceCauseLockBusy, 0);
 			@throw [CTKTransactionRetryException exceptionWithName:CTKTransactionRetryExceptionName
 															reason:@"Could not get reference write lock"
 														  userInfo:nil];
@@ -650,6 +868,7 @@ void CTKPthreadTransactionDestructor(void *txn)
 		
 		if (aRef.tvals != nil && aRef.tvals.point > self.readPoint)
 		{	
+			CTKTrace(CTKTraceEventConflict, self.startPoint, aRef.identifier, CTKTraceCauseNewerValue, 0);
 			@throw [CTKTransactionRetryException exceptionWithName:CTKTransactionRetryExceptionName
 															reason:@"The reference last known value commit point is higher than this transaction readpoint."
 														  userInfo:nil];
@@ -660,10 +879,12 @@ void CTKPthreadTransactionDestructor(void *txn)
 		if (refInfo != nil && refInfo != self.info && refInfo.isRunning)
 		{
 			// There is a write lock conflict
-			if (![self private_canBargeIntoTransactionWithInfo:refInfo])
+			if (![self private_canBargeIntoTransactionWithInfo:refInfo reference:aRef])
 			{
+				// Waited on after unlocking, when its owner may already have released it
+				[[refInfo retain] autorelease];
 				unlocked = [aRef unlock];
-				[self private_blockAndBailWithInfo:refInfo]; // throws exception
+				[self private_blockAndBailWithInfo:refInfo reference:aRef]; // throws exception
 			}
 		}
 		
@@ -680,10 +901,15 @@ void CTKPthreadTransactionDestructor(void *txn)
 // @TODO how to maintain API and also eliminate exceptions here? I would need some way of breaking the transaction using an ivar which I check? info.status = RETRY ?
 - (id) valueForReference:(CTKReference *)aRef
 {
+	CTKTrace(CTKTraceEventRead, self.startPoint, aRef.identifier, CTKTraceCauseNone, 0);
+	
 	if (self.info.isRunning == NO)
+	{
+		CTKTrace(CTKTraceEventConflict, self.startPoint, aRef.identifier, CTKTraceCauseKilled, 0);
 		@throw [CTKTransactionRetryException exceptionWithName:CTKTransactionRetryExceptionName
 														reason:@"Transaction is not running."
 													  userInfo:nil];
+	}
 	
 	// Return the in-transaction value if there is one
 	id value = [self.vals objectForKey:aRef];
@@ -721,6 +947,7 @@ void CTKPthreadTransactionDestructor(void *txn)
 	
 	// No version of value preceeds the read point
 	[aRef incrementFaults];
+	CTKTrace(CTKTraceEventConflict, self.startPoint, aRef.identifier, CTKTraceCauseFault, 0);
 	
 	NSString *reason = [NSString stringWithFormat:
 						@"No version of value preceeds this transaction readPoint (%U).", self.readPoint];
@@ -733,8 +960,11 @@ void CTKPthreadTransactionDestructor(void *txn)
 // @TODO eliminate retry exception add error
 - (id) setValue:(id)aValue forReference:(CTKReference *)aRef
 {
+	CTKTrace(CTKTraceEventWrite, self.startPoint, aRef.identifier, CTKTraceCauseNone, 0);
+	
 	if (self.info.isRunning == NO)
 	{
+		CTKTrace(CTKTraceEventConflict, self.startPoint, aRef.identifier, CTKTraceCauseKilled, 0);
 		
 		@throw [CTKTransactionRetryException exceptionWithName:CTKTransactionRetryExceptionName
 														reason:@"The current thread has no running transaction."
@@ -747,7 +977,17 @@ void CTKPthreadTransactionDestructor(void *txn)
 									   reason:@"Cannot perform a set after a commute"
 									 userInfo:nil];
 	
-	if (![self.sets containsObject:aRef])
+	if (aRef.mergePolicy != CTKReferenceMergeNone && ![self.sets containsObject:aRef])
+	{
+		// Nothing is locked until commit, remember what this transaction started from
+		if ([self.merges objectForKey:aRef] == nil)
+		{
+			id base = [self valueForReference:aRef]; // throws exception
+			[self.merges setObject:(base != nil) ? base : [NSNull null] forKey:aRef];
+		}
+	}
+	
+	else if (![self.sets containsObject:aRef])
 	{
 		[self.sets addObject:aRef];
 		[self lockReference:aRef]; // throws exception
@@ -765,10 +1005,15 @@ void CTKPthreadTransactionDestructor(void *txn)
 	
 	id result;
 	
+	CTKTrace(CTKTraceEventCommute, self.startPoint, aRef.identifier, CTKTraceCauseNone, 0);
+	
 	if (self.info.isRunning == NO)
+	{
+		CTKTrace(CTKTraceEventConflict, self.startPoint, aRef.identifier, CTKTraceCauseKilled, 0);
 		@throw [CTKTransactionRetryException exceptionWithName:CTKTransactionRetryExceptionName
 														reason:@"The current thread has no running transaction."
 													  userInfo:nil];
+	}
 	
 	if ([self.vals objectForKey:aRef] == nil)
 	{
@@ -791,11 +1036,14 @@ void CTKPthreadTransactionDestructor(void *txn)
 	
 	if (operations == nil)
 	{
-		operations = [NSMutableArray array];
+		operations = [[NSMutableArray alloc] init];
 		[self.commutes setObject:operations forKey:aRef];
+		[operations release];
 	}
 	
-	[operations addObject:[[aBlock copy] autorelease]];
+	id (^operation)(id) = [aBlock copy];
+	[operations addObject:operation];
+	[operation release];
 	
 	result = aBlock([self.vals objectForKey:aRef]);
 	[self.vals setObject:result forKey:aRef];
@@ -803,7 +1051,58 @@ void CTKPthreadTransactionDestructor(void *txn)
 	return result;
 }
 
-- (BOOL) private_canBargeIntoTransactionWithInfo:(CTKLockingTransactionInfo *)refInfo
+#pragma mark Transaction Handle
+
+- (id) read:(CTKReference *)aRef
+{
+	return [self valueForReference:aRef];
+}
+
+- (id) write:(CTKReference *)aRef value:(id)aValue
+{
+	return [self setValue:aValue forReference:aRef];
+}
+
+- (id) alter:(CTKReference *)aRef block:(id (^)(id))aBlock
+{
+	return [self setValue:aBlock([self valueForReference:aRef]) forReference:aRef];
+}
+
+- (id) commute:(CTKReference *)aRef block:(id (^)(id))aBlock
+{
+	return [self commuteReference:aRef block:aBlock];
+}
+
+- (void) ensure:(CTKReference *)aRef
+{
+	[self ensureReference:aRef];
+}
+
+- (void) send:(CTKAgent *)anAgent block:(id (^)(id))aBlock
+{
+	if (self.info.isRunning == NO)
+		@throw [CTKTransactionRetryException exceptionWithName:CTKTransactionRetryExceptionName
+														reason:@"Transaction is not running."
+													  userInfo:nil];
+	
+	CTKAgentAction *action = [[CTKAgentAction alloc] initWithAgent:anAgent block:aBlock blocking:NO];
+	[self.actions addObject:action];
+	[action release];
+}
+
+- (void) sendOff:(CTKAgent *)anAgent block:(id (^)(id))aBlock
+{
+	if (self.info.isRunning == NO)
+		@throw [CTKTransactionRetryException exceptionWithName:CTKTransactionRetryExceptionName
+														reason:@"Transaction is not running."
+													  userInfo:nil];
+	
+	CTKAgentAction *action = [[CTKAgentAction alloc] initWithAgent:anAgent block:aBlock blocking:YES];
+	[self.actions addObject:action];
+	[action release];
+}
+
+- (BOOL) private_canBargeIntoTransactionWithInfo:(CTKLockingTransactionInfo *)refInfo reference:(CTKReference *)aRef
 {	
 	BOOL barged = NO;
 	
@@ -831,6 +1130,7 @@ void CTKPthreadTransactionDestructor(void *txn)
 		
 		if (barged)
 		{
+			CTKTrace(CTKTraceEventBarge, self.startPoint, aRef.identifier, CTKTraceCauseNone, refInfo.startPoint);
 			CTKWarningLog(@"Barged txn: %@", refInfo);
 			[refInfo broadcast];
 		}
@@ -839,9 +1139,16 @@ void CTKPthreadTransactionDestructor(void *txn)
 	return barged;
 }
 
+/*
+ Called after unlocking aRef, the caller keeps refInfo alive for the wait.
+ */
 // @TODO eliminate retry exception add error?
-- (void) private_blockAndBailWithInfo:(CTKLockingTransactionInfo *)refInfo
+- (void) private_blockAndBailWithInfo:(CTKLockingTransactionInfo *)refInfo reference:(CTKReference *)aRef
 {
+	NSUInteger attempt = self.startPoint;
+	uint64_t waitStart = CTKTransactionTracingEnabled ? [CTKUtils currentTimeInNanos] : 0;
+	
+	CTKTrace(CTKTraceEventConflict, attempt, aRef.identifier, CTKTraceCauseOwned, refInfo.startPoint);
 	[self private_stopWithStatus:CTKTransactionStatusRetry];
 	
 	@try {
@@ -852,6 +1159,10 @@ void CTKPthreadTransactionDestructor(void *txn)
 		CTKErrorLog(@"%@", e);
 	}
 	
+	if (__builtin_expect(CTKTransactionTracingEnabled && waitStart != 0, 0))
+		CTKTraceRecord(CTKTraceEventLockWait, attempt, aRef.identifier, CTKTraceCauseNone, refInfo.startPoint, 
+					   [CTKUtils currentTimeInNanos] - waitStart);
+	
 	@throw [CTKTransactionRetryException exceptionWithName:CTKTransactionRetryExceptionName
 													reason:@"Transaction was bailed."
 												  userInfo:nil];
@@ -901,8 +1212,7 @@ void CTKPthreadTransactionDestructor(void *txn)
 }
 
 #pragma mark Properties
-//@synthesize actions;
-@synthesize info, vals, sets, commutes, startPoint, readPoint, startTime, retryLimit, ensures;
+@synthesize info, actions, vals, sets, commutes, startPoint, readPoint, startTime, retryLimit, ensures, merges;
 @dynamic bargeTimeElapsed, isRunning;
 
 
@@ -53,6 +53,9 @@ typedef enum {
 
 + (id) infoWithStatus:(CTKTransactionStatus)aStatus startPoint:(NSUInteger)aStartPoint;
 
+// Same as above but the caller owns the returned info, used once per transaction attempt
++ (id) newInfoWithStatus:(CTKTransactionStatus)aStatus startPoint:(NSUInteger)aStartPoint;
+
 - (id) initWithStatus:(CTKTransactionStatus)aStatus startPoint:(NSUInteger)aStartPoint;
 
 - (BOOL) compareStatus:(CTKTransactionStatus)expectedStatus setStatus:(CTKTransactionStatus)updatedStatus;
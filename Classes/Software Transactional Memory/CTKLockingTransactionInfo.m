@@ -40,7 +40,12 @@
 
 + (id) infoWithStatus:(CTKTransactionStatus)aStatus startPoint:(NSUInteger)aStartPoint
 {
-	return [[[self alloc] initWithStatus:aStatus startPoint:aStartPoint] autorelease];
+	return [[self newInfoWithStatus:aStatus startPoint:aStartPoint] autorelease];
+}
+
++ (id) newInfoWithStatus:(CTKTransactionStatus)aStatus startPoint:(NSUInteger)aStartPoint
+{
+	return [[self alloc] initWithStatus:aStatus startPoint:aStartPoint];
 }
 
 #pragma mark Initializers and dealloc
@@ -41,11 +41,13 @@
 	CTKLockingTransactionValue *next;
 }
 
-@property (readwrite, assign) NSUInteger point;
-@property (readwrite, assign) NSUInteger msecs;
+// Only read or written while holding the lock of the owning CTKReference, hence nonatomic
+@property (readwrite, assign, nonatomic) NSUInteger point;
+@property (readwrite, assign, nonatomic) NSUInteger msecs;
+// Atomic: readers return the value after unlocking the reference, while a commit reusing this node releases it
 @property (readwrite, retain) id value;
-@property (readwrite, retain) CTKLockingTransactionValue *prior; 
-@property (readwrite, assign) CTKLockingTransactionValue *next;
+@property (readwrite, retain, nonatomic) CTKLockingTransactionValue *prior; 
+@property (readwrite, assign, nonatomic) CTKLockingTransactionValue *next;
 
 #pragma mark Class methods
 
@@ -56,4 +58,15 @@
 
 + (id) transactionValueWithValue:(id)aValue point:(NSUInteger)aPoint msecs:(NSUInteger)timeInMillis;
 
+/*
+ Same as above but the caller owns the returned value. Commits create their history nodes through these so that
+ they never go through the autorelease pool.
+ */
++ (id) newTransactionValueWithValue:(id)aValue 
+							  point:(NSUInteger)aPoint 
+							  msecs:(NSUInteger)timeInMillis 
+							  prior:(CTKLockingTransactionValue *)aPriorValue;
+
++ (id) newTransactionValueWithValue:(id)aValue point:(NSUInteger)aPoint msecs:(NSUInteger)timeInMillis;
+
 @end
@@ -33,6 +33,17 @@
 #pragma mark Class methods
 
 + (id) transactionValueWithValue:(id)aValue point:(NSUInteger)aPoint msecs:(NSUInteger)timeInMillis prior:(CTKLockingTransactionValue *)aPriorValue
+{
+	return [[self newTransactionValueWithValue:aValue point:aPoint msecs:timeInMillis prior:aPriorValue] autorelease];
+}
+
+
++ (id) transactionValueWithValue:(id)aValue point:(NSUInteger)aPoint msecs:(NSUInteger)timeInMillis
+{
+	return [[self newTransactionValueWithValue:aValue point:aPoint msecs:timeInMillis] autorelease];
+}
+
++ (id) newTransactionValueWithValue:(id)aValue point:(NSUInteger)aPoint msecs:(NSUInteger)timeInMillis prior:(CTKLockingTransactionValue *)aPriorValue
 {
 	CTKLockingTransactionValue *instance = [CTKLockingTransactionValue new];
 	instance.value = aValue;
@@ -43,11 +54,11 @@
 	instance.prior.next = instance;
 	instance.next.prior = instance;
 	
-	return [instance autorelease];
+	return instance;
 }
 
 
-+ (id) transactionValueWithValue:(id)aValue point:(NSUInteger)aPoint msecs:(NSUInteger)timeInMillis
++ (id) newTransactionValueWithValue:(id)aValue point:(NSUInteger)aPoint msecs:(NSUInteger)timeInMillis
 {
 	CTKLockingTransactionValue *instance = [CTKLockingTransactionValue new];
 	instance.value = aValue;
@@ -56,7 +67,7 @@
 	instance.prior = instance;
 	instance.next = instance;
 	
-	return [instance autorelease];
+	return instance;
 }
 
 #pragma mark Initializers and dealloc
@@ -27,6 +27,15 @@
 #import <Cocoa/Cocoa.h>
 #import "CTKLockingTransactionValue.h"
 @class CTKLockingTransactionInfo;
+@class CTKDurableLog;
+
+/*
+ What a committing transaction does when a reference it wrote was committed by someone else since its read point.
+ */
+typedef enum {
+	CTKReferenceMergeNone = 0,		// the transaction retries (the write conflicts as soon as it is made)
+	CTKReferenceMergeHashMapKeys	// CTKPersistentHashMap values are merged key by key, the transaction retries on a key conflict
+} CTKReferenceMergePolicy;
 
 
 /*
@@ -77,6 +86,9 @@
 	CTKLockingTransactionValue *tvals;
 	CTKLockingTransactionInfo *txnInfo;
 	volatile int64_t faults;
+	CTKDurableLog *durableLog;
+	NSString *durableName;
+	CTKReferenceMergePolicy mergePolicy;
 	pthread_rwlock_t rwlock; /**< Use to read all and to write txnInfo and tvals to this reference*/
 }
 
@@ -98,13 +110,16 @@
 @property (readonly, assign) NSUInteger historyCount;
 /**
  * \return Returns the last committed value for this reference.
+ * \attention Nonatomic, read and write it only while holding the reference lock (readLock, tryWriteLock).
  */
-@property (readwrite, retain) CTKLockingTransactionValue *tvals;
+@property (readwrite, retain, nonatomic) CTKLockingTransactionValue *tvals;
 /**
  * An info object marks this reference as having an in-transaction value for a given transaction.
  * \attention It is an alternative to having this reference locked for the duration of a transaction.
+ * Nonatomic, read and write it while holding the reference lock. The owner releases the info when it begins again
+ * and the next locker replaces it, so retain it before unlocking if it is used afterwards.
  */
-@property (readwrite, retain) CTKLockingTransactionInfo *txnInfo;
+@property (readwrite, retain, nonatomic) CTKLockingTransactionInfo *txnInfo;
 /**
  * \return the minimum number of commit values the reference should keep
  * \see CTKLockingTransactionValue class to understand how the reference keeps its history of committed values.
@@ -129,6 +144,25 @@
  * reaches the maxHistory count.
  */
 @property (readwrite, assign) volatile int64_t faults;
+/**
+ * \return The write-ahead log the committed values of this reference are appended to, nil if it is not durable.
+ * \see CTKDurableLog registerReference:name:
+ * \attention Nonatomic, set it before the reference is shared between threads.
+ */
+@property (readwrite, retain, nonatomic) CTKDurableLog *durableLog;
+/**
+ * \return The name identifying this reference in its durableLog across restarts.
+ */
+@property (readwrite, copy, nonatomic) NSString *durableName;
+/**
+ * \return CTKReferenceMergeNone by default.
+ * \details With CTKReferenceMergeHashMapKeys writes do not take ownership of the reference: the commit locks it, and if 
+ * its value moved past the transaction read point, commits the three-way merge of the value at the read point, the
+ * committed value and the in-transaction value (see CTKPersistentHashMap mapByMergingBase:theirs:mine:). Two 
+ * transactions setting different keys of the map both commit, they only retry when they change the same key.
+ * \attention Nonatomic, set it before the reference is shared between threads.
+ */
+@property (readwrite, assign, nonatomic) CTKReferenceMergePolicy mergePolicy;
 
 #pragma mark Class methods
 /**
@@ -189,6 +223,21 @@
 
 - (void) trimHistory;
 
+#pragma mark Introspection
+
+/**
+ * \return The number of committed values held, the current one included (historyCount + 1), 0 if unbound.
+ */
+- (NSUInteger) historyLength;
+
+/**
+ * \return The bytes kept alive only by the history: its CTKLockingTransactionValue nodes and what the older values 
+ * do not share with the current one or with each other.
+ * \details CTKPersistentHashMap values are compared node by node (see CTKPersistentHashMapStatistics), other values
+ * count their own allocation. Use it along with historyLength and faults to pick maxHistory.
+ */
+- (size_t) historyRetainedBytes;
+
 #pragma mark Private Operations
 
 /**
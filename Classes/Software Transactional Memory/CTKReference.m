@@ -30,6 +30,8 @@
 #import "CTKUtils.h"
 #import "CTKLockingTransaction.h"
 #import "CTKLockingTransactionValue.h"
+#import "CTKPersistentHashMapStatistics.h"
+#include <malloc/malloc.h>
 
 
 @interface CTKReference ()
@@ -56,10 +58,13 @@
 
 - (id) initWithValue:(id)aValue
 {	
-	CTKLockingTransactionValue *tval = [CTKLockingTransactionValue transactionValueWithValue:aValue 
-																					   point:0 
-																					   msecs:[CTKUtils currentTimeInMillis]];
-	return [self initWithTransactionValue:tval];	
+	CTKLockingTransactionValue *tval = [CTKLockingTransactionValue newTransactionValueWithValue:aValue 
+																						 point:0 
+																						 msecs:[CTKUtils currentTimeInMillis]];
+	self = [self initWithTransactionValue:tval];
+	[tval release];
+	
+	return self;
 }
 
 - (id) initWithTransactionValue:(CTKLockingTransactionValue *)aTval
@@ -87,6 +92,8 @@
 	pthread_rwlock_destroy( &rwlock );
 	[tvals release];
 	[txnInfo release];
+	[durableLog release];
+	[durableName release];
 	
 	[super dealloc];	
 }
@@ -305,7 +312,7 @@
 
 #pragma marl Properties
 
-@synthesize identifier, tvals, txnInfo, faults, maxHistory, minHistory;
+@synthesize identifier, tvals, txnInfo, faults, maxHistory, minHistory, durableLog, durableName, mergePolicy;
 @dynamic value, isBound, historyCount;
 
 - (id) value
@@ -366,6 +373,45 @@
 	return count;
 }
 
+#pragma mark Introspection
+
+- (NSUInteger) historyLength
+{
+	NSUInteger length = 0;
+	
+	pthread_rwlock_rdlock( &rwlock );
+	length = (self.tvals == nil) ? 0 : [self private_historyCount] + 1;
+	pthread_rwlock_unlock( &rwlock );
+	
+	return length;
+}
+
+- (size_t) historyRetainedBytes
+{
+	NSMutableArray *versions = [NSMutableArray array];
+	size_t size = 0;
+	
+	pthread_rwlock_rdlock( &rwlock );
+	
+	if (self.tvals != nil) {
+		
+		// Newest first, the current value is what the history is measured against
+		[versions addObject:(self.tvals.value != nil) ? self.tvals.value : [NSNull null]];
+		
+		for(CTKLockingTransactionValue *tval = self.tvals.prior; tval != self.tvals; tval = tval.prior){
+			
+			size += malloc_size(tval);
+			
+			if (tval.value != nil)
+				[versions addObject:tval.value];
+		}
+	}
+	
+	pthread_rwlock_unlock( &rwlock );
+	
+	return size + [CTKPersistentHashMapStatistics retainedBytesOfVersions:versions];
+}
+
 
 @end
 
@@ -0,0 +1,158 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#import <Cocoa/Cocoa.h>
+
+typedef enum {
+	CTKTraceEventBegin = 0,		// an attempt starts
+	CTKTraceEventRead,
+	CTKTraceEventWrite,
+	CTKTraceEventCommute,
+	CTKTraceEventEnsure,
+	CTKTraceEventLockWait,		// the attempt blocked on the transaction owning reference, see duration
+	CTKTraceEventBarge,			// the attempt killed the transaction owning reference
+	CTKTraceEventConflict,		// the attempt must retry because of reference, see cause
+	CTKTraceEventCommit,		// the attempt committed
+	CTKTraceEventRetry			// the attempt ended without committing
+} CTKTraceEventType;
+
+typedef enum {
+	CTKTraceCauseNone = 0,
+	CTKTraceCauseLockBusy,		// the write lock of the reference was held by someone else
+	CTKTraceCauseNewerValue,	// the reference was committed after the read point
+	CTKTraceCauseOwned,			// a running transaction owned the reference and could not be barged
+	CTKTraceCauseFault,			// the history of the reference had no value older than the read point
+	CTKTraceCauseKilled,		// the attempt was barged by another transaction
+	CTKTraceCauseMergeConflict	// both transactions changed the same key of a merged reference
+} CTKTraceCause;
+
+typedef struct {
+	uint64_t timestamp;			// ns, CTKUtils currentTimeInNanos
+	uint64_t duration;			// ns, lock waits only
+	uint64_t transaction;		// startPoint of the attempt, what other transactions see as the owner of a reference
+	uint64_t reference;			// identifier of the reference, 0 if none
+	uint64_t other;				// startPoint of the conflicting transaction, 0 if unknown
+	uint32_t type;
+	uint32_t cause;
+} CTKTraceEvent;
+
+/*
+ Read by CTKTrace on every transactional access, set it with CTKTransactionTracer setEnabled:.
+ */
+extern volatile BOOL CTKTransactionTracingEnabled;
+
+extern void CTKTraceRecord(CTKTraceEventType aType, NSUInteger aTransaction, NSUInteger aReference, 
+						   CTKTraceCause aCause, NSUInteger anOther, uint64_t aDuration);
+
+/*
+ When tracing is disabled an event costs one load and a branch predicted not taken, the arguments are not evaluated.
+ */
+#define CTKTrace(type, txn, ref, cause, other) \
+	do { if (__builtin_expect(CTKTransactionTracingEnabled, 0)) CTKTraceRecord((type), (txn), (ref), (cause), (other), 0); } while (0)
+
+#pragma mark -
+
+/*
+ * \class CTKTraceHotReference CTKTransactionTracer.h
+ * \brief The conflicts a reference caused in the traced events.
+ */
+@interface CTKTraceHotReference : NSObject {
+	@private
+	NSUInteger identifier;
+	NSUInteger conflicts;
+	NSUInteger barges;
+	NSUInteger lockWaits;
+	uint64_t lockWaitNanos;
+	NSUInteger transactions;
+}
+
+/**
+ * \return The identifier of the CTKReference.
+ */
+@property (readonly, assign, nonatomic) NSUInteger identifier;
+/**
+ * \return The attempts that retried because of this reference, one per retry.
+ */
+@property (readonly, assign, nonatomic) NSUInteger conflicts;
+@property (readonly, assign, nonatomic) NSUInteger barges;
+@property (readonly, assign, nonatomic) NSUInteger lockWaits;
+@property (readonly, assign, nonatomic) uint64_t lockWaitNanos;
+/**
+ * \return The distinct transactions involved in the conflicts, on either side.
+ */
+@property (readonly, assign, nonatomic) NSUInteger transactions;
+
+@end
+
+#pragma mark -
+
+/*
+ * \class CTKTransactionTracer CTKTransactionTracer.h
+ * \brief Records the attempts of CTKLockingTransaction(s) to find which references and code paths cause the retries.
+ * \details Every thread records its events in a ring buffer of its own (the oldest events are overwritten), recording
+ * takes no lock. An attempt is the span between a CTKTraceEventBegin and a CTKTraceEventCommit or CTKTraceEventRetry of
+ * the same thread, the CTKTraceEventConflict before a retry tells its cause, the reference and, when known, the 
+ * transaction it conflicted with.
+ * 
+ * Export the events once the traced work is done, buffers written during an export may yield torn events.
+ * \code
+ * [CTKTransactionTracer setEnabled:YES];
+ * ... // run the workload
+ * [CTKTransactionTracer setEnabled:NO];
+ * [CTKTransactionTracer writeChromeTraceToFile:@"/tmp/stm.json" error:&error]; // open it in chrome://tracing
+ * for (CTKTraceHotReference *hot in [CTKTransactionTracer hottestReferences:10]) ...
+ * \endcode
+ */
+@interface CTKTransactionTracer : NSObject {
+}
+
++ (void) setEnabled:(BOOL)flag;
+
++ (BOOL) isEnabled;
+
+/**
+ * \brief Drops the recorded events.
+ */
++ (void) reset;
+
+/**
+ * \return The recorded events as NSValue(s) holding CTKTraceEvent(s), in time order.
+ */
++ (NSArray *) events;
+
+/**
+ * \return The events in the Chrome trace event format: attempts as duration events of the thread that ran them, 
+ * accesses, conflicts and barges as instant events, lock waits as complete events.
+ */
++ (NSData *) chromeTraceData;
+
++ (BOOL) writeChromeTraceToFile:(NSString *)aPath error:(NSError **)error;
+
+/**
+ * \return CTKTraceHotReference(s) sorted by conflicts then barges then time spent waiting, at most aLimit of them.
+ */
++ (NSArray *) hottestReferences:(NSUInteger)aLimit;
+
+@end
@@ -0,0 +1,341 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#import "CTKTransactionTracer.h"
+#import "CTKUtils.h"
+#include <libkern/OSAtomic.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+static NSUInteger const CTKTraceBufferCapacity = 16384; // events per thread, a power of two
+
+volatile BOOL CTKTransactionTracingEnabled = NO;
+
+/*
+ Written by its thread only. head counts the events ever recorded, it is published after the event it covers.
+ Buffers are never freed: the events of threads that exited stay exportable.
+ */
+typedef struct CTKTraceBuffer {
+	struct CTKTraceBuffer *next;
+	uint32_t thread;
+	volatile uint64_t head;
+	CTKTraceEvent events[CTKTraceBufferCapacity];
+} CTKTraceBuffer;
+
+static pthread_key_t CTKTraceBufferKey;
+static pthread_once_t CTKTraceBufferKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t CTKTraceBuffersMutex = PTHREAD_MUTEX_INITIALIZER;
+static CTKTraceBuffer *CTKTraceBuffers;
+static uint32_t CTKTraceThreadCount;
+
+static void CTKTraceCreateBufferKey(void)
+{
+	pthread_key_create(&CTKTraceBufferKey, NULL);
+}
+
+static CTKTraceBuffer * CTKTraceThreadBuffer(void)
+{
+	pthread_once(&CTKTraceBufferKeyOnce, CTKTraceCreateBufferKey);
+	
+	CTKTraceBuffer *buffer = pthread_getspecific(CTKTraceBufferKey);
+	
+	if (buffer == NULL) {
+		
+		buffer = calloc(1, sizeof(CTKTraceBuffer));
+		
+		if (buffer == NULL)
+			return NULL;
+		
+		pthread_mutex_lock(&CTKTraceBuffersMutex);
+		buffer->thread = ++CTKTraceThreadCount;
+		buffer->next = CTKTraceBuffers;
+		CTKTraceBuffers = buffer;
+		pthread_mutex_unlock(&CTKTraceBuffersMutex);
+		
+		pthread_setspecific(CTKTraceBufferKey, buffer);
+	}
+	
+	return buffer;
+}
+
+void CTKTraceRecord(CTKTraceEventType aType, NSUInteger aTransaction, NSUInteger aReference, 
+					CTKTraceCause aCause, NSUInteger anOther, uint64_t aDuration)
+{
+	CTKTraceBuffer *buffer = CTKTraceThreadBuffer();
+	
+	if (buffer == NULL)
+		return;
+	
+	CTKTraceEvent *event = &buffer->events[buffer->head & (CTKTraceBufferCapacity - 1)];
+	
+	event->timestamp = [CTKUtils currentTimeInNanos];
+	event->duration = aDuration;
+	event->transaction = aTransaction;
+	event->reference = aReference;
+	event->other = anOther;
+	event->type = aType;
+	event->cause = aCause;
+	
+	OSMemoryBarrier();
+	buffer->head++;
+}
+
+/*
+ Calls aBlock with the retained events of every buffer, oldest first within a buffer.
+ */
+static void CTKTraceEnumerateEvents(void (^aBlock)(CTKTraceEvent *event, uint32_t thread))
+{
+	pthread_mutex_lock(&CTKTraceBuffersMutex);
+	
+	for (CTKTraceBuffer *buffer = CTKTraceBuffers; buffer != NULL; buffer = buffer->next) {
+		
+		uint64_t head = buffer->head;
+		uint64_t first = (head > CTKTraceBufferCapacity) ? head - CTKTraceBufferCapacity : 0;
+		
+		OSMemoryBarrier();
+		
+		for (uint64_t i = first; i < head; i++) {
+			CTKTraceEvent event = buffer->events[i & (CTKTraceBufferCapacity - 1)];
+			aBlock(&event, buffer->thread);
+		}
+	}
+	
+	pthread_mutex_unlock(&CTKTraceBuffersMutex);
+}
+
+static NSString * const CTKTraceCauseNames[] = {
+	@"none", @"lock busy", @"newer value", @"owned", @"fault", @"killed", @"merge conflict"
+};
+
+static NSString * CTKTraceCauseName(uint32_t aCause)
+{
+	return (aCause <= CTKTraceCauseMergeConflict) ? CTKTraceCauseNames[aCause] : @"unknown";
+}
+
+#pragma mark -
+
+@interface CTKTraceHotReference ()
+
+@property (readwrite, assign, nonatomic) NSUInteger identifier;
+@property (readwrite, assign, nonatomic) NSUInteger conflicts;
+@property (readwrite, assign, nonatomic) NSUInteger barges;
+@property (readwrite, assign, nonatomic) NSUInteger lockWaits;
+@property (readwrite, assign, nonatomic) uint64_t lockWaitNanos;
+@property (readwrite, assign, nonatomic) NSUInteger transactions;
+
+- (NSComparisonResult) compareHeat:(CTKTraceHotReference *)other;
+
+@end
+
+@implementation CTKTraceHotReference
+
+@synthesize identifier, conflicts, barges, lockWaits, lockWaitNanos, transactions;
+
+- (NSComparisonResult) compareHeat:(CTKTraceHotReference *)other
+{
+	if (self.conflicts != other.conflicts)
+		return (self.conflicts > other.conflicts) ? NSOrderedAscending : NSOrderedDescending;
+	
+	if (self.barges != other.barges)
+		return (self.barges > other.barges) ? NSOrderedAscending : NSOrderedDescending;
+	
+	if (self.lockWaitNanos != other.lockWaitNanos)
+		return (self.lockWaitNanos > other.lockWaitNanos) ? NSOrderedAscending : NSOrderedDescending;
+	
+	return NSOrderedSame;
+}
+
+- (NSString *) description
+{
+	return [NSString stringWithFormat:@"<ref %U: %U conflicts, %U barges, %U lock waits (%llu us), %U transactions>", 
+			self.identifier, self.conflicts, self.barges, self.lockWaits, 
+			(unsigned long long)(self.lockWaitNanos / 1000), self.transactions];
+}
+
+@end
+
+#pragma mark -
+
+@implementation CTKTransactionTracer
+
++ (void) setEnabled:(BOOL)flag
+{
+	CTKTransactionTracingEnabled = flag;
+	OSMemoryBarrier();
+}
+
++ (BOOL) isEnabled
+{
+	return CTKTransactionTracingEnabled;
+}
+
++ (void) reset
+{
+	pthread_mutex_lock(&CTKTraceBuffersMutex);
+	
+	// Only safe while nothing is traced: a thread recording now would publish a stale slot
+	for (CTKTraceBuffer *buffer = CTKTraceBuffers; buffer != NULL; buffer = buffer->next)
+		buffer->head = 0;
+	
+	pthread_mutex_unlock(&CTKTraceBuffersMutex);
+}
+
++ (NSArray *) events
+{
+	NSMutableArray *events = [NSMutableArray array];
+	
+	CTKTraceEnumerateEvents(^(CTKTraceEvent *event, uint32_t thread){
+		[events addObject:[NSValue valueWithBytes:event objCType:@encode(CTKTraceEvent)]];
+	});
+	
+	[events sortUsingComparator:^NSComparisonResult(id a, id b){
+		CTKTraceEvent eventA, eventB;
+		[a getValue:&eventA];
+		[b getValue:&eventB];
+		
+		if (eventA.timestamp == eventB.timestamp)
+			return NSOrderedSame;
+		
+		return (eventA.timestamp < eventB.timestamp) ? NSOrderedAscending : NSOrderedDescending;
+	}];
+	
+	return events;
+}
+
++ (NSData *) chromeTraceData
+{
+	NSMutableString *json = [NSMutableString stringWithString:@"{\"traceEvents\":[\n"];
+	__block BOOL first = YES;
+	
+	CTKTraceEnumerateEvents(^(CTKTraceEvent *event, uint32_t thread){
+		
+		// Timestamps are in us in the trace format
+		double ts = (double)event->timestamp / 1000.0;
+		NSString *entry = nil;
+		
+		switch (event->type) {
+			case CTKTraceEventBegin:
+				entry = [NSString stringWithFormat:@"{\"name\":\"attempt\",\"cat\":\"stm\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,"
+						 "\"args\":{\"txn\":%llu}}", ts, thread, event->transaction];
+				break;
+			case CTKTraceEventCommit:
+			case CTKTraceEventRetry:
+				entry = [NSString stringWithFormat:@"{\"name\":\"attempt\",\"cat\":\"stm\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,"
+						 "\"args\":{\"outcome\":\"%@\"}}", ts, thread, (event->type == CTKTraceEventCommit) ? @"commit" : @"retry"];
+				break;
+			case CTKTraceEventRead:
+			case CTKTraceEventWrite:
+			case CTKTraceEventCommute:
+			case CTKTraceEventEnsure: {
+				NSString *names[] = {@"read", @"write", @"commute", @"ensure"};
+				entry = [NSString stringWithFormat:@"{\"name\":\"%@\",\"cat\":\"stm\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,"
+						 "\"args\":{\"ref\":%llu}}", names[event->type - CTKTraceEventRead], ts, thread, event->reference];
+				break;
+			}
+			case CTKTraceEventLockWait:
+				entry = [NSString stringWithFormat:@"{\"name\":\"lock wait\",\"cat\":\"stm\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,"
+						 "\"args\":{\"ref\":%llu,\"owner\":%llu}}", 
+						 ts - (double)event->duration / 1000.0, (double)event->duration / 1000.0, thread, event->reference, event->other];
+				break;
+			case CTKTraceEventBarge:
+				entry = [NSString stringWithFormat:@"{\"name\":\"barge\",\"cat\":\"stm\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,"
+						 "\"args\":{\"ref\":%llu,\"victim\":%llu}}", ts, thread, event->reference, event->other];
+				break;
+			case CTKTraceEventConflict:
+				entry = [NSString stringWithFormat:@"{\"name\":\"conflict\",\"cat\":\"stm\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,"
+						 "\"args\":{\"ref\":%llu,\"cause\":\"%@\",\"other\":%llu}}", 
+						 ts, thread, event->reference, CTKTraceCauseName(event->cause), event->other];
+				break;
+			default:
+				break;
+		}
+		
+		if (entry != nil) {
+			[json appendString:first ? @"" : @",\n"];
+			[json appendString:entry];
+			first = NO;
+		}
+	});
+	
+	[json appendString:@"\n]}\n"];
+	
+	return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (BOOL) writeChromeTraceToFile:(NSString *)aPath error:(NSError **)error
+{
+	return [[self chromeTraceData] writeToFile:aPath options:NSDataWritingAtomic error:error];
+}
+
++ (NSArray *) hottestReferences:(NSUInteger)aLimit
+{
+	NSMutableDictionary *hot = [NSMutableDictionary dictionary];
+	NSMutableDictionary *involved = [NSMutableDictionary dictionary]; // identifier -> transactions
+	
+	CTKTraceEnumerateEvents(^(CTKTraceEvent *event, uint32_t thread){
+		
+		if (event->reference == 0 
+			|| (event->type != CTKTraceEventConflict && event->type != CTKTraceEventBarge && event->type != CTKTraceEventLockWait))
+			return;
+		
+		NSNumber *key = [NSNumber numberWithUnsignedLongLong:event->reference];
+		CTKTraceHotReference *entry = [hot objectForKey:key];
+		NSMutableSet *transactions = [involved objectForKey:key];
+		
+		if (entry == nil) {
+			entry = [[[CTKTraceHotReference alloc] init] autorelease];
+			entry.identifier = (NSUInteger)event->reference;
+			[hot setObject:entry forKey:key];
+			
+			transactions = [NSMutableSet set];
+			[involved setObject:transactions forKey:key];
+		}
+		
+		if (event->type == CTKTraceEventConflict)
+			entry.conflicts++;
+		
+		else if (event->type == CTKTraceEventBarge)
+			entry.barges++;
+		
+		else {
+			entry.lockWaits++;
+			entry.lockWaitNanos += event->duration;
+		}
+		
+		[transactions addObject:[NSNumber numberWithUnsignedLongLong:event->transaction]];
+		
+		if (event->other != 0)
+			[transactions addObject:[NSNumber numberWithUnsignedLongLong:event->other]];
+	});
+	
+	for (NSNumber *key in hot)
+		[[hot objectForKey:key] setTransactions:[[involved objectForKey:key] count]];
+	
+	NSArray *ranking = [[hot allValues] sortedArrayUsingSelector:@selector(compareHeat:)];
+	
+	return ([ranking count] > aLimit) ? [ranking subarrayWithRange:NSMakeRange(0, aLimit)] : ranking;
+}
+
+@end
@@ -0,0 +1,124 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#import <Cocoa/Cocoa.h>
+@class CTKReference;
+@class CTKPersistentHashMap;
+
+/*
+ * \class CTKTransactionalHashMap CTKTransactionalHashMap.h
+ * \brief A map shared across threads whose writers only conflict when they write keys of the same bucket.
+ * \details Holding a whole CTKPersistentHashMap in one CTKReference makes every two writers conflict in lockReference:
+ * whatever keys they touch. A CTKTransactionalHashMap splits its entries over a fixed number of buckets, each one a 
+ * CTKReference holding a CTKPersistentHashMap of the keys that hash to it: transactions writing keys of different buckets
+ * lock different references and commit in parallel.
+ *
+ * Reads inside a transaction go through the transaction like any other dereference, so iterating all the buckets 
+ * (enumerateKeysAndObjectsUsingBlock:, persistentHashMap) sees a consistent snapshot at the transaction read point.
+ * Reads outside a transaction see the last committed value of each bucket.
+ *
+ * The count is the sum of the counts of the bucket maps. It is not kept in a separate reference, so adding or 
+ * removing keys writes nothing but the bucket and the count is never a conflict point.
+ * \code
+ * CTKTransactionalHashMap *sessions = [CTKTransactionalHashMap transactionalHashMap];
+ * [CTKLockingTransaction performBlock:^{ 
+ *		[sessions setObject:session forKey:sessionId];
+ *		return (id)nil;
+ * } error:&error];
+ * \endcode
+ */
+@interface CTKTransactionalHashMap : NSObject {
+	@private
+	NSUInteger seed;
+	NSUInteger bucketCount;
+	CTKReference **buckets;
+}
+
+/**
+ * \return The number of buckets, a power of two.
+ */
+@property (readonly, assign) NSUInteger bucketCount;
+@property (readonly, assign) NSUInteger seed;
+
+#pragma mark Initialization
+
+/**
+ * \brief A map with 256 buckets.
+ */
++ (id) transactionalHashMap;
+
++ (id) transactionalHashMapWithBucketCount:(NSUInteger)aCount;
+
+/**
+ * \brief Designated initializer.
+ * \param aCount Rounded up to a power of two. More buckets mean fewer conflicts but slower iteration.
+ * \param aSeed Mixed into the key hashes like the seed of a CTKPersistentHashMap (see CTKTrieNodeMixHash).
+ */
+- (id) initWithBucketCount:(NSUInteger)aCount seed:(NSUInteger)aSeed;
+
+#pragma mark Operations
+
+- (id) objectForKey:(id)aKey;
+
+- (BOOL) containsObjectForKey:(id)aKey;
+
+/**
+ * \brief Must be called inside a transaction, writes the bucket of aKey.
+ * \throws CTKTransactionRetryException
+ */
+- (void) setObject:(id)anObject forKey:(id)aKey;
+
+/**
+ * \brief Must be called inside a transaction, writes the bucket of aKey if it holds it.
+ * \throws CTKTransactionRetryException
+ */
+- (void) removeObjectForKey:(id)aKey;
+
+/**
+ * \return The sum of the bucket counts, O(bucketCount). Inside a transaction it is read at the transaction read point
+ * and includes the transaction's own insertions and removals.
+ */
+- (NSUInteger) count;
+
+#pragma mark Iteration
+
+/**
+ * \brief Calls aBlock for the entries of every bucket. Inside a transaction the entries are a consistent snapshot.
+ */
+- (void) enumerateKeysAndObjectsUsingBlock:(void (^)(id aKey, id anObject, BOOL *stop))aBlock;
+
+/**
+ * \return The entries of all the buckets in a single CTKPersistentHashMap with the same seed, O(n).
+ */
+- (CTKPersistentHashMap *) persistentHashMap;
+
+#pragma mark Introspection
+
+/**
+ * \return The reference holding the bucket of aKey, e.g. to ensure it (touch) without writing it.
+ */
+- (CTKReference *) referenceForKey:(id)aKey;
+
+@end
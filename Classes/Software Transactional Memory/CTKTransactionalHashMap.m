@@ -0,0 +1,245 @@
+/*
+ * Author: Alejandro M. Ramallo
+ * Copyright (c) Alejandro M. Ramallo. All rights reserved.
+ *
+ * The use and distribution terms for this software are covered by the
+ * Eclipse Public License 1.0 <http://opensource.org/licenses/eclipse-1.0.php>
+ * which can be found in the file epl-v10.html at the root of this distribution.
+ * By using this software in any fashion, you are agreeing to be bound by
+ * the terms of this license.
+ * You must not remove this notice, or any other, from this software.
+ *
+ * The work contained herein is derived from and in many places is a direct translation 
+ * of Clojure distribution <http://clojure.org/>. That work contains the following notice:
+ *
+ *   -----------------------------------------------------------------------------
+ *   Clojure
+ *   Copyright (c) Rich Hickey. All rights reserved.
+ *   The use and distribution terms for this software are covered by the
+ *   Eclipse Public License 1.0 (http://opensource.org/licenses/eclipse-1.0.php)
+ *   which can be found in the file epl-v10.html at the root of this distribution.
+ *   By using this software in any fashion, you are agreeing to be bound by
+ *   the terms of this license.
+ *   You must not remove this notice, or any other, from this software.
+ *   -----------------------------------------------------------------------------
+ */
+#import "CTKTransactionalHashMap.h"
+#import "CTKReference.h"
+#import "CTKPersistentHashMap.h"
+#import "CTKTrieNode.h"
+#include <stdlib.h>
+
+static NSUInteger const CTKTransactionalHashMapDefaultBucketCount = 256;
+
+/*
+ Buckets take the high half of the mixed hash, the bucket maps index their tries with the low bits of the same hash.
+ */
+static NSUInteger CTKTransactionalHashMapBucketIndex(id aKey, NSUInteger aSeed, NSUInteger aCount)
+{
+	NSUInteger hashValue = CTKTrieNodeMixHash((aKey != nil) ? [aKey hash] : 0, aSeed);
+	
+	return (NSUInteger)((uint64_t)hashValue >> 32) & (aCount - 1);
+}
+
+#pragma mark -
+
+@interface CTKTransactionalHashMap ()
+
+@property (readwrite, assign) NSUInteger bucketCount;
+@property (readwrite, assign) NSUInteger seed;
+
+@end
+
+@interface CTKTransactionalHashMap (Private)
+
+- (NSUInteger) private_bucketIndexForKey:(id)aKey;
+
+@end
+
+#pragma mark -
+
+@implementation CTKTransactionalHashMap
+
+#pragma mark Initialization
+
++ (id) transactionalHashMap
+{
+	return [self transactionalHashMapWithBucketCount:CTKTransactionalHashMapDefaultBucketCount];
+}
+
++ (id) transactionalHashMapWithBucketCount:(NSUInteger)aCount
+{
+	return [[[CTKTransactionalHashMap alloc] initWithBucketCount:aCount seed:0] autorelease];
+}
+
+- (id) initWithBucketCount:(NSUInteger)aCount seed:(NSUInteger)aSeed
+{
+	self = [super init];
+	
+	if (self != nil) {
+		
+		NSUInteger powerOfTwo = 1;
+		
+		while (powerOfTwo < aCount && powerOfTwo < ((NSUInteger)1 << 32))
+			powerOfTwo <<= 1;
+		
+		self.bucketCount = powerOfTwo;
+		self.seed = aSeed;
+		
+		CTKPersistentHashMap *empty = [CTKPersistentHashMap emptyHashMapWithSeed:aSeed];
+		
+		buckets = malloc(sizeof(CTKReference *) * bucketCount);
+		
+		for (NSUInteger i = 0; i < bucketCount; i++)
+			buckets[i] = [[CTKReference alloc] initWithValue:empty];
+	}
+	
+	return self;
+}
+
+- (id) init
+{
+	return [self initWithBucketCount:CTKTransactionalHashMapDefaultBucketCount seed:0];
+}
+
+- (void) dealloc
+{
+	for (NSUInteger i = 0; i < bucketCount; i++)
+		[buckets[i] release];
+	
+	free(buckets);
+	
+	[super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize bucketCount, seed;
+
+#pragma mark Operations
+
+- (id) objectForKey:(id)aKey
+{
+	CTKPersistentHashMap *map = [buckets[[self private_bucketIndexForKey:aKey]] dereference];
+	
+	return [map objectForKey:aKey];
+}
+
+- (BOOL) containsObjectForKey:(id)aKey
+{
+	CTKPersistentHashMap *map = [buckets[[self private_bucketIndexForKey:aKey]] dereference];
+	
+	return [map containsObjectForKey:aKey];
+}
+
+- (void) setObject:(id)anObject forKey:(id)aKey
+{
+	CTKReference *bucket = buckets[[self private_bucketIndexForKey:aKey]];
+	CTKPersistentHashMap *map = [bucket dereference];
+	CTKPersistentHashMap *newMap = [map newMapBySettingObject:anObject forKey:aKey];
+	
+	// Setting an equal object leaves the bucket untouched, it does not conflict with anyone
+	if (newMap != map)
+		[bucket setValue:newMap];
+	
+	[newMap release];
+}
+
+- (void) removeObjectForKey:(id)aKey
+{
+	CTKReference *bucket = buckets[[self private_bucketIndexForKey:aKey]];
+	CTKPersistentHashMap *map = [bucket dereference];
+	
+	if (![map containsObjectForKey:aKey])
+		return;
+	
+	CTKPersistentHashMap *newMap = [map newMapByRemovingObjectForKey:aKey];
+	
+	[bucket setValue:newMap];
+	[newMap release];
+}
+
+- (NSUInteger) count
+{
+	NSUInteger total = 0;
+	
+	for (NSUInteger i = 0; i < bucketCount; i++)
+		total += [(CTKPersistentHashMap *)[buckets[i] dereference] count];
+	
+	return total;
+}
+
+#pragma mark Iteration
+
+- (void) enumerateKeysAndObjectsUsingBlock:(void (^)(id aKey, id anObject, BOOL *stop))aBlock
+{
+	__block BOOL stopped = NO;
+	
+	for (NSUInteger i = 0; i < bucketCount && !stopped; i++) {
+		
+		CTKPersistentHashMap *map = [buckets[i] dereference];
+		
+		if (map.count == 0)
+			continue;
+		
+		[map enumerateKeysAndObjectsUsingBlock:^(id aKey, id anObject, BOOL *stop){
+			aBlock(aKey, anObject, stop);
+			stopped = *stop;
+		}];
+	}
+}
+
+- (CTKPersistentHashMap *) persistentHashMap
+{
+	NSMutableArray *maps = [NSMutableArray arrayWithCapacity:bucketCount];
+	NSUInteger total = 0;
+	
+	// Read every bucket first, the entries are counted before copying them out
+	for (NSUInteger i = 0; i < bucketCount; i++) {
+		
+		CTKPersistentHashMap *map = [buckets[i] dereference];
+		
+		if (map.count > 0) {
+			[maps addObject:map];
+			total += map.count;
+		}
+	}
+	
+	id *keys = malloc(sizeof(id) * (total + 1));
+	id *objects = malloc(sizeof(id) * (total + 1));
+	__block NSUInteger cursor = 0;
+	
+	for (CTKPersistentHashMap *map in maps)
+		[map enumerateKeysAndObjectsUsingBlock:^(id aKey, id anObject, BOOL *stop){
+			keys[cursor] = aKey;
+			objects[cursor] = anObject;
+			cursor++;
+		}];
+	
+	CTKPersistentHashMap *result = [CTKPersistentHashMap hashMapWithObjects:objects forKeys:keys count:cursor seed:self.seed];
+	
+	free(keys);
+	free(objects);
+	
+	return result;
+}
+
+#pragma mark Introspection
+
+- (CTKReference *) referenceForKey:(id)aKey
+{
+	return buckets[[self private_bucketIndexForKey:aKey]];
+}
+
+@end
+
+#pragma mark -
+
+@implementation CTKTransactionalHashMap (Private)
+
+- (NSUInteger) private_bucketIndexForKey:(id)aKey
+{
+	return CTKTransactionalHashMapBucketIndex(aKey, seed, bucketCount);
+}
+
+@end